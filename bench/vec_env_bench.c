@@ -0,0 +1,87 @@
+#include "common.h"
+#include <time.h>
+#include "vec_env.h"
+#include "encode.h"
+#include "search.h"
+
+int g_game_dbg = 0;
+struct game_events g_game_events = {0};
+
+/*
+ * vec_env_bench [B [N [FILE]]]: B new games of AQ (256) stepped N times
+ * (1000) with random legal actions, tensors into FILE if given.
+ * MONOPOLY_SEARCH_THREADS sets the workers.
+ */
+int main(int argc, char *argv[])
+{
+    struct vec_env_config cfg = { .players = "AQ", .seed = 1 };
+    const struct vec_env_obs *obs;
+    struct encode_shape shape;
+    struct vec_env *env;
+    struct timespec t0, t1;
+    int32_t *actions;
+    uint64_t rng = 1;
+    long i, n_step = 1000;
+    const char *threads = getenv("MONOPOLY_SEARCH_THREADS");
+    double sec;
+    int b, a, n;
+
+    cfg.n_env = argc > 1 ? atoi(argv[1]) : 256;
+    if (argc > 2)
+        n_step = atol(argv[2]);
+    if (cfg.n_env <= 0 || n_step <= 0) {
+        fprintf(stderr, "usage: %s [B [N [FILE]]]\n", argv[0]);
+        return 1;
+    }
+    if (threads && atoi(threads) > 0)
+        search_set_threads(atoi(threads));
+
+    /* the map of a new game */
+    encode_shape(g_default_map_layout->map_size, &shape);
+    if (argc > 3) {
+        cfg.tensor = encode_map_shared(argv[3], cfg.n_env * shape.size);
+        if (!cfg.tensor)
+            return 1;
+    }
+
+    env = vec_env_create(&cfg);
+    actions = calloc(cfg.n_env, sizeof(*actions));
+    if (!env || !actions) {
+        fprintf(stderr, "fail to create games\n");
+        return 1;
+    }
+    obs = vec_env_obs(env);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < n_step; i++) {
+        /* any legal action */
+        for (b = 0; b < cfg.n_env; b++) {
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+            for (a = 0, n = 0; a < VEC_ENV_N_ACT; a++)
+                n += obs->legal[b * VEC_ENV_N_ACT + a];
+            n = n ? (int) (rng % n) : 0;
+            for (a = 0; a < VEC_ENV_N_ACT - 1; a++) {
+                if (obs->legal[b * VEC_ENV_N_ACT + a] && !n--)
+                    break;
+            }
+            actions[b] = a;
+        }
+        if (vec_env_step(env, actions))
+            break;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    sec = t1.tv_sec - t0.tv_sec + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("%d games, %ld steps in %.3fs, %.0f steps/s, %ld episodes\n", cfg.n_env, i * cfg.n_env, sec,
+           i * cfg.n_env / (sec + 1e-9), obs->n_episode);
+    if (cfg.tensor)
+        printf("%d tensors of %ld floats in %s\n", cfg.n_env, shape.size, argv[3]);
+
+    vec_env_destroy(env);
+    encode_unmap(cfg.tensor, cfg.n_env * shape.size);
+    free(actions);
+    search_uninit();
+    return 0;
+}
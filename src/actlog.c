@@ -0,0 +1,149 @@
+#include <unistd.h>
+#include <sys/mman.h>
+#include "common.h"
+#include "actlog.h"
+#include "save.h"
+#include "varint.h"
+
+struct actlog_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+};
+
+#define ACT_TYPE_MASK   0x0f
+#define ACT_IMM_SHIFT   4
+#define ACT_IMM_VARINT  0x0f
+
+int actlog_record(struct actlog *log, const char *path, const struct game_image *img)
+{
+    struct actlog_header hdr = {
+        .magic = ACTLOG_MAGIC,
+        .version = ACTLOG_VERSION,
+        .header_size = sizeof(hdr),
+    };
+
+    memset(log, 0, sizeof(*log));
+
+    log->fp = fopen(path, "wb");
+    if (!log->fp) {
+        game_err("fail to open %s\n", path);
+        return -1;
+    }
+
+    if (fwrite(&hdr, sizeof(hdr), 1, log->fp) != 1 || game_fwrite_image(img, log->fp)) {
+        game_err("fail to write action log header to %s\n", path);
+        fclose(log->fp);
+        log->fp = NULL;
+        return -2;
+    }
+
+    log->mode = ACTLOG_RECORD;
+    return 0;
+}
+
+int actlog_replay(struct actlog *log, const char *path, struct game_image *img)
+{
+    const struct actlog_header *hdr;
+    size_t used;
+    off_t size;
+    void *buf;
+    FILE *fp;
+
+    memset(log, 0, sizeof(*log));
+
+    fp = fopen(path, "rb");
+    if (!fp) {
+        game_err("fail to open %s\n", path);
+        return -1;
+    }
+
+    size = lseek(fileno(fp), 0, SEEK_END);
+    if (size < (off_t) sizeof(*hdr)) {
+        fclose(fp);
+        return -1;
+    }
+
+    buf = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    fclose(fp);
+    if (buf == MAP_FAILED)
+        return -1;
+
+    hdr = buf;
+    if (hdr->magic != ACTLOG_MAGIC || hdr->version != ACTLOG_VERSION || hdr->header_size != sizeof(*hdr)
+        || game_decode_image((char *) buf + sizeof(*hdr), size - sizeof(*hdr), img, &used)) {
+        game_err("%s is not a valid action log\n", path);
+        munmap(buf, size);
+        return -2;
+    }
+
+    log->buf = buf;
+    log->size = size;
+    log->off = sizeof(*hdr) + used;
+    log->mode = ACTLOG_REPLAY;
+    return 0;
+}
+
+void actlog_close(struct actlog *log)
+{
+    if (log->fp)
+        fclose(log->fp);
+    if (log->buf)
+        munmap((void *) log->buf, log->size);
+
+    memset(log, 0, sizeof(*log));
+}
+
+int actlog_put(struct actlog *log, enum act_type type, int64_t val)
+{
+    unsigned char rec[1 + VARINT_MAX_LEN];
+    uint64_t zz = varint_zigzag(val);
+    int n = 0;
+
+    if (log->mode != ACTLOG_RECORD)
+        return -1;
+
+    if (zz < ACT_IMM_VARINT) {
+        rec[n++] = type | zz << ACT_IMM_SHIFT;
+    } else {
+        rec[n++] = type | ACT_IMM_VARINT << ACT_IMM_SHIFT;
+        n += varint_put(rec + n, zz);
+    }
+
+    if (fwrite(rec, n, 1, log->fp) != 1) {
+        game_err("fail to write action log, stop recording\n");
+        actlog_close(log);
+        return -1;
+    }
+
+    log->n_act++;
+    return 0;
+}
+
+int actlog_get(struct actlog *log, struct act *act)
+{
+    const unsigned char *p;
+    uint64_t zz;
+    int n;
+
+    if (log->mode != ACTLOG_REPLAY || log->off >= log->size)
+        return 0;
+
+    p = log->buf + log->off++;
+    act->type = *p & ACT_TYPE_MASK;
+    zz = *p >> ACT_IMM_SHIFT;
+
+    if (zz == ACT_IMM_VARINT) {
+        n = varint_get(log->buf + log->off, log->size - log->off, &zz);
+        if (n < 0)
+            return -1;
+        log->off += n;
+    }
+
+    if (act->type <= ACT_NONE || act->type >= ACT_MAX)
+        return -1;
+
+    act->val = varint_unzigzag(zz);
+    log->n_act++;
+    return 1;
+}
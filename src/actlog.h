@@ -0,0 +1,69 @@
+#pragma once
+#include <stdint.h>
+#include "common.h"
+
+struct game_image;
+
+#define ACTLOG_MAGIC    0x5443414dU /* "MACT" on little endian */
+#define ACTLOG_VERSION  3
+
+/*
+ * Action log, a game image of the starting state followed by one record per
+ * player input. A record is one byte of type in the low nibble and a small
+ * zigzag value in the high nibble, value 15 means a varint follows. Positions
+ * are stored relative to the acting player, so almost every record is one byte.
+ */
+enum act_type {
+    ACT_NONE,
+    /* dice value */
+    ACT_ROLL,
+    /* step command */
+    ACT_STEP,
+    /* sold map pos, relative to player */
+    ACT_SELL,
+    /* item offset, relative to player */
+    ACT_BLOCK,
+    ACT_BOMB,
+    ACT_ROBOT,
+    ACT_SKIP,
+    /* y/n answer */
+    ACT_BOOL,
+    /* menu choice, -1 if invalid */
+    ACT_MENU,
+    /* end of turn, low 32 bits of state hash */
+    ACT_TURN,
+    ACT_MAX,
+};
+
+struct act {
+    enum act_type type;
+    int64_t val;
+};
+
+enum actlog_mode {
+    ACTLOG_OFF,
+    ACTLOG_RECORD,
+    ACTLOG_REPLAY,
+};
+
+struct actlog {
+    enum actlog_mode mode;
+    long n_act;
+    long n_turn;
+
+    /* record */
+    FILE *fp;
+
+    /* replay, whole file mapped */
+    const unsigned char *buf;
+    size_t size;
+    size_t off;
+};
+
+int actlog_record(struct actlog *log, const char *path, const struct game_image *img);
+int actlog_replay(struct actlog *log, const char *path, struct game_image *img);
+void actlog_close(struct actlog *log);
+
+int actlog_put(struct actlog *log, enum act_type type, int64_t val);
+/* @return: > 0 got one, 0 end of log, < 0 corrupted */
+int actlog_get(struct actlog *log, struct act *act);
@@ -0,0 +1,180 @@
+#include "common.h"
+#include "advise.h"
+
+#define ADVISE_LANES    8
+#define ADVISE_MAX_CAND ((2 * ADVISE_MAX_RANGE + 1 + ADVISE_LANES - 1) / ADVISE_LANES * ADVISE_LANES)
+
+typedef float advise_vec __attribute__((vector_size(ADVISE_LANES * sizeof(float))));
+
+/* one float per candidate offset, a vector at a time */
+union advise_row {
+    float f[ADVISE_MAX_CAND];
+    advise_vec v[ADVISE_MAX_CAND / ADVISE_LANES];
+};
+
+static inline struct map_node *advise_node(struct game *game, int pos)
+{
+    int n = game->map.n_used;
+
+    return &game->map.nodes[(pos % n + n) % n];
+}
+
+static inline int advise_legal(struct map_node *node)
+{
+    return node->type == MAP_NODE_VACANCY && node->item == ITEM_INVALID && list_empty(&node->players);
+}
+
+/* what @self gains on @walker stopping at @node */
+static float advise_stop(struct player *self, struct player *walker, struct map_node *node)
+{
+    struct player *owner = node->estate.owner;
+    int toll;
+
+    if (node->type != MAP_NODE_VACANCY || !owner || owner == walker || walker->buff.n_god_rounds || walker->stat.god)
+        return 0;
+
+    toll = map_node_price(node) / 2;
+    return owner == self ? 2 * toll : toll;
+}
+
+/* a turn of @walker from @pos, the estates it may buy or upgrade at half price */
+static float advise_turn_worth(struct game *game, struct player *walker)
+{
+    struct map_node *node;
+    float worth = 0;
+    int r;
+
+    for (r = 1; r <= game->dice_facets; r++) {
+        node = advise_node(game, walker->pos + r);
+        if (node->type == MAP_NODE_VACANCY && (!node->estate.owner || node->estate.owner == walker))
+            worth += map_node_price(node) / 2;
+    }
+    return worth / game->dice_facets;
+}
+
+/*
+ * Next walk of @walker with and without an item at each distance: @hit[d]
+ * chance it reaches d, @block[d] and @bomb[d] what @self expects to gain if
+ * a block or bomb lies there, rolls that stop short count nothing.
+ */
+static void advise_walk(struct game *game, struct player *self, struct player *walker,
+                        float *hit, float *block, float *bomb)
+{
+    int facets = game->dice_facets;
+    float base[ADVISE_MAX_FACETS + 1], p = 1.0f / facets, rest;
+    struct map_node *node;
+    int d, r, k, stop;
+
+    /* where each roll ends now, items on the way included */
+    for (r = 1; r <= facets; r++) {
+        for (k = 1, stop = r; k <= r; k++) {
+            node = advise_node(game, walker->pos + k);
+            if (node->item == ITEM_BLOCK || node->item == ITEM_BOMB) {
+                stop = node->item == ITEM_BLOCK ? k : -1;
+                break;
+            }
+        }
+        base[r] = stop < 0 ? 0 : advise_stop(self, walker, advise_node(game, walker->pos + stop));
+    }
+
+    rest = ADVISE_BOMB_REST * advise_turn_worth(game, walker);
+    for (d = 1, stop = 0; d <= facets; d++) {
+        hit[d] = block[d] = bomb[d] = 0;
+        if (stop)
+            continue;
+
+        node = advise_node(game, walker->pos + d);
+        for (r = d; r <= facets; r++) {
+            hit[d] += p;
+            block[d] += p * (advise_stop(self, walker, node) - base[r]);
+            bomb[d] += p * (rest - base[r]);
+        }
+        /* nothing further on is reached */
+        stop = node->item == ITEM_BLOCK || node->item == ITEM_BOMB;
+    }
+}
+
+static int advise_cmp(const void *a, const void *b)
+{
+    const struct advise_place *x = a, *y = b;
+
+    if (x->swing != y->swing)
+        return x->swing < y->swing ? 1 : -1;
+    return abs(x->offset) - abs(y->offset);
+}
+
+int advise_place(struct game *game, struct player *self, enum item_type type, int range, struct advise_place *places)
+{
+    float hit[ADVISE_MAX_FACETS + 1], block[ADVISE_MAX_FACETS + 1], bomb[ADVISE_MAX_FACETS + 1];
+    union advise_row left, swing, p_hit, gain;
+    int cand[ADVISE_MAX_CAND];
+    struct player *walker;
+    int i, c, d, n_cand = 0, n = game->map.n_used;
+    const float *value;
+
+    if ((type != ITEM_BLOCK && type != ITEM_BOMB) || !self->attached || self->stat.bankrupt || !n)
+        return -1;
+    if (game->dice_facets > ADVISE_MAX_FACETS)
+        return -1;
+
+    /* what @self may walk into on its own roll would trap @self, left out */
+    for (d = 0; d <= game->dice_facets; d++)
+        hit[d] = 0;
+    if (!self->buff.n_empty_rounds)
+        advise_walk(game, self, self, hit, block, bomb);
+
+    range = abs(range);
+    if (range > ADVISE_MAX_RANGE)
+        range = ADVISE_MAX_RANGE;
+    for (i = -range; i <= range; i++) {
+        d = (i % n + n) % n;
+        if (d >= 1 && d <= game->dice_facets && hit[d] > 0)
+            continue;
+        if (advise_legal(advise_node(game, self->pos + i)))
+            cand[n_cand++] = i;
+    }
+
+    for (c = 0; c < ADVISE_MAX_CAND; c++) {
+        left.f[c] = 1;
+        swing.f[c] = 0;
+    }
+
+    /* the others roll in turn order after @self */
+    for (i = 1; i < game->cur_player_nr; i++) {
+        walker = game->cur_players[(self->seq + i) % game->cur_player_nr];
+        if (!walker || !walker->attached || walker->stat.bankrupt || walker->buff.n_empty_rounds)
+            continue;
+
+        advise_walk(game, self, walker, hit, block, bomb);
+        value = type == ITEM_BLOCK ? block : bomb;
+
+        for (c = 0; c < ADVISE_MAX_CAND; c++) {
+            p_hit.f[c] = gain.f[c] = 0;
+            if (c >= n_cand)
+                continue;
+
+            d = ((self->pos + cand[c] - walker->pos) % n + n) % n;
+            if (d >= 1 && d <= game->dice_facets) {
+                p_hit.f[c] = hit[d];
+                gain.f[c] = value[d];
+            }
+        }
+
+        /* the item is still there for this walker only if nobody before took it */
+        for (c = 0; c < ADVISE_MAX_CAND / ADVISE_LANES; c++) {
+            swing.v[c] += left.v[c] * gain.v[c];
+            left.v[c] -= left.v[c] * p_hit.v[c];
+        }
+    }
+
+    for (c = 0; c < n_cand; c++) {
+        places[c] = (struct advise_place) {
+            .offset = cand[c],
+            .pos = ((self->pos + cand[c]) % n + n) % n,
+            .hit = 1 - left.f[c],
+            .swing = swing.f[c],
+        };
+    }
+    qsort(places, n_cand, sizeof(*places), advise_cmp);
+    return n_cand;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "common.h"
+#include "game.h"
+
+/* offsets looked at, either way */
+#define ADVISE_MAX_RANGE 15
+/* dice faces the solver handles */
+#define ADVISE_MAX_FACETS 16
+/* rounds a bomb rests its victim */
+#define ADVISE_BOMB_REST 3
+
+struct advise_place {
+    int offset;
+    int pos;
+    /* chance another player walks into it */
+    float hit;
+    /* expected worth @self gains on the players walking into it */
+    float swing;
+};
+
+/*
+ * Where @self best puts a block or bomb within @range, before its next
+ * turn: the others roll in turn order and the first walk reaching the item
+ * takes it. A walk reaching it is one whose roll is at least as far and
+ * that no item before stops. Offsets the next roll of @self may reach are
+ * left out, @self would walk into its own item.
+ *
+ * Swing counts tolls at map_node_price() / 2, what the walker pays, twice
+ * if to @self. A block stops the walk on the item instead of where the roll
+ * ends. A bomb sends the walker to hospital instead and costs it
+ * ADVISE_BOMB_REST turns, each worth the free or own estates its roll may
+ * end on at half their price. All offsets are evaluated against all players
+ * in one vectorized pass.
+ *
+ * @places: at least 2 * ADVISE_MAX_RANGE + 1 entries, filled best first
+ * @return: < 0 err, else number of legal offsets
+ */
+int advise_place(struct game *game, struct player *self, enum item_type type, int range, struct advise_place *places);
@@ -0,0 +1,94 @@
+#include <unistd.h>
+#include <sys/mman.h>
+#include "common.h"
+#include "arena.h"
+
+#define ARENA_HUGEPAGE_SIZE (2UL << 20)
+
+static size_t arena_round_up(size_t size, size_t align)
+{
+    return (size + align - 1) & ~(align - 1);
+}
+
+int arena_init(struct arena *arena, size_t size, int flags)
+{
+    void *base = MAP_FAILED;
+    size_t page = sysconf(_SC_PAGESIZE);
+
+    memset(arena, 0, sizeof(*arena));
+    if (!size)
+        return -1;
+
+    if (flags & ARENA_HUGEPAGE) {
+        size = arena_round_up(size, ARENA_HUGEPAGE_SIZE);
+#ifdef MAP_HUGETLB
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (base == MAP_FAILED)
+            game_dbg("no hugetlb pages for %zu bytes, use normal pages\n", size);
+#endif
+    } else {
+        size = arena_round_up(size, page);
+    }
+
+    if (base == MAP_FAILED) {
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED) {
+            game_err("fail to map arena of %zu bytes\n", size);
+            return -2;
+        }
+#ifdef MADV_HUGEPAGE
+        if (flags & ARENA_HUGEPAGE)
+            madvise(base, size, MADV_HUGEPAGE);
+#endif
+    }
+
+    arena->base = base;
+    arena->size = size;
+    arena->used = 0;
+    arena->dirty = 0;
+    arena->flags = flags;
+    return 0;
+}
+
+void arena_free(struct arena *arena)
+{
+    if (arena->base)
+        munmap(arena->base, arena->size);
+
+    memset(arena, 0, sizeof(*arena));
+}
+
+/* forget every allocation, memory is zeroed again on next arena_alloc() */
+void arena_reset(struct arena *arena)
+{
+    arena->used = 0;
+}
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+    char *ptr;
+    size_t need = arena_round_up(size, ARENA_ALIGN);
+
+    if (!arena->base || need < size || need > arena->size - arena->used) {
+        game_err("arena full, %zu/%zu used, want %zu\n", arena->used, arena->size, size);
+        return NULL;
+    }
+
+    ptr = arena->base + arena->used;
+    /* fresh pages of the mapping are zero already, leave them uncommitted */
+    if (arena->used < arena->dirty)
+        memset(ptr, 0, size < arena->dirty - arena->used ? size : arena->dirty - arena->used);
+    arena->used += need;
+    if (arena->used > arena->dirty)
+        arena->dirty = arena->used;
+
+    return ptr;
+}
+
+void *arena_calloc(struct arena *arena, size_t n, size_t size)
+{
+    if (size && n > (size_t) -1 / size)
+        return NULL;
+
+    return arena_alloc(arena, n * size);
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "common.h"
+
+/* cache line, enough for any object in game */
+#define ARENA_ALIGN 64
+
+enum {
+    /* try huge pages, fall back to normal pages with THP advice */
+    ARENA_HUGEPAGE = 1 << 0,
+};
+
+/* one contiguous mapping, bump allocated, released as a whole */
+struct arena {
+    char *base;
+    size_t size;
+    size_t used;
+    /* bytes ever handed out, the mapping past it is still zero */
+    size_t dirty;
+    int flags;
+};
+
+int arena_init(struct arena *arena, size_t size, int flags);
+void arena_free(struct arena *arena);
+void arena_reset(struct arena *arena);
+
+/* zeroed memory aligned to ARENA_ALIGN, NULL if arena is full */
+void *arena_alloc(struct arena *arena, size_t size);
+void *arena_calloc(struct arena *arena, size_t n, size_t size);
@@ -0,0 +1,346 @@
+#include "common.h"
+#include "bot.h"
+#include "game.h"
+#include "advise.h"
+
+static const struct bot_policy bot_policies[] = {
+    /* first one is the default */
+    { .name = "balanced", .reserve = 1000, .risk_pct = 100, .max_payback = 10 },
+    { .name = "greedy",   .reserve = 300,  .risk_pct = 50,  .max_payback = 20, .aggressive = 1 },
+    { .name = "cautious", .reserve = 2500, .risk_pct = 150, .max_payback = 7 },
+    { .name = "tactical", .reserve = 1000, .risk_pct = 100, .max_payback = 10, .advised = 1 },
+};
+
+/* points only buy items, about what a point is worth in cash */
+#define BOT_POINT_WORTH 5
+/* stock bought at item house */
+#define BOT_MAX_BLOCK   2
+#define BOT_MAX_BOMB    1
+#define BOT_MAX_ROBOT   1
+
+const struct bot_policy *bot_policy_find(const char *name)
+{
+    int i;
+
+    if (!name)
+        return &bot_policies[0];
+
+    for (i = 0; i < ARRAY_SIZE(bot_policies); i++) {
+        if (!strcmp(name, bot_policies[i].name))
+            return &bot_policies[i];
+    }
+    return NULL;
+}
+
+static inline struct map_node *bot_node(struct game *game, int pos)
+{
+    int n = game->map.n_used;
+
+    return &game->map.nodes[(pos % n + n) % n];
+}
+
+static inline int bot_is_opponent(struct player *self, struct player *player)
+{
+    return player != self && player->valid && player->attached && !player->stat.bankrupt;
+}
+
+/* toll @player pays on @node */
+static inline int bot_toll(struct player *player, struct map_node *node)
+{
+    if (node->type != MAP_NODE_VACANCY || !node->estate.owner || node->estate.owner == player)
+        return 0;
+    return map_node_price(node) / 2;
+}
+
+int bot_worth(struct player *player)
+{
+    struct map_node *node;
+    int worth = player->asset.n_money;
+
+    list_for_each_entry(node, &player->asset.estates, estate.estates_list)
+        worth += map_node_price(node);
+    return worth;
+}
+
+static int bot_n_opponents(struct game *game, struct player *self)
+{
+    struct player *player;
+    int n = 0;
+
+    for_each_player_begin(game, player) {
+        if (bot_is_opponent(self, player))
+            n++;
+    } for_each_player_end();
+    return n;
+}
+
+/* cash kept for the tolls two rolls may run into */
+static int bot_reserve(struct controller *ctl, struct game *game, struct player *self)
+{
+    int i, toll, max_toll = 0;
+
+    for (i = 1; i <= 2 * game->dice_facets && !self->stat.god; i++) {
+        toll = bot_toll(self, bot_node(game, self->pos + i));
+        if (toll > max_toll)
+            max_toll = toll;
+    }
+    return ctl->policy->reserve + max_toll * ctl->policy->risk_pct / 100;
+}
+
+/*
+ * Each opponent lands on a given node about once per mean roll length,
+ * (1 + facets) / 2 nodes, so @toll comes in n_opponent * 2 / (1 + facets)
+ * times a round.
+ */
+static int bot_pays_back(struct controller *ctl, struct game *game, struct player *self, int cost, int toll)
+{
+    long n_opponent = bot_n_opponents(game, self);
+
+    return (long) cost * (1 + game->dice_facets) <= (long) ctl->policy->max_payback * toll * n_opponent * 2;
+}
+
+static int bot_decide_buy(struct controller *ctl, struct game *game, struct player *self, struct map_node *node)
+{
+    int price = node->estate.price;
+
+    if (self->asset.n_money - price < bot_reserve(ctl, game, self))
+        return 0;
+    return bot_pays_back(ctl, game, self, price, price / 2);
+}
+
+static int bot_decide_upgrade(struct controller *ctl, struct game *game, struct player *self, struct map_node *node)
+{
+    int price = node->estate.price;
+
+    /* only from spare cash, twice the reserve */
+    if (self->asset.n_money - price < bot_reserve(ctl, game, self) + ctl->policy->reserve)
+        return 0;
+    return bot_pays_back(ctl, game, self, price, price / 2);
+}
+
+/* an opponent rolling d or more passes a node d ahead of it */
+static long bot_item_score(struct controller *ctl, struct game *game, struct player *self,
+                           enum item_type type, struct map_node *node)
+{
+    int facets = game->dice_facets;
+    int self_worth = bot_worth(self);
+    struct player *player;
+    long score, best = 0;
+    int d;
+
+    for_each_player_begin(game, player) {
+        if (!bot_is_opponent(self, player) || player->buff.n_empty_rounds)
+            continue;
+
+        d = (node->idx - player->pos + game->map.n_used) % game->map.n_used;
+        if (d < 1 || d > facets)
+            continue;
+
+        if (type == ITEM_BOMB) {
+            /* hospital for whoever is ahead */
+            score = bot_worth(player);
+            if (!ctl->policy->aggressive && score < self_worth)
+                continue;
+        } else {
+            /* block only pays when they stop on our estate */
+            if (node->estate.owner != self || player->stat.god)
+                continue;
+            score = map_node_price(node) / 2;
+        }
+
+        score *= facets - d + 1;
+        if (score > best)
+            best = score;
+    } for_each_player_end();
+
+    return best;
+}
+
+/* @return: > 0 @offset of best node to place @type at */
+static int bot_place_item(struct controller *ctl, struct game *game, struct player *self,
+                          enum item_type type, int range, int *offset)
+{
+    struct advise_place places[2 * ADVISE_MAX_RANGE + 1];
+    struct map_node *node;
+    long score, best = 0;
+    int o;
+
+    if (ctl->policy->advised) {
+        /* best first, our own roll is weighed in */
+        if (advise_place(game, self, type, range, places) <= 0 || places[0].swing <= 0)
+            return 0;
+        *offset = places[0].offset;
+        return 1;
+    }
+
+    for (o = -range; o <= range; o++) {
+        /* our own roll walks over it */
+        if (o >= 0 && o <= game->dice_facets)
+            continue;
+
+        node = bot_node(game, self->pos + o);
+        if (node->type != MAP_NODE_VACANCY || node->item != ITEM_INVALID || !list_empty(&node->players))
+            continue;
+
+        score = bot_item_score(ctl, game, self, type, node);
+        if (score > best) {
+            best = score;
+            *offset = o;
+        }
+    }
+    return best > 0;
+}
+
+/* robot clears what lies on the next roll */
+static int bot_use_robot(struct game *game, struct player *self)
+{
+    struct map_node *node;
+    int i;
+
+    if (self->asset.n_robot <= 0)
+        return 0;
+
+    for (i = 1; i < GAME_ITEM_ROBOT_RANGE && i <= game->dice_facets; i++) {
+        node = bot_node(game, self->pos + i);
+        if (node->item != ITEM_INVALID)
+            return 1;
+    }
+    return 0;
+}
+
+static int bot_decide_turn(struct controller *ctl, struct game *game, struct player *self, struct act *act)
+{
+    int offset = 0;
+
+    act->val = 0;
+    if (bot_use_robot(game, self)) {
+        act->type = ACT_ROBOT;
+    } else if (self->asset.n_bomb > 0
+               && bot_place_item(ctl, game, self, ITEM_BOMB, GAME_ITEM_BOMB_RANGE, &offset)) {
+        act->type = ACT_BOMB;
+        act->val = offset;
+    } else if (self->asset.n_block > 0
+               && bot_place_item(ctl, game, self, ITEM_BLOCK, GAME_ITEM_BLOCK_RANGE, &offset)) {
+        act->type = ACT_BLOCK;
+        act->val = offset;
+    } else {
+        act->type = ACT_ROLL;
+    }
+    return 0;
+}
+
+int bot_turn_candidates(struct game *game, struct player *self, const struct bot_policy *policy,
+                        struct act *acts, int max)
+{
+    struct controller ctl = { .policy = policy };
+    int n = 0, offset = 0;
+
+    if (n < max)
+        acts[n++] = (struct act) { .type = ACT_ROLL };
+    if (n < max && bot_use_robot(game, self))
+        acts[n++] = (struct act) { .type = ACT_ROBOT };
+    if (n < max && self->asset.n_bomb > 0
+        && bot_place_item(&ctl, game, self, ITEM_BOMB, GAME_ITEM_BOMB_RANGE, &offset))
+        acts[n++] = (struct act) { .type = ACT_BOMB, .val = offset };
+    if (n < max && self->asset.n_block > 0
+        && bot_place_item(&ctl, game, self, ITEM_BLOCK, GAME_ITEM_BLOCK_RANGE, &offset))
+        acts[n++] = (struct act) { .type = ACT_BLOCK, .val = offset };
+    return n;
+}
+
+/* robot first, then blocks, until points run out, last choice leaves */
+static int bot_choose_item(struct controller *ctl, struct game *game, struct player *self, const struct select *sel)
+{
+    static const struct {
+        enum item_type type;
+        int max;
+    } wish[] = {
+        { ITEM_ROBOT, BOT_MAX_ROBOT },
+        { ITEM_BLOCK, BOT_MAX_BLOCK },
+        { ITEM_BOMB, BOT_MAX_BOMB },
+    };
+    struct items_list *items = &bot_node(game, self->pos)->item_house.items;
+    const int have[ITEM_MAX] = {
+        [ITEM_BLOCK] = self->asset.n_block,
+        [ITEM_BOMB] = self->asset.n_bomb,
+        [ITEM_ROBOT] = self->asset.n_robot,
+    };
+    int i, type;
+
+    for (i = 0; i < ARRAY_SIZE(wish); i++) {
+        type = wish[i].type;
+        if (!items->info[type].on_sell || !sel->choices[type].name)
+            continue;
+        if (have[type] < wish[i].max && items->info[type].price <= self->asset.n_points)
+            return type;
+    }
+    return sel->n_choice - 1;
+}
+
+/* average toll over the map is what a roll costs, god skips it */
+static long bot_toll_per_roll(struct game *game, struct player *self)
+{
+    long sum = 0;
+    int i;
+
+    for (i = 0; i < game->map.n_used; i++)
+        sum += bot_toll(self, &game->map.nodes[i]);
+    return sum / game->map.n_used;
+}
+
+static int bot_choose_gift(struct controller *ctl, struct game *game, struct player *self, const struct select *sel)
+{
+    struct gift_house *house = &bot_node(game, self->pos)->gift_house;
+    struct gift_info *gift;
+    long value, best = -1;
+    int i, choice = 0;
+
+    for (i = 0; i < sel->n_choice && i < house->n_gifts; i++) {
+        gift = &house->gifts[i];
+
+        if (gift->grant == player_grant_gift_money)
+            value = gift->value * (self->asset.n_money < bot_reserve(ctl, game, self) ? 2 : 1);
+        else if (gift->grant == player_grant_gift_point)
+            value = gift->value * BOT_POINT_WORTH;
+        else if (gift->grant == player_grant_gift_god)
+            value = gift->value * bot_toll_per_roll(game, self);
+        else
+            value = 0;
+
+        if (value > best) {
+            best = value;
+            choice = i;
+        }
+    }
+    return choice;
+}
+
+/* choice i + 1 is player idx i, 0 gives up */
+static int bot_choose_magic_target(struct controller *ctl, struct game *game, struct player *self,
+                                   const struct select *sel)
+{
+    struct player *player;
+    int worth, best = -1, choice = 0;
+
+    for_each_player_begin(game, player) {
+        if (!bot_is_opponent(self, player) || player->idx + 1 >= sel->n_choice)
+            continue;
+
+        worth = bot_worth(player);
+        if (worth > best) {
+            best = worth;
+            choice = player->idx + 1;
+        }
+    } for_each_player_end();
+    return choice;
+}
+
+const struct controller_ops g_bot_ops = {
+    .name = "bot",
+    .decide_turn = bot_decide_turn,
+    .decide_buy = bot_decide_buy,
+    .decide_upgrade = bot_decide_upgrade,
+    .choose_item = bot_choose_item,
+    .choose_gift = bot_choose_gift,
+    .choose_magic_target = bot_choose_magic_target,
+};
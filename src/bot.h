@@ -0,0 +1,36 @@
+#pragma once
+#include "common.h"
+#include "controller.h"
+
+/*
+ * Native strategies behind CONTROLLER_BOT. Every decision looks at a few
+ * map nodes around the players and the estate lists, nothing is allocated
+ * and no text is parsed.
+ */
+struct bot_policy {
+    const char *name;
+    /* cash always kept back for tolls */
+    int reserve;
+    /* percent of the highest toll within two rolls ahead added to reserve */
+    int risk_pct;
+    /* rounds an estate or upgrade may take to pay back through tolls */
+    int max_payback;
+    /* bombs hit any opponent in reach, not only those worth more */
+    int aggressive;
+    /* items go where advise_place() expects the most swing */
+    int advised;
+};
+
+extern const struct controller_ops g_bot_ops;
+
+/* @name: NULL for the default policy, @return: NULL if unknown */
+const struct bot_policy *bot_policy_find(const char *name);
+
+/* cash and estates at price */
+int bot_worth(struct player *player);
+/*
+ * Turn actions of @self worth a thought under @policy, roll first, then
+ * robot, best bomb and best block. @return: number of acts filled
+ */
+int bot_turn_candidates(struct game *game, struct player *self, const struct bot_policy *policy,
+                        struct act *acts, int max);
@@ -0,0 +1,152 @@
+#include <errno.h>
+#include <unistd.h>
+#include "common.h"
+#include "checkpoint.h"
+
+static int checkpoint_write(struct checkpoint *cp, const struct game_image *img)
+{
+    if (game_write_image(img, cp->tmp_path, 1)) {
+        game_err("fail to write checkpoint %s\n", cp->tmp_path);
+        unlink(cp->tmp_path);
+        return -1;
+    }
+
+    /* keep last good checkpoint until the new one is renamed in place */
+    if (rename(cp->path, cp->old_path) && errno != ENOENT)
+        game_err("fail to keep old checkpoint %s\n", cp->old_path);
+
+    if (rename(cp->tmp_path, cp->path)) {
+        game_err("fail to rename checkpoint to %s\n", cp->path);
+        return -1;
+    }
+    return 0;
+}
+
+static void *checkpoint_thread(void *arg)
+{
+    struct checkpoint *cp = arg;
+    int idx;
+
+    pthread_mutex_lock(&cp->lock);
+    while (1) {
+        while (cp->pending < 0 && !cp->stop)
+            pthread_cond_wait(&cp->cond, &cp->lock);
+
+        if (cp->pending < 0)
+            break;
+
+        idx = cp->writing = cp->pending;
+        cp->pending = -1;
+        pthread_mutex_unlock(&cp->lock);
+
+        if (!checkpoint_write(cp, &cp->images[idx]))
+            cp->n_written++;
+
+        pthread_mutex_lock(&cp->lock);
+        cp->writing = -1;
+    }
+    pthread_mutex_unlock(&cp->lock);
+    return NULL;
+}
+
+int checkpoint_init(struct checkpoint *cp, const char *path, int every_turns)
+{
+    memset(cp, 0, sizeof(*cp));
+
+    if (!path || strlen(path) >= CHECKPOINT_PATH_SZ)
+        return -1;
+
+    snprintf(cp->path, sizeof(cp->path), "%s", path);
+    snprintf(cp->old_path, sizeof(cp->old_path), "%s.old", path);
+    snprintf(cp->tmp_path, sizeof(cp->tmp_path), "%s.tmp", path);
+
+    cp->every_turns = every_turns > 0 ? every_turns : CHECKPOINT_DEFAULT_TURNS;
+    cp->pending = -1;
+    cp->writing = -1;
+
+    pthread_mutex_init(&cp->lock, NULL);
+    pthread_cond_init(&cp->cond, NULL);
+
+    if (pthread_create(&cp->thread, NULL, checkpoint_thread, cp)) {
+        game_err("fail to start checkpoint writer\n");
+        pthread_cond_destroy(&cp->cond);
+        pthread_mutex_destroy(&cp->lock);
+        return -2;
+    }
+
+    cp->running = 1;
+    return 0;
+}
+
+void checkpoint_uninit(struct checkpoint *cp)
+{
+    if (!cp->running)
+        return;
+
+    pthread_mutex_lock(&cp->lock);
+    cp->stop = 1;
+    pthread_cond_signal(&cp->cond);
+    pthread_mutex_unlock(&cp->lock);
+
+    pthread_join(cp->thread, NULL);
+    pthread_cond_destroy(&cp->cond);
+    pthread_mutex_destroy(&cp->lock);
+    cp->running = 0;
+}
+
+int checkpoint_submit(struct checkpoint *cp, struct game *game)
+{
+    int idx;
+
+    if (!cp->running)
+        return -1;
+
+    /* take the image writer is not using, drop an unwritten older snapshot */
+    pthread_mutex_lock(&cp->lock);
+    idx = cp->writing == 0 ? 1 : 0;
+    if (cp->pending == idx)
+        cp->pending = -1;
+    pthread_mutex_unlock(&cp->lock);
+
+    if (game_save_image(game, &cp->images[idx]))
+        return -1;
+
+    pthread_mutex_lock(&cp->lock);
+    cp->pending = idx;
+    pthread_cond_signal(&cp->cond);
+    pthread_mutex_unlock(&cp->lock);
+    return 0;
+}
+
+void checkpoint_turn(struct checkpoint *cp, struct game *game)
+{
+    if (!cp->running || game->state != GAME_STATE_RUNNING)
+        return;
+
+    if (++cp->n_turns < cp->every_turns)
+        return;
+
+    cp->n_turns = 0;
+    checkpoint_submit(cp, game);
+}
+
+int checkpoint_restore(struct checkpoint *cp, struct game *game)
+{
+    struct game_image img;
+    const char *path = cp->path;
+
+    /* a crash between the two renames leaves only the old one */
+    if (game_read_image(&img, path)) {
+        path = cp->old_path;
+        if (game_read_image(&img, path))
+            return -1;
+    }
+
+    if (game_load_image(game, &img)) {
+        game_err("fail to restore checkpoint %s\n", path);
+        return -2;
+    }
+
+    game_dbg("restored checkpoint %s\n", path);
+    return 0;
+}
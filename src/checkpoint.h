@@ -0,0 +1,46 @@
+#pragma once
+#include <pthread.h>
+#include "common.h"
+#include "save.h"
+
+#define CHECKPOINT_DEFAULT_TURNS 10
+#define CHECKPOINT_PATH_SZ 512
+
+/*
+ * Periodic snapshots of a running game. The turn loop only copies state into
+ * one of two images, a background thread writes the newest one to a temp file
+ * and renames it over the checkpoint. The previous checkpoint is kept as
+ * "<path>.old" until the new one is in place.
+ */
+struct checkpoint {
+    char path[CHECKPOINT_PATH_SZ];
+    char old_path[CHECKPOINT_PATH_SZ + 8];
+    char tmp_path[CHECKPOINT_PATH_SZ + 8];
+
+    int every_turns;
+    int n_turns;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int running;
+    int stop;
+
+    struct game_image images[2];
+    /* image idx waiting for writer / being written, -1 if none */
+    int pending;
+    int writing;
+    int n_written;
+};
+
+int checkpoint_init(struct checkpoint *cp, const char *path, int every_turns);
+/* write out pending snapshot, then stop writer */
+void checkpoint_uninit(struct checkpoint *cp);
+
+/* called at end of every turn, snapshots every cp->every_turns turns */
+void checkpoint_turn(struct checkpoint *cp, struct game *game);
+/* snapshot now regardless of turn count */
+int checkpoint_submit(struct checkpoint *cp, struct game *game);
+
+/* load newest valid checkpoint into game, @return: < 0 if none */
+int checkpoint_restore(struct checkpoint *cp, struct game *game);
@@ -24,6 +24,10 @@ struct range {
 
 /* forward declaration */
 struct game_events;
+struct arena;
+struct checkpoint;
+struct history;
+struct track;
 struct game;
 struct ui;
 struct map;
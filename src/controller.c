@@ -0,0 +1,292 @@
+#include "common.h"
+#include "controller.h"
+#include "player.h"
+#include "map.h"
+#include "ui.h"
+#include "bot.h"
+#include "mcts.h"
+#include "expectimax.h"
+
+#define CONTROLLER_LINE_SZ 256
+#define CONTROLLER_MAX_ARGC 4
+
+static int human_decide_turn(struct controller *ctl, struct game *game, struct player *player, struct act *act)
+{
+    return CONTROLLER_ASK;
+}
+
+static int human_decide(struct controller *ctl, struct game *game, struct player *player, struct map_node *node)
+{
+    return CONTROLLER_ASK;
+}
+
+static int human_choose(struct controller *ctl, struct game *game, struct player *player, const struct select *sel)
+{
+    return CONTROLLER_ASK;
+}
+
+static const struct controller_ops human_ops = {
+    .name = "human",
+    .decide_turn = human_decide_turn,
+    .decide_buy = human_decide,
+    .decide_upgrade = human_decide,
+    .choose_item = human_choose,
+    .choose_gift = human_choose,
+    .choose_magic_target = human_choose,
+};
+
+/* next line with something on it, NULL once the script runs dry */
+static char *script_next_line(struct controller *ctl, char *buf, int size)
+{
+    char *p;
+
+    while (fgets(buf, size, ctl->script)) {
+        ctl->n_line++;
+        buf[strcspn(buf, "\r\n")] = '\0';
+
+        for (p = buf; isspace(*p); p++)
+            ;
+        if (*p && *p != '#')
+            return p;
+    }
+    return NULL;
+}
+
+static int script_decide_turn(struct controller *ctl, struct game *game, struct player *player, struct act *act)
+{
+    static const char *const names[ACT_MAX] = {
+        [ACT_ROLL] = "roll",
+        [ACT_STEP] = "step",
+        [ACT_SELL] = "sell",
+        [ACT_BLOCK] = "block",
+        [ACT_BOMB] = "bomb",
+        [ACT_ROBOT] = "robot",
+        [ACT_SKIP] = "skip",
+    };
+    const char *argv[CONTROLLER_MAX_ARGC];
+    char buf[CONTROLLER_LINE_SZ];
+    char *line, *endptr = NULL;
+    int argc, i;
+
+    line = script_next_line(ctl, buf, sizeof(buf));
+    if (!line)
+        return CONTROLLER_ASK;
+
+    argc = ui_cmd_tokenize(line, argv, CONTROLLER_MAX_ARGC);
+    for (i = 0; i < ACT_MAX && argc > 0; i++) {
+        if (names[i] && !strcmp(argv[0], names[i]))
+            break;
+    }
+    if (argc <= 0 || i == ACT_MAX)
+        goto err;
+
+    act->type = i;
+    act->val = 0;
+    if (i == ACT_STEP || i == ACT_SELL || i == ACT_BLOCK || i == ACT_BOMB) {
+        if (argc != 2)
+            goto err;
+        act->val = strtol(argv[1], &endptr, 10);
+        if (*endptr)
+            goto err;
+    } else if (argc != 1) {
+        goto err;
+    }
+
+    /* sell takes a map pos, the log keeps it relative to the player */
+    if (i == ACT_SELL)
+        act->val -= player->pos;
+    return 0;
+
+err:
+    game_err("script line %ld is not a turn action\n", ctl->n_line);
+    return CONTROLLER_ASK;
+}
+
+static int script_decide(struct controller *ctl, struct game *game, struct player *player, struct map_node *node)
+{
+    char buf[CONTROLLER_LINE_SZ];
+    char *line;
+
+    line = script_next_line(ctl, buf, sizeof(buf));
+    if (!line)
+        return CONTROLLER_ASK;
+
+    if (tolower(*line) == 'y')
+        return 1;
+    if (tolower(*line) == 'n')
+        return 0;
+
+    game_err("script line %ld is not y or n\n", ctl->n_line);
+    return CONTROLLER_ASK;
+}
+
+static int script_choose(struct controller *ctl, struct game *game, struct player *player, const struct select *sel)
+{
+    char buf[CONTROLLER_LINE_SZ];
+    char *line;
+    int i;
+
+    line = script_next_line(ctl, buf, sizeof(buf));
+    if (!line)
+        return CONTROLLER_ASK;
+
+    for (i = 0; i < sel->n_choice; i++) {
+        if (!sel->choices[i].name || sel->choices[i].chosen)
+            continue;
+        if (*line == sel->choices[i].id || (sel->choices[i].alt_id && *line == sel->choices[i].alt_id))
+            return i;
+    }
+
+    game_err("script line %ld is not a choice\n", ctl->n_line);
+    return CONTROLLER_ASK;
+}
+
+static const struct controller_ops script_ops = {
+    .name = "script",
+    .decide_turn = script_decide_turn,
+    .decide_buy = script_decide,
+    .decide_upgrade = script_decide,
+    .choose_item = script_choose,
+    .choose_gift = script_choose,
+    .choose_magic_target = script_choose,
+};
+
+/* @opts: what follows "mcts", ":Nms" or ":N" playouts, then ":random" */
+static int controller_parse_mcts(struct controller *ctl, const char *opts)
+{
+    long num, ms = MCTS_DEFAULT_MS, playouts = 0;
+    char *endptr = NULL;
+
+    if (*opts == ':' && isdigit(opts[1])) {
+        num = strtol(opts + 1, &endptr, 10);
+        if (num <= 0)
+            return -1;
+        if (!strncmp(endptr, "ms", 2)) {
+            ms = num;
+            endptr += 2;
+        } else {
+            ms = 0;
+            playouts = num;
+        }
+        opts = endptr;
+    }
+
+    ctl->search_random = !strcmp(opts, ":random");
+    if (*opts && !ctl->search_random)
+        return -1;
+
+    ctl->search_ms = ms;
+    ctl->search_playouts = playouts;
+    return 0;
+}
+
+/* @opts: what follows "expectimax", ":Nms" and ":dN" for a depth */
+static int controller_parse_expectimax(struct controller *ctl, const char *opts)
+{
+    long ms = EXPECTIMAX_DEFAULT_MS, depth = EXPECTIMAX_MAX_DEPTH;
+    char *endptr = NULL;
+    int timed = 0;
+
+    if (*opts == ':' && isdigit(opts[1])) {
+        ms = strtol(opts + 1, &endptr, 10);
+        if (ms <= 0 || strncmp(endptr, "ms", 2))
+            return -1;
+        opts = endptr + 2;
+        timed = 1;
+    }
+
+    /* a fixed depth searches without a clock */
+    if (!strncmp(opts, ":d", 2)) {
+        depth = strtol(opts + 2, &endptr, 10);
+        if (depth <= 0 || depth > EXPECTIMAX_MAX_DEPTH || *endptr)
+            return -1;
+        if (!timed)
+            ms = 0;
+        opts = endptr;
+    }
+    if (*opts)
+        return -1;
+
+    ctl->search_ms = ms;
+    ctl->search_depth = depth;
+    return 0;
+}
+
+int controller_init(struct controller *ctl, const char *spec)
+{
+    struct controller mcts = { .type = CONTROLLER_MCTS, .ops = &g_mcts_ops };
+    struct controller expectimax = { .type = CONTROLLER_EXPECTIMAX, .ops = &g_expectimax_ops };
+    const struct bot_policy *policy;
+    FILE *script = NULL;
+
+    if (!strcmp(spec, "human")) {
+        controller_uninit(ctl);
+        return 0;
+    }
+
+    if (!strncmp(spec, "bot", 3) && (!spec[3] || spec[3] == ':')) {
+        policy = bot_policy_find(spec[3] ? spec + 4 : NULL);
+        if (!policy) {
+            game_err("unknown bot policy %s\n", spec + 4);
+            return -1;
+        }
+
+        controller_uninit(ctl);
+        ctl->type = CONTROLLER_BOT;
+        ctl->ops = &g_bot_ops;
+        ctl->policy = policy;
+        return 0;
+    }
+
+    if (!strncmp(spec, "mcts", 4) && (!spec[4] || spec[4] == ':')) {
+        if (controller_parse_mcts(&mcts, spec + 4)) {
+            game_err("bad mcts budget %s, use mcts[:Nms|:N][:random]\n", spec + 4);
+            return -1;
+        }
+
+        /* fallback when no search can run */
+        mcts.policy = bot_policy_find(NULL);
+        controller_uninit(ctl);
+        *ctl = mcts;
+        return 0;
+    }
+
+    if (!strncmp(spec, "expectimax", 10) && (!spec[10] || spec[10] == ':')) {
+        if (controller_parse_expectimax(&expectimax, spec + 10)) {
+            game_err("bad expectimax budget %s, use expectimax[:Nms][:dN]\n", spec + 10);
+            return -1;
+        }
+
+        expectimax.policy = bot_policy_find(NULL);
+        controller_uninit(ctl);
+        *ctl = expectimax;
+        return 0;
+    }
+
+    if (!strncmp(spec, "script:", 7)) {
+        script = fopen(spec + 7, "r");
+        if (!script) {
+            game_err("fail to open script %s\n", spec + 7);
+            return -1;
+        }
+
+        controller_uninit(ctl);
+        ctl->type = CONTROLLER_SCRIPT;
+        ctl->ops = &script_ops;
+        ctl->script = script;
+        return 0;
+    }
+
+    game_err("unknown controller %s, use human, bot[:POLICY], mcts[:BUDGET], expectimax[:BUDGET] or script:FILE\n", spec);
+    return -1;
+}
+
+void controller_uninit(struct controller *ctl)
+{
+    if (ctl->script)
+        fclose(ctl->script);
+
+    memset(ctl, 0, sizeof(*ctl));
+    ctl->type = CONTROLLER_HUMAN;
+    ctl->ops = &human_ops;
+}
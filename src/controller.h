@@ -0,0 +1,77 @@
+#pragma once
+#include <stdio.h>
+#include "common.h"
+#include "actlog.h"
+
+struct game;
+struct player;
+struct map_node;
+struct select;
+struct controller;
+struct bot_policy;
+
+enum controller_type {
+    /* whoever feeds the game answers the prompt */
+    CONTROLLER_HUMAN = 0,
+    /* answers read from a file, one per line */
+    CONTROLLER_SCRIPT,
+    /* native policy, no text involved */
+    CONTROLLER_BOT,
+    /* tree search over copies of the game, see mcts.h */
+    CONTROLLER_MCTS,
+    /* see expectimax.h */
+    CONTROLLER_EXPECTIMAX,
+    CONTROLLER_MAX,
+};
+
+/* left to the prompt */
+#define CONTROLLER_ASK (-1)
+
+/*
+ * Decisions of one seat. Every method may return CONTROLLER_ASK to leave
+ * the decision to the prompt, which is all the human controller does.
+ */
+struct controller_ops {
+    const char *name;
+    /* fill @act like the action log records it, val of ACT_ROLL is not used */
+    int (*decide_turn)(struct controller *ctl, struct game *game, struct player *player, struct act *act);
+    /* @return: 1 yes, 0 no */
+    int (*decide_buy)(struct controller *ctl, struct game *game, struct player *player, struct map_node *node);
+    int (*decide_upgrade)(struct controller *ctl, struct game *game, struct player *player, struct map_node *node);
+    /* @return: index of choice in @sel */
+    int (*choose_item)(struct controller *ctl, struct game *game, struct player *player, const struct select *sel);
+    int (*choose_gift)(struct controller *ctl, struct game *game, struct player *player, const struct select *sel);
+    int (*choose_magic_target)(struct controller *ctl, struct game *game, struct player *player,
+                               const struct select *sel);
+};
+
+struct controller {
+    enum controller_type type;
+    const struct controller_ops *ops;
+
+    /* CONTROLLER_SCRIPT */
+    FILE *script;
+    long n_line;
+
+    /* CONTROLLER_BOT */
+    const struct bot_policy *policy;
+
+    /* CONTROLLER_MCTS and CONTROLLER_EXPECTIMAX, budget of a decision, time if search_ms is set */
+    long search_ms;
+    long search_playouts;
+    int search_depth;
+    /* rollouts move at random instead of by the default bot policy */
+    int search_random;
+
+    /* owner data of ops not listed above */
+    void *priv;
+};
+
+/*
+ * @spec: "human", "bot[:POLICY]", "mcts[:Nms|:N][:random]",
+ *        "expectimax[:Nms][:dN]" or "script:FILE",
+ * @return: < 0 err, seat left as it was
+ */
+int controller_init(struct controller *ctl, const char *spec);
+/* back to human */
+void controller_uninit(struct controller *ctl);
@@ -0,0 +1,124 @@
+#include <unistd.h>
+#include <sys/mman.h>
+#include "common.h"
+#include "encode.h"
+#include "player.h"
+
+typedef float encode_vec __attribute__((vector_size(ENCODE_ALIGN)));
+
+_Static_assert(ENCODE_N_FEAT == ENCODE_LANES, "features of a seat fill one vector");
+
+/* @n: multiple of ENCODE_LANES */
+static inline void encode_zero(float *p, long n)
+{
+    const encode_vec zero = { 0 };
+    long i;
+
+    for (i = 0; i < n; i += ENCODE_LANES)
+        *(encode_vec *) (p + i) = zero;
+}
+
+static inline float *encode_plane(const struct encode_shape *shape, float *out, int plane)
+{
+    return out + (long) plane * shape->stride;
+}
+
+void encode_shape(int n_node, struct encode_shape *shape)
+{
+    long size;
+
+    shape->n_node = n_node;
+    shape->stride = (n_node + ENCODE_LANES - 1) / ENCODE_LANES * ENCODE_LANES;
+    size = (long) ENCODE_N_PLANE * shape->stride + GAME_PLAYER_MAX * ENCODE_N_FEAT;
+    shape->size = (size + ENCODE_LANES - 1) / ENCODE_LANES * ENCODE_LANES;
+}
+
+void encode_layout(const struct encode_shape *shape, const struct game *game, float *out)
+{
+    float *type = encode_plane(shape, out, ENCODE_PLANE_TYPE);
+    int i;
+
+    encode_zero(type, (long) MAP_NODE_MAX * shape->stride);
+    for (i = 0; i < shape->n_node; i++)
+        type[(long) game->map.nodes[i].type * shape->stride + i] = 1;
+}
+
+void encode_state(const struct encode_shape *shape, struct game *game, struct player *self, float *out)
+{
+    float *owner = encode_plane(shape, out, ENCODE_PLANE_OWNER);
+    float *level = encode_plane(shape, out, ENCODE_PLANE_LEVEL);
+    float *item = encode_plane(shape, out, ENCODE_PLANE_ITEM);
+    float *pos = encode_plane(shape, out, ENCODE_PLANE_POS);
+    float *feat = encode_plane(shape, out, ENCODE_N_PLANE);
+    struct player *player;
+    struct map_node *node;
+    int s, i, n = game->cur_player_nr;
+
+    /* everything past the layout, only the ones are written after */
+    encode_zero(owner, shape->size - (long) ENCODE_PLANE_OWNER * shape->stride);
+
+    for (s = 0; s < n && s < GAME_PLAYER_MAX; s++) {
+        player = game->cur_players[(self->seq + s) % n];
+
+        /* estates are few, walk them instead of the map */
+        list_for_each_entry(node, &player->asset.estates, estate.estates_list) {
+            owner[(long) s * shape->stride + node->idx] = 1;
+            level[(long) node->estate.level * shape->stride + node->idx] = 1;
+        }
+        if (player->attached && !player->stat.bankrupt)
+            pos[(long) s * shape->stride + player->pos] = 1;
+
+        /* in enum encode_feat order */
+        *(encode_vec *) (feat + s * ENCODE_N_FEAT) = (encode_vec) {
+            player->asset.n_money,
+            player->asset.n_points,
+            player->asset.n_block,
+            player->asset.n_bomb,
+            player->asset.n_robot,
+            player->buff.n_empty_rounds,
+            player->buff.n_god_rounds,
+            player->attached && !player->stat.bankrupt,
+        };
+    }
+
+    for (i = 0; i < shape->n_node; i++) {
+        if (game->map.nodes[i].item == ITEM_BLOCK)
+            item[i] = 1;
+        else if (game->map.nodes[i].item == ITEM_BOMB)
+            item[shape->stride + i] = 1;
+    }
+}
+
+float *encode_map_shared(const char *path, long n_float)
+{
+    size_t size = n_float * sizeof(float);
+    FILE *fp;
+    void *p;
+
+    /* kept if there, a reader may have it mapped already */
+    fp = fopen(path, "r+");
+    if (!fp)
+        fp = fopen(path, "w+");
+    if (!fp) {
+        game_err("fail to open %s\n", path);
+        return NULL;
+    }
+    if (ftruncate(fileno(fp), size)) {
+        game_err("fail to resize %s\n", path);
+        fclose(fp);
+        return NULL;
+    }
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(fp), 0);
+    fclose(fp);
+    if (p == MAP_FAILED) {
+        game_err("fail to map %s\n", path);
+        return NULL;
+    }
+    return p;
+}
+
+void encode_unmap(float *p, long n_float)
+{
+    if (p)
+        munmap(p, n_float * sizeof(float));
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "common.h"
+#include "game.h"
+
+/* floats of a vector store, planes and tensors start on one */
+#define ENCODE_LANES 8
+#define ENCODE_ALIGN (ENCODE_LANES * sizeof(float))
+
+/* planes of a tensor, stride floats each, node i at [i] */
+enum encode_plane {
+    /* one-hot node type, MAP_NODE_MAX planes */
+    ENCODE_PLANE_TYPE = 0,
+    /* owner of the estate by seat, GAME_PLAYER_MAX planes */
+    ENCODE_PLANE_OWNER = ENCODE_PLANE_TYPE + MAP_NODE_MAX,
+    /* one-hot level of owned estates, ESTATE_MAX planes */
+    ENCODE_PLANE_LEVEL = ENCODE_PLANE_OWNER + GAME_PLAYER_MAX,
+    /* block, then bomb */
+    ENCODE_PLANE_ITEM = ENCODE_PLANE_LEVEL + ESTATE_MAX,
+    /* position of the seat if still in the game, GAME_PLAYER_MAX planes */
+    ENCODE_PLANE_POS = ENCODE_PLANE_ITEM + 2,
+    ENCODE_N_PLANE = ENCODE_PLANE_POS + GAME_PLAYER_MAX,
+};
+
+/* features of a seat, after the planes, raw values */
+enum encode_feat {
+    ENCODE_FEAT_MONEY,
+    ENCODE_FEAT_POINTS,
+    ENCODE_FEAT_BLOCK,
+    ENCODE_FEAT_BOMB,
+    ENCODE_FEAT_ROBOT,
+    ENCODE_FEAT_EMPTY,
+    ENCODE_FEAT_GOD,
+    ENCODE_FEAT_ALIVE,
+    ENCODE_N_FEAT,
+};
+
+struct encode_shape {
+    int n_node;
+    /* floats of a plane, n_node rounded up to a vector */
+    int stride;
+    /* floats of a tensor, rounded up to a vector so tensors of a batch stay aligned */
+    long size;
+};
+
+/* of a map of @n_node nodes, map.n_used */
+void encode_shape(int n_node, struct encode_shape *shape);
+
+/*
+ * A tensor is ENCODE_N_PLANE planes of stride floats, then GAME_PLAYER_MAX
+ * seats of ENCODE_N_FEAT floats. Seats are in turn order starting from the
+ * player the tensor is encoded for, missing ones are zero. The node type
+ * planes only change with the map, encode_layout() writes them and
+ * encode_state() everything else, so a buffer reused for the same map only
+ * needs the latter. Both write to @out in place, aligned to ENCODE_ALIGN.
+ */
+void encode_layout(const struct encode_shape *shape, const struct game *game, float *out);
+void encode_state(const struct encode_shape *shape, struct game *game, struct player *self, float *out);
+
+/*
+ * @n_float floats backed by file @path, shared with whoever maps it too, as
+ * a trainer in another process does. The file is created or resized.
+ * @return: NULL err
+ */
+float *encode_map_shared(const char *path, long n_float);
+void encode_unmap(float *p, long n_float);
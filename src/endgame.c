@@ -0,0 +1,657 @@
+#include "common.h"
+#include <pthread.h>
+#include <stdint.h>
+#include "endgame.h"
+#include "map.h"
+#include "player.h"
+#include "search.h"
+
+/* answers of a decision the model tells apart */
+#define EG_MAX_OPT  2
+#define EG_MAX_FACE 16
+#define EG_MAX_BUFF 255
+
+/* one position between two turns, compared and hashed bytewise */
+struct eg_state {
+    /* slots of free estates bought by each side */
+    uint64_t bought[2];
+    /* slots of items stepped on */
+    uint64_t cleared;
+    /* in buckets */
+    int32_t money[2];
+    uint16_t pos[2];
+    uint8_t empty[2];
+    uint8_t god[2];
+    /* side to move */
+    uint8_t turn;
+    uint8_t pad[7];
+};
+
+/* a node of the map as it stood at the root */
+struct eg_node {
+    enum node_type type;
+    /* side owning the estate, -1 for none */
+    int owner;
+    /* bit of a free estate, -1 for none */
+    int slot;
+    /* bit of the item lying here, -1 for none */
+    int item_slot;
+    enum item_type item;
+    /* in buckets, tolls paid and received apart as they round apart */
+    int price;
+    int toll;
+    int toll_in;
+    int hospital;
+    int gift_money;
+    int gift_god;
+};
+
+struct eg_opt {
+    /* side bankrupted, -1 if the game goes on */
+    int loser;
+    struct eg_state next;
+};
+
+/* answers after one face of the dice, the mover picks one */
+struct eg_face {
+    int n_opt;
+    struct eg_opt opts[EG_MAX_OPT];
+};
+
+struct eg_entry {
+    struct eg_state state;
+    double win[2];
+};
+
+/* states of one ply that hash to one worker */
+struct eg_part {
+    pthread_mutex_t lock;
+    struct eg_entry *entries;
+    long n_entry;
+    long cap;
+    /* entry idx + 1, 0 for empty */
+    uint32_t *index;
+    long index_mask;
+};
+
+enum eg_phase {
+    EG_ROOT,
+    EG_EXPAND,
+    EG_VALUE,
+};
+
+struct eg_job {
+    struct eg_node *nodes;
+    int n_used;
+    int facets;
+    struct eg_state root;
+    int bucket;
+    /* some amount is not whole buckets */
+    int rounded;
+
+    enum eg_phase phase;
+    /* ply expanded or valued */
+    int ply;
+    int horizon;
+    int n_part;
+    long n_state;
+    int overflow;
+    int nomem;
+
+    struct eg_part parts[ENDGAME_MAX_PLY + 1][SEARCH_MAX_THREAD];
+};
+
+static inline uint64_t eg_mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static uint64_t eg_hash(const struct eg_state *s)
+{
+    uint64_t w[sizeof(*s) / sizeof(uint64_t)], h = 0;
+    size_t i;
+
+    memcpy(w, s, sizeof(w));
+    for (i = 0; i < ARRAY_SIZE(w); i++)
+        h = eg_mix(h ^ w[i]);
+    return h;
+}
+
+static struct eg_entry *eg_find(struct eg_part *part, const struct eg_state *s, uint64_t hash)
+{
+    long i;
+    uint32_t e;
+
+    if (!part->index)
+        return NULL;
+
+    for (i = (hash >> 8) & part->index_mask; (e = part->index[i]); i = (i + 1) & part->index_mask) {
+        if (!memcmp(&part->entries[e - 1].state, s, sizeof(*s)))
+            return &part->entries[e - 1];
+    }
+    return NULL;
+}
+
+static int eg_grow_index(struct eg_part *part)
+{
+    long size = part->index ? (part->index_mask + 1) * 2 : 1024;
+    uint32_t *index = calloc(size, sizeof(*index));
+    long e, i;
+
+    if (!index)
+        return -1;
+
+    for (e = 0; e < part->n_entry; e++) {
+        i = (eg_hash(&part->entries[e].state) >> 8) & (size - 1);
+        while (index[i])
+            i = (i + 1) & (size - 1);
+        index[i] = e + 1;
+    }
+
+    free(part->index);
+    part->index = index;
+    part->index_mask = size - 1;
+    return 0;
+}
+
+/* @return: < 0 err, == 0 added, > 0 known */
+static int eg_insert(struct eg_part *part, const struct eg_state *s, uint64_t hash)
+{
+    struct eg_entry *entries;
+    long i;
+
+    if (eg_find(part, s, hash))
+        return 1;
+
+    if (part->n_entry == part->cap) {
+        part->cap = part->cap ? part->cap * 2 : 1024;
+        entries = realloc(part->entries, part->cap * sizeof(*entries));
+        if (!entries)
+            return -1;
+        part->entries = entries;
+    }
+    if ((part->n_entry + 1) * 2 > part->index_mask + 1 && eg_grow_index(part))
+        return -1;
+
+    part->entries[part->n_entry] = (struct eg_entry) { .state = *s };
+    for (i = (hash >> 8) & part->index_mask; part->index[i]; i = (i + 1) & part->index_mask)
+        ;
+    part->index[i] = ++part->n_entry;
+    return 0;
+}
+
+static void eg_part_free(struct eg_part *part)
+{
+    free(part->entries);
+    free(part->index);
+    part->entries = NULL;
+    part->index = NULL;
+    part->n_entry = part->cap = 0;
+    part->index_mask = 0;
+}
+
+static inline int eg_buff_add(int n, int add)
+{
+    return n + add > EG_MAX_BUFF ? EG_MAX_BUFF : n + add;
+}
+
+/* walk as game_player_step(), stopped by blocks and sent to hospital by bombs */
+static int eg_walk(const struct eg_job *job, struct eg_state *s, int me, int step)
+{
+    const struct eg_node *node;
+    int n, pos = s->pos[me];
+
+    for (n = 1; n <= step; n++) {
+        pos = (s->pos[me] + n) % job->n_used;
+        node = &job->nodes[pos];
+        if (node->item_slot < 0 || (s->cleared >> node->item_slot & 1))
+            continue;
+
+        s->cleared |= 1ULL << node->item_slot;
+        if (node->item == ITEM_BOMB) {
+            s->empty[me] = 3;
+            return node->hospital;
+        }
+        return pos;
+    }
+    return pos;
+}
+
+/* stop at @s->pos[me] as game_map_after_action(), @return: number of answers */
+static int eg_land(const struct eg_job *job, const struct eg_state *s, int me, int god, struct eg_face *face)
+{
+    const struct eg_node *node = &job->nodes[s->pos[me]];
+    struct eg_opt *opts = face->opts;
+    int owner, op = !me;
+
+    opts[0] = (struct eg_opt) { .loser = -1, .next = *s };
+    face->n_opt = 1;
+
+    switch (node->type) {
+    case MAP_NODE_VACANCY:
+        owner = node->owner;
+        if (node->slot >= 0) {
+            if (s->bought[0] >> node->slot & 1)
+                owner = 0;
+            else if (s->bought[1] >> node->slot & 1)
+                owner = 1;
+        }
+
+        if (owner < 0) {
+            if (node->slot < 0 || s->money[me] < node->price)
+                break;
+            opts[1] = opts[0];
+            opts[1].next.money[me] -= node->price;
+            opts[1].next.bought[me] |= 1ULL << node->slot;
+            face->n_opt = 2;
+        } else if (owner == op && !god) {
+            opts[0].next.money[me] -= node->toll;
+            if (opts[0].next.money[me] < 0)
+                opts[0].loser = me;
+            else
+                opts[0].next.money[op] += node->toll_in;
+        }
+        break;
+
+    case MAP_NODE_GIFT_HOUSE:
+        opts[1] = opts[0];
+        opts[0].next.money[me] += node->gift_money;
+        opts[1].next.god[me] = eg_buff_add(opts[1].next.god[me], node->gift_god);
+        face->n_opt = 2;
+        break;
+
+    case MAP_NODE_MAGIC_HOUSE:
+        opts[1] = opts[0];
+        opts[1].next.empty[op] = eg_buff_add(opts[1].next.empty[op], 2);
+        face->n_opt = 2;
+        break;
+
+    case MAP_NODE_PRISON:
+        opts[0].next.empty[me] = 2;
+        break;
+
+    default:
+        break;
+    }
+    return face->n_opt;
+}
+
+/* answers to the turn of @s->turn, one face of the dice each, @return: number of faces */
+static int eg_expand(const struct eg_job *job, const struct eg_state *s, struct eg_face *faces)
+{
+    int me = s->turn, god = s->god[me] > 0;
+    struct eg_state base = *s, next;
+    int d;
+
+    /* buffs wear off as in player_buff_wearoff(), whatever the turn brings */
+    base.turn = !me;
+    if (base.god[me])
+        base.god[me]--;
+
+    if (s->empty[me]) {
+        base.empty[me]--;
+        faces[0] = (struct eg_face) { .n_opt = 1, .opts[0] = { .loser = -1, .next = base } };
+        return 1;
+    }
+
+    for (d = 1; d <= job->facets; d++) {
+        next = base;
+        next.pos[me] = eg_walk(job, &next, me, d);
+        eg_land(job, &next, me, god, &faces[d - 1]);
+    }
+    return job->facets;
+}
+
+static void eg_worker_root(struct eg_job *job, int idx, int n)
+{
+    if (idx == 0)
+        job->n_part = n;
+    if (eg_hash(&job->root) % n != (uint64_t) idx)
+        return;
+
+    if (eg_insert(&job->parts[0][idx], &job->root, eg_hash(&job->root)) < 0)
+        __atomic_store_n(&job->nomem, 1, __ATOMIC_RELAXED);
+    else
+        __atomic_add_fetch(&job->n_state, 1, __ATOMIC_RELAXED);
+}
+
+/* successors of our part of the ply go to the part of the next ply their hash picks */
+static void eg_worker_expand(struct eg_job *job, int idx, int n)
+{
+    struct eg_part *part = &job->parts[job->ply][idx];
+    struct eg_part *dst;
+    struct eg_face faces[EG_MAX_FACE];
+    const struct eg_state *next;
+    uint64_t hash;
+    int f, o, n_face, ret;
+    long e;
+
+    for (e = 0; e < part->n_entry; e++) {
+        if (__atomic_load_n(&job->overflow, __ATOMIC_RELAXED))
+            return;
+
+        n_face = eg_expand(job, &part->entries[e].state, faces);
+        for (f = 0; f < n_face; f++) {
+            for (o = 0; o < faces[f].n_opt; o++) {
+                if (faces[f].opts[o].loser >= 0)
+                    continue;
+
+                next = &faces[f].opts[o].next;
+                hash = eg_hash(next);
+                dst = &job->parts[job->ply + 1][hash % n];
+
+                pthread_mutex_lock(&dst->lock);
+                ret = eg_insert(dst, next, hash);
+                pthread_mutex_unlock(&dst->lock);
+
+                if (ret < 0) {
+                    __atomic_store_n(&job->nomem, 1, __ATOMIC_RELAXED);
+                    __atomic_store_n(&job->overflow, 1, __ATOMIC_RELAXED);
+                    return;
+                }
+                if (!ret && __atomic_add_fetch(&job->n_state, 1, __ATOMIC_RELAXED) > ENDGAME_MAX_STATE) {
+                    __atomic_store_n(&job->overflow, 1, __ATOMIC_RELAXED);
+                    return;
+                }
+            }
+        }
+    }
+}
+
+/* each face goes to the answer best for the mover, ties to the one worse for the other */
+static void eg_worker_value(struct eg_job *job, int idx, int n)
+{
+    struct eg_part *part = &job->parts[job->ply][idx];
+    struct eg_face faces[EG_MAX_FACE];
+    const struct eg_entry *found;
+    const struct eg_opt *opt;
+    struct eg_entry *entry;
+    double win[2], best[2] = { 0 };
+    uint64_t hash;
+    int f, o, me, n_face;
+    long e;
+
+    if (job->ply == job->horizon)
+        return;
+
+    for (e = 0; e < part->n_entry; e++) {
+        entry = &part->entries[e];
+        me = entry->state.turn;
+        n_face = eg_expand(job, &entry->state, faces);
+
+        for (f = 0; f < n_face; f++) {
+            for (o = 0; o < faces[f].n_opt; o++) {
+                opt = &faces[f].opts[o];
+                if (opt->loser >= 0) {
+                    win[opt->loser] = 0;
+                    win[!opt->loser] = 1;
+                } else {
+                    hash = eg_hash(&opt->next);
+                    found = eg_find(&job->parts[job->ply + 1][hash % n], &opt->next, hash);
+                    assert(found);
+                    win[0] = found->win[0];
+                    win[1] = found->win[1];
+                }
+
+                if (!o || win[me] > best[me] || (win[me] == best[me] && win[!me] < best[!me])) {
+                    best[0] = win[0];
+                    best[1] = win[1];
+                }
+            }
+            entry->win[0] += best[0] / n_face;
+            entry->win[1] += best[1] / n_face;
+        }
+    }
+}
+
+static void eg_worker(struct game *sim, int idx, int n, void *arg)
+{
+    struct eg_job *job = arg;
+
+    switch (job->phase) {
+    case EG_ROOT:
+        eg_worker_root(job, idx, n);
+        break;
+    case EG_EXPAND:
+        eg_worker_expand(job, idx, n);
+        break;
+    case EG_VALUE:
+        eg_worker_value(job, idx, n);
+        break;
+    }
+}
+
+/* @return: < 0 err, > 0 the map does not fit in the slots of a state */
+static int eg_model_map(struct eg_job *job, struct game *game, struct player **sides)
+{
+    struct map *map = &game->map;
+    struct map_node *node;
+    struct eg_node *eg;
+    int i, j, n_slot = 0, n_item = 0;
+
+    job->n_used = map->n_used;
+    job->nodes = calloc(map->n_used, sizeof(*job->nodes));
+    if (!job->nodes)
+        return -1;
+
+    for (i = 0; i < map->n_used; i++) {
+        node = &map->nodes[i];
+        eg = &job->nodes[i];
+        *eg = (struct eg_node) { .type = node->type, .owner = -1, .slot = -1, .item_slot = -1, .item = node->item };
+
+        if (node->item == ITEM_BLOCK || node->item == ITEM_BOMB) {
+            if (n_item == ENDGAME_MAX_SLOT)
+                return 1;
+            eg->item_slot = n_item++;
+            if (node->item == ITEM_BOMB)
+                eg->hospital = map_nearest_node_from(map, game->cur_layout, i, MAP_NODE_HOSPITAL);
+        }
+
+        if (node->type == MAP_NODE_VACANCY) {
+            eg->price = node->estate.price;
+            eg->toll = map_node_price(node) / 2;
+            if (node->estate.owner == sides[0] || node->estate.owner == sides[1]) {
+                eg->owner = node->estate.owner == sides[1];
+            } else {
+                if (n_slot == ENDGAME_MAX_SLOT)
+                    return 1;
+                eg->slot = n_slot++;
+            }
+        }
+
+        if (node->type == MAP_NODE_GIFT_HOUSE) {
+            for (j = 0; j < node->gift_house.n_gifts; j++) {
+                if (node->gift_house.gifts[j].grant == player_grant_gift_money)
+                    eg->gift_money = node->gift_house.gifts[j].value;
+                else if (node->gift_house.gifts[j].grant == player_grant_gift_god)
+                    eg->gift_god = node->gift_house.gifts[j].value;
+            }
+        }
+    }
+    return 0;
+}
+
+static int eg_gcd(int a, int b)
+{
+    int t;
+
+    while (b) {
+        t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/* @amount in buckets rounded down, or up with @up */
+static int eg_to_bucket(struct eg_job *job, int amount, int up)
+{
+    if (amount % job->bucket)
+        job->rounded = 1;
+    return (amount + (up ? job->bucket - 1 : 0)) / job->bucket;
+}
+
+/* every amount of the model into buckets, see endgame_solve() */
+static void eg_model_money(struct eg_job *job)
+{
+    struct eg_node *node;
+    int i, w = 0, rich;
+
+    for (i = 0; i < 2; i++)
+        w = eg_gcd(w, job->root.money[i]);
+    for (i = 0; i < job->n_used; i++) {
+        node = &job->nodes[i];
+        w = eg_gcd(eg_gcd(eg_gcd(w, node->price), node->toll), node->gift_money);
+    }
+
+    rich = job->root.money[0] > job->root.money[1] ? job->root.money[0] : job->root.money[1];
+    if (rich > (long) ENDGAME_MAX_BUCKET * w)
+        w = (rich + ENDGAME_MAX_BUCKET - 1) / ENDGAME_MAX_BUCKET;
+    job->bucket = w > 0 ? w : 1;
+
+    for (i = 0; i < 2; i++)
+        job->root.money[i] = eg_to_bucket(job, job->root.money[i], 0);
+    for (i = 0; i < job->n_used; i++) {
+        node = &job->nodes[i];
+        node->price = eg_to_bucket(job, node->price, 1);
+        node->toll_in = eg_to_bucket(job, node->toll, 0);
+        node->toll = eg_to_bucket(job, node->toll, 1);
+        node->gift_money = eg_to_bucket(job, node->gift_money, 0);
+    }
+}
+
+/* @return: < 0 err, > 0 not two players */
+static int eg_model(struct eg_job *job, struct game *game, struct endgame_result *res)
+{
+    struct player *sides[2] = { game->next_player, NULL };
+    struct player *player;
+    int i, ret;
+
+    if (game->state != GAME_STATE_RUNNING || !sides[0] || game->bankrupt_nr + 2 != game->cur_player_nr)
+        return 1;
+    if (game->dice_facets > EG_MAX_FACE)
+        return 1;
+
+    for (i = 0; i < game->cur_player_nr; i++) {
+        player = game->cur_players[i];
+        if (player && player != sides[0] && !player->stat.bankrupt)
+            sides[1] = player;
+    }
+    if (!sides[1] || !sides[0]->attached || !sides[1]->attached)
+        return 1;
+
+    job->facets = game->dice_facets;
+    for (i = 0; i < 2; i++) {
+        res->idx[i] = sides[i]->idx;
+        job->root.money[i] = sides[i]->asset.n_money;
+        job->root.pos[i] = sides[i]->pos;
+        job->root.empty[i] = eg_buff_add(sides[i]->buff.n_empty_rounds, 0);
+        job->root.god[i] = eg_buff_add(sides[i]->buff.n_god_rounds, 0);
+    }
+
+    ret = eg_model_map(job, game, sides);
+    if (!ret)
+        eg_model_money(job);
+    return ret;
+}
+
+static void eg_job_free(struct eg_job *job)
+{
+    int p, i;
+
+    for (p = 0; p <= ENDGAME_MAX_PLY; p++) {
+        for (i = 0; i < SEARCH_MAX_THREAD; i++) {
+            eg_part_free(&job->parts[p][i]);
+            pthread_mutex_destroy(&job->parts[p][i].lock);
+        }
+    }
+    free(job->nodes);
+    free(job);
+}
+
+static long eg_ply_size(struct eg_job *job, int ply)
+{
+    long n = 0;
+    int i;
+
+    for (i = 0; i < job->n_part; i++)
+        n += job->parts[ply][i].n_entry;
+    return n;
+}
+
+int endgame_solve(struct game *game, struct endgame_result *res)
+{
+    struct eg_job *job;
+    struct eg_entry *root;
+    int ret, p, i;
+
+    *res = (struct endgame_result) { 0 };
+
+    job = calloc(1, sizeof(*job));
+    if (!job)
+        return -1;
+    for (p = 0; p <= ENDGAME_MAX_PLY; p++) {
+        for (i = 0; i < SEARCH_MAX_THREAD; i++)
+            pthread_mutex_init(&job->parts[p][i].lock, NULL);
+    }
+
+    ret = eg_model(job, game, res);
+    if (ret)
+        goto out;
+
+    ret = -1;
+    job->phase = EG_ROOT;
+    if (search_run(eg_worker, job) < 0 || job->nomem)
+        goto out;
+
+    /* forward, a ply at a time, until nothing is left or it does not fit */
+    job->phase = EG_EXPAND;
+    for (job->ply = 0; job->ply < ENDGAME_MAX_PLY; job->ply++) {
+        if (search_run(eg_worker, job) < 0 || job->nomem)
+            goto out;
+        if (job->overflow) {
+            for (i = 0; i < job->n_part; i++)
+                eg_part_free(&job->parts[job->ply + 1][i]);
+            break;
+        }
+        if (!eg_ply_size(job, job->ply + 1)) {
+            res->exact = 1;
+            job->ply++;
+            break;
+        }
+    }
+    job->horizon = job->ply;
+    for (p = 0; p <= job->horizon; p++)
+        res->n_state += eg_ply_size(job, p);
+
+    /* backward, the plies past the horizon are nobody's win */
+    job->phase = EG_VALUE;
+    for (job->ply = job->horizon; job->ply >= 0; job->ply--) {
+        if (search_run(eg_worker, job) < 0)
+            goto out;
+        if (job->ply < job->horizon) {
+            for (i = 0; i < job->n_part; i++)
+                eg_part_free(&job->parts[job->ply + 1][i]);
+        }
+    }
+
+    root = eg_find(&job->parts[0][eg_hash(&job->root) % job->n_part], &job->root, eg_hash(&job->root));
+    assert(root);
+    res->win[0] = root->win[0];
+    res->win[1] = root->win[1];
+    res->n_ply = job->horizon;
+    res->bucket = job->bucket;
+    res->exact = res->exact && !job->rounded;
+    ret = 0;
+
+    game_dbg("endgame %d plies, %ld states, win %f %f\n", res->n_ply, res->n_state, res->win[0], res->win[1]);
+
+out:
+    eg_job_free(job);
+    return ret;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "common.h"
+#include "game.h"
+
+/* turns looked ahead at most */
+#define ENDGAME_MAX_PLY    64
+/* states of all plies together, the solver stops short of a ply that would not fit */
+#define ENDGAME_MAX_STATE  (1 << 20)
+/* estates free and items lying on the map, one bit each in a state */
+#define ENDGAME_MAX_SLOT   64
+/* money buckets the richer side starts with at most, buckets get wider past it */
+#define ENDGAME_MAX_BUCKET 256
+
+struct endgame_result {
+    /* player idx of the two left, the one to move first */
+    int idx[2];
+    /* chance each of them bankrupts the other within n_ply turns */
+    double win[2];
+    int n_ply;
+    long n_state;
+    /* money is counted in buckets this wide */
+    int bucket;
+    /* nobody can be left standing after n_ply turns and no amount was rounded, win[] adds up to 1 */
+    int exact;
+};
+
+/*
+ * Win chances of a game down to two players, by dynamic programming over
+ * every position reachable in a number of turns. A position is compact:
+ * places, money, empty and god rounds of both players, which of the estates
+ * free at the start got bought by whom and which items got stepped on.
+ *
+ * Money is kept in buckets, the gcd of the money, prices, tolls and gifts
+ * at the start if the richer side has ENDGAME_MAX_BUCKET of them at most,
+ * wider otherwise. Wider buckets round every amount against the player,
+ * prices and tolls paid up, money, tolls received and gifts down.
+ *
+ * Both players play their best at the buy, gift and magic decisions and
+ * nothing else, nobody upgrades, sells or places items. The plies are
+ * expanded and valued turn by turn, each ply split by state hash over the
+ * workers of the search pool (search.h). The deeper the solver gets the
+ * more of the game is settled, what is left is neither player's win and
+ * win[] are lower bounds then.
+ *
+ * @return: < 0 err, == 0 solved, > 0 not a game of two players this models
+ */
+int endgame_solve(struct game *game, struct endgame_result *res);
@@ -0,0 +1,475 @@
+#include "common.h"
+#include <stdint.h>
+#include "expectimax.h"
+#include "bot.h"
+#include "game.h"
+#include "save.h"
+#include "search.h"
+
+/* nodes between two looks at the clock */
+#define EX_CLOCK_EVERY 256
+#define EX_VALUE_ONE   65535
+#define EX_INFO_CUT    (1ULL << 32)
+
+/*
+ * check is key ^ values ^ info, a writer racing a reader leaves an entry
+ * whose words do not add up and the reader takes it as a miss.
+ */
+struct ex_entry {
+    uint64_t check;
+    /* 16 bits of reward per seat */
+    uint64_t values;
+    /* best answer, EX_INFO_CUT if a leaf below was cut by depth */
+    uint64_t info;
+};
+
+static struct ex_entry *g_ex_tt;
+
+/* one decision for the pool, read only while the workers run */
+struct ex_job {
+    struct game_image img;
+    enum game_decision decision;
+    /* 0 for none, a fixed depth then */
+    long ms;
+    int max_depth;
+    struct timespec deadline;
+    int seats[PLAYER_MAX];
+    int n_seat;
+
+    /* deepest finished iteration of each worker */
+    struct ex_result {
+        int depth;
+        int best;
+        long n_node;
+    } results[SEARCH_MAX_THREAD];
+};
+
+struct ex_worker {
+    const struct ex_job *job;
+    struct game *sim;
+    int idx;
+    long n_node;
+    int aborted;
+    /* some leaf was cut by depth, a deeper iteration may see more */
+    int cut;
+
+    /* answer the next seat asked gives, all others ask */
+    int forced;
+    struct act answer;
+
+    /* position and open decision of every level on the way down */
+    struct game_image imgs[EXPECTIMAX_MAX_DEPTH + 1];
+    enum game_decision decisions[EXPECTIMAX_MAX_DEPTH + 1];
+};
+
+static inline uint64_t ex_mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/* positions reached with the same decision open and as much depth left */
+static uint64_t ex_key(struct game *sim, int depth)
+{
+    uint64_t extra = sim->prompt.decision;
+
+    extra = extra << 8 | sim->prompt.player->idx;
+    extra = extra << 8 | depth;
+    extra = extra << 8 | sim->dice_facets;
+    extra = extra << 16 | sim->map.n_used;
+    return sim->track.hash ^ ex_mix(extra + 1);
+}
+
+/* @cut: set if the entry was searched with some leaf cut by depth, @return: best answer, < 0 miss */
+static int ex_tt_get(uint64_t key, int n_seat, float *value, int *cut)
+{
+    struct ex_entry *ent = &g_ex_tt[key & (EXPECTIMAX_TT_SIZE - 1)];
+    uint64_t check, values, info;
+    int s;
+
+    check = __atomic_load_n(&ent->check, __ATOMIC_RELAXED);
+    values = __atomic_load_n(&ent->values, __ATOMIC_RELAXED);
+    info = __atomic_load_n(&ent->info, __ATOMIC_RELAXED);
+    if ((check ^ values ^ info) != key)
+        return -1;
+
+    for (s = 0; s < n_seat; s++)
+        value[s] = (float) (values >> (16 * s) & 0xffff) / EX_VALUE_ONE;
+    *cut = !!(info & EX_INFO_CUT);
+    return info & 0xffff;
+}
+
+static void ex_tt_put(uint64_t key, int n_seat, const float *value, int best, int cut)
+{
+    struct ex_entry *ent = &g_ex_tt[key & (EXPECTIMAX_TT_SIZE - 1)];
+    uint64_t values = 0, info = best | (cut ? EX_INFO_CUT : 0);
+    int s;
+
+    for (s = 0; s < n_seat; s++)
+        values |= (uint64_t) (value[s] * EX_VALUE_ONE + 0.5f) << (16 * s);
+
+    __atomic_store_n(&ent->check, key ^ values ^ info, __ATOMIC_RELAXED);
+    __atomic_store_n(&ent->values, values, __ATOMIC_RELAXED);
+    __atomic_store_n(&ent->info, info, __ATOMIC_RELAXED);
+}
+
+/* copies answer what the search asks once, then stop at the next decision */
+static int ex_sim_turn(struct controller *ctl, struct game *game, struct player *player, struct act *act)
+{
+    struct ex_worker *w = ctl->priv;
+
+    if (!w->forced)
+        return CONTROLLER_ASK;
+    w->forced = 0;
+    *act = w->answer;
+    return 0;
+}
+
+static int ex_sim_decide(struct controller *ctl, struct game *game, struct player *player, struct map_node *node)
+{
+    struct ex_worker *w = ctl->priv;
+
+    if (!w->forced)
+        return CONTROLLER_ASK;
+    w->forced = 0;
+    return w->answer.val;
+}
+
+static int ex_sim_choose(struct controller *ctl, struct game *game, struct player *player, const struct select *sel)
+{
+    struct ex_worker *w = ctl->priv;
+
+    if (!w->forced)
+        return CONTROLLER_ASK;
+    w->forced = 0;
+    return w->answer.val;
+}
+
+static const struct controller_ops ex_sim_ops = {
+    .name = "expectimax",
+    .decide_turn = ex_sim_turn,
+    .decide_buy = ex_sim_decide,
+    .decide_upgrade = ex_sim_decide,
+    .choose_item = ex_sim_choose,
+    .choose_gift = ex_sim_choose,
+    .choose_magic_target = ex_sim_choose,
+};
+
+/* restore @level into the copy, @answer: NULL to leave its decision open */
+static int ex_load(struct ex_worker *w, int level, const struct act *answer)
+{
+    struct game *sim = w->sim;
+    int i;
+
+    if (game_sim_load(sim, &w->imgs[level], w->decisions[level]))
+        return -1;
+
+    for (i = 0; i < PLAYER_MAX; i++)
+        sim->ctrls[i] = (struct controller) { .type = CONTROLLER_EXPECTIMAX, .ops = &ex_sim_ops, .priv = w };
+    if (!answer)
+        return 0;
+
+    w->forced = 1;
+    w->answer = *answer;
+    game_feed(sim, NULL);
+
+    if (!(++w->n_node % EX_CLOCK_EVERY) && w->job->ms && search_expired(&w->job->deadline))
+        w->aborted = 1;
+    return 0;
+}
+
+/*
+ * Worth share as search_score(), but cash short of the reserve of the
+ * default bot policy counts against the player, a horizon of a few rolls
+ * does not see the toll that breaks it.
+ */
+static void ex_score(struct game *sim, const int *seats, float *reward)
+{
+    int reserve = bot_policy_find(NULL)->reserve;
+    long worth[PLAYER_MAX] = { 0 }, total = 0;
+    struct player *player;
+    struct map_node *node;
+    long w;
+
+    if (sim->state == GAME_STATE_STOPPED) {
+        search_score(sim, seats, reward);
+        return;
+    }
+
+    for_each_player_begin(sim, player) {
+        if (player->stat.bankrupt)
+            continue;
+
+        w = 0;
+        list_for_each_entry(node, &player->asset.estates, estate.estates_list)
+            w += map_node_price(node);
+        w += player->asset.n_money;
+        if (player->asset.n_money < reserve)
+            w -= reserve - player->asset.n_money;
+
+        worth[player->idx] = w > 1 ? w : 1;
+        total += worth[player->idx];
+    } for_each_player_end();
+
+    for_each_player_begin(sim, player) {
+        reward[seats[player->idx]] = total > 0 ? (float) worth[player->idx] / total : 0;
+    } for_each_player_end();
+}
+
+static int ex_value(struct ex_worker *w, int level, int depth, float *value);
+
+/* value of @answer to the decision of @level */
+static void ex_answer(struct ex_worker *w, int level, int depth, const struct act *answer, float *value)
+{
+    float sum[GAME_PLAYER_MAX] = { 0 };
+    struct act step = { .type = ACT_STEP };
+    int facets = w->job->img.dice_facets;
+    int s;
+
+    if (answer->type != ACT_ROLL) {
+        if (ex_load(w, level, answer))
+            ex_score(w->sim, w->job->seats, value);
+        else
+            ex_value(w, level + 1, depth - 1, value);
+        return;
+    }
+
+    /* chance node, every face is as likely */
+    for (step.val = 1; step.val <= facets && !w->aborted; step.val++) {
+        if (ex_load(w, level, &step))
+            ex_score(w->sim, w->job->seats, value);
+        else
+            ex_value(w, level + 1, depth - 1, value);
+
+        for (s = 0; s < w->job->n_seat; s++)
+            sum[s] += value[s];
+    }
+    for (s = 0; s < w->job->n_seat; s++)
+        value[s] = sum[s] / facets;
+}
+
+/*
+ * Expectimax value of the position in the copy, its decision open.
+ * @return: index of the best answer, < 0 if none was searched
+ */
+static int ex_value(struct ex_worker *w, int level, int depth, float *value)
+{
+    const struct ex_job *job = w->job;
+    struct game *sim = w->sim;
+    struct player *player = sim->prompt.player;
+    struct act cands[SEARCH_MAX_CAND];
+    float child[GAME_PLAYER_MAX];
+    int i, k, n, s, seat, cut, best = -1;
+    uint64_t key = 0;
+
+    /* game over, or a turn left to a seat gone human */
+    if (sim->state != GAME_STATE_RUNNING || !player || sim->prompt.decision == GAME_DECIDE_NONE) {
+        ex_score(sim, job->seats, value);
+        return -1;
+    }
+    if (!depth || level >= EXPECTIMAX_MAX_DEPTH) {
+        w->cut = 1;
+        ex_score(sim, job->seats, value);
+        return -1;
+    }
+
+    /* root answers differ from those below it, it never takes a hit */
+    key = ex_key(sim, depth);
+    if (level && ex_tt_get(key, job->n_seat, value, &cut) >= 0) {
+        /* a stored cut still hides more to a deeper iteration */
+        w->cut |= cut;
+        return 0;
+    }
+
+    n = search_candidates(sim, player, sim->prompt.decision, &sim->prompt.sel, !level, cands);
+    if (level) {
+        w->decisions[level] = sim->prompt.decision;
+        if (game_save_image(sim, &w->imgs[level])) {
+            ex_score(sim, job->seats, value);
+            return -1;
+        }
+    }
+
+    /* cuts below this position only, for its entry */
+    cut = w->cut;
+    w->cut = 0;
+
+    seat = job->seats[player->idx];
+    for (k = 0; k < n && !w->aborted; k++) {
+        /* workers walk the root in orders of their own */
+        i = level ? k : (k + w->idx) % n;
+
+        ex_answer(w, level, depth, &cands[i], child);
+        if (best < 0 || child[seat] > value[seat] || (child[seat] == value[seat] && i < best)) {
+            best = i;
+            for (s = 0; s < job->n_seat; s++)
+                value[s] = child[s];
+        }
+    }
+
+    if (!w->aborted && best >= 0)
+        ex_tt_put(key, job->n_seat, value, best, w->cut);
+    w->cut |= cut;
+    return best;
+}
+
+/* search_fn_t, iterative deepening from the root of the job */
+static void ex_worker(struct game *sim, int idx, int n_worker, void *arg)
+{
+    struct ex_job *job = arg;
+    struct ex_result *result = &job->results[idx];
+    float value[GAME_PLAYER_MAX];
+    struct ex_worker *w;
+    int depth, best;
+
+    result->depth = 0;
+    result->best = -1;
+    result->n_node = 0;
+
+    w = calloc(1, sizeof(*w));
+    if (!w)
+        return;
+    w->job = job;
+    w->sim = sim;
+    w->idx = idx;
+    w->imgs[0] = job->img;
+    w->decisions[0] = job->decision;
+
+    for (depth = 1; depth <= job->max_depth; depth++) {
+        w->cut = 0;
+        if (ex_load(w, 0, NULL))
+            break;
+
+        best = ex_value(w, 0, depth, value);
+        if (w->aborted)
+            break;
+
+        result->depth = depth;
+        result->best = best;
+        /* the whole game tree is in, deeper finds nothing new */
+        if (!w->cut)
+            break;
+    }
+
+    result->n_node = w->n_node;
+    free(w);
+}
+
+/* @return: index of the best of @n_cand answers to the open prompt, < 0 err */
+static int ex_search(struct controller *ctl, struct game *game, enum game_decision decision, int n_cand)
+{
+    struct ex_job *job;
+    long n_node = 0;
+    int i, n, depth = 0, best = -1;
+
+    if (!g_ex_tt) {
+        g_ex_tt = calloc(EXPECTIMAX_TT_SIZE, sizeof(*g_ex_tt));
+        if (!g_ex_tt)
+            return -1;
+    }
+
+    job = malloc(sizeof(*job));
+    if (!job || game_save_image(game, &job->img))
+        goto out;
+
+    job->decision = decision;
+    job->ms = ctl->search_ms;
+    job->max_depth = ctl->search_depth;
+    job->n_seat = search_seats(game, job->seats);
+    search_deadline(&job->deadline, job->ms);
+
+    n = search_run(ex_worker, job);
+    for (i = 0; i < n; i++) {
+        n_node += job->results[i].n_node;
+        if (job->results[i].depth > depth && job->results[i].best < n_cand) {
+            depth = job->results[i].depth;
+            best = job->results[i].best;
+        }
+    }
+    game_dbg("decision %d, depth %d, %ld nodes, answer %d of %d\n", decision, depth, n_node, best, n_cand);
+
+out:
+    free(job);
+    return best;
+}
+
+/* the best of the candidates, or what the bot would do */
+static int ex_decide(struct controller *ctl, struct game *game, struct player *player,
+                     enum game_decision decision, const struct select *sel, struct act *act)
+{
+    struct act cands[SEARCH_MAX_CAND];
+    int i, n;
+
+    n = search_candidates(game, player, decision, sel, 1, cands);
+    i = n > 1 ? ex_search(ctl, game, decision, n) : 0;
+    if (i < 0 || !n)
+        return CONTROLLER_ASK;
+
+    *act = cands[i];
+    return 0;
+}
+
+static int ex_decide_turn(struct controller *ctl, struct game *game, struct player *player, struct act *act)
+{
+    if (ex_decide(ctl, game, player, GAME_DECIDE_COMMAND, NULL, act))
+        return g_bot_ops.decide_turn(ctl, game, player, act);
+    return 0;
+}
+
+static int ex_decide_buy(struct controller *ctl, struct game *game, struct player *player, struct map_node *node)
+{
+    struct act act;
+
+    if (ex_decide(ctl, game, player, GAME_DECIDE_BUY, NULL, &act))
+        return g_bot_ops.decide_buy(ctl, game, player, node);
+    return act.val;
+}
+
+static int ex_decide_upgrade(struct controller *ctl, struct game *game, struct player *player, struct map_node *node)
+{
+    struct act act;
+
+    if (ex_decide(ctl, game, player, GAME_DECIDE_UPGRADE, NULL, &act))
+        return g_bot_ops.decide_upgrade(ctl, game, player, node);
+    return act.val;
+}
+
+static int ex_choose_item(struct controller *ctl, struct game *game, struct player *player, const struct select *sel)
+{
+    struct act act;
+
+    if (ex_decide(ctl, game, player, GAME_DECIDE_ITEM, sel, &act))
+        return g_bot_ops.choose_item(ctl, game, player, sel);
+    return act.val;
+}
+
+static int ex_choose_gift(struct controller *ctl, struct game *game, struct player *player, const struct select *sel)
+{
+    struct act act;
+
+    if (ex_decide(ctl, game, player, GAME_DECIDE_GIFT, sel, &act))
+        return g_bot_ops.choose_gift(ctl, game, player, sel);
+    return act.val;
+}
+
+static int ex_choose_magic_target(struct controller *ctl, struct game *game, struct player *player,
+                                  const struct select *sel)
+{
+    struct act act;
+
+    if (ex_decide(ctl, game, player, GAME_DECIDE_MAGIC, sel, &act))
+        return g_bot_ops.choose_magic_target(ctl, game, player, sel);
+    return act.val;
+}
+
+const struct controller_ops g_expectimax_ops = {
+    .name = "expectimax",
+    .decide_turn = ex_decide_turn,
+    .decide_buy = ex_decide_buy,
+    .decide_upgrade = ex_decide_upgrade,
+    .choose_item = ex_choose_item,
+    .choose_gift = ex_choose_gift,
+    .choose_magic_target = ex_choose_magic_target,
+};
@@ -0,0 +1,25 @@
+#pragma once
+#include "common.h"
+#include "controller.h"
+
+/* budget of a decision when the spec names none */
+#define EXPECTIMAX_DEFAULT_MS 100
+/* decisions looked ahead at most */
+#define EXPECTIMAX_MAX_DEPTH  16
+/* entries of the transposition table, power of 2 */
+#define EXPECTIMAX_TT_SIZE    (1 << 18)
+
+/*
+ * Depth limited expectimax behind CONTROLLER_EXPECTIMAX. A ply is one
+ * decision of whoever is asked, its player takes the answer best for its
+ * own worth share, and a roll averages over every face of the dice. Every
+ * block and bomb offset in range is searched at the root.
+ *
+ * Positions are keyed by the state hash of the game (game_state_hash) and
+ * kept in a transposition table shared by all workers of the search pool
+ * without locks, a torn entry fails its check and reads as a miss. The
+ * workers deepen iteratively on the same root, each in an order of its own,
+ * until the time of the decision is up, the deepest finished iteration
+ * answers.
+ */
+extern const struct controller_ops g_expectimax_ops;
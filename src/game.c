@@ -1,22 +1,42 @@
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
 #include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
 #include "common.h"
 #include "game.h"
 #include "player.h"
 #include "ui.h"
+#include "save.h"
+#include "checkpoint.h"
+#include "history.h"
+#include "endgame.h"
+#include "winprob.h"
+#include "landing.h"
+#include "risk.h"
+#include "advise.h"
+#include "liquidate.h"
 
 static const struct game_options default_option = {
     .opts = {
-        [GAME_OPT_DEBUG] = { .name = "debug" },
+        [GAME_OPT_DEBUG] = { .name = "debug", .shared = 1 },
         [GAME_OPT_MANUAL_SKIP] = { .name = "mskip", .on = 0 },
         [GAME_OPT_SELL_BOMB] = { .name = "sell_bomb", .on = 0 },
-        [GAME_OPT_OLD_MAP] = { .name = "oldmap" },
+        [GAME_OPT_OLD_MAP] = { .name = "oldmap", .shared = 1 },
+        [GAME_OPT_LIQUIDATE] = { .name = "liquidate" },
     }
 };
 
 static int game_init_map(struct game *game)
 {
+    int ret;
+
     game->cur_layout = g_default_map_layout;
-    return map_init(&game->map, g_default_map_layout);
+    ret = map_init(&game->map, g_default_map_layout, &game->arena);
+    game->map.track = &game->track;
+    return ret;
 }
 
 static void game_uninit_map(struct game *game)
@@ -43,8 +63,9 @@ int game_add_player(struct game *game, int idx)
     if (player->valid)
         return -2;
 
-    player_init(player, idx, game->cur_player_nr);
-    player->asset.n_money = game->default_money;
+    player_init(player, idx, game->cur_player_nr, &game->arena);
+    player->track = &game->track;
+    player_set(player, TRACK_PLAYER_MONEY, player->asset.n_money, game->default_money);
 
     game->cur_players[game->cur_player_nr] = player;
     game->cur_player_nr++;
@@ -75,10 +96,8 @@ int game_add_players(struct game *game, int idxs[], int n_idx)
         }
     }
 
-    if (last_player_nr == 0 && game->cur_player_nr > 0) {
-        game->next_player_seq = 0;
-        game->next_player = game->cur_players[0];
-    }
+    if (last_player_nr == 0 && game->cur_player_nr > 0)
+        game_set_next_player(game, game->cur_players[0]);
     return 0;
 }
 
@@ -107,6 +126,12 @@ struct player *game_get_player_by_id(struct game *game, const char *id)
     return NULL;
 }
 
+static inline void game_track_next_player(struct game *game, struct player *player)
+{
+    track_update(&game->track, TRACK_NEXT_PLAYER, 0, TRACK_PLAYER_ID(game->next_player), TRACK_PLAYER_ID(player));
+    game->next_player = player;
+}
+
 int game_rotate_player(struct game *game)
 {
     int next, dead;
@@ -120,8 +145,8 @@ int game_rotate_player(struct game *game)
 
 again:
     if (dead >= game->cur_player_nr) {
-        game->next_player_seq = 0;
-        game->next_player = NULL;
+        track_set(&game->track, TRACK_NEXT_SEQ, 0, game->next_player_seq, 0);
+        game_track_next_player(game, NULL);
         game_dbg("no player left on map\n");
         return 0;
     }
@@ -139,8 +164,8 @@ again:
         goto again;
     }
 
-    game->next_player_seq = next;
-    game->next_player = player;
+    track_set(&game->track, TRACK_NEXT_SEQ, 0, game->next_player_seq, next);
+    game_track_next_player(game, player);
     return 0;
 }
 
@@ -152,8 +177,8 @@ int game_set_next_player(struct game *game, struct player *player)
     if (player->seq < 0 || player->seq >= game->cur_player_nr)
         return -2;
 
-    game->next_player = player;
-    game->next_player_seq = player->seq;
+    game_track_next_player(game, player);
+    track_set(&game->track, TRACK_NEXT_SEQ, 0, game->next_player_seq, player->seq);
     return 0;
 }
 
@@ -237,40 +262,236 @@ struct player *game_find_player_by_id(struct game *game, const char *id)
     return NULL;
 }
 
+uint64_t game_state_hash(struct game *game)
+{
+    struct track track = {};
+    struct player *player;
+    struct map_node *node;
+    int i;
 
-int game_init(struct game *game)
+    for_each_player_begin(game, player) {
+        track_update(&track, TRACK_PLAYER_POS, player->idx, 0, player->pos);
+        track_update(&track, TRACK_PLAYER_MONEY, player->idx, 0, player->asset.n_money);
+        track_update(&track, TRACK_PLAYER_POINTS, player->idx, 0, player->asset.n_points);
+        track_update(&track, TRACK_PLAYER_BLOCK, player->idx, 0, player->asset.n_block);
+        track_update(&track, TRACK_PLAYER_BOMB, player->idx, 0, player->asset.n_bomb);
+        track_update(&track, TRACK_PLAYER_ROBOT, player->idx, 0, player->asset.n_robot);
+        track_update(&track, TRACK_PLAYER_GOD, player->idx, 0, player->buff.n_god_rounds);
+        track_update(&track, TRACK_PLAYER_EMPTY, player->idx, 0, player->buff.n_empty_rounds);
+        track_update(&track, TRACK_PLAYER_BANKRUPT, player->idx, 0, player->stat.bankrupt);
+        track_update(&track, TRACK_PLAYER_ATTACHED, player->idx, 0, player->attached);
+        track_update(&track, TRACK_PLAYER_GOD_ON, player->idx, 0, player->stat.god);
+        track_update(&track, TRACK_PLAYER_EMPTY_ON, player->idx, 0, player->stat.empty);
+        track_update(&track, TRACK_PLAYER_SELL, player->idx, 0, player->stat.n_sell_done);
+    } for_each_player_end();
+
+    for (i = 0; i < game->map.n_used; i++) {
+        node = &game->map.nodes[i];
+        track_update(&track, TRACK_NODE_ITEM, i, 0, TRACK_ITEM_ID(node->item));
+        track_update(&track, TRACK_NODE_ITEM_OWNER, i, 0, TRACK_PLAYER_ID(node->item_owner));
+        if (node->type != MAP_NODE_VACANCY)
+            continue;
+        track_update(&track, TRACK_NODE_OWNER, i, 0, TRACK_PLAYER_ID(node->estate.owner));
+        track_update(&track, TRACK_NODE_LEVEL, i, 0, node->estate.level);
+    }
+
+    track_update(&track, TRACK_NEXT_PLAYER, 0, 0, TRACK_PLAYER_ID(game->next_player));
+    track_update(&track, TRACK_NEXT_SEQ, 0, 0, game->next_player_seq);
+    track_update(&track, TRACK_BANKRUPT_NR, 0, 0, game->bankrupt_nr);
+    return track.hash;
+}
+
+void game_track_reset(struct game *game)
+{
+    game->track.hash = game_state_hash(game);
+    if (game->track.journal)
+        track_journal_clear(game->track.journal);
+    game->turn_marked = 0;
+    game->turn_timed = 0;
+}
+
+static int game_init_journal(struct game *game)
+{
+    struct track_entry *entries;
+
+    entries = arena_calloc(&game->arena, GAME_JOURNAL_SIZE, sizeof(*entries));
+    if (!entries)
+        return -1;
+
+    track_journal_init(&game->journal, entries, GAME_JOURNAL_SIZE);
+    game->track.journal = &game->journal;
+    return 0;
+}
+
+
+static void game_reset_controllers(struct game *game)
+{
+    int i;
+
+    for (i = 0; i < PLAYER_MAX; i++)
+        controller_uninit(&game->ctrls[i]);
+}
+
+static void game_seed(struct game *game, unsigned long seed)
+{
+    game->rng = 0x9e3779b97f4a7c15ULL * (seed + 1);
+    if (!game->rng)
+        game->rng = 1;
+}
+
+/* xorshift64*, one stream per game, the games of a server roll apart */
+static inline uint32_t game_rand(struct game *game, uint32_t n)
+{
+    game->rng ^= game->rng >> 12;
+    game->rng ^= game->rng << 25;
+    game->rng ^= game->rng >> 27;
+    return (uint32_t) ((game->rng * 0x2545f4914f6cdd1dULL) >> 32) % n;
+}
+
+/* @journal: 0 for a copy that never undoes, it gets no room for the journal either */
+static int game_init_state(struct game *game, int journal)
 {
     memset(game, 0, sizeof(*game));
     game->default_money = GAME_DEFAULT_MONEY;
     game->max_sell_per_turn = GAME_MAX_SELL_PER_TURN;
     game->option = default_option;
+    timer_init(&game->deadline);
+    game_reset_controllers(game);
 
-    if (ui_init(&game->ui))
+    if (arena_init(&game->arena, journal ? GAME_ARENA_SIZE : GAME_SIM_ARENA_SIZE, GAME_ARENA_FLAGS))
         goto err;
 
+    if (ui_init(&game->ui, &game->arena))
+        goto err_arena;
+
     game->dice_facets = GAME_DEFAULT_DICE_SHAPE;
     if (game_init_map(game))
         goto err_ui;
 
-    srand(time(NULL));
+    /* undo is optional, game goes on without it */
+    if (journal && game_init_journal(game))
+        game_err("fail to alloc undo journal\n");
+
     game->state = GAME_STATE_INIT;
     return 0;
 
 err_ui:
     ui_uninit(&game->ui);
+err_arena:
+    arena_free(&game->arena);
 err:
     game->state = GAME_STATE_UNINIT;
     return -1;
 }
 
+int game_init(struct game *game)
+{
+    /* games opened within the same second still roll apart */
+    static unsigned long n_game;
+
+    if (game_init_state(game, 1))
+        return -1;
+
+    game_seed(game, time(NULL) ^ __atomic_add_fetch(&n_game, 1, __ATOMIC_RELAXED) << 20);
+    return 0;
+}
+
+static void game_history_stop(struct game *game)
+{
+    if (!game->history)
+        return;
+
+    if (history_close(game->history))
+        game_err("fail to finish history file\n");
+    free(game->history);
+    game->history = NULL;
+}
+
 void game_uninit(struct game *game)
 {
+    game_reset_controllers(game);
+    actlog_close(&game->actlog);
+    game_history_stop(game);
     game_del_all_players(game);
     game_uninit_map(game);
     ui_uninit(&game->ui);
+    arena_free(&game->arena);
     game->state = GAME_STATE_UNINIT;
 }
 
+/* back to GAME_STATE_INIT in place, map nodes and ui buffers are reused */
+int game_reset(struct game *game)
+{
+    if (game->state == GAME_STATE_UNINIT)
+        return game_init(game);
+
+    /* players can only be deleted out of running state */
+    game->state = GAME_STATE_INIT;
+    game_del_all_players(game);
+    actlog_close(&game->actlog);
+    game_history_stop(game);
+
+    game->need_dump = 0;
+    game->default_money = GAME_DEFAULT_MONEY;
+    game->max_sell_per_turn = GAME_MAX_SELL_PER_TURN;
+    game->option = default_option;
+    game->dice_facets = GAME_DEFAULT_DICE_SHAPE;
+    game_reset_controllers(game);
+
+    game->bankrupt_nr = 0;
+    game->next_player_seq = 0;
+    game->next_player = NULL;
+    memset(&game->prompt, 0, sizeof(game->prompt));
+
+    ui_reset(&game->ui);
+    /* presets fed to a copy show nothing either */
+    if (game->sim)
+        game->ui.mute = 1;
+
+    game->cur_layout = g_default_map_layout;
+    if (map_reset(&game->map, g_default_map_layout)) {
+        game_uninit(game);
+        return -1;
+    }
+
+    /* no player, nothing owned */
+    game_track_reset(game);
+    return 0;
+}
+
+
+static void game_actlog_stop(struct game *game)
+{
+    if (game->actlog.mode == ACTLOG_REPLAY)
+        game->ui.mute = 0;
+    actlog_close(&game->actlog);
+}
+
+static inline void game_actlog_put(struct game *game, enum act_type type, int64_t val)
+{
+    if (game->actlog.mode == ACTLOG_RECORD)
+        actlog_put(&game->actlog, type, val);
+}
+
+/* @return: > 0 next replayed action of @type, 0 no more to replay */
+static int game_actlog_get(struct game *game, enum act_type type, struct act *act)
+{
+    int ret;
+
+    if (game->actlog.mode != ACTLOG_REPLAY)
+        return 0;
+
+    ret = actlog_get(&game->actlog, act);
+    if (ret > 0 && act->type == type)
+        return 1;
+
+    if (ret < 0 || (ret > 0 && act->type != type))
+        game_err("action log corrupted at action %ld, expects %d got %d\n",
+                 game->actlog.n_act, type, ret > 0 ? act->type : -1);
+
+    game_actlog_stop(game);
+    return 0;
+}
 
 static int game_prompt_action(struct game *game)
 {
@@ -293,6 +514,13 @@ static int game_check_finish(struct game *game)
     if (game->bankrupt_nr + 1 < game->cur_player_nr)
         return 0;
 
+    /* searches score the final state */
+    if (game->sim) {
+        game->state = GAME_STATE_STOPPED;
+        return 1;
+    }
+
+    game_actlog_stop(game);
     ui_map_render(ui, &game->map);
 
     /* reset cursor window to avoid truncating stats dump */
@@ -303,12 +531,12 @@ static int game_check_finish(struct game *game)
     ui_bprintln(ui, "\n");
     ui_bprintln(ui, "\n");
 
-    /* restart game */
-    sleep(2);
-    game_uninit(game);
+    /* restart game, only pause for a human to read the result */
+    if (ui_is_interactive(ui))
+        sleep(2);
 
-    if (game_init(game)) {
-        game_err("restart game init fail\n");
+    if (game_reset(game)) {
+        game_err("restart game reset fail\n");
         return -1;
     }
     return 1;
@@ -336,50 +564,137 @@ int game_before_action(struct game *game)
                 ui_player_name(&game->ui, player), player->buff.n_empty_rounds);
         return 1;
     }
+
+    /* undo goes back to here, skipped turns fold into the one before */
+    if (!game->turn_marked) {
+        track_mark(&game->track);
+        game->turn_marked = 1;
+    }
     return 0;
 }
 
-static int game_prompt_buy(struct game *game, struct player *player, struct map_node *node)
+_Static_assert(ITEM_MAX + 1 <= GAME_PROMPT_MAX_CHOICE && 1 + GAME_PLAYER_MAX <= GAME_PROMPT_MAX_CHOICE,
+               "prompt choices too small");
+
+static void game_prompt_set(struct game *game, enum game_prompt_type type, const char *fmt, ...) __printf(3, 4);
+
+static void game_prompt_set(struct game *game, enum game_prompt_type type, const char *fmt, ...)
 {
-    struct ui *ui = &game->ui;
-    int ret, buy;
-    const char *prompt;
+    struct game_prompt *prompt = &game->prompt;
+    va_list ap;
 
-    assert(node->type == MAP_NODE_VACANCY);
+    prompt->type = type;
+    va_start(ap, fmt);
+    vsnprintf(prompt->text, sizeof(prompt->text), fmt, ap);
+    va_end(ap);
+}
 
-    if (player->asset.n_money < node->estate.price)
+static int game_prompt_command(struct game *game, struct player *player)
+{
+    if (player)
+        game_prompt_set(game, GAME_PROMPT_COMMAND, "%s", player->name);
+    else
+        game_prompt_set(game, GAME_PROMPT_COMMAND, "enter 'start' to play");
+    return 1;
+}
+
+static int game_prompt_money(struct game *game)
+{
+    struct game_prompt *prompt = &game->prompt;
+
+    prompt->range.begin = GAME_DEFAULT_MONEY_MIN;
+    prompt->range.end = GAME_DEFAULT_MONEY_MAX;
+    game_prompt_set(game, GAME_PROMPT_INT, "select initial money (%ld-%ld): ",
+                    prompt->range.begin, prompt->range.end);
+    return 1;
+}
+
+static int game_prompt_n_players(struct game *game)
+{
+    struct game_prompt *prompt = &game->prompt;
+
+    prompt->range.begin = GAME_PLAYER_MIN;
+    prompt->range.end = GAME_PLAYER_MAX;
+    game_prompt_set(game, GAME_PROMPT_INT, "select number of players (%ld-%ld): ",
+                    prompt->range.begin, prompt->range.end);
+    return 1;
+}
+
+static int game_prompt_players(struct game *game)
+{
+    struct game_prompt *prompt = &game->prompt;
+    struct choice *choices = prompt->choices;
+    int i;
+
+    /* build choices */
+    for (i = 0; i < GAME_PLAYER_MAX; i++) {
+        choices[i].name = player_idx_to_name(i);
+        choices[i].id = player_idx_to_char(i);
+        if (i < 9)
+            choices[i].alt_id = '1' + i;
+    }
+
+    prompt->sel.n_choice = GAME_PLAYER_MAX;
+    game_prompt_set(game, GAME_PROMPT_MENU, "select your player (%d/%d):\n",
+                    prompt->sel.n_selected + 1, prompt->n_pick);
+    return 1;
+}
+
+static int game_decide_players(struct game *game, int choice)
+{
+    struct game_prompt *prompt = &game->prompt;
+    int idxs[GAME_PLAYER_MAX];
+    int i, seq;
+
+    if (choice < 0)
         return 0;
 
-    prompt = ui_fmt(ui, "[BUY] Pay %d to buy this estate?", node->estate.price);
-    while (1) {
-        ret = ui_input_bool_prompt(ui, prompt, &buy);
-        if (ret < 0)
-            goto out_stop;
-        if (ret > 0)
-            break;
+    if (prompt->sel.n_selected < prompt->n_pick) {
+        game_prompt_set(game, GAME_PROMPT_MENU, "select your player (%d/%d):\n",
+                        prompt->sel.n_selected + 1, prompt->n_pick);
+        return 0;
     }
 
-    if (!buy)
+    for (i = 0, seq = 0; i < GAME_PLAYER_MAX && seq < prompt->n_pick; i++) {
+        if (!prompt->choices[i].chosen)
+            continue;
+        idxs[seq++] = i;
+    }
+
+    if (game_add_players(game, idxs, prompt->n_pick)) {
+        game_err("fail to add players\n");
+        return -1;
+    }
+
+    game->state = GAME_STATE_STARTING;
+    return 1;
+}
+
+static int game_prompt_buy(struct game *game, struct player *player, struct map_node *node)
+{
+    assert(node->type == MAP_NODE_VACANCY);
+
+    if (player->asset.n_money < node->estate.price)
         return 0;
 
-    player->asset.n_money -= node->estate.price;
-    node->estate.owner = player;
-    list_add_tail(&node->estate.estates_list, &player->asset.estates);
+    game_prompt_set(game, GAME_PROMPT_BOOL, "[BUY] Pay %d to buy this estate?", node->estate.price);
+    return 1;
+}
 
-    ui_bprintln(ui, "[BUY] Bought estate at position %d.\n", player->pos);
-    return 0;
+static int game_decide_buy(struct game *game, struct player *player, struct map_node *node, int buy)
+{
+    if (!buy)
+        return 1;
 
-out_stop:
-    game_stop(game, GAME_STATE_STOPPED);
-    return -1;
+    player_set(player, TRACK_PLAYER_MONEY, player->asset.n_money, player->asset.n_money - node->estate.price);
+    map_set_owner(&game->map, node->idx, player);
+
+    ui_bprintln(&game->ui, "[BUY] Bought estate at position %d.\n", player->pos);
+    return 1;
 }
 
 static int game_prompt_upgrade(struct game *game, struct player *player, struct map_node *node)
 {
-    struct ui *ui = &game->ui;
-    int ret, up;
-    const char *prompt;
-
     assert(node->type == MAP_NODE_VACANCY);
 
     if (node->estate.level >= ESTATE_SKYSCRAPER)
@@ -387,27 +702,40 @@ static int game_prompt_upgrade(struct game *game, struct player *player, struct
     if (player->asset.n_money < node->estate.price)
         return 0;
 
-    prompt = ui_fmt(ui, "[UPGRADE] Pay %d to upgrade this estate?", node->estate.price);
-    while (1) {
-        ret = ui_input_bool_prompt(ui, prompt, &up);
-        if (ret < 0)
-            goto out_stop;
-        if (ret > 0)
-            break;
-    }
+    game_prompt_set(game, GAME_PROMPT_BOOL, "[UPGRADE] Pay %d to upgrade this estate?", node->estate.price);
+    return 1;
+}
 
+static int game_decide_upgrade(struct game *game, struct player *player, struct map_node *node, int up)
+{
     if (!up)
-        return 0;
+        return 1;
 
-    player->asset.n_money -= node->estate.price;
-    node->estate.level += 1;
+    player_set(player, TRACK_PLAYER_MONEY, player->asset.n_money, player->asset.n_money - node->estate.price);
+    map_set_level(&game->map, node->idx, node->estate.level + 1);
 
-    ui_bprintln(ui, "[UPGRADE] Upgraded estate at position %d to level %d.\n", player->pos, node->estate.level);
-    return 0;
+    ui_bprintln(&game->ui, "[UPGRADE] Upgraded estate at position %d to level %d.\n", player->pos, node->estate.level);
+    return 1;
+}
 
-out_stop:
-    game_stop(game, GAME_STATE_STOPPED);
-    return -1;
+/* sell what keeps the most toll to get out of debt, no sale limit, @return: < 0 still in debt */
+static int game_player_liquidate(struct game *game, struct player *player)
+{
+    struct ui *ui = &game->ui;
+    int picks[MAP_MAX_NODE];
+    int i, n, sold;
+
+    n = liquidate_plan(game, player, -player->asset.n_money, picks);
+    if (n < 0)
+        return -1;
+
+    for (i = 0; i < n; i++) {
+        sold = 2 * map_node_price(&game->map.nodes[picks[i]]);
+        player_set(player, TRACK_PLAYER_MONEY, player->asset.n_money, player->asset.n_money + sold);
+        map_clear_owner(&game->map, picks[i]);
+        ui_bprintln(ui, "[LIQUIDATE] Sold map %d estate at price %d.\n", picks[i], sold);
+    }
+    return player->asset.n_money < 0 ? -1 : 0;
 }
 
 static int game_player_pay_toll(struct game *game, struct player *player, struct map_node *node)
@@ -423,28 +751,24 @@ static int game_player_pay_toll(struct game *game, struct player *player, struct
         return 0;
     }
 
-    player->asset.n_money -= price;
+    player_set(player, TRACK_PLAYER_MONEY, player->asset.n_money, player->asset.n_money - price);
+    if (player->asset.n_money < 0 && game->option.opts[GAME_OPT_LIQUIDATE].on)
+        game_player_liquidate(game, player);
     if (player->asset.n_money < 0) {
         ui_bprintln(ui, "[BANKRUPT] Went backrupt, debt %d.\n", player->asset.n_money);
         return 0;
     }
 
-    node->estate.owner->asset.n_money += price;
+    player_set(node->estate.owner, TRACK_PLAYER_MONEY, node->estate.owner->asset.n_money,
+               node->estate.owner->asset.n_money + price);
     return 0;
 }
 
-static int game_prompt_item_house(struct game *game, struct player *player, struct map_node *node)
+/* @return: > 0 player can buy more */
+static int game_item_house_check(struct game *game, struct player *player, struct map_node *node)
 {
     struct ui *ui = &game->ui;
     struct asset *asset = &player->asset;
-    struct item_house *house = &node->item_house;
-    int i, j, ret;
-    struct choice choices[ITEM_MAX + 1] = {};
-    struct select sel;
-    const char *prompt;
-    struct item_info *chosen;
-
-    assert(node->type == MAP_NODE_ITEM_HOUSE);
 
     if (asset->n_bomb + asset->n_robot + asset->n_block >= PLAYER_MAX_ITEM) {
         ui_bprintln(ui, "[ITEM HOUSE] Inventory full, can't buy new item.\n");
@@ -454,6 +778,20 @@ static int game_prompt_item_house(struct game *game, struct player *player, stru
         ui_bprintln(ui, "[ITEM HOUSE] Player points %d not enough, exit from item house.\n", asset->n_points);
         return 0;
     }
+    return 1;
+}
+
+static int game_prompt_item_house(struct game *game, struct player *player, struct map_node *node)
+{
+    struct ui *ui = &game->ui;
+    struct item_house *house = &node->item_house;
+    struct choice *choices = game->prompt.choices;
+    int i, j;
+
+    assert(node->type == MAP_NODE_ITEM_HOUSE);
+
+    if (!game_item_house_check(game, player, node))
+        return 0;
 
     /* build choices */
     for (i = 0, j = 0; i < ITEM_MAX; i++) {
@@ -468,68 +806,56 @@ static int game_prompt_item_house(struct game *game, struct player *player, stru
     choices[ITEM_MAX].id = 'f';
     choices[ITEM_MAX].alt_id = 'q';
 
-    sel.n_selected = 0;
-    sel.n_choice = ARRAY_SIZE(choices);
-    sel.choices = choices;
-    prompt = ui_fmt(ui, "[ITEM HOUSE] Welcome %s, what item do you what?\n", ui_player_name(ui, player));
-    while (1) {
-        ret = ui_selection_menu_prompt(ui, prompt, &sel);
-        if (ret < 0)
-            goto out_stop;
-        if (ret == 0)
-            continue;
+    game->prompt.sel.n_choice = ITEM_MAX + 1;
+    game_prompt_set(game, GAME_PROMPT_MENU, "[ITEM HOUSE] Welcome %s, what item do you what?\n",
+                    ui_player_name(ui, player));
+    return 1;
+}
 
-        if (sel.cur_choice == ITEM_MAX) {
-            ui_bprintln(ui, "[ITEM HOUSE] Exit from item house.\n");
-            return 0;
-        }
+static int game_decide_item_house(struct game *game, struct player *player, struct map_node *node, int choice)
+{
+    struct ui *ui = &game->ui;
+    struct asset *asset = &player->asset;
+    struct choice *choices = game->prompt.choices;
+    struct item_info *chosen;
 
-        /* infinite goods supply */
-        chosen = &house->items.info[sel.cur_choice];
-        choices[sel.cur_choice].chosen = 0;
+    if (choice < 0)
+        return 0;
 
-        if (asset->n_points < chosen->price) {
-            ui_bprintln(ui, "[ITEM HOUSE] Player points %d not enough, need %d to by '%s'.\n",
-                    asset->n_points, chosen->price, choices[sel.cur_choice].name);
-            continue;
-        }
+    if (choice == ITEM_MAX) {
+        ui_bprintln(ui, "[ITEM HOUSE] Exit from item house.\n");
+        return 1;
+    }
 
-        asset->n_points -= chosen->price;
-        ui_bprintln(ui, "[ITEM HOUSE] Bought '%s', payed %d points.\n", choices[sel.cur_choice].name, chosen->price);
-        if (sel.cur_choice == ITEM_BLOCK)
-            asset->n_block++;
-        else if (sel.cur_choice == ITEM_BOMB)
-            asset->n_bomb++;
-        else if (sel.cur_choice == ITEM_ROBOT)
-            asset->n_robot++;
-
-        /* check again */
-        if (asset->n_bomb + asset->n_robot + asset->n_block >= PLAYER_MAX_ITEM) {
-            ui_bprintln(ui, "[ITEM HOUSE] Inventory full, can't buy new item.\n");
-            return 0;
-        }
-        if (asset->n_points < node->item_house.min_price) {
-            ui_bprintln(ui, "[ITEM HOUSE] Player points %d not enough, exit from item house.\n", asset->n_points);
-            return 0;
-        }
+    /* infinite goods supply */
+    chosen = &node->item_house.items.info[choice];
+    choices[choice].chosen = 0;
+
+    if (asset->n_points < chosen->price) {
+        ui_bprintln(ui, "[ITEM HOUSE] Player points %d not enough, need %d to by '%s'.\n",
+                asset->n_points, chosen->price, choices[choice].name);
+        return 0;
     }
 
-    return 0;
+    player_set(player, TRACK_PLAYER_POINTS, asset->n_points, asset->n_points - chosen->price);
+    ui_bprintln(ui, "[ITEM HOUSE] Bought '%s', payed %d points.\n", choices[choice].name, chosen->price);
+    if (choice == ITEM_BLOCK)
+        player_set(player, TRACK_PLAYER_BLOCK, asset->n_block, asset->n_block + 1);
+    else if (choice == ITEM_BOMB)
+        player_set(player, TRACK_PLAYER_BOMB, asset->n_bomb, asset->n_bomb + 1);
+    else if (choice == ITEM_ROBOT)
+        player_set(player, TRACK_PLAYER_ROBOT, asset->n_robot, asset->n_robot + 1);
 
-out_stop:
-    game_stop(game, GAME_STATE_STOPPED);
-    return -1;
+    /* check again */
+    return !game_item_house_check(game, player, node);
 }
 
 static int game_prompt_gift_house(struct game *game, struct player *player, struct map_node *node)
 {
     struct ui *ui = &game->ui;
     struct gift_house *house = &node->gift_house;
-    int i, j, ret;
-    struct choice choices[GIFT_MAX] = {};
-    struct select sel;
-    const char *prompt;
-    struct gift_info *chosen;
+    struct choice *choices = game->prompt.choices;
+    int i, j;
 
     assert(node->type == MAP_NODE_GIFT_HOUSE);
 
@@ -540,38 +866,31 @@ static int game_prompt_gift_house(struct game *game, struct player *player, stru
         j++;
     }
 
-    sel.n_selected = 0;
-    sel.n_choice = ARRAY_SIZE(choices);
-    sel.choices = choices;
-    prompt = ui_fmt(ui, "[GIFT HOUSE] Welcome %s, what gift do you what?\n", ui_player_name(ui, player));
+    game->prompt.sel.n_choice = GIFT_MAX;
+    game_prompt_set(game, GAME_PROMPT_MENU, "[GIFT HOUSE] Welcome %s, what gift do you what?\n",
+                    ui_player_name(ui, player));
+    return 1;
+}
+
+static int game_decide_gift_house(struct game *game, struct player *player, struct map_node *node, int choice)
+{
+    struct gift_info *chosen;
 
     /* player only has one chance to choose gift */
-    ret = ui_selection_menu_prompt(ui, prompt, &sel);
-    if (ret < 0)
-        goto out_stop;
-
-    if (ret == 0) {
-        ui_bprintln(ui, "[GIFT HOUSE] Choice is invalid, exit from gift house.\n");
+    if (choice < 0) {
+        ui_bprintln(&game->ui, "[GIFT HOUSE] Choice is invalid, exit from gift house.\n");
     } else {
-        chosen = &house->gifts[sel.cur_choice];
+        chosen = &node->gift_house.gifts[choice];
         chosen->grant(chosen, game, player);
     }
-
-    return 0;
-
-out_stop:
-    game_stop(game, GAME_STATE_STOPPED);
-    return -1;
+    return 1;
 }
 
 static int game_prompt_magic_house(struct game *game, struct player *player, struct map_node *node)
 {
     struct ui *ui = &game->ui;
-    const char *prompt;
-    int ret, i;
-    struct choice choices[1 + GAME_PLAYER_MAX] = {};
-    struct select sel;
-    struct player *chosen;
+    struct choice *choices = game->prompt.choices;
+    int i;
 
     assert(node->type == MAP_NODE_MAGIC_HOUSE);
 
@@ -585,41 +904,183 @@ static int game_prompt_magic_house(struct game *game, struct player *player, str
             choices[i+1].alt_id = '1' + i;
     }
 
-    sel.n_selected = 0;
-    sel.n_choice = ARRAY_SIZE(choices);
-    sel.choices = choices;
-    prompt = ui_fmt(ui, "[MAGIC HOUSE] Welcome %s, cast dark magic on whom? (stop target)\n",
+    game->prompt.sel.n_choice = 1 + GAME_PLAYER_MAX;
+    game_prompt_set(game, GAME_PROMPT_MENU, "[MAGIC HOUSE] Welcome %s, cast dark magic on whom? (stop target)\n",
                     ui_player_name(ui, player));
+    return 1;
+}
 
-    while (1) {
-        ret = ui_selection_menu_prompt(ui, prompt, &sel);
-        if (ret < 0)
-            goto out_stop;
-        if (ret == 0)
-            continue;
+static int game_decide_magic_house(struct game *game, struct player *player, struct map_node *node, int choice)
+{
+    struct ui *ui = &game->ui;
+    struct player *chosen;
 
-        if (sel.cur_choice == 0) {
-            ui_bprintln(ui, "[MAGIC HOUSE] Exit from magic house.\n");
-            return 0;
-        }
+    if (choice < 0)
+        return 0;
 
-        chosen = &game->players[sel.cur_choice - 1];
-        if (!chosen->valid || !chosen->attached) {
-            ui_bprintln(ui, "[MAGIC HOUSE] Input invalid, please select a player currently on map.\n");
-            continue;
-        }
-        break;
+    if (choice == 0) {
+        ui_bprintln(ui, "[MAGIC HOUSE] Exit from magic house.\n");
+        return 1;
     }
 
-    chosen->buff.n_empty_rounds += 2;
+    chosen = &game->players[choice - 1];
+    if (!chosen->valid || !chosen->attached) {
+        ui_bprintln(ui, "[MAGIC HOUSE] Input invalid, please select a player currently on map.\n");
+        return 0;
+    }
+
+    player_set(chosen, TRACK_PLAYER_EMPTY, chosen->buff.n_empty_rounds, chosen->buff.n_empty_rounds + 2);
     ui_bprintln(ui, "[MAGIC HOUSE] Added %d empty rounds to player %s.\n", 2, chosen->name);
-    return 0;
+    return 1;
+}
 
-out_stop:
-    game_stop(game, GAME_STATE_STOPPED);
-    return -1;
+static void game_prompt_print(struct game *game)
+{
+    struct game_prompt *prompt = &game->prompt;
+    struct ui *ui = &game->ui;
+
+    switch (prompt->type) {
+    case GAME_PROMPT_COMMAND:
+        game_prompt_action(game);
+        break;
+    case GAME_PROMPT_BOOL:
+        ui_input_bool_prompt(ui, prompt->text);
+        break;
+    case GAME_PROMPT_INT:
+        ui_input_int_prompt(ui, prompt->text);
+        break;
+    case GAME_PROMPT_MENU:
+        ui_selection_menu_prompt(ui, prompt->text, &prompt->sel);
+        break;
+    default:
+        break;
+    }
+}
+
+/* only players are on the clock, commands of a turn share one deadline */
+static void game_prompt_deadline(struct game *game, enum game_decision decision)
+{
+    struct game_prompt *prompt = &game->prompt;
+
+    prompt->deadline_ms = 0;
+    if (!prompt->player)
+        return;
+
+    if (decision != GAME_DECIDE_COMMAND) {
+        prompt->deadline_ms = game->prompt_deadline_ms;
+        game->deadline_seq++;
+        return;
+    }
+
+    prompt->deadline_ms = game->turn_deadline_ms;
+    if (!game->turn_timed) {
+        game->turn_timed = 1;
+        game->deadline_seq++;
+    }
+}
+
+/* set up and print prompt of @decision, @return: > 0 opened, == 0 nothing to decide */
+static int game_open(struct game *game, enum game_decision decision)
+{
+    struct game_prompt *prompt = &game->prompt;
+    struct player *player = NULL;
+    struct map_node *node = NULL;
+    int ret;
+
+    if (game->state == GAME_STATE_RUNNING && game->next_player) {
+        player = game->next_player;
+        node = &game->map.nodes[player->pos];
+    }
+
+    memset(prompt->choices, 0, sizeof(prompt->choices));
+    prompt->sel = (struct select) { .choices = prompt->choices };
+    prompt->player = player;
+
+    switch (decision) {
+    case GAME_DECIDE_COMMAND:
+        ret = game_prompt_command(game, player);
+        break;
+    case GAME_DECIDE_MONEY:
+        ret = game_prompt_money(game);
+        break;
+    case GAME_DECIDE_N_PLAYERS:
+        ret = game_prompt_n_players(game);
+        break;
+    case GAME_DECIDE_PLAYERS:
+        ret = game_prompt_players(game);
+        break;
+    case GAME_DECIDE_BUY:
+        ret = game_prompt_buy(game, player, node);
+        break;
+    case GAME_DECIDE_UPGRADE:
+        ret = game_prompt_upgrade(game, player, node);
+        break;
+    case GAME_DECIDE_ITEM:
+        ret = game_prompt_item_house(game, player, node);
+        break;
+    case GAME_DECIDE_GIFT:
+        ret = game_prompt_gift_house(game, player, node);
+        break;
+    case GAME_DECIDE_MAGIC:
+        ret = game_prompt_magic_house(game, player, node);
+        break;
+    default:
+        ret = 0;
+        break;
+    }
+
+    if (ret <= 0)
+        return ret;
+
+    prompt->decision = decision;
+    game_prompt_deadline(game, decision);
+    game_prompt_print(game);
+    return 1;
+}
+
+/* @return: < 0 err, == 0 ask again, > 0 decided */
+static int game_decide(struct game *game, int val)
+{
+    struct player *player = game->prompt.player;
+    struct map_node *node = player ? &game->map.nodes[player->pos] : NULL;
+
+    switch (game->prompt.decision) {
+    case GAME_DECIDE_MONEY:
+        game->default_money = val;
+        return 1;
+    case GAME_DECIDE_N_PLAYERS:
+        game->prompt.n_pick = val;
+        return 1;
+    case GAME_DECIDE_PLAYERS:
+        return game_decide_players(game, val);
+    case GAME_DECIDE_BUY:
+        return game_decide_buy(game, player, node, val);
+    case GAME_DECIDE_UPGRADE:
+        return game_decide_upgrade(game, player, node, val);
+    case GAME_DECIDE_ITEM:
+        return game_decide_item_house(game, player, node, val);
+    case GAME_DECIDE_GIFT:
+        return game_decide_gift_house(game, player, node, val);
+    case GAME_DECIDE_MAGIC:
+        return game_decide_magic_house(game, player, node, val);
+    default:
+        return -1;
+    }
+}
+
+/* player on map whose turn it is, NULL if none acts */
+static inline struct player *game_acting_player(struct game *game)
+{
+    struct player *player = game->next_player;
+
+    if (game->state != GAME_STATE_RUNNING)
+        return NULL;
+    if (!player || player->stat.bankrupt || !player->attached)
+        return NULL;
+    return player;
 }
 
+/* @return: > 0 a decision is open, it ends the turn once answered */
 static int game_map_after_action(struct game *game)
 {
     struct map *map = &game->map;
@@ -629,26 +1090,26 @@ static int game_map_after_action(struct game *game)
     switch (node->type) {
     case MAP_NODE_VACANCY:
         if (!node->estate.owner)
-            return game_prompt_buy(game, player, node);
+            return game_open(game, GAME_DECIDE_BUY);
 
         if (node->estate.owner == player)
-            return game_prompt_upgrade(game, player, node);
+            return game_open(game, GAME_DECIDE_UPGRADE);
         return game_player_pay_toll(game, player, node);
 
     case MAP_NODE_ITEM_HOUSE:
-        return game_prompt_item_house(game, player, node);
+        return game_open(game, GAME_DECIDE_ITEM);
     case MAP_NODE_GIFT_HOUSE:
-        return game_prompt_gift_house(game, player, node);
+        return game_open(game, GAME_DECIDE_GIFT);
     case MAP_NODE_MAGIC_HOUSE:
-        return game_prompt_magic_house(game, player, node);
+        return game_open(game, GAME_DECIDE_MAGIC);
 
     case MAP_NODE_PRISON:
-        player->buff.n_empty_rounds = 2;
+        player_set(player, TRACK_PLAYER_EMPTY, player->buff.n_empty_rounds, 2);
         ui_bprintln(&game->ui, "[PRISON] Caught and handcuffed.\n");
         break;
 
     case MAP_NODE_MINE:
-        player->asset.n_points += node->mine_points;
+        player_set(player, TRACK_PLAYER_POINTS, player->asset.n_points, player->asset.n_points + node->mine_points);
         ui_bprintln(&game->ui, "[MINE] Got %d points.\n", node->mine_points);
         break;
 
@@ -665,49 +1126,41 @@ static int game_map_after_action(struct game *game)
 static int game_player_after_action(struct game *game)
 {
     struct map *map = &game->map;
-    struct player *player = game->next_player;
+    struct player *player = game_acting_player(game);
+
+    if (!player)
+        return 0;
 
     if (player->asset.n_money < 0) {
         struct list_head *p, *n;
 
-        player->stat.bankrupt = 1;
+        player_set(player, TRACK_PLAYER_BANKRUPT, player->stat.bankrupt, 1);
         map_detach_player(map, player);
 
         list_for_each_safe(p, n, &player->asset.estates) {
             struct map_node *node = list_entry(p, struct map_node, estate.estates_list);
             assert(node->type == MAP_NODE_VACANCY);
-            node->estate.level = ESTATE_WASTELAND;
-            node->estate.owner = NULL;
-            list_del_init(&node->estate.estates_list);
+            map_clear_owner(map, node->idx);
         }
 
-        game->bankrupt_nr++;
+        track_set(&game->track, TRACK_BANKRUPT_NR, 0, game->bankrupt_nr, game->bankrupt_nr + 1);
         return 0;
     }
 
-    player->stat.n_sell_done = 0;
+    player_set(player, TRACK_PLAYER_SELL, player->stat.n_sell_done, 0);
     player_buff_wearoff(player);
     return 0;
 }
 
+/* @return: > 0 a decision is open, it ends the turn once answered */
 int game_after_action(struct game *game)
 {
-    struct player *player = game->next_player;
+    struct player *player = game_acting_player(game);
 
-    if (game->state != GAME_STATE_RUNNING)
-        return 0;
-
-    if (!player)
+    if (!player || player->stat.empty)
         return 0;
-    if (player->stat.bankrupt || !player->attached)
-        return 0;
-
-    if (!player->stat.empty)
-        game_map_after_action(game);
-
-    game_player_after_action(game);
 
-    return 0;
+    return game_map_after_action(game);
 }
 
 #ifdef GAME_DEBUG
@@ -718,12 +1171,185 @@ static inline void game_debug_show_cmd(int argc, const char *argv[])
     for (i = 0; i < argc; i++)
         game_dbg("argv[%d]: %s\n", i, argv[i]);
 }
+
+/* every mutation must be tracked */
+static inline void game_debug_check_hash(struct game *game)
+{
+    assert(game->track.hash == game_state_hash(game));
+}
 #else
 static inline void game_debug_show_cmd(int argc, const char *argv[])
 {
 }
+
+static inline void game_debug_check_hash(struct game *game)
+{
+}
 #endif
 
+static void game_check_starting(struct game *game)
+{
+    if (game->state != GAME_STATE_STARTING)
+        return;
+
+    game->state = GAME_STATE_RUNNING;
+    ui_on_game_start(&game->ui, &game->map);
+}
+
+static void game_history_append(struct game *game)
+{
+    struct game_image img;
+
+    if (game_save_image(game, &img) || history_append(game->history, &img)) {
+        game_err("fail to append history, stop\n");
+        game_history_stop(game);
+    }
+}
+
+/* @return: < 0 err */
+static int game_finish_turn(struct game *game)
+{
+    struct act act;
+
+    game_player_after_action(game);
+    game->turn_marked = 0;
+    game->turn_timed = 0;
+
+    if (game_rotate_player(game))
+        return -1;
+
+    game_debug_check_hash(game);
+
+    /* turn boundary with state hash, replay stops at the first divergent turn */
+    if (game->state != GAME_STATE_RUNNING) {
+        ;
+    } else if (game->actlog.mode == ACTLOG_RECORD) {
+        game_actlog_put(game, ACT_TURN, (uint32_t) game->track.hash);
+        game->actlog.n_turn++;
+    } else if (game_actlog_get(game, ACT_TURN, &act)) {
+        long n_turn = game->actlog.n_turn++;
+
+        if (act.val != (uint32_t) game->track.hash) {
+            game_actlog_stop(game);
+            ui_bprintln(&game->ui, "[REPLAY] State diverged at turn %ld, hash %08x expected %08lx.\n",
+                        n_turn, (uint32_t) game->track.hash, (long) act.val);
+        }
+    }
+
+    if (game->history && game->state == GAME_STATE_RUNNING)
+        game_history_append(game);
+
+    if (game->checkpoint)
+        checkpoint_turn(game->checkpoint, game);
+    return 0;
+}
+
+/* @return: < 0 err, a decision may be left open to finish the turn */
+static int game_end_turn(struct game *game)
+{
+    if (game_after_action(game) > 0)
+        return 0;
+
+    return game_finish_turn(game);
+}
+
+/* decide open prompt with @val and go on, @return: < 0 err */
+static int game_resolve(struct game *game, int val)
+{
+    struct game_prompt *prompt = &game->prompt;
+    enum game_decision decision = prompt->decision;
+    int ret;
+
+    ret = game_decide(game, val);
+    if (ret == 0)
+        game_prompt_print(game);
+    if (ret <= 0)
+        return ret;
+
+    prompt->decision = GAME_DECIDE_NONE;
+    switch (decision) {
+    case GAME_DECIDE_MONEY:
+        game_open(game, GAME_DECIDE_N_PLAYERS);
+        return 0;
+    case GAME_DECIDE_N_PLAYERS:
+        game_open(game, GAME_DECIDE_PLAYERS);
+        return 0;
+    case GAME_DECIDE_PLAYERS:
+        game_check_starting(game);
+        ui_map_render(&game->ui, &game->map);
+        return 0;
+    default:
+        /* decisions on map node end the turn */
+        return game_finish_turn(game);
+    }
+}
+
+static void game_menu_pick(struct select *sel, int val)
+{
+    if (val < 0 || val >= sel->n_choice)
+        return;
+
+    sel->choices[val].chosen = 1;
+    sel->cur_choice = val;
+    sel->n_selected++;
+}
+
+/* answer of open prompt from action log, @return: > 0 answered */
+static int game_resolve_from_log(struct game *game)
+{
+    struct game_prompt *prompt = &game->prompt;
+    struct select *sel = &prompt->sel;
+    struct act act;
+    int val;
+
+    if (prompt->type == GAME_PROMPT_BOOL && game_actlog_get(game, ACT_BOOL, &act)) {
+        val = !!act.val;
+    } else if (prompt->type == GAME_PROMPT_MENU && game_actlog_get(game, ACT_MENU, &act)) {
+        /* invalid choices are logged too */
+        val = act.val >= 0 && act.val < sel->n_choice ? act.val : -1;
+        game_menu_pick(sel, val);
+    } else {
+        return 0;
+    }
+
+    if (game_resolve(game, val) < 0)
+        return -1;
+    return 1;
+}
+
+/* @return: < 0 err */
+static int game_feed_decision(struct game *game, char *line)
+{
+    struct game_prompt *prompt = &game->prompt;
+    struct ui *ui = &game->ui;
+    int val = -1;
+
+    switch (prompt->type) {
+    case GAME_PROMPT_BOOL:
+        if (!ui_input_bool(ui, line, &val)) {
+            game_prompt_print(game);
+            return 0;
+        }
+        game_actlog_put(game, ACT_BOOL, val);
+        break;
+    case GAME_PROMPT_INT:
+        if (!ui_input_int(ui, line, &prompt->range, &val)) {
+            game_prompt_print(game);
+            return 0;
+        }
+        break;
+    case GAME_PROMPT_MENU:
+        if (ui_selection_menu(ui, line, &prompt->sel))
+            val = prompt->sel.cur_choice;
+        game_actlog_put(game, ACT_MENU, val);
+        break;
+    default:
+        return -1;
+    }
+
+    return game_resolve(game, val);
+}
+
 static int game_cmd_preset_user(struct game *game, int argc, const char *argv[])
 {
     int i;
@@ -752,10 +1378,9 @@ static int game_cmd_preset_user(struct game *game, int argc, const char *argv[])
     }
 
     game_stop(game, GAME_STOP_NODUMP);
-    game_uninit(game);
 
-    if (game_init(game)) {
-        game_err("preset game init fail\n");
+    if (game_reset(game)) {
+        game_err("preset game reset fail\n");
         return -2;
     }
 
@@ -805,8 +1430,7 @@ static int game_cmd_preset_map(struct game *game, int argc, const char *argv[])
         return -1;
 
     assert(game->map.nodes[pos].type == MAP_NODE_VACANCY);
-    game->map.nodes[pos].estate.level = lv;
-    return 0;
+    return map_set_level(&game->map, pos, lv);
 }
 
 static int game_cmd_preset_asset(struct game *game, int argc, const char *argv[])
@@ -835,9 +1459,9 @@ static int game_cmd_preset_asset(struct game *game, int argc, const char *argv[]
         return -1;
 
     if (!strcmp(argv[1], "fund"))
-        player->asset.n_money = num;
+        player_set(player, TRACK_PLAYER_MONEY, player->asset.n_money, num);
     else if (!strcmp(argv[1], "credit"))
-        player->asset.n_points = num;
+        player_set(player, TRACK_PLAYER_POINTS, player->asset.n_points, num);
     else
         return -1;
 
@@ -872,20 +1496,20 @@ static int game_cmd_preset_gift(struct game *game, int argc, const char *argv[])
     if (!strcmp(argv[3], "barrier")) {
         if (num + player->asset.n_bomb + player->asset.n_robot > PLAYER_MAX_ITEM)
             return -1;
-        player->asset.n_block = num;
+        player_set(player, TRACK_PLAYER_BLOCK, player->asset.n_block, num);
 
     } else if (!strcmp(argv[3], "bomb")) {
         if (player->asset.n_block + num + player->asset.n_robot > PLAYER_MAX_ITEM)
             return -1;
-        player->asset.n_bomb = num;
+        player_set(player, TRACK_PLAYER_BOMB, player->asset.n_bomb, num);
 
     } else if (!strcmp(argv[3], "robot")) {
         if (player->asset.n_block + player->asset.n_bomb + num > PLAYER_MAX_ITEM)
             return -1;
-        player->asset.n_robot = num;
+        player_set(player, TRACK_PLAYER_ROBOT, player->asset.n_robot, num);
 
     } else if (!strcmp(argv[3], "god"))  {
-        player->buff.n_god_rounds = num;
+        player_set(player, TRACK_PLAYER_GOD, player->buff.n_god_rounds, num);
     } else {
         return -1;
     }
@@ -925,7 +1549,7 @@ static int game_cmd_preset_userloc(struct game *game, int argc, const char *argv
     if (pos < 0 || pos >= game->map.n_used || empty_round < 0)
         return -1;
 
-    player->buff.n_empty_rounds = empty_round;
+    player_set(player, TRACK_PLAYER_EMPTY, player->buff.n_empty_rounds, empty_round);
     return map_move_player(&game->map, player, pos);
 }
 
@@ -980,6 +1604,33 @@ static inline int game_cmd_preset_bomb(struct game *game, int argc, const char *
     return game_cmd_preset_item(game, ITEM_BOMB, argc, argv);
 }
 
+void game_apply_option(struct game *game, enum game_option opt)
+{
+    int on = game->option.opts[opt].on;
+
+    /* process wide, searches leave it to the real game */
+    if (opt == GAME_OPT_DEBUG && !game->sim) {
+        g_game_dbg = on;
+    }
+    if (opt == GAME_OPT_SELL_BOMB) {
+        int j;
+        for (j = 0; j < game->cur_layout->n_item_house; j++) {
+            int pos = game->cur_layout->pos_item_house[j];
+            struct map_node *node = &game->map.nodes[pos];
+
+            assert(node->type == MAP_NODE_ITEM_HOUSE);
+            node->item_house.items.info[ITEM_BOMB].on_sell = on;
+        }
+    }
+    if (opt == GAME_OPT_OLD_MAP) {
+        /* for test only, take effect at next game_map_init() */
+        if (on)
+            map_set_default_layout(MAP_LAYOUT_V1);
+        else
+            map_set_default_layout(MAP_LAYOUT_V2);
+    }
+}
+
 static int game_cmd_preset_option(struct game *game, int argc, const char *argv[])
 {
     int i;
@@ -998,6 +1649,10 @@ static int game_cmd_preset_option(struct game *game, int argc, const char *argv[
         game_err("unknown option %s\n", argv[2]);
         return -1;
     }
+    if (game->no_shared && game->option.opts[i].shared) {
+        ui_bprintln(&game->ui, "option '%s' not served here, it would reach every other game\n", argv[2]);
+        return -1;
+    }
 
     if (!strcmp(argv[3], "1") || !strcmp(argv[3], "on")) {
         game->option.opts[i].on = 1;
@@ -1012,30 +1667,57 @@ static int game_cmd_preset_option(struct game *game, int argc, const char *argv[
         return -1;
     }
 
-    if (i == GAME_OPT_DEBUG) {
-        g_game_dbg = game->option.opts[i].on;
-    }
-    if (i == GAME_OPT_SELL_BOMB) {
-        int j;
-        for (j = 0; j < game->cur_layout->n_item_house; j++) {
-            int pos = game->cur_layout->pos_item_house[j];
-            struct map_node *node = &game->map.nodes[pos];
+    game_apply_option(game, i);
+    return 0;
+}
 
-            assert(node->type == MAP_NODE_ITEM_HOUSE);
-            node->item_house.items.info[ITEM_BOMB].on_sell = game->option.opts[i].on;
-        }
+/* @arg: "ID=SPEC", SPEC as controller_init() takes */
+static int game_set_controller(struct game *game, const char *arg)
+{
+    int idx;
+
+    idx = player_char_to_idx(arg[0]);
+    if (idx < 0 || idx >= GAME_PLAYER_MAX || arg[1] != '=') {
+        ui_bprintln(&game->ui, "seat '%s' unknown, use ID=human|bot|mcts|expectimax|script:FILE\n", arg);
+        return -1;
     }
-    if (i == GAME_OPT_OLD_MAP) {
-        /* for test only, take effect at next game_map_init() */
-        if (game->option.opts[i].on)
-            map_set_default_layout(MAP_LAYOUT_V1);
-        else
-            map_set_default_layout(MAP_LAYOUT_V2);
+    if (game->no_search && (!strncmp(arg + 2, "mcts", 4) || !strncmp(arg + 2, "expectimax", 10))) {
+        ui_bprintln(&game->ui, "seat '%s' not served here, searching seats hold up every other game\n", arg);
+        return -1;
+    }
+    if (game->no_files && !strncmp(arg + 2, "script", 6)) {
+        ui_bprintln(&game->ui, "seat '%s' not served here, the files are the host's\n", arg);
+        return -1;
     }
+    return controller_init(&game->ctrls[idx], arg + 2);
+}
+
+/* dice of the real game, so seats rolling on their own play the same every run */
+static int game_cmd_preset_seed(struct game *game, int argc, const char *argv[])
+{
+    unsigned long seed;
+    char *endptr;
+
+    if (argc != 3)
+        return -1;
+
+    seed = strtoul(argv[2], &endptr, 10);
+    if (*endptr)
+        return -1;
 
+    game_seed(game, seed);
     return 0;
 }
 
+static int game_cmd_preset_ctrl(struct game *game, int argc, const char *argv[])
+{
+    if (argc != 3) {
+        game_err("usage: preset ctrl ID=human|bot|mcts|expectimax|script:FILE\n");
+        return -1;
+    }
+    return game_set_controller(game, argv[2]);
+}
+
 static int game_cmd_preset(struct game *game, int argc, const char *argv[])
 {
     int i;
@@ -1044,6 +1726,11 @@ static int game_cmd_preset(struct game *game, int argc, const char *argv[])
     if (argc < 2)
         return -1;
 
+    /* presets set up the scene, undo never goes back past them */
+    if (game->track.journal)
+        track_journal_clear(game->track.journal);
+    game->turn_marked = 0;
+
     subcmd = argv[1];
 
     if (!strcmp(subcmd, "user")) {
@@ -1072,83 +1759,28 @@ static int game_cmd_preset(struct game *game, int argc, const char *argv[])
 
     } else if (!strcmp(subcmd, "option")) {
         return game_cmd_preset_option(game, argc, argv);
+
+    } else if (!strcmp(subcmd, "ctrl")) {
+        return game_cmd_preset_ctrl(game, argc, argv);
+
+    } else if (!strcmp(subcmd, "seed")) {
+        return game_cmd_preset_seed(game, argc, argv);
     }
     return -1;
 }
 
-static int game_cmd_start(struct game *game)
+static int game_cmd_start(struct game *game, int argc, const char *argv[])
 {
-    struct ui *ui = &game->ui;
-    const char *prompt;
-    struct range range;
-    int ret, i, seq;
-    int  n_players;
-    int idxs[GAME_PLAYER_MAX];
-    struct choice choices[GAME_PLAYER_MAX] = {};
-    struct select sel;
-
-    range.begin = GAME_DEFAULT_MONEY_MIN;
-    range.end = GAME_DEFAULT_MONEY_MAX;
-    prompt = ui_fmt(ui, "select initial money (%ld-%ld): ", range.begin, range.end);
-    while (1) {
-        ret = ui_input_int_prompt(ui, prompt, &range, &game->default_money);
-        if (ret < 0)
-            goto out_stop;
-        if (ret > 0)
-            break;
-    }
-
-    range.begin = GAME_PLAYER_MIN;
-    range.end = GAME_PLAYER_MAX;
-    prompt = ui_fmt(ui, "select number of players (%ld-%ld): ", range.begin, range.end);
-    while (1) {
-        ret = ui_input_int_prompt(ui, prompt, &range, &n_players);
-        if (ret < 0)
-            goto out_stop;
-        if (ret > 0)
-            break;
-    }
-
-    /* build choices */
-    for (i = 0; i < GAME_PLAYER_MAX; i++) {
-        choices[i].name = player_idx_to_name(i);
-        choices[i].id = player_idx_to_char(i);
-        if (i < 9)
-            choices[i].alt_id = '1' + i;
-    }
-
-    sel.n_selected = 0;
-    sel.n_choice = ARRAY_SIZE(choices);
-    sel.choices = choices;
-    while (1) {
-        prompt = ui_fmt(ui, "select your player (%d/%d):\n", sel.n_selected + 1, n_players);
-        ret = ui_selection_menu_prompt(ui, prompt, &sel);
-        if (ret < 0)
-            goto out_stop;
-        if (ret == 0)
-            continue;
-
-        if (sel.n_selected >= n_players)
-            break;
-    }
-
-    for (i = 0, seq = 0; i < GAME_PLAYER_MAX && seq < n_players; i++) {
-        if (!choices[i].chosen)
-            continue;
-        idxs[seq++] = i;
-    }
+    int i;
 
-    if (game_add_players(game, idxs, n_players)) {
-        game_err("fail to add players\n");
-        goto out_stop;
+    for (i = 1; i < argc; i++) {
+        if (game_set_controller(game, argv[i]))
+            return -1;
     }
 
-    game->state = GAME_STATE_STARTING;
+    game->prompt.n_pick = 0;
+    game_open(game, GAME_DECIDE_MONEY);
     return 0;
-
-out_stop:
-    game_stop(game, GAME_STATE_STOPPED);
-    return -1;
 }
 
 static int game_player_step(struct game *game, struct player *player, int step)
@@ -1205,7 +1837,7 @@ step_into:
                 game_err("failt to move player to hospital pos %d\n", hospital_pos);
                 return -1;
             }
-            player->buff.n_empty_rounds = 3;
+            player_set(player, TRACK_PLAYER_EMPTY, player->buff.n_empty_rounds, 3);
             return 1;
         }
     }
@@ -1218,32 +1850,21 @@ step_into:
 
 static int game_cmd_roll(struct game *game)
 {
-    return game_player_step(game, game->next_player, 1 + rand() % game->dice_facets);
+    int dice = 1 + game_rand(game, game->dice_facets);
+
+    game_actlog_put(game, ACT_ROLL, dice);
+    return game_player_step(game, game->next_player, dice);
 }
 
-static int game_cmd_sell(struct game *game, int argc, const char *argv[])
+static int game_player_sell(struct game *game, struct player *player, int idx)
 {
     struct ui *ui = &game->ui;
     struct map *map = &game->map;
-    struct player *player = game->next_player;
     struct map_node *node;
-    int idx, sold;
-    char *endptr;
+    int sold;
 
-    if (argc != 2 || !argv[1]) {
-        ui_bprintln(ui, "sell command syntax error\n");
-        return -1;
-    }
-
-    endptr = NULL;
-    idx = strtol(argv[1], &endptr, 10);
-    if (*endptr) {
-        ui_bprintln(ui, "not a valid number: %s\n", argv[1]);
-        return -1;
-    }
-
-    if (idx < 0 || idx >= map->n_used) {
-        ui_bprintln(ui, "sell %d out of map idx range [%d, %d)\n", idx, 0, map->n_used);
+    if (idx < 0 || idx >= map->n_used) {
+        ui_bprintln(ui, "sell %d out of map idx range [%d, %d)\n", idx, 0, map->n_used);
         return -1;
     }
 
@@ -1263,16 +1884,45 @@ static int game_cmd_sell(struct game *game, int argc, const char *argv[])
     }
 
     sold = 2 * map_node_price(node);
-    player->asset.n_money += sold;
-
-    node->estate.owner = NULL;
-    node->estate.level = ESTATE_WASTELAND;
-    list_del_init(&node->estate.estates_list);
+    player_set(player, TRACK_PLAYER_MONEY, player->asset.n_money, player->asset.n_money + sold);
+    player_set(player, TRACK_PLAYER_SELL, player->stat.n_sell_done, player->stat.n_sell_done + 1);
+    map_clear_owner(map, idx);
 
     ui_bprintln(ui, "[SELL] Sold map %d estate at price %d.\n", idx, sold);
     return 0;
 }
 
+static int game_act_sell(struct game *game, struct player *player, int idx)
+{
+    if (game_player_sell(game, player, idx))
+        return -1;
+
+    game_actlog_put(game, ACT_SELL, idx - player->pos);
+    return 0;
+}
+
+static int game_cmd_sell(struct game *game, int argc, const char *argv[])
+{
+    struct ui *ui = &game->ui;
+    struct player *player = game->next_player;
+    int idx;
+    char *endptr;
+
+    if (argc != 2 || !argv[1]) {
+        ui_bprintln(ui, "sell command syntax error\n");
+        return -1;
+    }
+
+    endptr = NULL;
+    idx = strtol(argv[1], &endptr, 10);
+    if (*endptr) {
+        ui_bprintln(ui, "not a valid number: %s\n", argv[1]);
+        return -1;
+    }
+
+    return game_act_sell(game, player, idx);
+}
+
 
 static int game_player_place_item(struct game *game, struct player *player, enum item_type type, int offset)
 {
@@ -1306,10 +1956,27 @@ static int game_player_place_item(struct game *game, struct player *player, enum
     }
 
     if (type == ITEM_BLOCK)
-        player->asset.n_block--;
+        player_set(player, TRACK_PLAYER_BLOCK, player->asset.n_block, player->asset.n_block - 1);
     else if (type == ITEM_BOMB)
-        player->asset.n_bomb--;
+        player_set(player, TRACK_PLAYER_BOMB, player->asset.n_bomb, player->asset.n_bomb - 1);
+
+    return 0;
+}
+
+static int game_act_place_item(struct game *game, enum item_type type, int range, int offset)
+{
+    struct ui *ui = &game->ui;
+
+    range = abs(range);
+    if (offset < -range || offset > range) {
+        ui_bprintln(ui, "command only allow a range of [%d, %d], got %d\n", -range, range, offset);
+        return -1;
+    }
+
+    if (game_player_place_item(game, game->next_player, type, offset))
+        return -1;
 
+    game_actlog_put(game, type == ITEM_BLOCK ? ACT_BLOCK : ACT_BOMB, offset);
     return 0;
 }
 
@@ -1331,50 +1998,44 @@ static int game_cmd_place_item(struct game *game, enum item_type type, int range
         return -1;
     }
 
-    range = abs(range);
-    if (offset < -range || offset > range) {
-        ui_bprintln(ui, "command only allow a range of [%d, %d], got %d\n", -range, range, offset);
-        return -1;
-    }
+    return game_act_place_item(game, type, range, offset);
+}
+
+static int game_has_item(struct game *game, enum item_type type)
+{
+    struct asset *asset = &game->next_player->asset;
+    int n = type == ITEM_BLOCK ? asset->n_block : asset->n_bomb;
 
-    return game_player_place_item(game, game->next_player, type, offset);
+    if (n <= 0)
+        ui_bprintln(&game->ui, "[ITEM] no '%s' item to use\n", ui_item_name(type));
+    return n > 0;
 }
 
 static inline int game_cmd_block(struct game *game, int argc, const char *argv[])
 {
-    if (game->next_player->asset.n_block <= 0) {
-        ui_bprintln(&game->ui, "[ITEM] no '%s' item to use\n", ui_item_name(ITEM_BLOCK));
+    if (!game_has_item(game, ITEM_BLOCK))
         return -1;
-    }
     return game_cmd_place_item(game, ITEM_BLOCK, GAME_ITEM_BLOCK_RANGE, argc, argv);
 }
 
 static inline int game_cmd_bomb(struct game *game, int argc, const char *argv[])
 {
-    if (game->next_player->asset.n_bomb <= 0) {
-        ui_bprintln(&game->ui, "[ITEM] no '%s' item to use\n", ui_item_name(ITEM_BOMB));
+    if (!game_has_item(game, ITEM_BOMB))
         return -1;
-    }
     return game_cmd_place_item(game, ITEM_BOMB, GAME_ITEM_BOMB_RANGE, argc, argv);
 }
 
-static int game_cmd_robot(struct game *game, int argc, const char *argv[])
+static int game_player_robot(struct game *game, struct player *player)
 {
     int i, pos, n_clear;
     struct ui *ui = &game->ui;
     struct map *map = &game->map;
-    struct player *player = game->next_player;
-
-    if (argc != 1) {
-        ui_bprintln(ui, "robot command syntax error, use 'robot' with no argument\n");
-        return -1;
-    }
 
     if (player->asset.n_robot <= 0) {
         ui_bprintln(ui, "[ITEM] no '%s' item to use\n", ui_item_name(ITEM_ROBOT));
         return -1;
     }
-    player->asset.n_robot--;
+    player_set(player, TRACK_PLAYER_ROBOT, player->asset.n_robot, player->asset.n_robot - 1);
 
     /* don't clear node under our foot */
     for (i = 1, n_clear = 0; i < GAME_ITEM_ROBOT_RANGE; i++) {
@@ -1388,192 +2049,1408 @@ static int game_cmd_robot(struct game *game, int argc, const char *argv[])
     return 0;
 }
 
+static int game_cmd_robot(struct game *game, int argc, const char *argv[])
+{
+    if (argc != 1) {
+        ui_bprintln(&game->ui, "robot command syntax error, use 'robot' with no argument\n");
+        return -1;
+    }
+
+    if (game_player_robot(game, game->next_player))
+        return -1;
+
+    game_actlog_put(game, ACT_ROBOT, 0);
+    return 0;
+}
+
+/* chance @p in whole per mille, the way answer lines carry it */
+static int game_permille(double p)
+{
+    return (int) (p * 1000 + 0.5);
+}
+
+/*
+ * Answer of a query for a program driving the console: "answer KEY WORDS..."
+ * on the stream the dump goes to, words only, nothing on a terminal
+ */
+static void game_answer(struct game *game, const char *key, const char *fmt, ...)
+{
+    struct ui *ui = &game->ui;
+    va_list ap;
+
+    if (ui->mute || !ui->err || isatty(fileno(ui->err)))
+        return;
+
+    fprintf(ui->err, "answer %s ", key);
+    va_start(ap, fmt);
+    vfprintf(ui->err, fmt, ap);
+    va_end(ap);
+    fputc('\n', ui->err);
+}
+
+static int game_query_endgame(struct game *game)
+{
+    struct ui *ui = &game->ui;
+    struct endgame_result res;
+    int i, ret;
+
+    if (game->no_search) {
+        ui_bprintln(ui, "[ENDGAME] Not served here, the solver would hold up every other game.\n");
+        return 0;
+    }
+
+    ret = endgame_solve(game, &res);
+    if (ret > 0) {
+        ui_bprintln(ui, "[ENDGAME] Only a game of two players left can be solved.\n");
+        return 0;
+    }
+    if (ret < 0) {
+        ui_bprintln(ui, "[ENDGAME] Fail to solve.\n");
+        return 0;
+    }
+
+    ui_bprintln(ui, "[ENDGAME] %s wins %.1f%%, %s wins %.1f%% within %d turns%s (%ld states, money by %d).\n",
+                ui_player_name(ui, &game->players[res.idx[0]]), res.win[0] * 100,
+                ui_player_name(ui, &game->players[res.idx[1]]), res.win[1] * 100,
+                res.n_ply, res.exact ? ", exact" : "", res.n_state, res.bucket);
+    for (i = 0; i < 2; i++)
+        game_answer(game, "endgame", "%c %d", player_id_to_char(&game->players[res.idx[i]]), game_permille(res.win[i]));
+    game_answer(game, "endgame", "turns %d %s", res.n_ply, res.exact ? "exact" : "cut");
+    return 0;
+}
+
+/* the @n_top nodes most likely in @dist on one line */
+static void game_print_landing(struct ui *ui, const char *what, const float *dist, int n_node, int n_top)
+{
+    char buf[256];
+    char picked[MAP_MAX_NODE] = { 0 };
+    int i, k, best, len = 0;
+
+    for (k = 0; k < n_top; k++) {
+        best = -1;
+        for (i = 0; i < n_node; i++) {
+            if (!picked[i] && dist[i] > 0 && (best < 0 || dist[i] > dist[best]))
+                best = i;
+        }
+        if (best < 0)
+            break;
+
+        picked[best] = 1;
+        len += snprintf(buf + len, sizeof(buf) - len, "%s#%d %.1f%%", k ? ", " : "", best, dist[best] * 100);
+    }
+    ui_bprintln(ui, "[LANDING] %s: %s.\n", what, len ? buf : "nowhere");
+}
+
+static int game_query_landing(struct game *game)
+{
+    struct player *player = game->next_player;
+    struct ui *ui = &game->ui;
+    const struct landing *landing;
+    float dist[MAP_MAX_NODE];
+    int i, n;
+
+    /* bombs as dense as on the map now */
+    landing = landing_get(game->cur_layout, game->dice_facets, landing_bomb_permille(&game->map));
+    if (!landing || landing->n_node != game->map.n_used) {
+        ui_bprintln(ui, "[LANDING] No chain for this map.\n");
+        return 0;
+    }
+
+    game_print_landing(ui, "Long run, per turn", landing->steady, landing->n_node, GAME_LANDING_TOP);
+    for (i = 0; i < landing->n_node; i++) {
+        n = game_permille(landing->steady[i]);
+        if (n)
+            game_answer(game, "landing", "steady %d %d", i, n);
+    }
+
+    if (!player || landing_after(landing, player->pos, player->buff.n_empty_rounds, 1, dist))
+        return 0;
+    game_print_landing(ui, "Next turn", dist, landing->n_node, GAME_LANDING_TOP);
+    for (i = 0; i < landing->n_node; i++) {
+        n = game_permille(dist[i]);
+        if (n)
+            game_answer(game, "landing", "next %d %d", i, n);
+    }
+    return 0;
+}
+
 static int game_cmd_query(struct game *game, int argc, const char *argv[])
 {
     int i, pos, n_clear;
     struct ui *ui = &game->ui;
     struct player *player = game->next_player;
 
+    if (argc == 2 && !strcmp(argv[1], "endgame"))
+        return game_query_endgame(game);
+    if (argc == 2 && !strcmp(argv[1], "landing"))
+        return game_query_landing(game);
+
     if (argc != 1) {
-        ui_bprintln(ui, "query command syntax error, use 'query' with no argument\n");
+        ui_bprintln(ui, "query command syntax error, use 'query', 'query endgame' or 'query landing'\n");
         return -1;
     }
     return ui_dump_player_stats(ui, "QUERY", player);
 }
 
-static int game_cmd_step(struct game *game, int argc, const char *argv[])
+/* @argv: "risk [N [ID]]", @return: < 0 err, > 0 nothing to forecast */
+static int game_risk_args(struct game *game, int argc, const char *argv[], long *n_turn, struct player **player)
 {
     struct ui *ui = &game->ui;
-    int step;
     char *endptr;
+    int idx;
 
-    if (argc != 2 || !argv[1]) {
-        ui_bprintln(ui, "step command syntax error\n");
+    *n_turn = GAME_RISK_TURN;
+    *player = game->next_player;
+    if (argc > 3) {
+        ui_bprintln(ui, "risk command syntax error, use 'risk [N [ID]]'\n");
         return -1;
     }
-
-    endptr = NULL;
-    step = strtol(argv[1], &endptr, 10);
-    if (*endptr) {
-        ui_bprintln(ui, "not a valid number: %s\n", argv[1]);
-        return -1;
+    if (argc > 1) {
+        endptr = NULL;
+        *n_turn = strtol(argv[1], &endptr, 10);
+        if (*endptr || *n_turn <= 0 || *n_turn > RISK_MAX_TURN) {
+            ui_bprintln(ui, "not a valid number of turns: %s, 1 to %d\n", argv[1], RISK_MAX_TURN);
+            return -1;
+        }
+    }
+    if (argc > 2) {
+        idx = player_char_to_idx(argv[2][0]);
+        if (argv[2][1] || idx < 0 || idx >= GAME_PLAYER_MAX || !game->players[idx].valid) {
+            ui_bprintln(ui, "player '%s' unknown\n", argv[2]);
+            return -1;
+        }
+        *player = &game->players[idx];
     }
 
-    return game_player_step(game, game->next_player, step);
+    if (game->state != GAME_STATE_RUNNING || !*player) {
+        ui_bprintln(ui, "[RISK] No game running.\n");
+        return 1;
+    }
+    return 0;
 }
 
-static void game_cmd_help(struct game *game)
+static int game_cmd_risk(struct game *game, int argc, const char *argv[])
 {
     struct ui *ui = &game->ui;
+    struct player *player;
+    struct risk_result res;
+    long n_turn;
+    int i, ret, id_char;
+
+    ret = game_risk_args(game, argc, argv, &n_turn, &player);
+    if (ret)
+        return ret < 0 ? ret : 0;
+    if (risk_bankrupt(game, player, n_turn, &res)) {
+        ui_bprintln(ui, "[RISK] No forecast for %s.\n", ui_player_name(ui, player));
+        return 0;
+    }
 
-    ui_bprintln(ui, "Available commands:\n");
-    ui_bprintln(ui, "  start       begin game\n");
-    ui_bprintln(ui, "  roll        roll dice and walk\n");
-    ui_bprintln(ui, "  sell N      sell estate on N-th map node\n");
-    ui_bprintln(ui, "  block N     use barrier item, N is distance from current player\n");
-    ui_bprintln(ui, "  bomb N      use bomb item, N is distance from current player\n");
-    ui_bprintln(ui, "  robot       use robot item\n");
-    ui_bprintln(ui, "  query       show current player stats\n");
-    ui_bprintln(ui, "  skip        skip your turn\n");
-    ui_bprintln(ui, "  quit        stop game and exit\n");
-    ui_bprintln(ui, "  help        show this help\n");
-    ui_bprintln(ui, "\n");
+    ui_bprintln(ui, "[RISK] %s goes bankrupt within %ld turn(s) at %s%.1f%%.\n", ui_player_name(ui, player),
+                n_turn, res.exact ? "" : "most ", res.bankrupt[n_turn - 1] * 100);
+    /* the chance by every turn */
+    id_char = player_id_to_char(player);
+    for (i = 0; i < n_turn; i++)
+        game_answer(game, "risk", "%c %d %d", id_char, i + 1, game_permille(res.bankrupt[i]));
+    game_answer(game, "risk", "%c %s", id_char, res.exact ? "exact" : "most");
+    return 0;
 }
 
-#define GAME_CMD_MAX_ARGC 16
-
-/* @return: < 0 err, == 0 good, > 0 action performed */
-static int game_handle_command(struct game *game, char *line, int should_skip)
+static void game_advise_item(struct game *game, struct player *player, enum item_type type, int range)
 {
     struct ui *ui = &game->ui;
-    int argc;
-    const char *cmd;
-    const char *argv[GAME_CMD_MAX_ARGC];
+    struct advise_place places[2 * ADVISE_MAX_RANGE + 1];
+    const char *key = type == ITEM_BLOCK ? "block" : "bomb";
+    int i, n, swing;
 
-    /* starting state should not be visible */
-    assert(game->state != GAME_STATE_STARTING);
+    n = advise_place(game, player, type, range, places);
+    if (n <= 0) {
+        ui_bprintln(ui, "[ADVISE] No place for a %s.\n", ui_item_name(type));
+        return;
+    }
 
-    argc = ui_cmd_tokenize(line, argv, GAME_CMD_MAX_ARGC);
-    if (argc <= 0)
-        return -1;
+    for (i = 0; i < n && i < GAME_ADVISE_TOP; i++) {
+        ui_bprintln(ui, "[ADVISE] %s at %d (#%d): hit %.1f%%, swing %+.0f.\n", ui_item_name(type),
+                    places[i].offset, places[i].pos, places[i].hit * 100, places[i].swing);
+        /* words only, a loss is not a negative gain */
+        swing = (int) ((places[i].swing < 0 ? -places[i].swing : places[i].swing) + 0.5f);
+        game_answer(game, "advise", "%s %d rank %d", key, places[i].pos, i + 1);
+        game_answer(game, "advise", "%s %d hit %d", key, places[i].pos, game_permille(places[i].hit));
+        game_answer(game, "advise", "%s %d %s %d", key, places[i].pos, places[i].swing < 0 ? "loss" : "gain", swing);
+    }
+}
 
-    cmd = argv[0];
-    game_debug_show_cmd(argc, argv);
+static int game_cmd_advise(struct game *game, int argc, const char *argv[])
+{
+    struct ui *ui = &game->ui;
+    struct player *player = game_acting_player(game);
+    int block = 1, bomb = 1;
 
-    if (!strcmp(cmd, "preset")) {
-        return game_cmd_preset(game, argc, argv);
-    } else if (!strcmp(cmd, "query")) {
-        return game_cmd_query(game, argc, argv);
-    } else if (!strcmp(cmd, "help")) {
-        game_cmd_help(game);
-        return 0;
-    } else if (!strcmp(cmd, "dump")) {
-        game_stop(game, GAME_STOP_DUMP);
-        return 0;
-    } else if (!strcmp(cmd, "quit")) {
-        game_stop(game, GAME_STOP_NODUMP);
-        return 0;
-    } else if (!strcmp(cmd, "skip")) {
-        return 1;
+    if (argc == 2 && !strcmp(argv[1], "block")) {
+        bomb = 0;
+    } else if (argc == 2 && !strcmp(argv[1], "bomb")) {
+        block = 0;
+    } else if (argc != 1) {
+        ui_bprintln(ui, "advise command syntax error, use 'advise', 'advise block' or 'advise bomb'\n");
+        return -1;
     }
 
-    if (should_skip) {
-        ui_bprintln(ui, "[NOTE] manually skip option is on, use 'skip' command to continue game\n");
+    if (!player) {
+        ui_bprintln(ui, "[ADVISE] Nobody to advise.\n");
         return 0;
     }
+    if (block)
+        game_advise_item(game, player, ITEM_BLOCK, GAME_ITEM_BLOCK_RANGE);
+    if (bomb)
+        game_advise_item(game, player, ITEM_BOMB, GAME_ITEM_BOMB_RANGE);
+    return 0;
+}
 
-    if (game->state == GAME_STATE_INIT) {
-        if (!strcmp(cmd, "start"))
-            return game_cmd_start(game);
+static int game_cmd_winprob(struct game *game, int argc, const char *argv[])
+{
+    struct ui *ui = &game->ui;
+    struct winprob_estimate est;
+    long n;
+    int i;
+
+    if (argc != 1) {
+        ui_bprintln(ui, "winprob command syntax error, use 'winprob' with no argument\n");
         return -1;
     }
 
-    /* real game commands */
-    if (!strcmp(cmd, "roll")) {
-        return game_cmd_roll(game);
-
-    } else if (!strcmp(cmd, "sell")) {
-        return game_cmd_sell(game, argc, argv);
-
-    } else if (!strcmp(cmd, "block")) {
-        return game_cmd_block(game, argc, argv);
-
-    } else if (!strcmp(cmd, "bomb")) {
-        return game_cmd_bomb(game, argc, argv);
-
-    } else if (!strcmp(cmd, "robot")) {
-        return game_cmd_robot(game, argc, argv);
+    if (game->state != GAME_STATE_RUNNING) {
+        ui_bprintln(ui, "[WINPROB] No game running.\n");
+        return 0;
+    }
+    if (game->no_search) {
+        ui_bprintln(ui, "[WINPROB] Not served here, the rollouts would hold up every other game.\n");
+        return 0;
+    }
 
-    } else if (!strcmp(cmd, "step")) {
-        return game_cmd_step(game, argc, argv);
+    n = winprob_estimate(game, &est);
+    if (n <= 0) {
+        ui_bprintln(ui, "[WINPROB] No estimate, set MONOPOLY_WINPROB_THREADS to run rollouts.\n");
+        return 0;
     }
 
-    game_err("cmd '%s' unknown\n", cmd);
-    return -1;
+    for (i = 0; i < est.n_seat; i++) {
+        ui_bprintln(ui, "[WINPROB] %s wins %.1f%% +/- %.1f%%.\n", ui_player_name(ui, &game->players[est.idx[i]]),
+                    est.mean[i] * 100, est.half[i] * 100);
+        /* the rollouts counted differ run to run, not their number */
+        game_answer(game, "winprob", "%c %d %d", player_id_to_char(&game->players[est.idx[i]]),
+                    game_permille(est.mean[i]), game_permille(est.half[i]));
+    }
+    ui_bprintln(ui, "[WINPROB] %ld rollouts.\n", n);
+    return 0;
 }
 
-static char *game_read_line(struct game *game)
+static int game_cmd_step(struct game *game, int argc, const char *argv[])
 {
-    char *line = NULL;
+    struct ui *ui = &game->ui;
+    int step;
+    char *endptr;
 
-    line = ui_read_line(&game->ui);
+    if (argc != 2 || !argv[1]) {
+        ui_bprintln(ui, "step command syntax error\n");
+        return -1;
+    }
 
-    if (!line) {
-        game_stop(game, GAME_STOP_NODUMP);
+    endptr = NULL;
+    step = strtol(argv[1], &endptr, 10);
+    if (*endptr) {
+        ui_bprintln(ui, "not a valid number: %s\n", argv[1]);
+        return -1;
     }
-    return line;
+
+    game_actlog_put(game, ACT_STEP, step);
+    return game_player_step(game, game->next_player, step);
 }
 
-int game_event_loop(struct game *game)
+/* turn action of a controller, checked and logged like the typed command */
+static int game_player_act(struct game *game, const struct act *act)
 {
-    int stop_reason = 0;
-    int should_skip;
-    int should_rotate;
-    char *line = NULL;
+    struct player *player = game->next_player;
 
-    while (game->state != GAME_STATE_STOPPED) {
-        if (game->state == GAME_STATE_UNINIT) {
-            game_err("fail to restart game, exit\n");
-            stop_reason = 3;
-        }
+    switch (act->type) {
+    case ACT_ROLL:
+        return game_cmd_roll(game);
+    case ACT_STEP:
+        game_actlog_put(game, ACT_STEP, act->val);
+        return game_player_step(game, player, act->val);
+    case ACT_SELL:
+        return game_act_sell(game, player, player->pos + act->val);
+    case ACT_BLOCK:
+        if (!game_has_item(game, ITEM_BLOCK))
+            return -1;
+        return game_act_place_item(game, ITEM_BLOCK, GAME_ITEM_BLOCK_RANGE, act->val);
+    case ACT_BOMB:
+        if (!game_has_item(game, ITEM_BOMB))
+            return -1;
+        return game_act_place_item(game, ITEM_BOMB, GAME_ITEM_BOMB_RANGE, act->val);
+    case ACT_ROBOT:
+        if (game_player_robot(game, player))
+            return -1;
+        game_actlog_put(game, ACT_ROBOT, 0);
+        return 0;
+    case ACT_SKIP:
+        game_actlog_put(game, ACT_SKIP, 0);
+        return 1;
+    default:
+        return -1;
+    }
+}
+
+/* @return: < 0 err, == 0 done, > 0 action performed */
+static int game_replay_action(struct game *game, const struct act *act)
+{
+    struct player *player = game->next_player;
+
+    switch (act->type) {
+    case ACT_ROLL:
+    case ACT_STEP:
+        return game_player_step(game, player, act->val);
+    case ACT_SELL:
+        return game_player_sell(game, player, player->pos + act->val);
+    case ACT_BLOCK:
+        return game_player_place_item(game, player, ITEM_BLOCK, act->val);
+    case ACT_BOMB:
+        return game_player_place_item(game, player, ITEM_BOMB, act->val);
+    case ACT_ROBOT:
+        return game_player_robot(game, player);
+    case ACT_SKIP:
+        return 1;
+    default:
+        return -1;
+    }
+}
+
+static inline int game_replay_more(struct game *game)
+{
+    struct actlog *log = &game->actlog;
+
+    return log->mode == ACTLOG_REPLAY && log->off < log->size;
+}
+
+/* run actions from log muted, game is left running where the log ends */
+static void game_replay(struct game *game)
+{
+    struct act act;
+    int should_skip, ret;
 
-        if (g_game_events.event_winch)
-            ui_handle_winch(&game->ui, &game->map);
+    game_check_starting(game);
+    game->ui.mute = 1;
 
+    while (game->state == GAME_STATE_RUNNING && game_replay_more(game)) {
         should_skip = game_before_action(game);
-        if (should_skip && !game->option.opts[GAME_OPT_MANUAL_SKIP].on) {
-            goto skip_action;
+        if (game->state != GAME_STATE_RUNNING)
+            break;
+
+        ret = 1;
+        if (!should_skip || game->option.opts[GAME_OPT_MANUAL_SKIP].on) {
+            do {
+                if (actlog_get(&game->actlog, &act) <= 0)
+                    goto out_corrupted;
+
+                ret = game_replay_action(game, &act);
+                if (ret < 0)
+                    goto out_corrupted;
+            } while (!ret && game_replay_more(game));
+
+            /* log ends in the middle of a turn */
+            if (!ret)
+                break;
         }
 
-        game_prompt_action(game);
-        line = game_read_line(game);
-        if (!line) {
-            stop_reason = 1;
+        if (game_end_turn(game)) {
+            game_stop(game, GAME_STOP_NODUMP);
             break;
         }
 
-        should_rotate = game_handle_command(game, line, should_skip);
-        if (game->state == GAME_STATE_STARTING) {
-            game->state = GAME_STATE_RUNNING;
-            ui_on_game_start(&game->ui, &game->map);
+        while (game->prompt.decision != GAME_DECIDE_NONE) {
+            ret = game_resolve_from_log(game);
+            if (ret < 0) {
+                game_stop(game, GAME_STOP_NODUMP);
+                break;
+            }
+            /* log ends in a decision, player answers the rest */
+            if (!ret)
+                goto out;
+        }
+    }
+
+out:
+    game_actlog_stop(game);
+    /* opened while muted */
+    if (game->prompt.decision != GAME_DECIDE_NONE)
+        game_prompt_print(game);
+    return;
+
+out_corrupted:
+    game_err("action log corrupted at action %ld\n", game->actlog.n_act);
+    game_actlog_stop(game);
+}
+
+static int game_cmd_save(struct game *game, int argc, const char *argv[])
+{
+    struct ui *ui = &game->ui;
+
+    if (argc != 2 || !argv[1]) {
+        ui_bprintln(ui, "save command syntax error, use 'save FILE'\n");
+        return -1;
+    }
+
+    if (game_save(game, argv[1])) {
+        ui_bprintln(ui, "[SAVE] Fail to save game to %s.\n", argv[1]);
+        return -1;
+    }
+
+    ui_bprintln(ui, "[SAVE] Saved game to %s.\n", argv[1]);
+    return 0;
+}
+
+static int game_cmd_load(struct game *game, int argc, const char *argv[])
+{
+    struct ui *ui = &game->ui;
+    struct game_image img;
+
+    if (argc != 2 || !argv[1]) {
+        ui_bprintln(ui, "load command syntax error, use 'load FILE'\n");
+        return -1;
+    }
+
+    /* a bad file leaves the running game alone */
+    if (game_read_image(&img, argv[1]) || game_check_image(&img)) {
+        ui_bprintln(ui, "[LOAD] Fail to load game from %s.\n", argv[1]);
+        return -1;
+    }
+
+    game_stop(game, GAME_STOP_NODUMP);
+    if (game_load_image(game, &img)) {
+        ui_bprintln(ui, "[LOAD] Fail to load game from %s.\n", argv[1]);
+        return -1;
+    }
+
+    ui_bprintln(ui, "[LOAD] Loaded game from %s.\n", argv[1]);
+    return 0;
+}
+
+static int game_cmd_record(struct game *game, int argc, const char *argv[])
+{
+    struct ui *ui = &game->ui;
+    struct game_image img;
+
+    if (argc != 2 || !argv[1]) {
+        ui_bprintln(ui, "record command syntax error, use 'record FILE' or 'record stop'\n");
+        return -1;
+    }
+
+    if (!strcmp(argv[1], "stop")) {
+        if (game->actlog.mode == ACTLOG_RECORD)
+            ui_bprintln(ui, "[RECORD] Stopped, %ld actions recorded.\n", game->actlog.n_act);
+        game_actlog_stop(game);
+        return 0;
+    }
+
+    if (game->state != GAME_STATE_RUNNING) {
+        ui_bprintln(ui, "[RECORD] Only a running game can be recorded.\n");
+        return -1;
+    }
+
+    game_actlog_stop(game);
+    if (game_save_image(game, &img) || actlog_record(&game->actlog, argv[1], &img)) {
+        ui_bprintln(ui, "[RECORD] Fail to record game to %s.\n", argv[1]);
+        return -1;
+    }
+
+    ui_bprintln(ui, "[RECORD] Recording game to %s.\n", argv[1]);
+    return 0;
+}
+
+static int game_cmd_replay(struct game *game, int argc, const char *argv[])
+{
+    struct ui *ui = &game->ui;
+    struct game_image img;
+    struct actlog log;
+
+    if (argc != 2 || !argv[1]) {
+        ui_bprintln(ui, "replay command syntax error, use 'replay FILE'\n");
+        return -1;
+    }
+
+    if (actlog_replay(&log, argv[1], &img)) {
+        ui_bprintln(ui, "[REPLAY] Fail to open action log %s.\n", argv[1]);
+        return -1;
+    }
+    if (game_check_image(&img)) {
+        ui_bprintln(ui, "[REPLAY] Fail to restore game from %s.\n", argv[1]);
+        actlog_close(&log);
+        return -1;
+    }
+
+    /* loading resets the game, which closes any log in use */
+    game_stop(game, GAME_STOP_NODUMP);
+    if (game_load_image(game, &img)) {
+        ui_bprintln(ui, "[REPLAY] Fail to restore game from %s.\n", argv[1]);
+        actlog_close(&log);
+        return -1;
+    }
+
+    game->actlog = log;
+    game_replay(game);
+
+    ui_bprintln(ui, "[REPLAY] Replayed actions from %s.\n", argv[1]);
+    return 0;
+}
+
+static int game_cmd_history(struct game *game, int argc, const char *argv[])
+{
+    struct ui *ui = &game->ui;
+    int every = HISTORY_DEFAULT_EVERY;
+    char *endptr;
+
+    if ((argc != 2 && argc != 3) || !argv[1]) {
+        ui_bprintln(ui, "history command syntax error, use 'history FILE [K]' or 'history stop'\n");
+        return -1;
+    }
+
+    if (!strcmp(argv[1], "stop")) {
+        if (game->history)
+            ui_bprintln(ui, "[HISTORY] Stopped, %ld turns written.\n", game->history->n_turn);
+        game_history_stop(game);
+        return 0;
+    }
+
+    if (argc == 3) {
+        endptr = NULL;
+        every = strtol(argv[2], &endptr, 10);
+        if (*endptr || every <= 0) {
+            ui_bprintln(ui, "not a valid keyframe interval: %s\n", argv[2]);
+            return -1;
+        }
+    }
+
+    if (game->state != GAME_STATE_RUNNING) {
+        ui_bprintln(ui, "[HISTORY] Only a running game has history.\n");
+        return -1;
+    }
+
+    game_history_stop(game);
+    game->history = malloc(sizeof(*game->history));
+    if (!game->history || history_create(game->history, argv[1], every)) {
+        ui_bprintln(ui, "[HISTORY] Fail to write history to %s.\n", argv[1]);
+        free(game->history);
+        game->history = NULL;
+        return -1;
+    }
+
+    /* turn 0 */
+    game_history_append(game);
+    ui_bprintln(ui, "[HISTORY] Writing history to %s, keyframe every %d turns.\n", argv[1], every);
+    return 0;
+}
+
+static int game_cmd_seek(struct game *game, int argc, const char *argv[])
+{
+    struct ui *ui = &game->ui;
+    struct game_image img;
+    long turn, n_turn = 0;
+    char *endptr;
+    int ret;
+
+    if (argc != 3 || !argv[1] || !argv[2]) {
+        ui_bprintln(ui, "seek command syntax error, use 'seek FILE TURN'\n");
+        return -1;
+    }
+
+    endptr = NULL;
+    turn = strtol(argv[2], &endptr, 10);
+    if (*endptr) {
+        ui_bprintln(ui, "not a valid number: %s\n", argv[2]);
+        return -1;
+    }
+
+    ret = history_seek(argv[1], turn, &img, &n_turn);
+    if (ret == -3) {
+        ui_bprintln(ui, "[SEEK] Turn %ld out of range [0, %ld).\n", turn, n_turn);
+        return -1;
+    }
+    if (ret || game_check_image(&img)) {
+        ui_bprintln(ui, "[SEEK] Fail to read history %s.\n", argv[1]);
+        return -1;
+    }
+
+    game_stop(game, GAME_STOP_NODUMP);
+    if (game_load_image(game, &img)) {
+        ui_bprintln(ui, "[SEEK] Fail to restore turn %ld.\n", turn);
+        return -1;
+    }
+
+    ui_bprintln(ui, "[SEEK] Restored turn %ld of %ld.\n", turn, n_turn);
+    return 0;
+}
+
+static void game_track_restore(struct game *game, const struct track_entry *entry)
+{
+    struct track *track = &game->track;
+    struct map *map = &game->map;
+    struct player *player = NULL;
+    struct map_node *node;
+    int idx = entry->idx;
+    int32_t val = entry->old_val;
+
+    if (entry->field < TRACK_NODE_OWNER || entry->field == TRACK_PLAYER_SELL) {
+        player = &game->players[idx];
+    } else if (entry->field < TRACK_NEXT_PLAYER) {
+        node = &map->nodes[idx];
+    }
+
+    switch (entry->field) {
+    case TRACK_PLAYER_POS:
+        if (player->attached)
+            map_move_player(map, player, val);
+        else
+            player_set(player, TRACK_PLAYER_POS, player->pos, val);
+        break;
+    case TRACK_PLAYER_MONEY:
+        player_set(player, TRACK_PLAYER_MONEY, player->asset.n_money, val);
+        break;
+    case TRACK_PLAYER_POINTS:
+        player_set(player, TRACK_PLAYER_POINTS, player->asset.n_points, val);
+        break;
+    case TRACK_PLAYER_BLOCK:
+        player_set(player, TRACK_PLAYER_BLOCK, player->asset.n_block, val);
+        break;
+    case TRACK_PLAYER_BOMB:
+        player_set(player, TRACK_PLAYER_BOMB, player->asset.n_bomb, val);
+        break;
+    case TRACK_PLAYER_ROBOT:
+        player_set(player, TRACK_PLAYER_ROBOT, player->asset.n_robot, val);
+        break;
+    case TRACK_PLAYER_GOD:
+        player_set(player, TRACK_PLAYER_GOD, player->buff.n_god_rounds, val);
+        break;
+    case TRACK_PLAYER_EMPTY:
+        player_set(player, TRACK_PLAYER_EMPTY, player->buff.n_empty_rounds, val);
+        break;
+    case TRACK_PLAYER_BANKRUPT:
+        player_set(player, TRACK_PLAYER_BANKRUPT, player->stat.bankrupt, val);
+        break;
+    case TRACK_PLAYER_ATTACHED:
+        if (val)
+            map_attach_player(map, player);
+        else
+            map_detach_player(map, player);
+        break;
+    case TRACK_PLAYER_GOD_ON:
+        player_set(player, TRACK_PLAYER_GOD_ON, player->stat.god, val);
+        break;
+    case TRACK_PLAYER_EMPTY_ON:
+        player_set(player, TRACK_PLAYER_EMPTY_ON, player->stat.empty, val);
+        break;
+    case TRACK_PLAYER_SELL:
+        player_set(player, TRACK_PLAYER_SELL, player->stat.n_sell_done, val);
+        break;
+    case TRACK_NODE_OWNER:
+        map_change_owner(map, idx, val ? &game->players[val - 1] : NULL);
+        break;
+    case TRACK_NODE_LEVEL:
+        map_set_level(map, idx, val);
+        break;
+    case TRACK_NODE_ITEM:
+        track_update(track, TRACK_NODE_ITEM, idx, TRACK_ITEM_ID(node->item), val);
+        node->item = val - 1;
+        map->dirty = 1;
+        break;
+    case TRACK_NODE_ITEM_OWNER:
+        track_update(track, TRACK_NODE_ITEM_OWNER, idx, TRACK_PLAYER_ID(node->item_owner), val);
+        node->item_owner = val ? &game->players[val - 1] : NULL;
+        break;
+    case TRACK_NEXT_PLAYER:
+        game_track_next_player(game, val ? &game->players[val - 1] : NULL);
+        break;
+    case TRACK_NEXT_SEQ:
+        track_set(track, TRACK_NEXT_SEQ, 0, game->next_player_seq, val);
+        break;
+    case TRACK_BANKRUPT_NR:
+        track_set(track, TRACK_BANKRUPT_NR, 0, game->bankrupt_nr, val);
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * Pop journal back to the mark of current turn, or of the turn before if
+ * nothing happened yet in this one.
+ * @return: 0 done, < 0 no turn left in journal
+ */
+static int game_undo_turn(struct game *game)
+{
+    struct track_journal *journal = game->track.journal;
+    const struct track_entry *entry;
+
+    if (!journal)
+        return -1;
+
+    entry = track_journal_top(journal);
+    if (!entry || journal->n_mark < (entry->field == TRACK_MARK ? 2 : 1))
+        return -1;
+
+    if (entry->field == TRACK_MARK)
+        track_journal_pop(journal);
+
+    journal->paused = 1;
+    while ((entry = track_journal_top(journal)) && entry->field != TRACK_MARK) {
+        game_track_restore(game, entry);
+        track_journal_pop(journal);
+    }
+    journal->paused = 0;
+
+    /* player of the rewound turn gets a fresh deadline */
+    game->turn_marked = 1;
+    game->turn_timed = 0;
+    return 0;
+}
+
+static int game_cmd_undo(struct game *game, int argc, const char *argv[])
+{
+    struct ui *ui = &game->ui;
+    long i, n = 1;
+    char *endptr;
+
+    if (!strcmp(argv[0], "rewind")) {
+        if (argc != 2 || !argv[1]) {
+            ui_bprintln(ui, "rewind command syntax error, use 'rewind N'\n");
+            return -1;
+        }
+        endptr = NULL;
+        n = strtol(argv[1], &endptr, 10);
+        if (*endptr || n <= 0) {
+            ui_bprintln(ui, "not a valid number: %s\n", argv[1]);
+            return -1;
         }
+    } else if (argc != 1) {
+        ui_bprintln(ui, "undo command syntax error, use 'undo'\n");
+        return -1;
+    }
+
+    if (game->state != GAME_STATE_RUNNING) {
+        ui_bprintln(ui, "[UNDO] Only a running game can be undone.\n");
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (game_undo_turn(game))
+            break;
+    }
+
+    if (!i) {
+        ui_bprintln(ui, "[UNDO] No turn left to undo.\n");
+        return -1;
+    }
 
-        if (game->state == GAME_STATE_RUNNING)
-            ui_map_render(&game->ui, &game->map);
+    /* log and history describe the turns just dropped */
+    game_actlog_stop(game);
+    game_history_stop(game);
 
-        if (should_rotate <= 0)
+    ui_bprintln(ui, "[UNDO] Rewound %ld turn(s).\n", i);
+    return 0;
+}
+
+static void game_cmd_help(struct game *game)
+{
+    struct ui *ui = &game->ui;
+
+    ui_bprintln(ui, "Available commands:\n");
+    ui_bprintln(ui, "  start [ID=CTRL]...  begin game, CTRL of a seat is human, bot, mcts, expectimax or script:FILE\n");
+    ui_bprintln(ui, "  roll        roll dice and walk\n");
+    ui_bprintln(ui, "  sell N      sell estate on N-th map node\n");
+    ui_bprintln(ui, "  block N     use barrier item, N is distance from current player\n");
+    ui_bprintln(ui, "  bomb N      use bomb item, N is distance from current player\n");
+    ui_bprintln(ui, "  robot       use robot item\n");
+    ui_bprintln(ui, "  query       show current player stats\n");
+    ui_bprintln(ui, "  query endgame  win chances once two players are left\n");
+    ui_bprintln(ui, "  query landing  where walks end most, in the long run and next turn\n");
+    ui_bprintln(ui, "  winprob     win chances by rollouts, with 95%% intervals\n");
+    ui_bprintln(ui, "  risk [N [ID]]  chance to go bankrupt on tolls within N turns\n");
+    ui_bprintln(ui, "  advise [block|bomb]  best places for a block or bomb\n");
+    ui_bprintln(ui, "  skip        skip your turn\n");
+    ui_bprintln(ui, "  save FILE   save game to binary file\n");
+    ui_bprintln(ui, "  load FILE   restore game from binary file\n");
+    ui_bprintln(ui, "  record FILE record actions from now on, 'record stop' to stop\n");
+    ui_bprintln(ui, "  replay FILE restore game and replay actions from record\n");
+    ui_bprintln(ui, "  history FILE [K]  write state of every turn, keyframe every K turns\n");
+    ui_bprintln(ui, "  seek FILE N restore state of N-th turn from history\n");
+    ui_bprintln(ui, "  undo        take back current or last turn\n");
+    ui_bprintln(ui, "  rewind N    undo N turns\n");
+    ui_bprintln(ui, "  quit        stop game and exit\n");
+    ui_bprintln(ui, "  help        show this help\n");
+    ui_bprintln(ui, "\n");
+}
+
+#define GAME_CMD_MAX_ARGC 16
+
+/* commands naming a file of the host */
+static int game_cmd_is_file(const char *cmd)
+{
+    static const char *const cmds[] = { "save", "load", "record", "replay", "history", "seek" };
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(cmds); i++) {
+        if (!strcmp(cmd, cmds[i]))
+            return 1;
+    }
+    return 0;
+}
+
+/* @return: < 0 err, == 0 good, > 0 action performed */
+static int game_handle_command(struct game *game, char *line, int should_skip)
+{
+    struct ui *ui = &game->ui;
+    int argc;
+    const char *cmd;
+    const char *argv[GAME_CMD_MAX_ARGC];
+
+    /* starting state should not be visible */
+    assert(game->state != GAME_STATE_STARTING);
+
+    argc = ui_cmd_tokenize(line, argv, GAME_CMD_MAX_ARGC);
+    if (argc <= 0)
+        return -1;
+
+    cmd = argv[0];
+    game_debug_show_cmd(argc, argv);
+
+    if (game->no_files && game_cmd_is_file(cmd)) {
+        ui_bprintln(ui, "'%s' not served here, the files are the host's\n", cmd);
+        return -1;
+    }
+
+    if (!strcmp(cmd, "preset")) {
+        return game_cmd_preset(game, argc, argv);
+    } else if (!strcmp(cmd, "query")) {
+        return game_cmd_query(game, argc, argv);
+    } else if (!strcmp(cmd, "winprob")) {
+        return game_cmd_winprob(game, argc, argv);
+    } else if (!strcmp(cmd, "risk")) {
+        return game_cmd_risk(game, argc, argv);
+    } else if (!strcmp(cmd, "advise")) {
+        return game_cmd_advise(game, argc, argv);
+    } else if (!strcmp(cmd, "help")) {
+        game_cmd_help(game);
+        return 0;
+    } else if (!strcmp(cmd, "dump")) {
+        game_stop(game, GAME_STOP_DUMP);
+        return 0;
+    } else if (!strcmp(cmd, "quit")) {
+        game_stop(game, GAME_STOP_NODUMP);
+        return 0;
+    } else if (!strcmp(cmd, "skip")) {
+        game_actlog_put(game, ACT_SKIP, 0);
+        return 1;
+    } else if (!strcmp(cmd, "save")) {
+        return game_cmd_save(game, argc, argv);
+    } else if (!strcmp(cmd, "load")) {
+        return game_cmd_load(game, argc, argv);
+    } else if (!strcmp(cmd, "record")) {
+        return game_cmd_record(game, argc, argv);
+    } else if (!strcmp(cmd, "replay")) {
+        return game_cmd_replay(game, argc, argv);
+    } else if (!strcmp(cmd, "history")) {
+        return game_cmd_history(game, argc, argv);
+    } else if (!strcmp(cmd, "seek")) {
+        return game_cmd_seek(game, argc, argv);
+    } else if (!strcmp(cmd, "undo") || !strcmp(cmd, "rewind")) {
+        return game_cmd_undo(game, argc, argv);
+    }
+
+    if (should_skip) {
+        ui_bprintln(ui, "[NOTE] manually skip option is on, use 'skip' command to continue game\n");
+        return 0;
+    }
+
+    if (game->state == GAME_STATE_INIT) {
+        if (!strcmp(cmd, "start"))
+            return game_cmd_start(game, argc, argv);
+        return -1;
+    }
+
+    /* real game commands */
+    if (!strcmp(cmd, "roll")) {
+        return game_cmd_roll(game);
+
+    } else if (!strcmp(cmd, "sell")) {
+        return game_cmd_sell(game, argc, argv);
+
+    } else if (!strcmp(cmd, "block")) {
+        return game_cmd_block(game, argc, argv);
+
+    } else if (!strcmp(cmd, "bomb")) {
+        return game_cmd_bomb(game, argc, argv);
+
+    } else if (!strcmp(cmd, "robot")) {
+        return game_cmd_robot(game, argc, argv);
+
+    } else if (!strcmp(cmd, "step")) {
+        return game_cmd_step(game, argc, argv);
+    }
+
+    game_err("cmd '%s' unknown\n", cmd);
+    return -1;
+}
+
+static void game_after_command(struct game *game, int should_rotate);
+
+/* printed where a human would have typed it */
+static void game_echo_act(struct game *game, const struct act *act)
+{
+    static const char *const names[ACT_MAX] = {
+        [ACT_ROLL] = "roll",
+        [ACT_STEP] = "step",
+        [ACT_SELL] = "sell",
+        [ACT_BLOCK] = "block",
+        [ACT_BOMB] = "bomb",
+        [ACT_ROBOT] = "robot",
+        [ACT_SKIP] = "skip",
+    };
+    struct ui *ui = &game->ui;
+
+    switch (act->type) {
+    case ACT_STEP:
+    case ACT_BLOCK:
+    case ACT_BOMB:
+        ui_bprintln(ui, "%s %ld\n", names[act->type], (long) act->val);
+        break;
+    case ACT_SELL:
+        ui_bprintln(ui, "%s %ld\n", names[act->type], (long) (game->next_player->pos + act->val));
+        break;
+    default:
+        ui_bprintln(ui, "%s\n", names[act->type] ? names[act->type] : "?");
+        break;
+    }
+}
+
+/* @return: > 0 the seat took its turn, == 0 left to the prompt */
+static int game_controller_turn(struct game *game, struct controller *ctl, struct player *player)
+{
+    struct act act = { .type = ACT_SKIP };
+    int ret;
+
+    /* nothing to decide on a skipped turn */
+    if (!game->prompt.should_skip && ctl->ops->decide_turn(ctl, game, player, &act) == CONTROLLER_ASK)
+        return 0;
+
+    game_echo_act(game, &act);
+    game->prompt.decision = GAME_DECIDE_NONE;
+
+    ret = game_player_act(game, &act);
+    if (ret < 0) {
+        /* a seat stuck on a rejected action would never let go */
+        ui_bprintln(&game->ui, "[CTRL] Player %s %s action rejected, seat goes to human.\n",
+                    ui_player_name(&game->ui, player), ctl->ops->name);
+        controller_uninit(ctl);
+    }
+
+    game_after_command(game, ret);
+    return 1;
+}
+
+/*
+ * Seat of the deciding player answers the open prompt itself.
+ * @return: < 0 err, == 0 left to the prompt, > 0 answered
+ */
+static int game_controller_answer(struct game *game)
+{
+    struct game_prompt *prompt = &game->prompt;
+    struct player *player = prompt->player;
+    struct map_node *node;
+    struct controller *ctl;
+    int val;
+
+    if (!player || game->actlog.mode == ACTLOG_REPLAY)
+        return 0;
+
+    ctl = &game->ctrls[player->idx];
+    if (ctl->type == CONTROLLER_HUMAN)
+        return 0;
+
+    node = &game->map.nodes[player->pos];
+    switch (prompt->decision) {
+    case GAME_DECIDE_COMMAND:
+        return game_controller_turn(game, ctl, player);
+    case GAME_DECIDE_BUY:
+        val = ctl->ops->decide_buy(ctl, game, player, node);
+        break;
+    case GAME_DECIDE_UPGRADE:
+        val = ctl->ops->decide_upgrade(ctl, game, player, node);
+        break;
+    case GAME_DECIDE_ITEM:
+        val = ctl->ops->choose_item(ctl, game, player, &prompt->sel);
+        break;
+    case GAME_DECIDE_GIFT:
+        val = ctl->ops->choose_gift(ctl, game, player, &prompt->sel);
+        break;
+    case GAME_DECIDE_MAGIC:
+        val = ctl->ops->choose_magic_target(ctl, game, player, &prompt->sel);
+        break;
+    default:
+        return 0;
+    }
+
+    if (val == CONTROLLER_ASK)
+        return 0;
+
+    if (prompt->type == GAME_PROMPT_BOOL) {
+        val = !!val;
+        ui_bprintln(&game->ui, "%c\n", val ? 'y' : 'n');
+        game_actlog_put(game, ACT_BOOL, val);
+    } else {
+        if (val < 0 || val >= prompt->sel.n_choice)
+            return 0;
+        ui_bprintln(&game->ui, "%c\n", prompt->sel.choices[val].id);
+        game_menu_pick(&prompt->sel, val);
+        game_actlog_put(game, ACT_MENU, val);
+    }
+
+    if (game_resolve(game, val) < 0)
+        return -1;
+    return 1;
+}
+
+/* run until input is needed, @return: prompt waiting for input */
+static const struct game_prompt *game_advance(struct game *game)
+{
+    struct game_prompt *prompt = &game->prompt;
+    int ret;
+
+again:
+    while (prompt->decision == GAME_DECIDE_NONE) {
+        if (game->state == GAME_STATE_STOPPED) {
+            prompt->type = GAME_PROMPT_NONE;
+            break;
+        }
+        if (game->state == GAME_STATE_UNINIT) {
+            game_err("fail to restart game, exit\n");
+            game_stop(game, GAME_STOP_NODUMP);
             continue;
-skip_action:
-        game_after_action(game);
+        }
+
+        /* restored from checkpoint, or players just chosen */
+        game_check_starting(game);
 
-        if (game_rotate_player(game)) {
-            game_dbg("rotate player fail\n");
+        prompt->should_skip = game_before_action(game);
+        if (prompt->should_skip && !game->option.opts[GAME_OPT_MANUAL_SKIP].on) {
+            if (game_end_turn(game)) {
+                game_dbg("rotate player fail\n");
+                game_stop(game, GAME_STOP_NODUMP);
+            }
+            continue;
+        }
+
+        game_open(game, GAME_DECIDE_COMMAND);
+    }
+
+    /* bot and script seats play on until a human is asked */
+    ret = game_controller_answer(game);
+    if (ret < 0) {
+        prompt->decision = GAME_DECIDE_NONE;
+        game_stop(game, GAME_STOP_NODUMP);
+    }
+    if (ret)
+        goto again;
+
+    return prompt;
+}
+
+/* @should_rotate: as returned by game_handle_command() */
+static void game_after_command(struct game *game, int should_rotate)
+{
+    game_check_starting(game);
+    game_debug_check_hash(game);
+
+    if (game->state == GAME_STATE_RUNNING)
+        ui_map_render(&game->ui, &game->map);
+
+    /* command opened a dialog of its own */
+    if (should_rotate <= 0 || game->prompt.decision != GAME_DECIDE_NONE)
+        return;
+
+    if (game_end_turn(game)) {
+        game_dbg("rotate player fail\n");
+        game_stop(game, GAME_STOP_NODUMP);
+    }
+}
+
+static void game_feed_command(struct game *game, char *line)
+{
+    game_after_command(game, game_handle_command(game, line, game->prompt.should_skip));
+}
+
+const struct game_prompt *game_feed(struct game *game, char *line)
+{
+    struct game_prompt *prompt = &game->prompt;
+
+    if (!line || prompt->decision == GAME_DECIDE_NONE)
+        return game_advance(game);
+
+    if (prompt->decision == GAME_DECIDE_COMMAND) {
+        prompt->decision = GAME_DECIDE_NONE;
+        game_feed_command(game, line);
+    } else if (game_feed_decision(game, line) < 0) {
+        prompt->decision = GAME_DECIDE_NONE;
+        game_stop(game, GAME_STOP_NODUMP);
+    }
+
+    return game_advance(game);
+}
+
+/* choice of a menu left alone, < 0 is taken as invalid input */
+static int game_menu_default(enum game_decision decision)
+{
+    switch (decision) {
+    case GAME_DECIDE_ITEM:
+        return ITEM_MAX;
+    case GAME_DECIDE_MAGIC:
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+const struct game_prompt *game_timeout(struct game *game)
+{
+    struct game_prompt *prompt = &game->prompt;
+    struct ui *ui = &game->ui;
+    char skip[] = "skip";
+    int val, ret = 0;
+
+    if (!prompt->player || !prompt->deadline_ms)
+        return prompt;
+
+    /* prompt line is still open */
+    ui_bprintln(ui, "\n[TIMEOUT] Player %s ran out of time.\n", ui_player_name(ui, prompt->player));
+
+    /* logged as the player answer, replay takes the same path */
+    switch (prompt->type) {
+    case GAME_PROMPT_COMMAND:
+        prompt->decision = GAME_DECIDE_NONE;
+        game_feed_command(game, skip);
+        break;
+    case GAME_PROMPT_BOOL:
+        game_actlog_put(game, ACT_BOOL, 0);
+        ret = game_resolve(game, 0);
+        break;
+    case GAME_PROMPT_MENU:
+        val = game_menu_default(prompt->decision);
+        game_menu_pick(&prompt->sel, val);
+        game_actlog_put(game, ACT_MENU, val);
+        ret = game_resolve(game, val);
+        break;
+    default:
+        return prompt;
+    }
+
+    if (ret < 0) {
+        prompt->decision = GAME_DECIDE_NONE;
+        game_stop(game, GAME_STOP_NODUMP);
+    }
+    return game_advance(game);
+}
+
+void game_deadline_arm(struct game *game, struct timer_wheel *wheel)
+{
+    const struct game_prompt *prompt = &game->prompt;
+
+    if (prompt->type == GAME_PROMPT_NONE || !prompt->deadline_ms) {
+        timer_del(wheel, &game->deadline);
+        return;
+    }
+
+    /* same deadline still running */
+    if (game->deadline_armed == game->deadline_seq)
+        return;
+
+    game->deadline_armed = game->deadline_seq;
+    timer_add(wheel, &game->deadline, timer_ms_to_ticks(wheel, prompt->deadline_ms));
+}
+
+int game_sim_init(struct game *sim)
+{
+    struct ui *ui = &sim->ui;
+
+    if (game_init_state(sim, 0))
+        return -1;
+    /* searches turn rolls into steps, a stray roll still gets a die */
+    game_seed(sim, 0);
+
+    /* nobody to show */
+    ui->in = NULL;
+    ui->in_isatty = ui->out_isatty = 0;
+    ui->mute = 1;
+    sim->sim = 1;
+    return 0;
+}
+
+int game_sim_load(struct game *sim, const struct game_image *img, enum game_decision decision)
+{
+    if (game_load_image(sim, img))
+        return -1;
+
+    /* unmuted by game_reset() */
+    sim->ui.mute = 1;
+    game_check_starting(sim);
+
+    /* turn already began in @img, game_before_action() must not run twice */
+    return game_open(sim, decision) > 0 ? 0 : -1;
+}
+
+int game_events_init(struct game_events *events)
+{
+    sigset_t mask;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGWINCH);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+
+    /* before any thread starts, so every thread leaves them to sig_fd */
+    if (sigprocmask(SIG_BLOCK, &mask, NULL))
+        return -1;
+
+    events->sig_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    return events->sig_fd < 0 ? -1 : 0;
+}
+
+void game_events_read(struct game_events *events)
+{
+    struct signalfd_siginfo info;
+
+    while (read(events->sig_fd, &info, sizeof(info)) == sizeof(info)) {
+        if (info.ssi_signo == SIGWINCH)
+            events->event_winch = 1;
+        else
+            events->event_term = info.ssi_signo;
+    }
+}
+
+static void game_timer_arm(int fd, long ms)
+{
+    struct itimerspec its = {
+        .it_value = { .tv_sec = ms / 1000, .tv_nsec = ms % 1000 * 1000000 },
+    };
+
+    timerfd_settime(fd, 0, &its, NULL);
+}
+
+enum {
+    GAME_POLL_INPUT,
+    GAME_POLL_SIGNAL,
+    GAME_POLL_TIMER,
+    GAME_POLL_DEADLINE,
+    GAME_POLL_MAX,
+};
+
+int game_event_loop(struct game *game)
+{
+    struct ui *ui = &game->ui;
+    struct pollfd fds[GAME_POLL_MAX] = {};
+    const struct game_prompt *prompt;
+    struct timer_wheel wheel;
+    struct list_head deadlines;
+    char *line = NULL;
+    uint64_t expired;
+    int timer_fd;
+    int stop_reason = 0;
+    int ret;
+
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0) {
+        game_err("fail to create timer\n");
+        return -1;
+    }
+
+    if (timer_wheel_init(&wheel, GAME_DEADLINE_TICK_MS)) {
+        game_err("fail to create deadline timer\n");
+        close(timer_fd);
+        return -1;
+    }
+
+    fds[GAME_POLL_INPUT] = (struct pollfd) { .fd = fileno(ui->in), .events = POLLIN };
+    fds[GAME_POLL_SIGNAL] = (struct pollfd) { .fd = g_game_events.sig_fd, .events = POLLIN };
+    fds[GAME_POLL_TIMER] = (struct pollfd) { .fd = timer_fd, .events = POLLIN };
+    fds[GAME_POLL_DEADLINE] = (struct pollfd) { .fd = wheel.fd, .events = POLLIN };
+
+    prompt = game_feed(game, NULL);
+    while (prompt->type != GAME_PROMPT_NONE) {
+        line = ui_input_line(ui);
+        if (line) {
+            prompt = game_feed(game, line);
+            continue;
+        }
+
+        if (ui->in_eof) {
+            /* input ends inside a dialog, dump what was reached */
+            game_stop(game, prompt->type == GAME_PROMPT_COMMAND ? GAME_STOP_NODUMP : GAME_STOP_DUMP);
+            stop_reason = 1;
+            break;
+        }
+
+        game_deadline_arm(game, &wheel);
+        timer_wheel_sync(&wheel);
+
+        /* prompt has no newline */
+        fflush(ui->out);
+
+        /* idle cores estimate win chances until something happens */
+        if (ui_is_interactive(ui))
+            winprob_post(game);
+        ret = poll(fds, GAME_POLL_MAX, -1);
+        winprob_pause();
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            game_err("poll fail, %s\n", strerror(errno));
             game_stop(game, GAME_STOP_NODUMP);
             stop_reason = 2;
             break;
         }
+
+        if (fds[GAME_POLL_SIGNAL].revents & POLLIN)
+            game_events_read(&g_game_events);
+
+        if (g_game_events.event_term) {
+            game_dbg("killed by signal %d\n", g_game_events.event_term);
+            g_game_events.event_term = 0;
+            game_stop(game, GAME_STOP_NODUMP);
+            stop_reason = 1;
+            break;
+        }
+
+        /* resizes come in bursts, redraw once they settle */
+        if (g_game_events.event_winch) {
+            g_game_events.event_winch = 0;
+            game_timer_arm(timer_fd, GAME_WINCH_DELAY_MS);
+        }
+
+        if ((fds[GAME_POLL_TIMER].revents & POLLIN) && read(timer_fd, &expired, sizeof(expired)) > 0)
+            ui_handle_winch(ui, &game->map);
+
+        if (fds[GAME_POLL_DEADLINE].revents & POLLIN) {
+            INIT_LIST_HEAD(&deadlines);
+            timer_wheel_tick(&wheel, &deadlines);
+            if (!list_empty(&deadlines)) {
+                list_del_init(&game->deadline.node);
+                prompt = game_timeout(game);
+                continue;
+            }
+        }
+
+        if (fds[GAME_POLL_INPUT].revents & (POLLIN | POLLHUP | POLLERR))
+            ui_input_fill(ui);
     }
 
+    timer_del(&wheel, &game->deadline);
+    timer_wheel_uninit(&wheel);
+    close(timer_fd);
     return stop_reason;
 }
 
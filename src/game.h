@@ -2,6 +2,13 @@
 #include "player.h"
 #include "map.h"
 #include "ui.h"
+#include "arena.h"
+#include "actlog.h"
+#include "track.h"
+#include "timer.h"
+#include "controller.h"
+
+struct game_image;
 
 enum game_state {
     /* resource freed */
@@ -21,6 +28,8 @@ enum game_option {
     GAME_OPT_MANUAL_SKIP,
     GAME_OPT_SELL_BOMB,
     GAME_OPT_OLD_MAP,
+    /* sell estates to pay a toll instead of going bankrupt */
+    GAME_OPT_LIQUIDATE,
     GAME_OPT_MAX,
 };
 
@@ -28,6 +37,8 @@ struct game_opt {
     /* user must type skip command manually when stat->empty == 1, added for bomb testing */
     const char *name;
     int on;
+    /* process wide, every game of a server would see it */
+    int shared;
 };
 
 struct game_options {
@@ -35,11 +46,70 @@ struct game_options {
 };
 
 struct game_events {
+    /* SIGWINCH, SIGINT and SIGTERM arrive here, blocked otherwise */
+    int sig_fd;
     int event_winch;
     int event_term;
 };
 
+/* kind of input a game waits for */
+enum game_prompt_type {
+    /* game stopped, nothing to feed */
+    GAME_PROMPT_NONE,
+    /* a command line */
+    GAME_PROMPT_COMMAND,
+    /* y or n */
+    GAME_PROMPT_BOOL,
+    /* a number in range */
+    GAME_PROMPT_INT,
+    /* one of the choices not chosen yet */
+    GAME_PROMPT_MENU,
+};
+
+/* what the input decides */
+enum game_decision {
+    GAME_DECIDE_NONE,
+    GAME_DECIDE_COMMAND,
+    /* start dialog */
+    GAME_DECIDE_MONEY,
+    GAME_DECIDE_N_PLAYERS,
+    GAME_DECIDE_PLAYERS,
+    /* on the node a player stopped at */
+    GAME_DECIDE_BUY,
+    GAME_DECIDE_UPGRADE,
+    GAME_DECIDE_ITEM,
+    GAME_DECIDE_GIFT,
+    GAME_DECIDE_MAGIC,
+    GAME_DECIDE_MAX,
+};
+
+#define GAME_PROMPT_TEXT_SZ    128
+#define GAME_PROMPT_MAX_CHOICE 8
+
+struct game_prompt {
+    enum game_prompt_type type;
+    enum game_decision decision;
+    /* who decides, NULL before game start */
+    struct player *player;
+    /* as printed */
+    char text[GAME_PROMPT_TEXT_SZ];
+    /* GAME_PROMPT_COMMAND, only 'skip' and meta commands are taken */
+    int should_skip;
+    /* GAME_PROMPT_INT */
+    struct range range;
+    /* GAME_PROMPT_MENU */
+    struct select sel;
+    struct choice choices[GAME_PROMPT_MAX_CHOICE];
+    /* GAME_DECIDE_PLAYERS, number of players to choose */
+    int n_pick;
+    /* time the player has to answer, 0 for no limit, see game_deadline_arm() */
+    long deadline_ms;
+};
+
 struct game {
+    /* owns every game lifetime allocation */
+    struct arena arena;
+
     enum game_state state;
     int need_dump;
     struct game_options option;
@@ -47,6 +117,8 @@ struct game {
     struct ui ui;
 
     int dice_facets;
+    /* xorshift64* of the dice, one stream per game, preset seed sets it */
+    uint64_t rng;
     struct map map;
     const struct map_layout *cur_layout;
 
@@ -55,6 +127,8 @@ struct game {
 
     int cur_player_nr;
     struct player *cur_players[PLAYER_MAX];
+    /* who decides for each player idx, human again after game_reset() */
+    struct controller ctrls[PLAYER_MAX];
 
     /* only valid in game running state */
     int bankrupt_nr;
@@ -62,10 +136,66 @@ struct game {
     int next_player_seq;
     struct player *next_player;
     int max_sell_per_turn;
+
+    /* optional, kept across game_reset() */
+    struct checkpoint *checkpoint;
+
+    /* player input record or replay, stopped by game_reset() */
+    struct actlog actlog;
+
+    /* optional per turn state history, stopped by game_reset() */
+    struct history *history;
+
+    /* incremental hash of players, map and next player */
+    struct track track;
+    /* undo journal of track, kept across game_reset() */
+    struct track_journal journal;
+    /* journal has the mark of current turn */
+    int turn_marked;
+
+    /* input the game waits for, see game_feed() */
+    struct game_prompt prompt;
+
+    /* 0 for none, kept across game_reset() */
+    long turn_deadline_ms;
+    long prompt_deadline_ms;
+    /* bumped when a new deadline starts, one deadline spans all commands of a turn */
+    unsigned long deadline_seq;
+    unsigned long deadline_armed;
+    int turn_timed;
+    /* on the wheel of the driver while a deadline runs */
+    struct timer deadline;
+
+    /* search copy, muted, stops at the end of game instead of restarting */
+    int sim;
+    /* no mcts or expectimax seats, their search would hold up the other games of a server */
+    int no_search;
+    /* no save, load, record, replay, history, seek or script seats, the files are the host's */
+    int no_files;
+    /* no shared options, they would reach the other games of a server */
+    int no_shared;
 };
 
 #define GAME_DEFAULT_DICE_SHAPE 6
 
+/* build with -DGAME_ARENA_FLAGS=ARENA_HUGEPAGE for large simulation batches */
+#ifndef GAME_ARENA_FLAGS
+#define GAME_ARENA_FLAGS 0
+#endif
+
+/* entries of undo journal, power of 2 */
+#ifndef GAME_JOURNAL_SIZE
+#define GAME_JOURNAL_SIZE (1 << 16)
+#endif
+
+/* of a search copy, which has no undo journal */
+#define GAME_SIM_ARENA_SIZE (MAP_MAX_NODE * sizeof(struct map_node)             \
+                             + 2 * INPUT_BUF_SIZE + N_OUT_BUF * OUT_BUF_SIZE    \
+                             + N_FORMAT_BUF * FORMAT_BUF_SIZE                   \
+                             + PLAYER_MAX * PLAYER_NAME_SZ + 32 * ARENA_ALIGN)
+
+#define GAME_ARENA_SIZE (GAME_SIM_ARENA_SIZE + GAME_JOURNAL_SIZE * sizeof(struct track_entry))
+
 #define GAME_DEFAULT_MONEY      10000
 #define GAME_DEFAULT_MONEY_MIN  1000
 #define GAME_DEFAULT_MONEY_MAX  50000
@@ -79,18 +209,74 @@ struct game {
 #define GAME_ITEM_BOMB_RANGE  10
 #define GAME_ITEM_ROBOT_RANGE 10
 
+/* nodes listed by query landing */
+#define GAME_LANDING_TOP      6
+/* turns the risk command looks ahead by default */
+#define GAME_RISK_TURN        10
+/* placements listed by advise */
+#define GAME_ADVISE_TOP       3
+
 /* raw player creation/deletion, unattached */
 int game_add_player(struct game *game, int idx);
+/* create and attach players in seat order */
+int game_add_players(struct game *game, int idxs[], int n_idx);
 int game_del_player(struct game *game, int idx);
 /* delete every player, player should be attached on map */
 int game_del_all_players(struct game *game);
 
 struct player *game_get_player(struct game *game, int idx);
+int game_set_next_player(struct game *game, struct player *player);
+
+/* full recompute of game->track.hash */
+uint64_t game_state_hash(struct game *game);
+/* after bulk state changes: recompute hash, forget undo history */
+void game_track_reset(struct game *game);
+
+/* make side effects of option value take place */
+void game_apply_option(struct game *game, enum game_option opt);
 
 
 int game_init(struct game *game);
+void game_uninit(struct game *game);
+int game_reset(struct game *game);
+/*
+ * Resumable game driver: game_feed() takes one line of input for the
+ * current prompt, runs the game as far as it can without input, and
+ * returns the next prompt. Nothing blocks, the caller owns the input.
+ * A NULL @line only runs to the first prompt. @line is tokenized in place.
+ */
+const struct game_prompt *game_feed(struct game *game, char *line);
+/* game for searches to play on, see game_sim_load() */
+int game_sim_init(struct game *sim);
+/*
+ * Restore @img into @sim and open @decision for the next player again,
+ * the way it was open when @img was saved. Seats are human after the
+ * restore, game_feed(sim, NULL) goes on once they are set.
+ */
+int game_sim_load(struct game *sim, const struct game_image *img, enum game_decision decision);
+
+/* terminal driver, polls ui input, signals and timers */
 int game_event_loop(struct game *game);
 
+/*
+ * Answer the open prompt as if its player typed the default: skip the
+ * turn, decline, or leave the menu. Called when the deadline expires.
+ */
+const struct game_prompt *game_timeout(struct game *game);
+/* put game->deadline on @wheel for the open prompt, call after every feed */
+void game_deadline_arm(struct game *game, struct timer_wheel *wheel);
+
+/* resolution of deadlines */
+#define GAME_DEADLINE_TICK_MS 100
+
+/* delay of redraw after the last window resize */
+#define GAME_WINCH_DELAY_MS 50
+
+/* route signals to events->sig_fd, call before any thread is created */
+int game_events_init(struct game_events *events);
+/* drain sig_fd into event flags */
+void game_events_read(struct game_events *events);
+
 enum {
     GAME_STOP_NODUMP = 0,
     GAME_STOP_DUMP,
@@ -0,0 +1,474 @@
+#include <unistd.h>
+#include <sys/mman.h>
+#include "common.h"
+#include "history.h"
+#include "varint.h"
+
+enum history_rec {
+    HIST_REC_KEYFRAME = 'K',
+    HIST_REC_DELTA = 'D',
+};
+
+enum history_op {
+    HIST_OP_END,
+    /* pos, owner, level */
+    HIST_OP_MAP,
+    /* pos, item, item owner */
+    HIST_OP_ITEM,
+    /* player, money */
+    HIST_OP_FUND,
+    /* player, points */
+    HIST_OP_CREDIT,
+    /* player, enum history_gift, value */
+    HIST_OP_GIFT,
+    /* player, pos, empty rounds, attached */
+    HIST_OP_USERLOC,
+    /* player, bankrupt | empty << 1 | god << 2, sold this turn */
+    HIST_OP_STAT,
+    /* player, seat, bankrupt number */
+    HIST_OP_NEXTUSER,
+    HIST_OP_MAX,
+};
+
+enum history_gift {
+    HIST_GIFT_BLOCK,
+    HIST_GIFT_BOMB,
+    HIST_GIFT_ROBOT,
+    HIST_GIFT_GOD,
+    HIST_GIFT_MAX,
+};
+
+#define HIST_OP_MAX_ARGS 4
+
+int history_create(struct history *hist, const char *path, int every)
+{
+    struct history_header hdr = {};
+
+    memset(hist, 0, sizeof(*hist));
+    if (every <= 0)
+        return -1;
+
+    hist->fp = fopen(path, "wb");
+    if (!hist->fp) {
+        game_err("fail to open %s\n", path);
+        return -1;
+    }
+
+    /* real header is written by history_close() */
+    if (fwrite(&hdr, sizeof(hdr), 1, hist->fp) != 1) {
+        fclose(hist->fp);
+        hist->fp = NULL;
+        return -2;
+    }
+
+    hist->every = every;
+    return 0;
+}
+
+static int history_put_op(FILE *fp, enum history_op op, int n_arg, const int64_t *args)
+{
+    unsigned char buf[1 + HIST_OP_MAX_ARGS * VARINT_MAX_LEN];
+    int i, n = 0;
+
+    buf[n++] = op;
+    for (i = 0; i < n_arg; i++)
+        n += varint_put(buf + n, varint_zigzag(args[i]));
+
+    return fwrite(buf, n, 1, fp) == 1 ? 0 : -1;
+}
+
+#define history_op(fp, op, ...) ({                                      \
+    const int64_t __args[] = { __VA_ARGS__ };                           \
+    history_put_op(fp, op, ARRAY_SIZE(__args), __args);                 \
+})
+
+/* changes a delta can't express: options, layout, seats and item houses */
+static int history_need_keyframe(const struct game_image *last, const struct game_image *img)
+{
+    int i, j;
+
+    if (last->layout != img->layout || last->state != img->state
+        || last->dice_facets != img->dice_facets || last->default_money != img->default_money
+        || last->max_sell_per_turn != img->max_sell_per_turn || last->options != img->options
+        || last->cur_player_nr != img->cur_player_nr || last->n_node != img->n_node)
+        return 1;
+
+    if (memcmp(last->cur_players, img->cur_players, sizeof(img->cur_players)))
+        return 1;
+
+    for (i = 0; i < PLAYER_MAX; i++) {
+        if (last->players[i].valid != img->players[i].valid)
+            return 1;
+    }
+
+    for (i = 0; i < img->n_node; i++) {
+        if (last->nodes[i].mine_points != img->nodes[i].mine_points)
+            return 1;
+        for (j = 0; j < ITEM_MAX; j++) {
+            if (last->nodes[i].on_sell[j] != img->nodes[i].on_sell[j])
+                return 1;
+        }
+    }
+    return 0;
+}
+
+static inline int history_stat_bits(const struct game_image_player *ip)
+{
+    return !!ip->bankrupt | !!ip->empty << 1 | !!ip->god << 2;
+}
+
+static int history_put_player(FILE *fp, int idx, const struct game_image_player *old,
+                              const struct game_image_player *ip)
+{
+    int ret = 0;
+
+    if (old->n_money != ip->n_money)
+        ret |= history_op(fp, HIST_OP_FUND, idx, ip->n_money);
+    if (old->n_points != ip->n_points)
+        ret |= history_op(fp, HIST_OP_CREDIT, idx, ip->n_points);
+
+    if (old->n_block != ip->n_block)
+        ret |= history_op(fp, HIST_OP_GIFT, idx, HIST_GIFT_BLOCK, ip->n_block);
+    if (old->n_bomb != ip->n_bomb)
+        ret |= history_op(fp, HIST_OP_GIFT, idx, HIST_GIFT_BOMB, ip->n_bomb);
+    if (old->n_robot != ip->n_robot)
+        ret |= history_op(fp, HIST_OP_GIFT, idx, HIST_GIFT_ROBOT, ip->n_robot);
+    if (old->n_god_rounds != ip->n_god_rounds)
+        ret |= history_op(fp, HIST_OP_GIFT, idx, HIST_GIFT_GOD, ip->n_god_rounds);
+
+    if (old->pos != ip->pos || old->n_empty_rounds != ip->n_empty_rounds || old->attached != ip->attached)
+        ret |= history_op(fp, HIST_OP_USERLOC, idx, ip->pos, ip->n_empty_rounds, ip->attached);
+
+    if (history_stat_bits(old) != history_stat_bits(ip) || old->n_sell_done != ip->n_sell_done)
+        ret |= history_op(fp, HIST_OP_STAT, idx, history_stat_bits(ip), ip->n_sell_done);
+
+    return ret;
+}
+
+static int history_put_delta(FILE *fp, const struct game_image *last, const struct game_image *img)
+{
+    const struct game_image_node *old, *in;
+    int i, ret = 0;
+
+    if (fputc(HIST_REC_DELTA, fp) == EOF)
+        return -1;
+
+    for (i = 0; i < img->n_node; i++) {
+        old = &last->nodes[i];
+        in = &img->nodes[i];
+
+        if (old->owner != in->owner || old->level != in->level)
+            ret |= history_op(fp, HIST_OP_MAP, i, in->owner, in->level);
+        if (old->item != in->item || old->item_owner != in->item_owner)
+            ret |= history_op(fp, HIST_OP_ITEM, i, in->item, in->item_owner);
+    }
+
+    for (i = 0; i < PLAYER_MAX; i++) {
+        if (img->players[i].valid)
+            ret |= history_put_player(fp, i, &last->players[i], &img->players[i]);
+    }
+
+    if (last->next_player != img->next_player || last->next_player_seq != img->next_player_seq
+        || last->bankrupt_nr != img->bankrupt_nr)
+        ret |= history_op(fp, HIST_OP_NEXTUSER, img->next_player, img->next_player_seq, img->bankrupt_nr);
+
+    if (fputc(HIST_OP_END, fp) == EOF)
+        return -1;
+    return ret;
+}
+
+static int history_put_keyframe(struct history *hist, const struct game_image *img)
+{
+    struct history_index *ent;
+    long off = ftell(hist->fp);
+
+    if (off < 0)
+        return -1;
+
+    if (hist->n_index == hist->index_cap) {
+        int cap = hist->index_cap ? 2 * hist->index_cap : 64;
+
+        ent = realloc(hist->index, cap * sizeof(*ent));
+        if (!ent)
+            return -1;
+        hist->index = ent;
+        hist->index_cap = cap;
+    }
+
+    ent = &hist->index[hist->n_index++];
+    ent->turn = hist->n_turn;
+    ent->pad = 0;
+    ent->offset = off;
+
+    if (fputc(HIST_REC_KEYFRAME, hist->fp) == EOF)
+        return -1;
+    return game_fwrite_image(img, hist->fp);
+}
+
+int history_append(struct history *hist, const struct game_image *img)
+{
+    int ret;
+
+    if (!hist->fp)
+        return -1;
+
+    if (hist->n_turn % hist->every == 0 || history_need_keyframe(&hist->last, img))
+        ret = history_put_keyframe(hist, img);
+    else
+        ret = history_put_delta(hist->fp, &hist->last, img);
+
+    if (ret) {
+        game_err("fail to write turn %ld\n", hist->n_turn);
+        return -1;
+    }
+
+    memcpy(&hist->last, img, GAME_IMAGE_BODY_SIZE(img->n_node));
+    hist->n_turn++;
+    return 0;
+}
+
+int history_close(struct history *hist)
+{
+    struct history_header hdr = {
+        .magic = HISTORY_MAGIC,
+        .version = HISTORY_VERSION,
+        .header_size = sizeof(hdr),
+        .every = hist->every,
+        .n_turn = hist->n_turn,
+        .n_index = hist->n_index,
+    };
+    long off;
+    int ret = 0;
+
+    if (!hist->fp)
+        return 0;
+
+    /* index is read in place from mmap */
+    off = ftell(hist->fp);
+    while (off >= 0 && off % sizeof(uint64_t)) {
+        fputc(0, hist->fp);
+        off++;
+    }
+
+    if (off < 0 || fwrite(hist->index, sizeof(*hist->index), hist->n_index, hist->fp) != hist->n_index)
+        ret = -1;
+
+    hdr.index_offset = off;
+    if (ret || fseek(hist->fp, 0, SEEK_SET) || fwrite(&hdr, sizeof(hdr), 1, hist->fp) != 1)
+        ret = -1;
+
+    if (fclose(hist->fp))
+        ret = -1;
+
+    free(hist->index);
+    memset(hist, 0, sizeof(*hist));
+    return ret;
+}
+
+static int history_apply_op(struct game_image *img, enum history_op op, const int64_t *args)
+{
+    struct game_image_player *ip;
+    struct game_image_node *in;
+
+    if (op == HIST_OP_MAP || op == HIST_OP_ITEM) {
+        if (args[0] < 0 || args[0] >= img->n_node)
+            return -1;
+        in = &img->nodes[args[0]];
+
+        if (op == HIST_OP_MAP) {
+            in->owner = args[1];
+            in->level = args[2];
+        } else {
+            in->item = args[1];
+            in->item_owner = args[2];
+        }
+        return 0;
+    }
+
+    if (op == HIST_OP_NEXTUSER) {
+        img->next_player = args[0];
+        img->next_player_seq = args[1];
+        img->bankrupt_nr = args[2];
+        return 0;
+    }
+
+    if (args[0] < 0 || args[0] >= PLAYER_MAX)
+        return -1;
+    ip = &img->players[args[0]];
+
+    switch (op) {
+    case HIST_OP_FUND:
+        ip->n_money = args[1];
+        break;
+    case HIST_OP_CREDIT:
+        ip->n_points = args[1];
+        break;
+    case HIST_OP_GIFT:
+        if (args[1] == HIST_GIFT_BLOCK)
+            ip->n_block = args[2];
+        else if (args[1] == HIST_GIFT_BOMB)
+            ip->n_bomb = args[2];
+        else if (args[1] == HIST_GIFT_ROBOT)
+            ip->n_robot = args[2];
+        else if (args[1] == HIST_GIFT_GOD)
+            ip->n_god_rounds = args[2];
+        else
+            return -1;
+        break;
+    case HIST_OP_USERLOC:
+        ip->pos = args[1];
+        ip->n_empty_rounds = args[2];
+        ip->attached = args[3];
+        break;
+    case HIST_OP_STAT:
+        ip->bankrupt = args[1] & 1;
+        ip->empty = !!(args[1] & 2);
+        ip->god = !!(args[1] & 4);
+        ip->n_sell_done = args[2];
+        break;
+    default:
+        return -1;
+    }
+    return 0;
+}
+
+static const int history_op_args[HIST_OP_MAX] = {
+    [HIST_OP_MAP] = 3,
+    [HIST_OP_ITEM] = 3,
+    [HIST_OP_FUND] = 2,
+    [HIST_OP_CREDIT] = 2,
+    [HIST_OP_GIFT] = 3,
+    [HIST_OP_USERLOC] = 4,
+    [HIST_OP_STAT] = 3,
+    [HIST_OP_NEXTUSER] = 3,
+};
+
+/* @return: bytes consumed, < 0 err */
+static long history_apply_delta(const unsigned char *buf, size_t size, struct game_image *img)
+{
+    int64_t args[HIST_OP_MAX_ARGS];
+    size_t off = 0;
+    uint64_t val;
+    int op, i, n;
+
+    while (off < size) {
+        op = buf[off++];
+        if (op == HIST_OP_END)
+            return off;
+        if (op >= HIST_OP_MAX)
+            return -1;
+
+        for (i = 0; i < history_op_args[op]; i++) {
+            n = varint_get(buf + off, size - off, &val);
+            if (n < 0)
+                return -1;
+            off += n;
+            args[i] = varint_unzigzag(val);
+        }
+
+        if (history_apply_op(img, op, args))
+            return -1;
+    }
+    return -1;
+}
+
+/* last keyframe at or before @turn */
+static const struct history_index *history_find(const struct history_index *index, int n_index, long turn)
+{
+    int lo = 0, hi = n_index - 1, mid;
+
+    if (n_index <= 0 || index[0].turn > turn)
+        return NULL;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo + 1) / 2;
+        if (index[mid].turn <= turn)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return &index[lo];
+}
+
+static int history_rebuild(const unsigned char *buf, size_t size, const struct history_header *hdr,
+                           long turn, struct game_image *img)
+{
+    const struct history_index *ent;
+    size_t off, used;
+    long t, n;
+
+    ent = history_find((const void *) (buf + hdr->index_offset), hdr->n_index, turn);
+    if (!ent || ent->offset >= hdr->index_offset)
+        return -1;
+
+    off = ent->offset;
+    for (t = ent->turn; t <= turn; t++) {
+        if (off >= hdr->index_offset)
+            return -1;
+
+        if (buf[off] == HIST_REC_KEYFRAME) {
+            off++;
+            if (game_decode_image(buf + off, hdr->index_offset - off, img, &used))
+                return -1;
+            off += used;
+        } else if (buf[off] == HIST_REC_DELTA) {
+            off++;
+            n = history_apply_delta(buf + off, hdr->index_offset - off, img);
+            if (n < 0)
+                return -1;
+            off += n;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int history_seek(const char *path, long turn, struct game_image *img, long *n_turn)
+{
+    const struct history_header *hdr;
+    const unsigned char *buf;
+    off_t size;
+    FILE *fp;
+    int ret = -2;
+
+    fp = fopen(path, "rb");
+    if (!fp) {
+        game_err("fail to open %s\n", path);
+        return -1;
+    }
+
+    size = lseek(fileno(fp), 0, SEEK_END);
+    if (size < (off_t) sizeof(*hdr)) {
+        fclose(fp);
+        return -2;
+    }
+
+    buf = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    fclose(fp);
+    if (buf == MAP_FAILED)
+        return -1;
+
+    hdr = (const void *) buf;
+    if (hdr->magic != HISTORY_MAGIC || hdr->version != HISTORY_VERSION || hdr->header_size != sizeof(*hdr)
+        || hdr->index_offset < sizeof(*hdr) || hdr->index_offset % sizeof(uint64_t)
+        || hdr->index_offset + (uint64_t) hdr->n_index * sizeof(struct history_index) > (uint64_t) size) {
+        game_err("%s is not a finished history file\n", path);
+        goto out;
+    }
+
+    if (n_turn)
+        *n_turn = hdr->n_turn;
+
+    if (turn < 0 || turn >= hdr->n_turn) {
+        ret = -3;
+        goto out;
+    }
+
+    ret = history_rebuild(buf, size, hdr, turn, img) ? -2 : 0;
+    if (ret)
+        game_err("%s corrupted before turn %ld\n", path, turn);
+out:
+    munmap((void *) buf, size);
+    return ret;
+}
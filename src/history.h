@@ -0,0 +1,58 @@
+#pragma once
+#include <stdint.h>
+#include "common.h"
+#include "save.h"
+
+#define HISTORY_MAGIC           0x5453484dU /* "MHST" on little endian */
+#define HISTORY_VERSION         1
+#define HISTORY_DEFAULT_EVERY   64
+
+/*
+ * Per turn game states, a full game image every @every turns and deltas
+ * between. Deltas use the vocabulary of game_dump(): map, fund, credit, gift,
+ * userloc, barrier/bomb and nextuser, each a varint encoded op. The keyframe
+ * index at the end of file is binary searched, so seeking to any turn costs
+ * one keyframe decode plus at most @every - 1 deltas.
+ */
+struct history_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    uint32_t every;
+    uint32_t n_turn;
+    uint32_t n_index;
+    uint32_t pad;
+    /* 0 if the writer did not finish */
+    uint64_t index_offset;
+};
+
+struct history_index {
+    uint32_t turn;
+    uint32_t pad;
+    uint64_t offset;
+};
+
+struct history {
+    FILE *fp;
+    int every;
+    long n_turn;
+    /* state of last appended turn */
+    struct game_image last;
+
+    int n_index;
+    int index_cap;
+    struct history_index *index;
+};
+
+int history_create(struct history *hist, const char *path, int every);
+/* append state at the end of a turn */
+int history_append(struct history *hist, const struct game_image *img);
+/* write index and finish file */
+int history_close(struct history *hist);
+
+/*
+ * rebuild state after @turn appended turns, turn 0 is the state when
+ * recording started
+ * @return: < 0 err
+ */
+int history_seek(const char *path, long turn, struct game_image *img, long *n_turn);
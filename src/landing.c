@@ -0,0 +1,250 @@
+#include "common.h"
+#include <math.h>
+#include <pthread.h>
+#include "landing.h"
+
+#define LANDING_N_EMPTY (LANDING_MAX_EMPTY + 1)
+#define LANDING_LANES   8
+#define LANDING_ALIGN   (LANDING_LANES * sizeof(float))
+
+typedef float landing_vec __attribute__((vector_size(LANDING_ALIGN)));
+
+static struct {
+    pthread_mutex_t lock;
+    struct landing *chains;
+} g_landing = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static inline int landing_state(int node, int empty)
+{
+    return node * LANDING_N_EMPTY + empty;
+}
+
+/* zeroed, rows and vectors start on a vector */
+static float *landing_alloc(long n)
+{
+    size_t size = (n * sizeof(float) + LANDING_ALIGN - 1) / LANDING_ALIGN * LANDING_ALIGN;
+    float *p = aligned_alloc(LANDING_ALIGN, size);
+
+    if (p)
+        memset(p, 0, size);
+    return p;
+}
+
+static float landing_dot(const float *a, const float *b, int n)
+{
+    landing_vec acc = { 0 };
+    float sum = 0;
+    int i;
+
+    for (i = 0; i < n; i += LANDING_LANES)
+        acc += *(const landing_vec *) (a + i) * *(const landing_vec *) (b + i);
+    for (i = 0; i < LANDING_LANES; i++)
+        sum += acc[i];
+    return sum;
+}
+
+/* @y: chances one turn after @x */
+static void landing_step(const struct landing *l, const float *x, float *y)
+{
+    int j;
+
+    for (j = 0; j < l->n_state; j++)
+        y[j] = landing_dot(l->trans + (long) j * l->stride, x, l->stride);
+}
+
+/* @dist: where the turns of @x that walk end, @tmp: scratch of a state vector */
+static void landing_walks(const struct landing *l, const float *x, float *tmp, float *dist)
+{
+    int i, e;
+
+    memset(tmp, 0, l->stride * sizeof(float));
+    for (i = 0; i < l->n_node; i++)
+        tmp[landing_state(i, 0)] = x[landing_state(i, 0)];
+
+    landing_step(l, tmp, tmp + l->stride);
+    for (i = 0; i < l->n_node; i++) {
+        dist[i] = 0;
+        for (e = 0; e < LANDING_N_EMPTY; e++)
+            dist[i] += tmp[l->stride + landing_state(i, e)];
+    }
+}
+
+static inline void landing_add(struct landing *l, int from, int to, float p)
+{
+    l->trans[(long) to * l->stride + from] += p;
+}
+
+/* one walk of @step from @pos, as game_player_step() */
+static void landing_build_walk(struct landing *l, struct map *map, int pos, int step)
+{
+    float bomb = l->bomb_permille / 1000.0f, p = 1.0f / l->facets;
+    int n, q, hospital;
+
+    for (n = 1; n <= step; n++) {
+        q = (pos + n) % l->n_node;
+        if (bomb <= 0)
+            continue;
+
+        hospital = map_nearest_node_from(map, l->layout, q, MAP_NODE_HOSPITAL);
+        landing_add(l, landing_state(pos, 0), landing_state(hospital < 0 ? q : hospital, 3), p * bomb);
+        p *= 1 - bomb;
+    }
+
+    q = (pos + step) % l->n_node;
+    landing_add(l, landing_state(pos, 0), landing_state(q, map->nodes[q].type == MAP_NODE_PRISON ? 2 : 0), p);
+}
+
+/* @return: < 0 err */
+static int landing_build(struct landing *l)
+{
+    struct map map;
+    int pos, e, d;
+
+    if (map_init(&map, l->layout, NULL))
+        return -1;
+
+    l->n_node = map.n_used;
+    l->n_state = l->n_node * LANDING_N_EMPTY;
+    l->stride = (l->n_state + LANDING_LANES - 1) / LANDING_LANES * LANDING_LANES;
+    l->trans = landing_alloc((long) l->n_state * l->stride);
+    l->steady = landing_alloc(l->n_node);
+    if (!l->trans || !l->steady) {
+        map_free(&map);
+        return -1;
+    }
+
+    for (pos = 0; pos < l->n_node; pos++) {
+        for (e = 1; e < LANDING_N_EMPTY; e++)
+            landing_add(l, landing_state(pos, e), landing_state(pos, e - 1), 1);
+        for (d = 1; d <= l->facets; d++)
+            landing_build_walk(l, &map, pos, d);
+    }
+
+    map_free(&map);
+    return 0;
+}
+
+/* power iteration from everywhere at once, @return: < 0 err */
+static int landing_solve(struct landing *l)
+{
+    float *buf = landing_alloc(4L * l->stride), *x, *y, *t;
+    float diff;
+    int i;
+
+    if (!buf)
+        return -1;
+    x = buf;
+    y = buf + l->stride;
+
+    for (i = 0; i < l->n_node; i++)
+        x[landing_state(i, 0)] = 1.0f / l->n_node;
+
+    for (l->n_iter = 0; l->n_iter < LANDING_MAX_ITER; l->n_iter++) {
+        landing_step(l, x, y);
+        for (diff = 0, i = 0; i < l->n_state; i++)
+            diff += fabsf(y[i] - x[i]);
+
+        t = x;
+        x = y;
+        y = t;
+        if (diff < LANDING_EPSILON)
+            break;
+    }
+
+    landing_walks(l, x, buf + 2 * l->stride, l->steady);
+    free(buf);
+    return 0;
+}
+
+static void landing_free(struct landing *l)
+{
+    free(l->trans);
+    free(l->steady);
+    free(l);
+}
+
+const struct landing *landing_get(const struct map_layout *layout, int facets, int bomb_permille)
+{
+    struct landing *l;
+
+    if (!layout || facets <= 0 || bomb_permille < 0 || bomb_permille > 1000)
+        return NULL;
+
+    pthread_mutex_lock(&g_landing.lock);
+    for (l = g_landing.chains; l; l = l->next) {
+        if (l->layout == layout && l->facets == facets && l->bomb_permille == bomb_permille)
+            goto out;
+    }
+
+    l = calloc(1, sizeof(*l));
+    if (!l)
+        goto out;
+    l->layout = layout;
+    l->facets = facets;
+    l->bomb_permille = bomb_permille;
+
+    if (landing_build(l) || landing_solve(l)) {
+        landing_free(l);
+        l = NULL;
+        goto out;
+    }
+    game_dbg("landing chain of %d states, steady after %d iterations\n", l->n_state, l->n_iter);
+
+    l->next = g_landing.chains;
+    g_landing.chains = l;
+out:
+    pthread_mutex_unlock(&g_landing.lock);
+    return l;
+}
+
+int landing_after(const struct landing *l, int pos, int n_empty, int k, float *dist)
+{
+    float *x, *y, *t, *buf;
+    int i;
+
+    if (pos < 0 || pos >= l->n_node || k <= 0)
+        return -1;
+
+    buf = landing_alloc(4L * l->stride);
+    if (!buf)
+        return -1;
+    x = buf;
+    y = buf + l->stride;
+
+    x[landing_state(pos, n_empty < LANDING_MAX_EMPTY ? (n_empty > 0 ? n_empty : 0) : LANDING_MAX_EMPTY)] = 1;
+    for (i = 1; i < k; i++) {
+        landing_step(l, x, y);
+        t = x;
+        x = y;
+        y = t;
+    }
+
+    landing_walks(l, x, buf + 2 * l->stride, dist);
+    free(buf);
+    return 0;
+}
+
+int landing_bomb_permille(const struct map *map)
+{
+    int i, n_bomb = 0;
+
+    if (!map->n_used)
+        return 0;
+    for (i = 0; i < map->n_used; i++)
+        n_bomb += map->nodes[i].item == ITEM_BOMB;
+    return n_bomb * 1000 / map->n_used;
+}
+
+void landing_uninit(void)
+{
+    struct landing *l;
+
+    pthread_mutex_lock(&g_landing.lock);
+    while ((l = g_landing.chains)) {
+        g_landing.chains = l->next;
+        landing_free(l);
+    }
+    pthread_mutex_unlock(&g_landing.lock);
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include "common.h"
+#include "map.h"
+
+/* empty rounds a state tells apart, a bomb rests the longest */
+#define LANDING_MAX_EMPTY 3
+/* power iterations at most, and the change in the long run chances to stop at */
+#define LANDING_MAX_ITER  4096
+#define LANDING_EPSILON   1e-7f
+
+/*
+ * Where a player walks on a layout, as a Markov chain over places and the
+ * empty rounds still to wait. A turn waits one round off, or rolls one of
+ * @facets faces and walks: a bomb on a node passed, each with a chance of
+ * @bomb_permille, sends it to the nearest hospital for 3 rounds, a prison
+ * holds it for 2. Nothing else moves a player.
+ *
+ * The chain is built once per layout, facets and bomb rate and kept until
+ * landing_uninit(), so asking again costs nothing. Matrix and vectors are
+ * laid out for vectorized products.
+ */
+struct landing {
+    struct landing *next;
+    const struct map_layout *layout;
+    int facets;
+    int bomb_permille;
+
+    int n_node;
+    /* states are node * (LANDING_MAX_EMPTY + 1) + empty, rows padded */
+    int n_state;
+    int stride;
+    /* row j holds the chances of moving from every state to state j */
+    float *trans;
+
+    /* chance of a turn in the long run to end its walk on each node */
+    float *steady;
+    int n_iter;
+};
+
+/* @return: the chain, NULL err */
+const struct landing *landing_get(const struct map_layout *layout, int facets, int bomb_permille);
+/*
+ * Chance of the walk of the @k-th turn from now (1 for the next) to end on
+ * each node, starting on @pos with @n_empty rounds to wait. @dist: n_node
+ * entries. @return: < 0 err
+ */
+int landing_after(const struct landing *landing, int pos, int n_empty, int k, float *dist);
+/* bombs lying on @map per mille of its nodes, the rate to get a chain of */
+int landing_bomb_permille(const struct map *map);
+/* drop the cache */
+void landing_uninit(void);
@@ -0,0 +1,113 @@
+#include "common.h"
+#include "liquidate.h"
+#include "landing.h"
+
+/* kept sale price breaks ties between sets keeping the same toll */
+#define LIQUIDATE_TIE 1e-9
+
+static int liquidate_gcd(int a, int b)
+{
+    int t;
+
+    while (b) {
+        t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static int liquidate_n_opponents(struct game *game, struct player *self)
+{
+    struct player *player;
+    int n = 0;
+
+    for_each_player_begin(game, player) {
+        if (player != self && player->attached && !player->stat.bankrupt)
+            n++;
+    } for_each_player_end();
+    return n;
+}
+
+/* @return: < 0 err */
+static int liquidate_solve(int n, const int *weight, const double *value, int cap, char *sell)
+{
+    double *best = calloc(cap + 1, sizeof(*best));
+    char *keep = calloc((size_t) n * (cap + 1), 1);
+    int i, c;
+
+    if (!best || !keep) {
+        free(best);
+        free(keep);
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        for (c = cap; c >= weight[i]; c--) {
+            if (best[c - weight[i]] + value[i] > best[c]) {
+                best[c] = best[c - weight[i]] + value[i];
+                keep[(size_t) i * (cap + 1) + c] = 1;
+            }
+        }
+    }
+
+    for (c = cap, i = n - 1; i >= 0; i--) {
+        sell[i] = !keep[(size_t) i * (cap + 1) + c];
+        if (!sell[i])
+            c -= weight[i];
+    }
+
+    free(best);
+    free(keep);
+    return 0;
+}
+
+int liquidate_plan(struct game *game, struct player *player, int debt, int *picks)
+{
+    const struct landing *landing;
+    struct map_node *node;
+    int idx[MAP_MAX_NODE], sale[MAP_MAX_NODE], weight[MAP_MAX_NODE];
+    double value[MAP_MAX_NODE], rate;
+    char sell[MAP_MAX_NODE];
+    int i, n = 0, n_pick = 0, unit = 0, n_opp, cap;
+    long total = 0;
+
+    if (debt <= 0)
+        return 0;
+
+    landing = landing_get(game->cur_layout, game->dice_facets, landing_bomb_permille(&game->map));
+    if (landing && landing->n_node != game->map.n_used)
+        landing = NULL;
+    n_opp = liquidate_n_opponents(game, player);
+
+    list_for_each_entry(node, &player->asset.estates, estate.estates_list) {
+        if (n >= MAP_MAX_NODE)
+            break;
+        idx[n] = node->idx;
+        sale[n] = 2 * map_node_price(node);
+        /* tolls a turn, any spot alike if the chain is missing */
+        rate = landing ? landing->steady[node->idx] : 1.0 / game->map.n_used;
+        value[n] = rate * n_opp * (map_node_price(node) / 2) + LIQUIDATE_TIE * sale[n];
+        unit = liquidate_gcd(unit, sale[n]);
+        total += sale[n];
+        n++;
+    }
+    if (total < debt)
+        return -1;
+
+    /* money to keep back in estates, in units, kept ones rounded up to stay within */
+    cap = total - debt;
+    if (unit <= 0 || cap / unit > LIQUIDATE_MAX_CAP)
+        unit = (cap + LIQUIDATE_MAX_CAP - 1) / LIQUIDATE_MAX_CAP;
+    for (i = 0; i < n; i++)
+        weight[i] = (sale[i] + unit - 1) / unit;
+
+    if (liquidate_solve(n, weight, value, cap / unit, sell))
+        return -1;
+
+    for (i = 0; i < n; i++) {
+        if (sell[i])
+            picks[n_pick++] = idx[i];
+    }
+    return n_pick;
+}
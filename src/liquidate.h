@@ -0,0 +1,17 @@
+#pragma once
+#include "common.h"
+#include "game.h"
+
+/* knapsack capacity in units at most, sale prices get coarser past it */
+#define LIQUIDATE_MAX_CAP 4096
+
+/*
+ * Estates @player sells to pay a debt of @debt, the set that raises enough
+ * at 2 * map_node_price() while keeping the most expected toll: an estate
+ * earns its toll as often as the landing chain (landing.h) brings one of
+ * the opponents onto it. A 0/1 knapsack over the estates kept.
+ *
+ * @picks: map idx to sell, at least MAP_MAX_NODE entries
+ * @return: < 0 err or not enough to sell, else number of picks
+ */
+int liquidate_plan(struct game *game, struct player *player, int debt, int *picks);
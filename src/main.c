@@ -1,6 +1,11 @@
-#include <signal.h>
 #include "common.h"
+#include <unistd.h>
 #include "game.h"
+#include "checkpoint.h"
+#include "server.h"
+#include "search.h"
+#include "winprob.h"
+#include "landing.h"
 
 #ifdef GAME_DEBUG
 int g_game_dbg = 1;
@@ -9,34 +14,120 @@ int g_game_dbg = 0;
 #endif
 
 static struct game g_game;
+static struct checkpoint g_checkpoint;
 struct game_events g_game_events = {0};
 
-void handle_winch(int sig)
+/* MONOPOLY_CHECKPOINT=FILE enables checkpoints, every MONOPOLY_CHECKPOINT_TURNS turns */
+static void setup_checkpoint(struct game *game)
 {
-    g_game_events.event_winch = 1;
+    const char *path = getenv("MONOPOLY_CHECKPOINT");
+    const char *turns = getenv("MONOPOLY_CHECKPOINT_TURNS");
+
+    if (!path || !path[0])
+        return;
+
+    if (checkpoint_init(&g_checkpoint, path, turns ? atoi(turns) : 0)) {
+        game_err("fail to init checkpoint %s\n", path);
+        return;
+    }
+
+    if (checkpoint_restore(&g_checkpoint, game))
+        game_dbg("no checkpoint to restore from %s\n", path);
+    game->checkpoint = &g_checkpoint;
+}
+
+static long g_turn_deadline_ms;
+static long g_prompt_deadline_ms;
+
+/* MONOPOLY_TURN_DEADLINE_MS and MONOPOLY_PROMPT_DEADLINE_MS, unset or 0 waits forever */
+static void setup_deadline(void)
+{
+    const char *turn = getenv("MONOPOLY_TURN_DEADLINE_MS");
+    const char *prompt = getenv("MONOPOLY_PROMPT_DEADLINE_MS");
+
+    if (turn && atol(turn) > 0)
+        g_turn_deadline_ms = atol(turn);
+    if (prompt && atol(prompt) > 0)
+        g_prompt_deadline_ms = atol(prompt);
+}
+
+/* MONOPOLY_SEARCH_THREADS workers search for mcts and expectimax seats, unset for one per cpu */
+static void setup_search(void)
+{
+    const char *threads = getenv("MONOPOLY_SEARCH_THREADS");
+
+    if (threads && atoi(threads) > 0)
+        search_set_threads(atoi(threads));
+}
+
+/*
+ * MONOPOLY_WINPROB_THREADS threads estimate win chances while waiting for
+ * input, 0 for none. Unset, nothing runs in the background and the winprob
+ * command runs a few threads on demand.
+ */
+static void setup_winprob(void)
+{
+    const char *threads = getenv("MONOPOLY_WINPROB_THREADS");
+
+    if (threads)
+        winprob_set_threads(atoi(threads), 1);
+    else
+        winprob_set_threads(WINPROB_DEFAULT_THREADS, 0);
 }
 
-void handle_term(int sig)
+/* MONOPOLY_SERVER=unix:PATH or tcp:PORT hosts one game per connection instead */
+static int run_server(const char *addr)
 {
-    g_game_events.event_term = sig;
+    static struct server server;
+    int ret;
+
+    if (server_init(&server, addr)) {
+        game_err("fail to start server on %s\n", addr);
+        return -1;
+    }
+    server.turn_deadline_ms = g_turn_deadline_ms;
+    server.prompt_deadline_ms = g_prompt_deadline_ms;
+
+    ret = server_run(&server);
+    server_uninit(&server);
+    search_uninit();
+    winprob_uninit();
+    landing_uninit();
+    return ret;
 }
 
 int main(void)
 {
-    struct  sigaction winch_act = { .sa_handler = handle_winch };
-    struct  sigaction term_act = { .sa_handler = handle_term };
+    const char *server_addr = getenv("MONOPOLY_SERVER");
+    if (game_events_init(&g_game_events)) {
+        game_err("fail to init signal events\n");
+        return -1;
+    }
 
-    sigaction(SIGWINCH, &winch_act, NULL);
-    sigaction(SIGINT, &term_act, NULL);
-    sigaction(SIGTERM, &term_act, NULL);
+    setup_deadline();
+    setup_search();
+    setup_winprob();
+    if (server_addr && server_addr[0])
+        return run_server(server_addr) ? 1 : 0;
 
     if (game_init(&g_game)) {
         game_err("fail to init game\n");
         return -1;
     }
 
+    setup_checkpoint(&g_game);
+    g_game.turn_deadline_ms = g_turn_deadline_ms;
+    g_game.prompt_deadline_ms = g_prompt_deadline_ms;
     game_event_loop(&g_game);
 
+    /* final state, so a clean restart resumes where it stopped */
+    if (g_game.checkpoint)
+        checkpoint_submit(g_game.checkpoint, &g_game);
+    checkpoint_uninit(&g_checkpoint);
+    search_uninit();
+    winprob_uninit();
+    landing_uninit();
+
     game_exit(&g_game);
     return 0;
 }
@@ -1,10 +1,142 @@
 #include "common.h"
 #include "player.h"
 #include "map.h"
+#include "arena.h"
+#include "track.h"
+
+#define ITEM_BLOCK_PRICE    50
+#define ITEM_BOMB_PRICE     50
+#define ITEM_ROBOT_PRICE    30
+
+#define MAP_DEFAULT_ITEMS {                                             \
+    .info = {                                                           \
+        {.type = ITEM_BLOCK, .on_sell = 1, .price = ITEM_BLOCK_PRICE},  \
+        {.type = ITEM_BOMB,  .on_sell = 0, .price = ITEM_BOMB_PRICE},   \
+        {.type = ITEM_ROBOT, .on_sell = 1, .price = ITEM_ROBOT_PRICE},  \
+    }                                                                   \
+}
+
+#define MAP_DEFAULT_GIFTS {                                                                         \
+    .n_gifts = GIFT_MAX,                                                                            \
+    .gifts = {                                                                                      \
+        [GIFT_MONEY] = { .value = 2000, .name = "Bonus Cash",    .grant = player_grant_gift_money },\
+        [GIFT_POINT] = { .value = 200,  .name = "Point Card",    .grant = player_grant_gift_point },\
+        [GIFT_GOD]   = { .value = 5,    .name = "God of Wealth", .grant = player_grant_gift_god },  \
+    }                                                                                               \
+}
+
+/*
+ * Built-in layouts are expanded into node arrays at compile time, map_init() only copies them.
+ * MAP_REPn(F, i, a) expands F(i, a), F(i + 1, a), ..., F(i + n - 1, a).
+ */
+#define MAP_REP1(F, i, a)   F(i, a)
+#define MAP_REP2(F, i, a)   MAP_REP1(F, i, a), MAP_REP1(F, (i) + 1, a)
+#define MAP_REP4(F, i, a)   MAP_REP2(F, i, a), MAP_REP2(F, (i) + 2, a)
+#define MAP_REP8(F, i, a)   MAP_REP4(F, i, a), MAP_REP4(F, (i) + 4, a)
+#define MAP_REP16(F, i, a)  MAP_REP8(F, i, a), MAP_REP8(F, (i) + 8, a)
+
+#define MAP_NODE_TPL(pos, tp, ...) \
+    [pos] = { .idx = (pos), .type = (tp), .item = ITEM_INVALID, __VA_ARGS__ }
+
+#define MAP_ESTATE_TPL(pos, area_price) \
+    MAP_NODE_TPL(pos, MAP_NODE_VACANCY, .estate = { .price = (area_price), .level = ESTATE_WASTELAND })
+
+#define MAP_MINE_TPL(pos, points) \
+    MAP_NODE_TPL(pos, MAP_NODE_MINE, .mine_points = (points))
+
+/* 13 and 6 estates between special nodes of the default layouts */
+#define MAP_ESTATE_RUN13(pos, price) \
+    MAP_REP8(MAP_ESTATE_TPL, pos, price), MAP_REP4(MAP_ESTATE_TPL, (pos) + 8, price), MAP_ESTATE_TPL((pos) + 12, price)
+#define MAP_ESTATE_RUN6(pos, price) \
+    MAP_REP4(MAP_ESTATE_TPL, pos, price), MAP_REP2(MAP_ESTATE_TPL, (pos) + 4, price)
+
+/* item house must agree with MAP_DEFAULT_ITEMS, checked by map_verify_prebuilt() */
+#define MAP_DEFAULT_ITEM_HOUSE { .n_on_sell = 2, .min_price = ITEM_ROBOT_PRICE, .items = MAP_DEFAULT_ITEMS }
+
+#define MAP_DEFAULT_NODES(prison_type)                                                      \
+    MAP_NODE_TPL(START_POS, MAP_NODE_START),                                                \
+    MAP_ESTATE_RUN13(START_POS + 1, AREA_1_PRICE),                                          \
+    MAP_NODE_TPL(HOSPITAL_POS, MAP_NODE_HOSPITAL),                                          \
+    MAP_ESTATE_RUN13(HOSPITAL_POS + 1, AREA_1_PRICE),                                       \
+    MAP_NODE_TPL(ITEM_HOUSE_POS, MAP_NODE_ITEM_HOUSE, .item_house = MAP_DEFAULT_ITEM_HOUSE),\
+    MAP_ESTATE_RUN6(ITEM_HOUSE_POS + 1, AREA_2_PRICE),                                      \
+    MAP_NODE_TPL(GIFT_HOUSE_POS, MAP_NODE_GIFT_HOUSE, .gift_house = MAP_DEFAULT_GIFTS),     \
+    MAP_ESTATE_RUN13(GIFT_HOUSE_POS + 1, AREA_3_PRICE),                                     \
+    MAP_NODE_TPL(PRISON_POS, prison_type),                                                  \
+    MAP_ESTATE_RUN13(PRISON_POS + 1, AREA_3_PRICE),                                         \
+    MAP_NODE_TPL(MAGIC_HOUSE_POS, MAP_NODE_MAGIC_HOUSE),                                    \
+    MAP_MINE_TPL(64, 60), MAP_MINE_TPL(65, 80), MAP_MINE_TPL(66, 40),                       \
+    MAP_MINE_TPL(67, 100), MAP_MINE_TPL(68, 80), MAP_MINE_TPL(69, 20)
+
+#define MAP_DEFAULT_WIDTH   29
+#define MAP_DEFAULT_HEIGHT  (2 + (MAP_SIZE - MAP_DEFAULT_WIDTH * 2) / 2)
+
+/* same walk as the runtime fallback in map_screen_pos() */
+#define MAP_SCREEN_POS(line, col)                                       \
+    ((line) == 0 ? (col) :                                              \
+     (line) == MAP_DEFAULT_HEIGHT - 1 ? MAP_SIZE - (MAP_DEFAULT_HEIGHT - 1) - (col) : \
+     (col) == 0 ? MAP_SIZE - (line) :                                   \
+     (col) == MAP_DEFAULT_WIDTH - 1 ? MAP_DEFAULT_WIDTH + (line) - 1 : -1)
+
+#define MAP_SCREEN_TPL(col, line) \
+    [(line) * MAP_DEFAULT_WIDTH + (col)] = MAP_SCREEN_POS(line, col)
+
+#define MAP_SCREEN_ROW(line)                                \
+    MAP_REP16(MAP_SCREEN_TPL, 0, line), MAP_REP8(MAP_SCREEN_TPL, 16, line), \
+    MAP_REP4(MAP_SCREEN_TPL, 24, line), MAP_SCREEN_TPL(28, line)
+
+static const struct map_node g_default_nodes_v1[MAP_SIZE] = {
+    MAP_DEFAULT_NODES(MAP_NODE_PRISON),
+};
+
+static const struct map_node g_default_nodes_v2[MAP_SIZE] = {
+    MAP_DEFAULT_NODES(MAP_NODE_PARK),
+};
+
+static const int g_default_nearest_hospital[MAP_SIZE] = {
+    [0 ... HOSPITAL_POS - 1] = HOSPITAL_POS,
+    /* search never returns the node it starts from */
+    [HOSPITAL_POS] = -1,
+    [HOSPITAL_POS + 1 ... MAP_SIZE - 1] = HOSPITAL_POS,
+};
+
+static const signed char g_default_area[MAP_SIZE] = {
+    [START_POS ... ITEM_HOUSE_POS - 1] = 0,
+    [ITEM_HOUSE_POS ... GIFT_HOUSE_POS - 1] = 1,
+    [GIFT_HOUSE_POS ... MAGIC_HOUSE_POS] = 2,
+    [MAGIC_HOUSE_POS + 1 ... MAP_SIZE - 1] = -1,
+};
+
+static const short g_default_screen[MAP_DEFAULT_WIDTH * MAP_DEFAULT_HEIGHT] = {
+    MAP_SCREEN_ROW(0), MAP_SCREEN_ROW(1), MAP_SCREEN_ROW(2), MAP_SCREEN_ROW(3),
+    MAP_SCREEN_ROW(4), MAP_SCREEN_ROW(5), MAP_SCREEN_ROW(6), MAP_SCREEN_ROW(7),
+};
+
+_Static_assert(MAP_DEFAULT_HEIGHT == 8, "default screen table expects 8 rows");
+
+static const struct map_prebuilt g_default_prebuilt_v1 = {
+    .n_node = MAP_SIZE,
+    .width = MAP_DEFAULT_WIDTH,
+    .height = MAP_DEFAULT_HEIGHT,
+    .nodes = g_default_nodes_v1,
+    .nearest_hospital = g_default_nearest_hospital,
+    .area = g_default_area,
+    .screen = g_default_screen,
+};
+
+static const struct map_prebuilt g_default_prebuilt_v2 = {
+    .n_node = MAP_SIZE,
+    .width = MAP_DEFAULT_WIDTH,
+    .height = MAP_DEFAULT_HEIGHT,
+    .nodes = g_default_nodes_v2,
+    .nearest_hospital = g_default_nearest_hospital,
+    .area = g_default_area,
+    .screen = g_default_screen,
+};
 
 const struct map_layout g_default_map_layout_v1 = {
-    .map_size = 70,
-    .map_width = 29,
+    .map_size = MAP_SIZE,
+    .map_width = MAP_DEFAULT_WIDTH,
 
     .n_start = 1,
     .n_hospital = 1,
@@ -20,21 +152,8 @@ const struct map_layout g_default_map_layout_v1 = {
     .pos_prison = {PRISON_POS},
     .pos_magic_house = {MAGIC_HOUSE_POS},
 
-    .items = {
-        .info = {
-            {.type = ITEM_BLOCK, .on_sell = 1, .price = 50},
-            {.type = ITEM_BOMB,  .on_sell = 0, .price = 50},
-            {.type = ITEM_ROBOT, .on_sell = 1, .price = 30},
-        }
-    },
-    .gifts = {
-        .n_gifts = GIFT_MAX,
-        .gifts = {
-            [GIFT_MONEY] = { .value = 2000, .name = "Bonus Cash",    .grant = player_grant_gift_money },
-            [GIFT_POINT] = { .value = 200,  .name = "Point Card",    .grant = player_grant_gift_point },
-            [GIFT_GOD]   = { .value = 5,    .name = "God of Wealth", .grant = player_grant_gift_god },
-        }
-    },
+    .items = MAP_DEFAULT_ITEMS,
+    .gifts = MAP_DEFAULT_GIFTS,
 
     .n_area = 3,
     .areas = {
@@ -46,11 +165,13 @@ const struct map_layout g_default_map_layout_v1 = {
     .n_mine = 6,
     .pos_mine = {64, 65, 66, 67, 68, 69},
     .points_mine = {60, 80, 40, 100, 80, 20},
+
+    .prebuilt = &g_default_prebuilt_v1,
 };
 
 const struct map_layout g_default_map_layout_v2 = {
-    .map_size = 70,
-    .map_width = 29,
+    .map_size = MAP_SIZE,
+    .map_width = MAP_DEFAULT_WIDTH,
 
     .n_start = 1,
     .n_hospital = 1,
@@ -68,21 +189,8 @@ const struct map_layout g_default_map_layout_v2 = {
     .pos_park = {PRISON_POS},
     .pos_magic_house = {MAGIC_HOUSE_POS},
 
-    .items = {
-        .info = {
-            {.type = ITEM_BLOCK, .on_sell = 1, .price = 50},
-            {.type = ITEM_BOMB,  .on_sell = 0, .price = 50},
-            {.type = ITEM_ROBOT, .on_sell = 1, .price = 30},
-        }
-    },
-    .gifts = {
-        .n_gifts = GIFT_MAX,
-        .gifts = {
-            [GIFT_MONEY] = { .value = 2000, .name = "Bonus Cash",    .grant = player_grant_gift_money },
-            [GIFT_POINT] = { .value = 200,  .name = "Point Card",    .grant = player_grant_gift_point },
-            [GIFT_GOD]   = { .value = 5,    .name = "God of Wealth", .grant = player_grant_gift_god },
-        }
-    },
+    .items = MAP_DEFAULT_ITEMS,
+    .gifts = MAP_DEFAULT_GIFTS,
 
     .n_area = 3,
     .areas = {
@@ -94,6 +202,8 @@ const struct map_layout g_default_map_layout_v2 = {
     .n_mine = 6,
     .pos_mine = {64, 65, 66, 67, 68, 69},
     .points_mine = {60, 80, 40, 100, 80, 20},
+
+    .prebuilt = &g_default_prebuilt_v2,
 };
 
 const struct map_layout *g_default_map_layout = &g_default_map_layout_v2;
@@ -110,13 +220,41 @@ void map_set_default_layout(enum map_layout_ver ver)
     }
 }
 
-static int map_alloc(struct map *map, int n_node)
+const struct map_layout *map_get_layout(int ver)
+{
+    switch (ver) {
+    case MAP_LAYOUT_V1:
+        return &g_default_map_layout_v1;
+    case MAP_LAYOUT_V2:
+        return &g_default_map_layout_v2;
+    }
+    return NULL;
+}
+
+/* @return: < 0 if not a built-in layout */
+int map_layout_ver(const struct map_layout *layout)
+{
+    if (layout == &g_default_map_layout_v1)
+        return MAP_LAYOUT_V1;
+    if (layout == &g_default_map_layout_v2)
+        return MAP_LAYOUT_V2;
+    return -1;
+}
+
+/* arena backed map always takes full capacity, so map_reset() never allocates again */
+static int map_alloc(struct map *map, int n_node, struct arena *arena)
 {
     if (n_node <= 0 || n_node > MAP_MAX_NODE)
         return -1;
 
-    map->n_node = n_node;
-    map->nodes = calloc(n_node, sizeof(struct map_node));
+    if (arena) {
+        map->n_node = MAP_MAX_NODE;
+        map->nodes = arena_calloc(arena, MAP_MAX_NODE, sizeof(struct map_node));
+        map->arena = arena;
+    } else {
+        map->n_node = n_node;
+        map->nodes = calloc(n_node, sizeof(struct map_node));
+    }
 
     if (!map->nodes) {
         return -2;
@@ -130,10 +268,11 @@ void map_free(struct map *map)
     map->n_used = 0;
     map->n_node = 0;
 
-    if (map->nodes) {
+    if (map->nodes && !map->arena)
         free(map->nodes);
-        map->nodes = NULL;
-    }
+
+    map->nodes = NULL;
+    map->arena = NULL;
 }
 
 static void map_node_init(struct map_node *node, int idx, enum node_type type, const void *priv)
@@ -273,23 +412,128 @@ static int map_fill_layout(struct map *map, const struct map_layout *layout)
     return 0;
 }
 
-int map_init(struct map *map, const struct map_layout *layout)
+static void map_copy_prebuilt(struct map *map, const struct map_prebuilt *prebuilt)
+{
+    int i;
+    struct map_node *node;
+
+    memcpy(map->nodes, prebuilt->nodes, prebuilt->n_node * sizeof(struct map_node));
+    for (i = 0; i < prebuilt->n_node; i++) {
+        node = &map->nodes[i];
+        INIT_LIST_HEAD(&node->players);
+        if (node->type == MAP_NODE_VACANCY)
+            INIT_LIST_HEAD(&node->estate.estates_list);
+    }
+
+    map->n_used = prebuilt->n_node;
+    map->width = prebuilt->width;
+    map->height = prebuilt->height;
+    map->prebuilt = prebuilt;
+}
+
+#ifdef GAME_DEBUG
+static int map_gift_house_differs(const struct gift_house *a, const struct gift_house *b)
+{
+    int i;
+
+    if (a->n_gifts != b->n_gifts)
+        return 1;
+
+    for (i = 0; i < a->n_gifts; i++) {
+        if (a->gifts[i].value != b->gifts[i].value || a->gifts[i].grant != b->gifts[i].grant)
+            return 1;
+    }
+    return 0;
+}
+
+/* compile-time nodes must be what map_fill_layout() would have built */
+static int map_verify_prebuilt(const struct map *map, const struct map_layout *layout)
+{
+    struct map tmp = {0};
+    struct map_node *a, *b;
+    int i, ret = 0;
+
+    if (map_alloc(&tmp, layout->map_size, NULL) || map_fill_layout(&tmp, layout)) {
+        map_free(&tmp);
+        return -1;
+    }
+
+    if (tmp.width != map->width || tmp.height != map->height) {
+        game_err("prebuilt map %ux%u, layout %ux%u\n", map->width, map->height, tmp.width, tmp.height);
+        ret = -1;
+    }
+
+    for (i = 0; i < tmp.n_used; i++) {
+        a = &map->nodes[i];
+        b = &tmp.nodes[i];
+
+        if (a->idx != b->idx || a->type != b->type || a->item != b->item
+            || map_nearest_node_from(map, layout, i, MAP_NODE_HOSPITAL)
+               != map_nearest_node_from(&tmp, layout, i, MAP_NODE_HOSPITAL)
+            || map_area_idx(map, layout, i) != map_area_idx(&tmp, layout, i)) {
+            game_err("prebuilt node %d differs from layout\n", i);
+            ret = -1;
+            continue;
+        }
+
+        if ((a->type == MAP_NODE_VACANCY && a->estate.price != b->estate.price)
+            || (a->type == MAP_NODE_MINE && a->mine_points != b->mine_points)
+            || (a->type == MAP_NODE_ITEM_HOUSE && memcmp(&a->item_house, &b->item_house, sizeof(a->item_house)))
+            || (a->type == MAP_NODE_GIFT_HOUSE && map_gift_house_differs(&a->gift_house, &b->gift_house))) {
+            game_err("prebuilt node %d content differs from layout\n", i);
+            ret = -1;
+        }
+    }
+
+    map_free(&tmp);
+    return ret;
+}
+#else
+static inline int map_verify_prebuilt(const struct map *map, const struct map_layout *layout)
+{
+    (void) map;
+    (void) layout;
+    return 0;
+}
+#endif
+
+static int map_load_layout(struct map *map, const struct map_layout *layout)
+{
+    int ret;
+
+    map->prebuilt = NULL;
+    map->dirty = 0;
+
+    if (layout->prebuilt && layout->prebuilt->n_node == layout->map_size) {
+        map_copy_prebuilt(map, layout->prebuilt);
+        if (!map_verify_prebuilt(map, layout))
+            return 0;
+        /* stale table, build from the layout as if there were none */
+        game_err("prebuilt map does not match layout\n");
+        map->prebuilt = NULL;
+    }
+
+    ret = map_fill_layout(map, layout);
+    if (ret)
+        game_err("fail to fill map layout\n");
+    return ret;
+}
+
+int map_init(struct map *map, const struct map_layout *layout, struct arena *arena)
 {
     int ret;
 
     memset(map, 0, sizeof(*map));
 
-    ret = map_alloc(map, layout->map_size);
+    ret = map_alloc(map, layout->map_size, arena);
     if (ret) {
         game_err("fail to alloc %d map node(s)\n", layout->map_size);
         goto out;
     }
 
-    ret = map_fill_layout(map, layout);
-    if (ret) {
-        game_err("fail to fill map layout\n");
+    ret = map_load_layout(map, layout);
+    if (ret)
         goto out_free;
-    }
 
     return 0;
 
@@ -299,9 +543,27 @@ out:
     return ret;
 }
 
+/* reload layout into already allocated nodes, players must be detached */
+int map_reset(struct map *map, const struct map_layout *layout)
+{
+    struct arena *arena = map->arena;
+
+    struct track *track = map->track;
+    int ret;
+
+    if (!map->nodes || map->n_node < layout->map_size) {
+        map_free(map);
+        ret = map_init(map, layout, arena);
+        map->track = track;
+        return ret;
+    }
+
+    return map_load_layout(map, layout);
+}
+
 int map_init_default(struct map *map)
 {
-    return map_init(map, g_default_map_layout);
+    return map_init(map, g_default_map_layout, NULL);
 }
 
 int map_attach_player(struct map *map, struct player *player)
@@ -315,7 +577,7 @@ int map_attach_player(struct map *map, struct player *player)
 
     node = &map->nodes[player->pos];
     list_add(&player->pos_list, &node->players);
-    player->attached = 1;
+    track_set(map->track, TRACK_PLAYER_ATTACHED, player->idx, player->attached, 1);
 
     map->dirty = 1;
     return 0;
@@ -335,7 +597,7 @@ int map_detach_player(struct map *map, struct player *player)
         return -1;
 
     list_del_init(&player->pos_list);
-    player->attached = 0;
+    track_set(map->track, TRACK_PLAYER_ATTACHED, player->idx, player->attached, 0);
 
     map->dirty = 1;
     return 0;
@@ -343,17 +605,18 @@ int map_detach_player(struct map *map, struct player *player)
 
 int map_move_player(struct map *map, struct player *player, int pos)
 {
-    int ret;
-
     if (pos < 0 || pos >= map->n_used)
         return -1;
+    if (!player->attached)
+        return -1;
 
-    ret = map_detach_player(map, player);
-    if (ret)
-        return ret;
+    /* stays attached, only pos is changed */
+    list_del_init(&player->pos_list);
+    track_set(map->track, TRACK_PLAYER_POS, player->idx, player->pos, pos);
+    list_add(&player->pos_list, &map->nodes[pos].players);
 
-    player->pos = pos;
-    return map_attach_player(map, player);
+    map->dirty = 1;
+    return 0;
 }
 
 int map_place_item(struct map *map, int pos, enum item_type item, struct player *owner)
@@ -367,9 +630,12 @@ int map_place_item(struct map *map, int pos, enum item_type item, struct player
         return -1;
 
     node = &map->nodes[pos];
+    track_update(map->track, TRACK_NODE_ITEM, pos, TRACK_ITEM_ID(node->item), TRACK_ITEM_ID(item));
     node->item = item;
-    if (owner)
+    if (owner) {
+        track_update(map->track, TRACK_NODE_ITEM_OWNER, pos, TRACK_PLAYER_ID(node->item_owner), TRACK_PLAYER_ID(owner));
         node->item_owner = owner;
+    }
 
     map->dirty = 1;
     return 0;
@@ -384,9 +650,11 @@ int map_clear_item(struct map *map, int pos)
 
     node = &map->nodes[pos];
     if (node->item != ITEM_INVALID) {
+        track_update(map->track, TRACK_NODE_ITEM, pos, TRACK_ITEM_ID(node->item), 0);
         node->item = ITEM_INVALID;
         map->dirty = 1;
     }
+    track_update(map->track, TRACK_NODE_ITEM_OWNER, pos, TRACK_PLAYER_ID(node->item_owner), 0);
     node->item_owner = NULL;
     return 0;
 }
@@ -418,9 +686,64 @@ int map_set_owner(struct map *map, int pos, struct player *owner)
         return -1;
     }
 
-    if (owner != node->estate.owner) {
-        node->estate.owner = owner;
+    return map_change_owner(map, pos, owner);
+}
+
+int map_change_owner(struct map *map, int pos, struct player *owner)
+{
+    struct map_node *node;
+
+    if (pos < 0 || pos >= map->n_used)
+        return -1;
+
+    node = &map->nodes[pos];
+    if (node->type != MAP_NODE_VACANCY)
+        return -1;
+    if (node->estate.owner == owner)
+        return 0;
+
+    track_update(map->track, TRACK_NODE_OWNER, pos, TRACK_PLAYER_ID(node->estate.owner), TRACK_PLAYER_ID(owner));
+    if (node->estate.owner)
+        list_del_init(&node->estate.estates_list);
+
+    node->estate.owner = owner;
+    if (owner)
         list_add_tail(&node->estate.estates_list, &owner->asset.estates);
+
+    map->dirty = 1;
+    return 0;
+}
+
+int map_clear_owner(struct map *map, int pos)
+{
+    struct map_node *node;
+
+    if (pos < 0 || pos >= map->n_used)
+        return -1;
+
+    node = &map->nodes[pos];
+    if (node->type != MAP_NODE_VACANCY)
+        return -1;
+
+    map_change_owner(map, pos, NULL);
+    return map_set_level(map, pos, ESTATE_WASTELAND);
+}
+
+int map_set_level(struct map *map, int pos, enum estate_level level)
+{
+    struct map_node *node;
+
+    if (pos < 0 || pos >= map->n_used)
+        return -1;
+    if (level < ESTATE_WASTELAND || level >= ESTATE_MAX)
+        return -1;
+
+    node = &map->nodes[pos];
+    if (node->type != MAP_NODE_VACANCY)
+        return -1;
+
+    if (node->estate.level != level) {
+        track_set(map->track, TRACK_NODE_LEVEL, pos, node->estate.level, level);
         map->dirty = 1;
     }
     return 0;
@@ -435,6 +758,9 @@ int map_nearest_node_from(const struct map *map, const struct map_layout *layout
     if (from < 0 || from >= map->n_used)
         return -1;
 
+    if (type == MAP_NODE_HOSPITAL && map->prebuilt)
+        return map->prebuilt->nearest_hospital[from];
+
     if (layout->map_size != map->n_used) {
         game_err("layout size %d and map size %d not match\n", layout->map_size, map->n_used);
         return -1;
@@ -457,6 +783,43 @@ int map_nearest_node_from(const struct map *map, const struct map_layout *layout
     return -1;
 }
 
+int map_area_idx(const struct map *map, const struct map_layout *layout, int pos)
+{
+    int i;
+
+    if (pos < 0 || pos >= map->n_used)
+        return -1;
+
+    if (map->prebuilt)
+        return map->prebuilt->area[pos];
+
+    for (i = 0; i < MAP_MAX_AREA && i < layout->n_area; i++) {
+        if (pos >= layout->areas[i].pos_start && pos < layout->areas[i].pos_end)
+            return i;
+    }
+    return -1;
+}
+
+/* @return: node idx drawn at screen cell, -1 if blank */
+int map_screen_pos(const struct map *map, unsigned int line, unsigned int col)
+{
+    if (line >= map->height || col >= map->width)
+        return -1;
+
+    if (map->prebuilt)
+        return map->prebuilt->screen[line * map->width + col];
+
+    if (line == 0)
+        return col;
+    if (line == map->height - 1)
+        return map->n_used - (map->height - 1) - col;
+    if (col == 0)
+        return map->n_used - line;
+    if (col == map->width - 1)
+        return map->width + (line - 1);
+    return -1;
+}
+
 int map_node_price(struct map_node *node)
 {
     if (node->type != MAP_NODE_VACANCY)
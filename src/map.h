@@ -108,14 +108,24 @@ struct map_node {
 #define MAP_MIN_WIDTH   2
 #define MAP_MIN_HEIGHT  2
 
+struct map_prebuilt;
+
 struct map {
     int n_node;
     int n_used;
     struct map_node *nodes;
+    /* owner of nodes, NULL if nodes are from calloc */
+    struct arena *arena;
+
+    /* compile-time tables of a built-in layout, NULL if filled at runtime */
+    const struct map_prebuilt *prebuilt;
 
     /* need re-draw */
     int dirty;
 
+    /* optional, state hash of the game owning this map, kept across map_reset() */
+    struct track *track;
+
     /* corner is counted in both w/h */
     unsigned int width;
     unsigned int height;
@@ -163,6 +173,24 @@ struct map_layout {
 
     int n_area;
     struct map_area areas[MAP_MAX_AREA];
+
+    /* optional, nodes and lookup tables generated at compile time */
+    const struct map_prebuilt *prebuilt;
+};
+
+struct map_prebuilt {
+    int n_node;
+    unsigned int width;
+    unsigned int height;
+    /* list heads are left zeroed, fixed up after copy */
+    const struct map_node *nodes;
+
+    /* nearest hospital of each node, -1 if none */
+    const int *nearest_hospital;
+    /* index into layout areas of each node, -1 if not in any area */
+    const signed char *area;
+    /* node idx drawn at each screen cell in row major order, -1 for blank */
+    const short *screen;
 };
 
 extern const struct map_layout *g_default_map_layout;
@@ -173,8 +201,11 @@ enum map_layout_ver {
 };
 
 void map_set_default_layout(enum map_layout_ver ver);
+const struct map_layout *map_get_layout(int ver);
+int map_layout_ver(const struct map_layout *layout);
 
-int map_init(struct map *map, const struct map_layout *layout);
+int map_init(struct map *map, const struct map_layout *layout, struct arena *arena);
+int map_reset(struct map *map, const struct map_layout *layout);
 void map_free(struct map *map);
 
 int map_attach_player(struct map *map, struct player *player);
@@ -185,7 +216,14 @@ int map_place_item(struct map *map, int pos, enum item_type item, struct player
 int map_clear_item(struct map *map, int pos);
 
 int map_set_owner(struct map *map, int pos, struct player *owner);
+/* unchecked, NULL releases, level is left as is */
+int map_change_owner(struct map *map, int pos, struct player *owner);
+/* release estate back to wasteland without owner */
+int map_clear_owner(struct map *map, int pos);
+int map_set_level(struct map *map, int pos, enum estate_level level);
 
 int map_nearest_node_from(const struct map *map, const struct map_layout *layout, int pos, enum node_type type);
+int map_area_idx(const struct map *map, const struct map_layout *layout, int pos);
+int map_screen_pos(const struct map *map, unsigned int line, unsigned int col);
 
 int map_node_price(struct map_node *node);
@@ -0,0 +1,450 @@
+#include "common.h"
+#include <math.h>
+#include <stdint.h>
+#include "mcts.h"
+#include "bot.h"
+#include "game.h"
+#include "save.h"
+#include "search.h"
+
+/* exploration of UCT, rewards are in [0, 1] and worth shares lie close */
+#define MCTS_UCT_C       0.3f
+#define MCTS_MAX_DEPTH   256
+/* playouts between two looks at the clock */
+#define MCTS_CLOCK_EVERY 16
+/* trees of a search by playouts, fixed so the answer does not depend on the workers */
+#define MCTS_PLAYOUT_TREES 4
+
+struct mcts_node {
+    /* first of n_child nodes in a row, -1 while a leaf */
+    int32_t child;
+    uint16_t n_child;
+    uint16_t pad;
+    uint32_t n_visit;
+    /* summed rewards by seat */
+    float value[GAME_PLAYER_MAX];
+};
+
+/* one decision for the pool, read only while the workers run */
+struct mcts_job {
+    struct game_image img;
+    enum game_decision decision;
+    int random;
+    unsigned long seed;
+    /* split among trees, 0 for time */
+    long playouts;
+    /* trees grown, 0 for one per worker */
+    int n_tree;
+    struct timespec deadline;
+    int seats[PLAYER_MAX];
+    int n_seat;
+
+    /* root of every tree, written by its worker */
+    struct mcts_root {
+        long n_playout;
+        int n_child;
+        unsigned long visits[SEARCH_MAX_CAND];
+    } roots[SEARCH_MAX_THREAD];
+};
+
+struct mcts_tree {
+    const struct mcts_job *job;
+    struct game *sim;
+    uint64_t rng;
+
+    struct mcts_node *nodes;
+    int n_node;
+    /* nodes of the running playout, cur < 0 once it left the tree */
+    int path[MCTS_MAX_DEPTH];
+    int depth;
+    int cur;
+    int n_turn;
+};
+
+/* xorshift64*, one stream per tree */
+static inline uint32_t mcts_rand(struct mcts_tree *t, uint32_t n)
+{
+    t->rng ^= t->rng >> 12;
+    t->rng ^= t->rng << 25;
+    t->rng ^= t->rng >> 27;
+    return (uint32_t) ((t->rng * 0x2545f4914f6cdd1dULL) >> 32) % n;
+}
+
+/* grow children below the current node, leaves are expanded on their second visit */
+static int mcts_expand(struct mcts_tree *t, struct mcts_node *node, int n)
+{
+    struct mcts_node *child;
+    int i;
+
+    if ((t->cur && !node->n_visit) || t->n_node + n > MCTS_MAX_NODE || t->depth >= MCTS_MAX_DEPTH)
+        return 0;
+
+    node->child = t->n_node;
+    node->n_child = n;
+    for (i = 0; i < n; i++) {
+        child = &t->nodes[t->n_node++];
+        memset(child, 0, sizeof(*child));
+        child->child = -1;
+    }
+    return 1;
+}
+
+/* UCT for the seat to move, unvisited children first */
+static int mcts_select(struct mcts_node *nodes, struct mcts_node *node, int seat)
+{
+    float log_n = logf(node->n_visit + 1), score, best = -1.0f;
+    struct mcts_node *child;
+    int i, choice = 0;
+
+    for (i = 0; i < node->n_child; i++) {
+        child = &nodes[node->child + i];
+        if (!child->n_visit)
+            return i;
+
+        score = child->value[seat] / child->n_visit + MCTS_UCT_C * sqrtf(log_n / child->n_visit);
+        if (score > best) {
+            best = score;
+            choice = i;
+        }
+    }
+    return choice;
+}
+
+/*
+ * Step down the tree by one of @n answers, @seat < 0 for the dice.
+ * @return: index of answer, < 0 past the leaves, the rollout policy answers
+ */
+static int mcts_descend(struct mcts_tree *t, int seat, int n)
+{
+    struct mcts_node *node;
+    int i;
+
+    /* nothing to learn about a forced answer */
+    if (n <= 1)
+        return 0;
+    if (t->cur < 0)
+        return -1;
+
+    node = &t->nodes[t->cur];
+    if (node->child < 0 && !mcts_expand(t, node, n))
+        goto out_tree;
+    if (node->n_child != n)
+        goto out_tree;
+
+    i = seat < 0 ? (int) mcts_rand(t, n) : mcts_select(t->nodes, node, seat);
+    t->cur = node->child + i;
+    t->path[t->depth++] = t->cur;
+    return i;
+
+out_tree:
+    t->cur = -1;
+    return -1;
+}
+
+static int mcts_roll(struct mcts_tree *t, int facets)
+{
+    int i = mcts_descend(t, -1, facets);
+
+    return 1 + (i >= 0 ? i : (int) mcts_rand(t, facets));
+}
+
+/* @return: index of the answer to play in a copy, < 0 left to the bot policy */
+static int mcts_sim_pick(struct controller *ctl, struct game *game, struct player *player,
+                         enum game_decision decision, const struct select *sel, struct act *cands)
+{
+    struct mcts_tree *t = ctl->priv;
+    int n, i;
+
+    n = search_candidates(game, player, decision, sel, 0, cands);
+    i = mcts_descend(t, t->job->seats[player->idx], n);
+    if (i < 0 && ctl->search_random)
+        i = mcts_rand(t, n);
+    return i;
+}
+
+static int mcts_sim_turn(struct controller *ctl, struct game *game, struct player *player, struct act *act)
+{
+    struct mcts_tree *t = ctl->priv;
+    struct act cands[SEARCH_MAX_CAND];
+    int i;
+
+    /* horizon, game is scored as it stands */
+    if (t->n_turn++ >= MCTS_HORIZON)
+        return CONTROLLER_ASK;
+
+    i = mcts_sim_pick(ctl, game, player, GAME_DECIDE_COMMAND, NULL, cands);
+    if (i >= 0)
+        *act = cands[i];
+    else
+        g_bot_ops.decide_turn(ctl, game, player, act);
+
+    /* copies draw their own dice, from the tree while inside it */
+    if (act->type == ACT_ROLL) {
+        act->type = ACT_STEP;
+        act->val = mcts_roll(t, game->dice_facets);
+    }
+    return 0;
+}
+
+static int mcts_sim_buy(struct controller *ctl, struct game *game, struct player *player, struct map_node *node)
+{
+    struct act cands[SEARCH_MAX_CAND];
+    int i = mcts_sim_pick(ctl, game, player, GAME_DECIDE_BUY, NULL, cands);
+
+    return i >= 0 ? cands[i].val : g_bot_ops.decide_buy(ctl, game, player, node);
+}
+
+static int mcts_sim_upgrade(struct controller *ctl, struct game *game, struct player *player, struct map_node *node)
+{
+    struct act cands[SEARCH_MAX_CAND];
+    int i = mcts_sim_pick(ctl, game, player, GAME_DECIDE_UPGRADE, NULL, cands);
+
+    return i >= 0 ? cands[i].val : g_bot_ops.decide_upgrade(ctl, game, player, node);
+}
+
+static int mcts_sim_item(struct controller *ctl, struct game *game, struct player *player, const struct select *sel)
+{
+    struct act cands[SEARCH_MAX_CAND];
+    int i = mcts_sim_pick(ctl, game, player, GAME_DECIDE_ITEM, sel, cands);
+
+    return i >= 0 ? cands[i].val : g_bot_ops.choose_item(ctl, game, player, sel);
+}
+
+static int mcts_sim_gift(struct controller *ctl, struct game *game, struct player *player, const struct select *sel)
+{
+    struct act cands[SEARCH_MAX_CAND];
+    int i = mcts_sim_pick(ctl, game, player, GAME_DECIDE_GIFT, sel, cands);
+
+    return i >= 0 ? cands[i].val : g_bot_ops.choose_gift(ctl, game, player, sel);
+}
+
+static int mcts_sim_magic(struct controller *ctl, struct game *game, struct player *player, const struct select *sel)
+{
+    struct act cands[SEARCH_MAX_CAND];
+    int i = mcts_sim_pick(ctl, game, player, GAME_DECIDE_MAGIC, sel, cands);
+
+    return i >= 0 ? cands[i].val : g_bot_ops.choose_magic_target(ctl, game, player, sel);
+}
+
+/* every seat of a copy */
+static const struct controller_ops mcts_sim_ops = {
+    .name = "mcts",
+    .decide_turn = mcts_sim_turn,
+    .decide_buy = mcts_sim_buy,
+    .decide_upgrade = mcts_sim_upgrade,
+    .choose_item = mcts_sim_item,
+    .choose_gift = mcts_sim_gift,
+    .choose_magic_target = mcts_sim_magic,
+};
+
+static void mcts_playout(struct mcts_tree *t)
+{
+    const struct mcts_job *job = t->job;
+    struct game *sim = t->sim;
+    float reward[GAME_PLAYER_MAX] = { 0 };
+    struct mcts_node *node;
+    int i, s;
+
+    if (game_sim_load(sim, &job->img, job->decision))
+        return;
+
+    for (i = 0; i < PLAYER_MAX; i++) {
+        sim->ctrls[i] = (struct controller) {
+            .type = CONTROLLER_MCTS,
+            .ops = &mcts_sim_ops,
+            .policy = bot_policy_find(NULL),
+            .search_random = job->random,
+            .priv = t,
+        };
+    }
+
+    t->cur = 0;
+    t->path[0] = 0;
+    t->depth = 1;
+    t->n_turn = 0;
+    game_feed(sim, NULL);
+
+    search_score(sim, job->seats, reward);
+    for (i = 0; i < t->depth; i++) {
+        node = &t->nodes[t->path[i]];
+        node->n_visit++;
+        for (s = 0; s < job->n_seat; s++)
+            node->value[s] += reward[s];
+    }
+}
+
+/* tree @idx of the job, @playouts: 0 until the deadline */
+static void mcts_grow(struct mcts_job *job, struct game *sim, int idx, long playouts)
+{
+    struct mcts_root *root = &job->roots[idx];
+    struct mcts_tree t = {
+        .job = job,
+        .sim = sim,
+        .rng = 0x9e3779b97f4a7c15ULL * (idx + 1) ^ job->seed,
+    };
+    long n;
+    int i;
+
+    root->n_playout = 0;
+    root->n_child = 0;
+
+    t.nodes = malloc(MCTS_MAX_NODE * sizeof(*t.nodes));
+    if (!t.nodes)
+        return;
+    t.n_node = 1;
+    memset(&t.nodes[0], 0, sizeof(t.nodes[0]));
+    t.nodes[0].child = -1;
+
+    for (n = 0;; n++) {
+        if (playouts ? n >= playouts : n && !(n % MCTS_CLOCK_EVERY) && search_expired(&job->deadline))
+            break;
+        mcts_playout(&t);
+    }
+
+    root->n_playout = n;
+    root->n_child = t.nodes[0].n_child;
+    for (i = 0; i < root->n_child; i++)
+        root->visits[i] = t.nodes[t.nodes[0].child + i].n_visit;
+    free(t.nodes);
+}
+
+/* search_fn_t, fresh trees of the worker for the job */
+static void mcts_worker(struct game *sim, int idx, int n_worker, void *arg)
+{
+    struct mcts_job *job = arg;
+    int k;
+
+    if (!job->n_tree) {
+        mcts_grow(job, sim, idx, 0);
+        return;
+    }
+    for (k = idx; k < job->n_tree; k += n_worker)
+        mcts_grow(job, sim, k, (job->playouts + job->n_tree - 1) / job->n_tree);
+}
+
+/* @return: index of the best of @n_cand answers to the open prompt, < 0 err */
+static int mcts_search(struct controller *ctl, struct game *game, enum game_decision decision, int n_cand)
+{
+    static unsigned long seed;
+    unsigned long visits[SEARCH_MAX_CAND] = { 0 };
+    struct mcts_job *job;
+    long n_playout = 0;
+    int i, j, n, best = -1;
+
+    /* too big for the stack of a session */
+    job = malloc(sizeof(*job));
+    if (!job || game_save_image(game, &job->img))
+        goto out;
+
+    job->decision = decision;
+    job->random = ctl->search_random;
+    job->seed = __atomic_add_fetch(&seed, 1, __ATOMIC_RELAXED);
+    job->n_seat = search_seats(game, job->seats);
+    search_deadline(&job->deadline, ctl->search_ms);
+
+    job->playouts = ctl->search_ms ? 0 : ctl->search_playouts;
+    job->n_tree = job->playouts ? MCTS_PLAYOUT_TREES : 0;
+    n = search_run(mcts_worker, job);
+    if (n <= 0)
+        goto out;
+    if (job->n_tree)
+        n = job->n_tree;
+
+    /* root parallel, trees only meet here */
+    for (i = 0; i < n; i++) {
+        n_playout += job->roots[i].n_playout;
+        if (job->roots[i].n_child != n_cand)
+            continue;
+        for (j = 0; j < n_cand; j++)
+            visits[j] += job->roots[i].visits[j];
+    }
+
+    for (j = 0; j < n_cand; j++) {
+        if (best < 0 || visits[j] > visits[best])
+            best = j;
+    }
+    game_dbg("decision %d, %ld playouts, answer %d of %d\n", decision, n_playout, best, n_cand);
+
+out:
+    free(job);
+    return best;
+}
+
+/* the best of the candidates, or what the bot would do */
+static int mcts_decide(struct controller *ctl, struct game *game, struct player *player,
+                       enum game_decision decision, const struct select *sel, struct act *act)
+{
+    struct act cands[SEARCH_MAX_CAND];
+    int i, n;
+
+    n = search_candidates(game, player, decision, sel, 0, cands);
+    i = n > 1 ? mcts_search(ctl, game, decision, n) : 0;
+    if (i < 0 || !n)
+        return CONTROLLER_ASK;
+
+    *act = cands[i];
+    return 0;
+}
+
+static int mcts_decide_turn(struct controller *ctl, struct game *game, struct player *player, struct act *act)
+{
+    if (mcts_decide(ctl, game, player, GAME_DECIDE_COMMAND, NULL, act))
+        return g_bot_ops.decide_turn(ctl, game, player, act);
+    return 0;
+}
+
+static int mcts_decide_buy(struct controller *ctl, struct game *game, struct player *player, struct map_node *node)
+{
+    struct act act;
+
+    if (mcts_decide(ctl, game, player, GAME_DECIDE_BUY, NULL, &act))
+        return g_bot_ops.decide_buy(ctl, game, player, node);
+    return act.val;
+}
+
+static int mcts_decide_upgrade(struct controller *ctl, struct game *game, struct player *player, struct map_node *node)
+{
+    struct act act;
+
+    if (mcts_decide(ctl, game, player, GAME_DECIDE_UPGRADE, NULL, &act))
+        return g_bot_ops.decide_upgrade(ctl, game, player, node);
+    return act.val;
+}
+
+static int mcts_choose_item(struct controller *ctl, struct game *game, struct player *player, const struct select *sel)
+{
+    struct act act;
+
+    if (mcts_decide(ctl, game, player, GAME_DECIDE_ITEM, sel, &act))
+        return g_bot_ops.choose_item(ctl, game, player, sel);
+    return act.val;
+}
+
+static int mcts_choose_gift(struct controller *ctl, struct game *game, struct player *player, const struct select *sel)
+{
+    struct act act;
+
+    if (mcts_decide(ctl, game, player, GAME_DECIDE_GIFT, sel, &act))
+        return g_bot_ops.choose_gift(ctl, game, player, sel);
+    return act.val;
+}
+
+static int mcts_choose_magic_target(struct controller *ctl, struct game *game, struct player *player,
+                                    const struct select *sel)
+{
+    struct act act;
+
+    if (mcts_decide(ctl, game, player, GAME_DECIDE_MAGIC, sel, &act))
+        return g_bot_ops.choose_magic_target(ctl, game, player, sel);
+    return act.val;
+}
+
+const struct controller_ops g_mcts_ops = {
+    .name = "mcts",
+    .decide_turn = mcts_decide_turn,
+    .decide_buy = mcts_decide_buy,
+    .decide_upgrade = mcts_decide_upgrade,
+    .choose_item = mcts_choose_item,
+    .choose_gift = mcts_choose_gift,
+    .choose_magic_target = mcts_choose_magic_target,
+};
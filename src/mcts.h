@@ -0,0 +1,25 @@
+#pragma once
+#include "common.h"
+#include "controller.h"
+
+/* budget of a decision when the spec names none */
+#define MCTS_DEFAULT_MS   100
+/* turns a playout runs before the game is scored by worth */
+#define MCTS_HORIZON      48
+/* nodes of one tree, a full tree stops growing and only plays out */
+#define MCTS_MAX_NODE     (1 << 16)
+
+/*
+ * Monte Carlo tree search behind CONTROLLER_MCTS. Every worker of the search
+ * pool grows a tree of its own from its copy of the game (root parallelism)
+ * and the root visits of all trees are summed up to pick the answer. A
+ * budget of playouts is split over a fixed number of trees instead, so the
+ * same game picks the same answers with any number of workers.
+ *
+ * Playouts run the real game code on a muted copy, every seat of the copy
+ * is answered by the tree while inside it and by the default bot policy,
+ * or at random, past its leaves. Dice are chance nodes with one child per
+ * face. A playout is scored at the end of the game, or by worth share after
+ * MCTS_HORIZON turns.
+ */
+extern const struct controller_ops g_mcts_ops;
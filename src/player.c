@@ -2,6 +2,8 @@
 #include "player.h"
 #include "map.h"
 #include "game.h"
+#include "arena.h"
+#include "track.h"
 
 static const char *const g_player_ids[PLAYER_MAX] = {
     "Q",
@@ -83,7 +85,7 @@ const char *player_idx_to_name(int idx)
     return NULL;
 }
 
-static int player_add_name(struct player *player)
+static int player_add_name(struct player *player, struct arena *arena)
 {
     int idx = player->idx;
     char *buf;
@@ -93,7 +95,12 @@ static int player_add_name(struct player *player)
         return 0;
     }
 
-    buf = calloc(1, PLAYER_NAME_SZ);
+    buf = player->name_buf;
+    if (!buf && arena)
+        buf = player->name_buf = arena_alloc(arena, PLAYER_NAME_SZ);
+    else if (!buf)
+        buf = calloc(1, PLAYER_NAME_SZ);
+
     if (!buf) {
         game_err("fail to alloc player %d name\n", idx);
         return -1;
@@ -115,10 +122,10 @@ int player_del_name(struct player *player)
         return 0;
     }
 
-    if (player->name) {
+    if (player->name && player->name != player->name_buf)
         free((void *) player->name);
-        player->name = NULL;
-    }
+
+    player->name = NULL;
     return 0;
 }
 
@@ -141,12 +148,12 @@ static int player_stat_init(struct stat *stat)
     return 0;
 }
 
-int player_init(struct player *player, int idx, int seq)
+int player_init(struct player *player, int idx, int seq, struct arena *arena)
 {
     player->idx = idx;
     player->seq = seq;
     player->id = g_player_ids[idx];
-    player_add_name(player);
+    player_add_name(player, arena);
     player->color = g_player_colors[idx];
 
     player->pos = 0;
@@ -174,10 +181,10 @@ int player_buff_apply(struct player *player)
     struct stat *stat = &player->stat;
 
     if (buff->n_god_rounds)
-        stat->god = 1;
+        player_set(player, TRACK_PLAYER_GOD_ON, stat->god, 1);
 
     if (buff->n_empty_rounds)
-        stat->empty = 1;
+        player_set(player, TRACK_PLAYER_EMPTY_ON, stat->empty, 1);
 
     return 0;
 }
@@ -189,18 +196,18 @@ int player_buff_wearoff(struct player *player)
 
     if (stat->god) {
         if (buff->n_god_rounds > 0)
-            buff->n_god_rounds--;
+            player_set(player, TRACK_PLAYER_GOD, buff->n_god_rounds, buff->n_god_rounds - 1);
 
         if (buff->n_god_rounds == 0)
-            stat->god = 0;
+            player_set(player, TRACK_PLAYER_GOD_ON, stat->god, 0);
     }
 
     if (stat->empty) {
         if (buff->n_empty_rounds > 0)
-            buff->n_empty_rounds--;
+            player_set(player, TRACK_PLAYER_EMPTY, buff->n_empty_rounds, buff->n_empty_rounds - 1);
 
         if (buff->n_empty_rounds == 0)
-            stat->empty = 0;
+            player_set(player, TRACK_PLAYER_EMPTY_ON, stat->empty, 0);
     }
 
     game_dbg("player %s god %d (%d rounds) empty %d (%d rounds)\n", player->name,
@@ -212,7 +219,7 @@ int player_grant_gift_money(struct gift_info *gift, struct game *game, struct pl
 {
     struct ui *ui = &game->ui;
 
-    player->asset.n_money += gift->value;
+    player_set(player, TRACK_PLAYER_MONEY, player->asset.n_money, player->asset.n_money + gift->value);
     ui_bprintln(ui, "[GIFT] Acquired bonus cash %d.\n", gift->value);
     return 0;
 }
@@ -221,7 +228,7 @@ int player_grant_gift_point(struct gift_info *gift, struct game *game, struct pl
 {
     struct ui *ui = &game->ui;
 
-    player->asset.n_points += gift->value;
+    player_set(player, TRACK_PLAYER_POINTS, player->asset.n_points, player->asset.n_points + gift->value);
     ui_bprintln(ui, "[GIFT] Acquired bonus points %d.\n", gift->value);
     return 0;
 }
@@ -230,7 +237,7 @@ int player_grant_gift_god(struct gift_info *gift, struct game *game, struct play
 {
     struct ui *ui = &game->ui;
 
-    player->buff.n_god_rounds += gift->value;
+    player_set(player, TRACK_PLAYER_GOD, player->buff.n_god_rounds, player->buff.n_god_rounds + gift->value);
     ui_bprintln(ui, "[GIFT] God of Wealth be with you in %d rounds.\n", gift->value);
     return 0;
 }
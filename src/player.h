@@ -45,6 +45,8 @@ struct player {
     int seq;
     const char *id;
     const char *name;
+    /* arena backed name storage, kept across player_uninit() */
+    char *name_buf;
     enum player_color color;
 
     int pos;
@@ -54,11 +56,18 @@ struct player {
     struct asset asset;
     struct buff buff;
     struct stat stat;
+
+    /* optional, state hash of the game owning this player */
+    struct track *track;
 };
 
+/* tracked assignment to a player field, @field is enum track_field */
+#define player_set(player, field, lval, val) \
+    track_set((player)->track, field, (player)->idx, lval, val)
+
 #define PLAYER_MAX 16
 
-int player_init(struct player *player, int idx, int seq);
+int player_init(struct player *player, int idx, int seq, struct arena *arena);
 int player_uninit(struct player *player);
 int player_id_to_char(struct player *player);
 char player_idx_to_char(int idx);
@@ -0,0 +1,318 @@
+#include "common.h"
+#include "risk.h"
+#include "landing.h"
+
+#define RISK_N_EMPTY (LANDING_MAX_EMPTY + 1)
+#define RISK_LANES   8
+#define RISK_ALIGN   (RISK_LANES * sizeof(float))
+
+typedef float risk_vec __attribute__((vector_size(RISK_ALIGN)));
+/* same, loaded from any float */
+typedef float risk_uvec __attribute__((vector_size(RISK_ALIGN), aligned(sizeof(float))));
+
+/* walks from a place with no round to wait, as the chain has them */
+struct risk_moves {
+    /* moves of node i are [start[i], start[i + 1]) */
+    int *start;
+    int *to;
+    float *p;
+    /* toll in buckets */
+    int *cost;
+};
+
+/* chances by state and money bucket, state rows are zero out of [lo, hi) */
+struct risk_dist {
+    float *p;
+    int *lo;
+    int *hi;
+};
+
+struct risk_dp {
+    const struct landing *landing;
+    int n_bucket;
+    /* floats of a state row, zero past n_bucket and a vector more */
+    int row;
+    struct risk_dist x;
+    struct risk_dist y;
+    struct risk_moves moves;
+};
+
+static inline int risk_state(int node, int empty)
+{
+    return node * RISK_N_EMPTY + empty;
+}
+
+static inline int risk_align_down(int b)
+{
+    return b / RISK_LANES * RISK_LANES;
+}
+
+static inline int risk_align_up(int b)
+{
+    return (b + RISK_LANES - 1) / RISK_LANES * RISK_LANES;
+}
+
+static int risk_gcd(int a, int b)
+{
+    int t;
+
+    while (b) {
+        t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/* toll @player pays on each node, 0 if none */
+static void risk_tolls(struct game *game, struct player *player, int *tolls)
+{
+    struct map_node *node;
+    int i;
+
+    for (i = 0; i < game->map.n_used; i++) {
+        node = &game->map.nodes[i];
+        tolls[i] = 0;
+        if (node->type != MAP_NODE_VACANCY || !node->estate.owner || node->estate.owner == player)
+            continue;
+        tolls[i] = map_node_price(node) / 2;
+    }
+}
+
+/* bucket width, the largest that keeps @money and every toll whole if it fits */
+static int risk_bucket(int money, const int *tolls, int n_node, int *exact)
+{
+    int i, w = money;
+
+    for (i = 0; i < n_node; i++)
+        w = risk_gcd(w, tolls[i]);
+    if (!w)
+        w = 1;
+
+    *exact = 1;
+    if (money / w + 1 > RISK_MAX_BUCKET) {
+        w = (money + RISK_MAX_BUCKET - 2) / (RISK_MAX_BUCKET - 1);
+        for (i = 0; i < n_node && *exact; i++)
+            *exact = tolls[i] % w == 0;
+        *exact = *exact && money % w == 0;
+    }
+    return w;
+}
+
+/* @return: < 0 err */
+static int risk_build_moves(struct risk_dp *dp, const int *tolls, int w)
+{
+    const struct landing *l = dp->landing;
+    struct risk_moves *m = &dp->moves;
+    int pos, j, n = 0;
+    float p;
+
+    for (pos = 0; pos < l->n_node; pos++) {
+        for (j = 0; j < l->n_state; j++)
+            n += l->trans[(long) j * l->stride + risk_state(pos, 0)] > 0;
+    }
+
+    m->start = calloc(l->n_node + 1, sizeof(*m->start));
+    m->to = calloc(n ? n : 1, sizeof(*m->to));
+    m->p = calloc(n ? n : 1, sizeof(*m->p));
+    m->cost = calloc(n ? n : 1, sizeof(*m->cost));
+    if (!m->start || !m->to || !m->p || !m->cost)
+        return -1;
+
+    for (n = 0, pos = 0; pos < l->n_node; pos++) {
+        m->start[pos] = n;
+        for (j = 0; j < l->n_state; j++) {
+            p = l->trans[(long) j * l->stride + risk_state(pos, 0)];
+            if (p <= 0)
+                continue;
+
+            m->to[n] = j;
+            m->p[n] = p;
+            /* a bomb or prison does not stop on an estate */
+            m->cost[n] = j % RISK_N_EMPTY ? 0 : (tolls[j / RISK_N_EMPTY] + w - 1) / w;
+            n++;
+        }
+    }
+    m->start[pos] = n;
+    return 0;
+}
+
+/* @return: < 0 err */
+static int risk_dist_alloc(struct risk_dist *d, int n_state, int row)
+{
+    size_t size = (size_t) n_state * row * sizeof(float);
+    int i;
+
+    d->p = aligned_alloc(RISK_ALIGN, size);
+    d->lo = calloc(n_state, sizeof(*d->lo));
+    d->hi = calloc(n_state, sizeof(*d->hi));
+    if (!d->p || !d->lo || !d->hi)
+        return -1;
+
+    memset(d->p, 0, size);
+    for (i = 0; i < n_state; i++)
+        d->lo[i] = row;
+    return 0;
+}
+
+static void risk_dist_free(struct risk_dist *d)
+{
+    free(d->p);
+    free(d->lo);
+    free(d->hi);
+}
+
+/* widen the range of @state to hold [lo, hi) */
+static inline void risk_dist_span(struct risk_dist *d, int state, int lo, int hi)
+{
+    if (lo < d->lo[state])
+        d->lo[state] = lo;
+    if (hi > d->hi[state])
+        d->hi[state] = hi;
+}
+
+static void risk_dp_free(struct risk_dp *dp)
+{
+    risk_dist_free(&dp->x);
+    risk_dist_free(&dp->y);
+    free(dp->moves.start);
+    free(dp->moves.to);
+    free(dp->moves.p);
+    free(dp->moves.cost);
+}
+
+/* @dst[b] += @p * @src[b + @cost] for @src[lo, hi), @src is any float */
+static inline void risk_axpy_shift(float *dst, const float *src, float p, int cost, int lo, int hi)
+{
+    risk_vec vp = { p, p, p, p, p, p, p, p };
+    int b;
+
+    for (b = risk_align_down(lo > cost ? lo - cost : 0); b < hi - cost; b += RISK_LANES)
+        *(risk_vec *) (dst + b) += vp * *(const risk_uvec *) (src + cost + b);
+}
+
+static float risk_sum(const struct risk_dp *dp, const struct risk_dist *d)
+{
+    risk_vec acc = { 0 };
+    const float *x;
+    float sum = 0;
+    int i, b;
+
+    for (i = 0; i < dp->landing->n_state; i++) {
+        x = d->p + (long) i * dp->row;
+        for (b = risk_align_down(d->lo[i]); b < d->hi[i]; b += RISK_LANES)
+            acc += *(const risk_vec *) (x + b);
+    }
+    for (i = 0; i < RISK_LANES; i++)
+        sum += acc[i];
+    return sum;
+}
+
+/* zero @d again, row by row as far as anything got written */
+static void risk_dist_clear(const struct risk_dp *dp, struct risk_dist *d)
+{
+    int i, lo;
+
+    for (i = 0; i < dp->landing->n_state; i++) {
+        if (d->hi[i] > d->lo[i]) {
+            lo = risk_align_down(d->lo[i]);
+            memset(d->p + (long) i * dp->row + lo, 0, (risk_align_up(d->hi[i]) - lo) * sizeof(float));
+        }
+        d->lo[i] = dp->row;
+        d->hi[i] = 0;
+    }
+}
+
+/* one turn of @dp->x into @dp->y */
+static void risk_turn(struct risk_dp *dp, int god)
+{
+    const struct landing *l = dp->landing;
+    const struct risk_moves *m = &dp->moves;
+    struct risk_dist *x = &dp->x, *y = &dp->y;
+    int pos, e, s, k, c, row = dp->row;
+
+    risk_dist_clear(dp, y);
+    for (pos = 0; pos < l->n_node; pos++) {
+        for (e = 1; e < RISK_N_EMPTY; e++) {
+            s = risk_state(pos, e);
+            if (x->hi[s] <= x->lo[s])
+                continue;
+            risk_axpy_shift(y->p + (long) risk_state(pos, e - 1) * row, x->p + (long) s * row, 1, 0, x->lo[s], x->hi[s]);
+            risk_dist_span(y, risk_state(pos, e - 1), x->lo[s], x->hi[s]);
+        }
+
+        s = risk_state(pos, 0);
+        if (x->hi[s] <= x->lo[s])
+            continue;
+        for (k = m->start[pos]; k < m->start[pos + 1]; k++) {
+            c = god ? 0 : m->cost[k];
+            /* a toll past the money bankrupts, the mass just goes */
+            if (c >= x->hi[s])
+                continue;
+            risk_axpy_shift(y->p + (long) m->to[k] * row, x->p + (long) s * row, m->p[k], c, x->lo[s], x->hi[s]);
+            risk_dist_span(y, m->to[k], x->lo[s] > c ? x->lo[s] - c : 0, x->hi[s] - c);
+        }
+    }
+}
+
+int risk_bankrupt(struct game *game, struct player *player, int n_turn, struct risk_result *res)
+{
+    struct risk_dp dp = { 0 };
+    struct risk_dist t;
+    int tolls[MAP_MAX_NODE];
+    int i, w, money, empty, god, s;
+    float left;
+
+    if (n_turn <= 0 || n_turn > RISK_MAX_TURN)
+        return -1;
+    if (game->state != GAME_STATE_RUNNING || !player->attached || player->stat.bankrupt)
+        return -1;
+
+    dp.landing = landing_get(game->cur_layout, game->dice_facets, landing_bomb_permille(&game->map));
+    if (!dp.landing || dp.landing->n_node != game->map.n_used)
+        return -1;
+
+    money = player->asset.n_money;
+    res->n_turn = n_turn;
+    if (money < 0) {
+        for (i = 0; i < n_turn; i++)
+            res->bankrupt[i] = 1;
+        res->bucket = 1;
+        res->exact = 1;
+        return 0;
+    }
+
+    risk_tolls(game, player, tolls);
+    w = risk_bucket(money, tolls, dp.landing->n_node, &res->exact);
+    res->bucket = w;
+
+    dp.n_bucket = money / w + 1;
+    dp.row = risk_align_up(dp.n_bucket) + RISK_LANES;
+    if (risk_dist_alloc(&dp.x, dp.landing->n_state, dp.row) || risk_dist_alloc(&dp.y, dp.landing->n_state, dp.row) ||
+        risk_build_moves(&dp, tolls, w)) {
+        risk_dp_free(&dp);
+        return -1;
+    }
+
+    empty = player->buff.n_empty_rounds;
+    empty = empty < 0 ? 0 : empty > LANDING_MAX_EMPTY ? LANDING_MAX_EMPTY : empty;
+    s = risk_state(player->pos, empty);
+    dp.x.p[(long) s * dp.row + dp.n_bucket - 1] = 1;
+    risk_dist_span(&dp.x, s, dp.n_bucket - 1, dp.n_bucket);
+
+    for (i = 0; i < n_turn; i++) {
+        /* god rounds count down every turn, the one going on may be the last */
+        god = player->buff.n_god_rounds > i || (!i && player->stat.god);
+        risk_turn(&dp, god);
+
+        t = dp.x;
+        dp.x = dp.y;
+        dp.y = t;
+
+        left = risk_sum(&dp, &dp.x);
+        res->bankrupt[i] = left < 0 ? 1 : left > 1 ? 0 : 1 - left;
+    }
+
+    risk_dp_free(&dp);
+    return 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "common.h"
+#include "game.h"
+
+/* turns forecast at most */
+#define RISK_MAX_TURN    64
+/* money buckets at most, tolls get rounded up to wider buckets past it */
+#define RISK_MAX_BUCKET  512
+
+struct risk_result {
+    int n_turn;
+    /* chance to be bankrupt by the end of each of the next n_turn turns */
+    float bankrupt[RISK_MAX_TURN];
+    /* money a bucket holds */
+    int bucket;
+    /* every toll and the money are whole buckets, else bankrupt[] is an upper bound */
+    int exact;
+};
+
+/*
+ * Chance of @player to go bankrupt within its next @n_turn turns, by
+ * dynamic programming over the landing chain of the layout (landing.h) and
+ * its money in buckets. Each turn the distribution of place and empty rounds
+ * is carried through the chain, and every walk ending on an estate of
+ * somebody else takes its toll off the money, unless the god of wealth is
+ * with the player that turn. Owners, levels and bombs stay as they are and
+ * the player earns nothing, so this is the risk of sitting it out.
+ *
+ * @return: < 0 err
+ */
+int risk_bankrupt(struct game *game, struct player *player, int n_turn, struct risk_result *res);
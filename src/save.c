@@ -0,0 +1,405 @@
+#include <unistd.h>
+#include <sys/mman.h>
+#include "common.h"
+#include "save.h"
+
+_Static_assert(sizeof(struct game_image_player) == 44, "image player layout changed");
+_Static_assert(sizeof(struct game_image_node) == 12, "image node layout changed");
+_Static_assert(GAME_OPT_MAX <= 32, "image options bitmask too small");
+
+uint32_t game_image_checksum(const void *buf, size_t size)
+{
+    const unsigned char *p = buf;
+    uint32_t hash = 2166136261U;
+
+    while (size--) {
+        hash ^= *p++;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+static int8_t game_image_player_idx(struct player *player)
+{
+    return player ? player->idx : -1;
+}
+
+static void game_save_player(struct player *player, struct game_image_player *ip)
+{
+    ip->valid = player->valid;
+    ip->attached = player->attached;
+    ip->bankrupt = player->stat.bankrupt;
+    ip->empty = player->stat.empty;
+    ip->god = player->stat.god;
+
+    ip->pos = player->pos;
+    ip->n_money = player->asset.n_money;
+    ip->n_points = player->asset.n_points;
+    ip->n_block = player->asset.n_block;
+    ip->n_bomb = player->asset.n_bomb;
+    ip->n_robot = player->asset.n_robot;
+    ip->n_empty_rounds = player->buff.n_empty_rounds;
+    ip->n_god_rounds = player->buff.n_god_rounds;
+    ip->n_sell_done = player->stat.n_sell_done;
+}
+
+static void game_save_node(struct map_node *node, struct game_image_node *in)
+{
+    int i;
+
+    in->owner = -1;
+    in->item = node->item;
+    in->item_owner = game_image_player_idx(node->item_owner);
+
+    if (node->type == MAP_NODE_VACANCY) {
+        in->owner = game_image_player_idx(node->estate.owner);
+        in->level = node->estate.level;
+    } else if (node->type == MAP_NODE_ITEM_HOUSE) {
+        for (i = 0; i < ITEM_MAX; i++)
+            in->on_sell[i] = node->item_house.items.info[i].on_sell;
+    } else if (node->type == MAP_NODE_MINE) {
+        in->mine_points = node->mine_points;
+    }
+}
+
+int game_save_image(struct game *game, struct game_image *img)
+{
+    int i;
+
+    if (game->state == GAME_STATE_UNINIT)
+        return -1;
+
+    img->layout = map_layout_ver(game->cur_layout);
+    if (img->layout < 0) {
+        game_err("only built-in layouts can be saved\n");
+        return -1;
+    }
+
+    /* a stopped game is saved as it was running */
+    img->state = game->cur_player_nr ? GAME_STATE_RUNNING : GAME_STATE_INIT;
+    img->dice_facets = game->dice_facets;
+    img->default_money = game->default_money;
+    img->max_sell_per_turn = game->max_sell_per_turn;
+
+    img->options = 0;
+    for (i = 0; i < GAME_OPT_MAX; i++) {
+        if (game->option.opts[i].on)
+            img->options |= 1U << i;
+    }
+
+    memset(img->cur_players, -1, sizeof(img->cur_players));
+    for (i = 0; i < game->cur_player_nr; i++)
+        img->cur_players[i] = game->cur_players[i]->idx;
+    img->cur_player_nr = game->cur_player_nr;
+    img->bankrupt_nr = game->bankrupt_nr;
+    img->next_player_seq = game->next_player_seq;
+    img->next_player = game_image_player_idx(game->next_player);
+
+    memset(img->players, 0, sizeof(img->players));
+    for (i = 0; i < PLAYER_MAX; i++) {
+        if (game->players[i].valid)
+            game_save_player(&game->players[i], &img->players[i]);
+    }
+
+    img->n_node = game->map.n_used;
+    memset(img->nodes, 0, img->n_node * sizeof(img->nodes[0]));
+    for (i = 0; i < game->map.n_used; i++)
+        game_save_node(&game->map.nodes[i], &img->nodes[i]);
+
+    return 0;
+}
+
+static struct player *game_image_player(struct game *game, int idx)
+{
+    if (idx < 0)
+        return NULL;
+    return game_get_player(game, idx);
+}
+
+int game_check_image(const struct game_image *img)
+{
+    int i, idx;
+
+    if (!map_get_layout(img->layout))
+        return -1;
+    if (img->n_node != map_get_layout(img->layout)->map_size)
+        return -1;
+    if (img->cur_player_nr < 0 || img->cur_player_nr > GAME_PLAYER_MAX)
+        return -1;
+    if (img->dice_facets <= 0 || img->max_sell_per_turn < 0)
+        return -1;
+
+    for (i = 0; i < img->cur_player_nr; i++) {
+        idx = img->cur_players[i];
+        if (idx < 0 || idx >= PLAYER_MAX || !img->players[idx].valid)
+            return -1;
+        if (img->players[idx].pos < 0 || img->players[idx].pos >= img->n_node)
+            return -1;
+    }
+
+    /* the player to move sits where the seat says, somebody is left standing */
+    if (img->bankrupt_nr < 0 || img->bankrupt_nr > (img->cur_player_nr ? img->cur_player_nr - 1 : 0))
+        return -1;
+    if (img->cur_player_nr) {
+        if (img->next_player_seq < 0 || img->next_player_seq >= img->cur_player_nr)
+            return -1;
+        if (img->state == GAME_STATE_RUNNING && img->next_player != img->cur_players[img->next_player_seq])
+            return -1;
+    } else if (img->next_player_seq || img->next_player >= 0) {
+        return -1;
+    }
+
+    for (i = 0; i < img->n_node; i++) {
+        const struct game_image_node *in = &img->nodes[i];
+
+        if (in->owner >= PLAYER_MAX || in->item_owner >= PLAYER_MAX)
+            return -1;
+        if (in->item < ITEM_INVALID || in->item >= ITEM_MAX)
+            return -1;
+        if (in->level < ESTATE_WASTELAND || in->level >= ESTATE_MAX)
+            return -1;
+    }
+    return 0;
+}
+
+static int game_load_player(struct game *game, struct player *player, const struct game_image_player *ip)
+{
+    if (map_move_player(&game->map, player, ip->pos))
+        return -1;
+    if (!ip->attached && map_detach_player(&game->map, player))
+        return -1;
+
+    player->asset.n_money = ip->n_money;
+    player->asset.n_points = ip->n_points;
+    player->asset.n_block = ip->n_block;
+    player->asset.n_bomb = ip->n_bomb;
+    player->asset.n_robot = ip->n_robot;
+    player->buff.n_empty_rounds = ip->n_empty_rounds;
+    player->buff.n_god_rounds = ip->n_god_rounds;
+    player->stat.n_sell_done = ip->n_sell_done;
+    player->stat.empty = ip->empty;
+    player->stat.god = ip->god;
+    player->stat.bankrupt = ip->bankrupt;
+    return 0;
+}
+
+static int game_load_node(struct game *game, struct map_node *node, const struct game_image_node *in)
+{
+    int i;
+    struct player *owner;
+
+    if (node->type == MAP_NODE_VACANCY && in->owner >= 0) {
+        owner = game_image_player(game, in->owner);
+        if (!owner || map_set_owner(&game->map, node->idx, owner))
+            return -1;
+        node->estate.level = in->level;
+    } else if (node->type == MAP_NODE_ITEM_HOUSE) {
+        for (i = 0; i < ITEM_MAX; i++)
+            node->item_house.items.info[i].on_sell = in->on_sell[i];
+    } else if (node->type == MAP_NODE_MINE) {
+        node->mine_points = in->mine_points;
+    }
+
+    if (in->item != ITEM_INVALID)
+        return map_place_item(&game->map, node->idx, in->item, game_image_player(game, in->item_owner));
+    return 0;
+}
+
+/* replace current game with image, game is reset on any error */
+int game_load_image(struct game *game, const struct game_image *img)
+{
+    int i, idxs[PLAYER_MAX];
+    const struct map_layout *layout;
+    struct player *player;
+
+    if (game_check_image(img)) {
+        game_err("game image invalid\n");
+        return -1;
+    }
+
+    if (game_reset(game))
+        return -2;
+
+    for (i = 0; i < GAME_OPT_MAX; i++) {
+        game->option.opts[i].on = !!(img->options & (1U << i));
+        game_apply_option(game, i);
+    }
+
+    layout = map_get_layout(img->layout);
+    if (layout != game->cur_layout) {
+        game->cur_layout = layout;
+        if (map_reset(&game->map, layout))
+            goto err;
+    }
+
+    game->dice_facets = img->dice_facets;
+    game->default_money = img->default_money;
+    game->max_sell_per_turn = img->max_sell_per_turn;
+
+    for (i = 0; i < img->cur_player_nr; i++)
+        idxs[i] = img->cur_players[i];
+    if (img->cur_player_nr && game_add_players(game, idxs, img->cur_player_nr))
+        goto err;
+
+    for (i = 0; i < img->cur_player_nr; i++) {
+        player = &game->players[idxs[i]];
+        if (game_load_player(game, player, &img->players[idxs[i]]))
+            goto err;
+    }
+
+    /* ownership needs owners attached, bankrupt players own nothing */
+    for (i = 0; i < img->n_node; i++) {
+        if (game_load_node(game, &game->map.nodes[i], &img->nodes[i]))
+            goto err;
+    }
+
+    game->bankrupt_nr = img->bankrupt_nr;
+    game->next_player_seq = img->next_player_seq;
+    game->next_player = game_image_player(game, img->next_player);
+
+    if (img->state == GAME_STATE_RUNNING && game->cur_player_nr)
+        game->state = GAME_STATE_STARTING;
+    game->map.dirty = 1;
+
+    /* fields above are restored in bulk, not tracked one by one */
+    game_track_reset(game);
+    return 0;
+
+err:
+    game_err("fail to restore game image\n");
+    game_reset(game);
+    return -3;
+}
+
+int game_fwrite_image(const struct game_image *img, FILE *fp)
+{
+    struct game_image_header hdr;
+
+    hdr.magic = GAME_IMAGE_MAGIC;
+    hdr.version = GAME_IMAGE_VERSION;
+    hdr.header_size = sizeof(hdr);
+    hdr.body_size = GAME_IMAGE_BODY_SIZE(img->n_node);
+    hdr.checksum = game_image_checksum(img, hdr.body_size);
+
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 || fwrite(img, hdr.body_size, 1, fp) != 1)
+        return -1;
+    return 0;
+}
+
+/* @sync: fsync before close, for files that are renamed into place */
+int game_write_image(const struct game_image *img, const char *path, int sync)
+{
+    FILE *fp;
+    int ret = 0;
+
+    fp = fopen(path, "wb");
+    if (!fp) {
+        game_err("fail to open %s\n", path);
+        return -2;
+    }
+
+    if (game_fwrite_image(img, fp))
+        ret = -3;
+    if (sync && (fflush(fp) || fsync(fileno(fp))))
+        ret = -3;
+    if (fclose(fp))
+        ret = -3;
+    return ret;
+}
+
+/* @return: body inside buf, NULL if header or checksum is bad */
+static const void *game_image_body(const void *buf, size_t size, uint32_t *body_size)
+{
+    const struct game_image_header *hdr = buf;
+
+    if (size < sizeof(*hdr))
+        return NULL;
+    if (hdr->magic != GAME_IMAGE_MAGIC || hdr->version != GAME_IMAGE_VERSION)
+        return NULL;
+    if (hdr->header_size != sizeof(*hdr) || hdr->body_size > sizeof(struct game_image))
+        return NULL;
+    if (hdr->body_size < GAME_IMAGE_BODY_SIZE(0) || size - sizeof(*hdr) < hdr->body_size)
+        return NULL;
+
+    if (game_image_checksum((const char *) buf + sizeof(*hdr), hdr->body_size) != hdr->checksum)
+        return NULL;
+
+    *body_size = hdr->body_size;
+    return (const char *) buf + sizeof(*hdr);
+}
+
+/* @used: bytes taken by header and body */
+int game_decode_image(const void *buf, size_t size, struct game_image *img, size_t *used)
+{
+    const void *body;
+    uint32_t body_size;
+
+    body = game_image_body(buf, size, &body_size);
+    if (!body)
+        return -1;
+
+    memcpy(img, body, body_size);
+    if (img->n_node < 0 || GAME_IMAGE_BODY_SIZE(img->n_node) != body_size)
+        return -1;
+
+    if (used)
+        *used = sizeof(struct game_image_header) + body_size;
+    return 0;
+}
+
+int game_read_image(struct game_image *img, const char *path)
+{
+    off_t size;
+    void *buf;
+    FILE *fp;
+    int ret;
+
+    /* fcntl.h and sys/stat.h clash with struct stat of player.h */
+    fp = fopen(path, "rb");
+    if (!fp) {
+        game_dbg("fail to open %s\n", path);
+        return -1;
+    }
+
+    size = lseek(fileno(fp), 0, SEEK_END);
+    if (size <= 0) {
+        fclose(fp);
+        return -1;
+    }
+
+    buf = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    fclose(fp);
+    if (buf == MAP_FAILED)
+        return -1;
+
+    ret = game_decode_image(buf, size, img, NULL);
+    munmap(buf, size);
+    if (ret) {
+        game_err("%s is not a valid game image\n", path);
+        return -2;
+    }
+    return 0;
+}
+
+int game_save(struct game *game, const char *path)
+{
+    struct game_image img;
+
+    if (game_save_image(game, &img))
+        return -1;
+
+    return game_write_image(&img, path, 0);
+}
+
+int game_load(struct game *game, const char *path)
+{
+    struct game_image img;
+    int ret;
+
+    ret = game_read_image(&img, path);
+    if (ret)
+        return ret;
+
+    ret = game_load_image(game, &img);
+    return ret ? -3 : 0;
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <stdint.h>
+#include "common.h"
+#include "game.h"
+
+/*
+ * Binary game image, fixed layout with explicitly sized fields in host byte order.
+ * Bump GAME_IMAGE_VERSION on any change of the structures below.
+ */
+#define GAME_IMAGE_MAGIC    0x4f4e4f4dU /* "MONO" on little endian */
+#define GAME_IMAGE_VERSION  1
+
+struct game_image_header {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    /* bytes of struct game_image actually stored, nodes are truncated to n_node */
+    uint32_t body_size;
+    /* FNV-1a of the stored body */
+    uint32_t checksum;
+};
+
+struct game_image_player {
+    int8_t valid;
+    int8_t attached;
+    int8_t bankrupt;
+    int8_t empty;
+    int8_t god;
+    int8_t pad[3];
+
+    int32_t pos;
+    int32_t n_money;
+    int32_t n_points;
+    int32_t n_block;
+    int32_t n_bomb;
+    int32_t n_robot;
+    int32_t n_empty_rounds;
+    int32_t n_god_rounds;
+    int32_t n_sell_done;
+};
+
+struct game_image_node {
+    /* player idx or -1 */
+    int8_t owner;
+    int8_t level;
+    int8_t item;
+    int8_t item_owner;
+    /* item house only */
+    int8_t on_sell[ITEM_MAX];
+    int8_t pad;
+    int32_t mine_points;
+};
+
+struct game_image {
+    int32_t layout;
+    int32_t state;
+    int32_t dice_facets;
+    int32_t default_money;
+    int32_t max_sell_per_turn;
+    /* bit per enum game_option */
+    uint32_t options;
+
+    /* player idx in seat order */
+    int8_t cur_players[PLAYER_MAX];
+    int32_t cur_player_nr;
+    int32_t bankrupt_nr;
+    int32_t next_player_seq;
+    int32_t next_player;
+
+    struct game_image_player players[PLAYER_MAX];
+
+    int32_t n_node;
+    struct game_image_node nodes[MAP_MAX_NODE];
+};
+
+#define GAME_IMAGE_BODY_SIZE(n_node) \
+    (offsetof(struct game_image, nodes) + (n_node) * sizeof(struct game_image_node))
+
+uint32_t game_image_checksum(const void *buf, size_t size);
+
+/* fields in range and agreeing with each other, @return: < 0 err */
+int game_check_image(const struct game_image *img);
+
+/* in memory snapshot and restore, @return: < 0 err */
+int game_save_image(struct game *game, struct game_image *img);
+int game_load_image(struct game *game, const struct game_image *img);
+
+/* header + body, as stored in files */
+int game_fwrite_image(const struct game_image *img, FILE *fp);
+int game_decode_image(const void *buf, size_t size, struct game_image *img, size_t *used);
+
+/* header + body in one file, read through mmap */
+int game_write_image(const struct game_image *img, const char *path, int sync);
+int game_read_image(struct game_image *img, const char *path);
+
+int game_save(struct game *game, const char *path);
+int game_load(struct game *game, const char *path);
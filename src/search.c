@@ -0,0 +1,278 @@
+#include "common.h"
+#include <pthread.h>
+#include <unistd.h>
+#include "search.h"
+#include "bot.h"
+
+struct search_worker {
+    pthread_t thread;
+    int idx;
+    /* job seq last run */
+    unsigned long seq;
+    struct game sim;
+};
+
+static struct search_pool {
+    /* one search at a time */
+    pthread_mutex_t busy;
+    pthread_mutex_t lock;
+    pthread_cond_t job_cond;
+    pthread_cond_t done_cond;
+
+    int want_threads;
+    int n_thread;
+    struct search_worker *workers;
+
+    search_fn_t fn;
+    void *arg;
+    unsigned long seq;
+    int n_done;
+    int quit;
+} g_search_pool = {
+    .busy = PTHREAD_MUTEX_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .job_cond = PTHREAD_COND_INITIALIZER,
+    .done_cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void *search_worker_main(void *arg)
+{
+    struct search_pool *pool = &g_search_pool;
+    struct search_worker *w = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->quit && w->seq == pool->seq)
+            pthread_cond_wait(&pool->job_cond, &pool->lock);
+        if (pool->quit)
+            break;
+        w->seq = pool->seq;
+        pthread_mutex_unlock(&pool->lock);
+
+        pool->fn(&w->sim, w->idx, pool->n_thread, pool->arg);
+
+        pthread_mutex_lock(&pool->lock);
+        if (++pool->n_done == pool->n_thread)
+            pthread_cond_signal(&pool->done_cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/* @return: < 0 err */
+static int search_pool_start(struct search_pool *pool)
+{
+    struct search_worker *w;
+    int i, n = pool->want_threads;
+
+    if (n <= 0)
+        n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n <= 0)
+        n = 1;
+    if (n > SEARCH_MAX_THREAD)
+        n = SEARCH_MAX_THREAD;
+
+    pool->workers = calloc(n, sizeof(*pool->workers));
+    if (!pool->workers)
+        return -1;
+
+    for (i = 0; i < n; i++) {
+        w = &pool->workers[i];
+        w->idx = i;
+        w->seq = pool->seq;
+
+        if (game_sim_init(&w->sim))
+            break;
+        if (pthread_create(&w->thread, NULL, search_worker_main, w)) {
+            game_uninit(&w->sim);
+            break;
+        }
+        pool->n_thread++;
+    }
+
+    if (!pool->n_thread) {
+        game_err("fail to start search workers\n");
+        free(pool->workers);
+        pool->workers = NULL;
+        return -1;
+    }
+    game_dbg("%d search workers\n", pool->n_thread);
+    return 0;
+}
+
+void search_set_threads(int n)
+{
+    g_search_pool.want_threads = n;
+}
+
+int search_run(search_fn_t fn, void *arg)
+{
+    struct search_pool *pool = &g_search_pool;
+    int n = -1;
+
+    pthread_mutex_lock(&pool->busy);
+    if (!pool->workers && search_pool_start(pool))
+        goto out;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->n_done = 0;
+    pool->seq++;
+    pthread_cond_broadcast(&pool->job_cond);
+    while (pool->n_done < pool->n_thread)
+        pthread_cond_wait(&pool->done_cond, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+    n = pool->n_thread;
+
+out:
+    pthread_mutex_unlock(&pool->busy);
+    return n;
+}
+
+void search_uninit(void)
+{
+    struct search_pool *pool = &g_search_pool;
+    int i;
+
+    if (!pool->workers)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->job_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->n_thread; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+        game_uninit(&pool->workers[i].sim);
+    }
+    free(pool->workers);
+    pool->workers = NULL;
+    pool->n_thread = 0;
+    pool->quit = 0;
+}
+
+/* same checks as placing the item, free vacancy off our own roll */
+static int search_place_candidates(struct game *game, struct player *self, enum item_type type, int range,
+                                   struct act *cands)
+{
+    int n_used = game->map.n_used;
+    struct map_node *node;
+    int o, n = 0;
+
+    for (o = -range; o <= range; o++) {
+        node = &game->map.nodes[((self->pos + o) % n_used + n_used) % n_used];
+        if (!o || node->type != MAP_NODE_VACANCY || node->item != ITEM_INVALID || !list_empty(&node->players))
+            continue;
+        cands[n++] = (struct act) { .type = type == ITEM_BLOCK ? ACT_BLOCK : ACT_BOMB, .val = o };
+    }
+    return n;
+}
+
+static int search_turn_candidates(struct game *game, struct player *self, int all_places, struct act *cands)
+{
+    int n;
+
+    if (!all_places)
+        return bot_turn_candidates(game, self, bot_policy_find(NULL), cands, SEARCH_MAX_CAND);
+
+    /* roll and robot as the bot sees them */
+    n = bot_turn_candidates(game, self, bot_policy_find(NULL), cands, 2);
+    if (n > 1 && cands[1].type != ACT_ROBOT)
+        n = 1;
+    if (self->asset.n_block > 0)
+        n += search_place_candidates(game, self, ITEM_BLOCK, GAME_ITEM_BLOCK_RANGE, cands + n);
+    if (self->asset.n_bomb > 0)
+        n += search_place_candidates(game, self, ITEM_BOMB, GAME_ITEM_BOMB_RANGE, cands + n);
+    return n;
+}
+
+int search_candidates(struct game *game, struct player *self, enum game_decision decision,
+                      const struct select *sel, int all_places, struct act *cands)
+{
+    struct map_node *node = &game->map.nodes[self->pos];
+    struct items_list *items;
+    struct player *player;
+    int i, n = 0;
+
+    switch (decision) {
+    case GAME_DECIDE_COMMAND:
+        return search_turn_candidates(game, self, all_places, cands);
+    case GAME_DECIDE_BUY:
+    case GAME_DECIDE_UPGRADE:
+        cands[n++] = (struct act) { .type = ACT_BOOL, .val = 1 };
+        cands[n++] = (struct act) { .type = ACT_BOOL, .val = 0 };
+        return n;
+    case GAME_DECIDE_ITEM:
+        items = &node->item_house.items;
+        for (i = 0; i < ITEM_MAX; i++) {
+            if (sel->choices[i].name && items->info[i].on_sell && items->info[i].price <= self->asset.n_points)
+                cands[n++] = (struct act) { .type = ACT_MENU, .val = i };
+        }
+        cands[n++] = (struct act) { .type = ACT_MENU, .val = ITEM_MAX };
+        return n;
+    case GAME_DECIDE_GIFT:
+        for (i = 0; i < sel->n_choice && n < SEARCH_MAX_CAND; i++) {
+            if (sel->choices[i].name)
+                cands[n++] = (struct act) { .type = ACT_MENU, .val = i };
+        }
+        return n;
+    case GAME_DECIDE_MAGIC:
+        cands[n++] = (struct act) { .type = ACT_MENU, .val = 0 };
+        for_each_player_begin(game, player) {
+            if (player != self && player->attached && !player->stat.bankrupt && player->idx + 1 < sel->n_choice)
+                cands[n++] = (struct act) { .type = ACT_MENU, .val = player->idx + 1 };
+        } for_each_player_end();
+        return n;
+    default:
+        return 0;
+    }
+}
+
+int search_seats(struct game *game, int *seats)
+{
+    struct player *player;
+    int n = 0;
+
+    for_each_player_begin(game, player) {
+        seats[player->idx] = n++;
+    } for_each_player_end();
+    return n;
+}
+
+void search_score(struct game *game, const int *seats, float *reward)
+{
+    struct player *player;
+    long worth[PLAYER_MAX] = { 0 }, total = 0;
+
+    for_each_player_begin(game, player) {
+        if (!player->stat.bankrupt) {
+            worth[player->idx] = game->state == GAME_STATE_STOPPED ? 1 : bot_worth(player);
+            total += worth[player->idx];
+        }
+    } for_each_player_end();
+
+    for_each_player_begin(game, player) {
+        reward[seats[player->idx]] = total > 0 ? (float) worth[player->idx] / total : 0;
+    } for_each_player_end();
+}
+
+void search_deadline(struct timespec *deadline, long ms)
+{
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += ms / 1000;
+    deadline->tv_nsec += ms % 1000 * 1000000;
+    if (deadline->tv_nsec >= 1000000000) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000;
+    }
+}
+
+int search_expired(const struct timespec *deadline)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > deadline->tv_sec || (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <time.h>
+#include "common.h"
+#include "game.h"
+
+#define SEARCH_MAX_THREAD 64
+/* roll, robot and a block and a bomb at every offset in range */
+#define SEARCH_MAX_CAND   (2 + GAME_ITEM_BLOCK_RANGE * 2 + GAME_ITEM_BOMB_RANGE * 2)
+
+/*
+ * What the searching seats (mcts.h, expectimax.h) have in common: a pool
+ * of worker threads, each with a muted game copy of its own (game_sim_init),
+ * the answers worth searching at a decision and the score of a position.
+ */
+
+/* @sim: copy of the worker, @idx: worker idx of @n */
+typedef void (*search_fn_t)(struct game *sim, int idx, int n, void *arg);
+
+/* workers of the pool, <= 0 for one per cpu, takes effect before the first search */
+void search_set_threads(int n);
+/*
+ * Run @fn on every worker and wait for all of them, one search at a time.
+ * @return: number of workers that ran, < 0 err
+ */
+int search_run(search_fn_t fn, void *arg);
+/* join the pool */
+void search_uninit(void);
+
+/*
+ * Answers to the open @decision of @self, the same on the real game and on
+ * its copies. Menus and y/n questions fill val, turns fill the whole act,
+ * roll first. @all_places: every legal block and bomb offset instead of the
+ * best of each by the bot policy. @return: number of candidates
+ */
+int search_candidates(struct game *game, struct player *self, enum game_decision decision,
+                      const struct select *sel, int all_places, struct act *cands);
+
+/* seat of each player idx in seat order, @return: number of seats */
+int search_seats(struct game *game, int *seats);
+/* winner takes all, a running game goes by worth share, @reward by seat */
+void search_score(struct game *game, const int *seats, float *reward);
+
+void search_deadline(struct timespec *deadline, long ms);
+int search_expired(const struct timespec *deadline);
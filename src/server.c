@@ -0,0 +1,454 @@
+#include "common.h"
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "server.h"
+
+static int server_listen_unix(struct server *server, const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        game_err("socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    unlink(path);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) || listen(fd, SERVER_BACKLOG)) {
+        game_err("fail to listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    strcpy(server->path, path);
+    return fd;
+}
+
+static int server_listen_tcp(const char *port)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET };
+    char *endptr = NULL;
+    long num;
+    int fd, on = 1;
+
+    num = strtol(port, &endptr, 10);
+    if (*endptr || num <= 0 || num > 65535) {
+        game_err("not a valid port: %s\n", port);
+        return -1;
+    }
+    addr.sin_port = htons(num);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) || listen(fd, SERVER_BACKLOG)) {
+        game_err("fail to listen on port %ld: %s\n", num, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int server_init(struct server *server, const char *addr)
+{
+    struct epoll_event ev = { .events = EPOLLIN };
+
+    memset(server, 0, sizeof(*server));
+    INIT_LIST_HEAD(&server->sessions);
+    INIT_LIST_HEAD(&server->reaped);
+    server->listen_fd = -1;
+
+    if (!strncmp(addr, "unix:", 5)) {
+        server->listen_fd = server_listen_unix(server, addr + 5);
+    } else if (!strncmp(addr, "tcp:", 4)) {
+        server->listen_fd = server_listen_tcp(addr + 4);
+    } else {
+        game_err("unknown server address %s, use unix:PATH or tcp:PORT\n", addr);
+        return -1;
+    }
+    if (server->listen_fd < 0)
+        return -1;
+
+    if (timer_wheel_init(&server->wheel, GAME_DEADLINE_TICK_MS))
+        goto err_close;
+
+    server->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (server->epfd < 0)
+        goto err_wheel;
+
+    /* NULL data is the listening socket, &g_game_events the signals, &wheel the deadlines */
+    ev.data.ptr = NULL;
+    if (epoll_ctl(server->epfd, EPOLL_CTL_ADD, server->listen_fd, &ev))
+        goto err_epoll;
+    ev.data.ptr = &g_game_events;
+    if (epoll_ctl(server->epfd, EPOLL_CTL_ADD, g_game_events.sig_fd, &ev))
+        goto err_epoll;
+    ev.data.ptr = &server->wheel;
+    if (epoll_ctl(server->epfd, EPOLL_CTL_ADD, server->wheel.fd, &ev))
+        goto err_epoll;
+    return 0;
+
+err_epoll:
+    close(server->epfd);
+err_wheel:
+    timer_wheel_uninit(&server->wheel);
+err_close:
+    close(server->listen_fd);
+    if (server->path[0])
+        unlink(server->path);
+    return -1;
+}
+
+/* fopencookie() write, game output is queued for the socket */
+static ssize_t session_out_write(void *cookie, const char *buf, size_t size)
+{
+    struct session *session = cookie;
+    size_t cap = session->out_cap;
+    char *out;
+
+    if (session->out_len + size > cap) {
+        if (!cap)
+            cap = 4096;
+        while (session->out_len + size > cap)
+            cap *= 2;
+
+        out = realloc(session->out_buf, cap);
+        if (!out)
+            return -1;
+        session->out_buf = out;
+        session->out_cap = cap;
+    }
+
+    memcpy(session->out_buf + session->out_len, buf, size);
+    session->out_len += size;
+    return size;
+}
+
+static struct session *session_new(int fd)
+{
+    cookie_io_functions_t io = { .write = session_out_write };
+    struct session *session;
+    struct ui *ui;
+
+    session = calloc(1, sizeof(*session));
+    if (!session)
+        return NULL;
+    session->fd = fd;
+
+    session->out = fopencookie(session, "w", io);
+    if (!session->out)
+        goto err_free;
+
+    if (game_init(&session->game))
+        goto err_close;
+
+    /* plain output to the socket, nobody to wait for */
+    ui = &session->game.ui;
+    ui->out = ui->err = session->out;
+    ui->in = NULL;
+    ui->in_isatty = ui->out_isatty = 0;
+    ui->lines = ui->cols = 0;
+    session->game.no_search = 1;
+    session->game.no_files = 1;
+    session->game.no_shared = 1;
+    return session;
+
+err_close:
+    fclose(session->out);
+err_free:
+    free(session);
+    return NULL;
+}
+
+static void session_free(struct server *server, struct session *session)
+{
+    epoll_ctl(server->epfd, EPOLL_CTL_DEL, session->fd, NULL);
+    close(session->fd);
+    list_del(&session->list);
+    if (!session->dead)
+        server->n_session--;
+
+    timer_del(&server->wheel, &session->game.deadline);
+    if (session->game.state != GAME_STATE_UNINIT)
+        game_uninit(&session->game);
+    fclose(session->out);
+    free(session->out_buf);
+    free(session);
+}
+
+/*
+ * Events of the same epoll batch may still point to @session, it stops
+ * taking any and is freed by server_reap() once the batch is done.
+ */
+static void session_kill(struct server *server, struct session *session)
+{
+    if (session->dead)
+        return;
+
+    epoll_ctl(server->epfd, EPOLL_CTL_DEL, session->fd, NULL);
+    timer_del(&server->wheel, &session->game.deadline);
+    list_move_tail(&session->list, &server->reaped);
+    server->n_session--;
+    session->dead = 1;
+}
+
+static void server_reap(struct server *server)
+{
+    while (!list_empty(&server->reaped))
+        session_free(server, list_entry(server->reaped.next, struct session, list));
+}
+
+static int session_set_events(struct server *server, struct session *session, unsigned int events)
+{
+    struct epoll_event ev = { .events = events, .data.ptr = session };
+
+    if (session->events == events)
+        return 0;
+
+    session->events = events;
+    return epoll_ctl(server->epfd, EPOLL_CTL_MOD, session->fd, &ev);
+}
+
+/* @return: < 0 connection broken, == 0 all sent, > 0 would block */
+static int session_flush(struct session *session)
+{
+    ssize_t n;
+
+    fflush(session->out);
+    while (session->out_off < session->out_len) {
+        n = send(session->fd, session->out_buf + session->out_off, session->out_len - session->out_off,
+                 MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 1;
+        if (n <= 0)
+            return -1;
+        session->out_off += n;
+    }
+
+    session->out_off = session->out_len = 0;
+    return 0;
+}
+
+/* output of game stopped for good */
+static void session_stop(struct session *session)
+{
+    if (session->closing)
+        return;
+
+    /* dumps to the client if the game asked for it */
+    game_exit(&session->game);
+    session->closing = 1;
+}
+
+static void session_feed(struct session *session, char *line)
+{
+    const struct game_prompt *prompt;
+
+    prompt = game_feed(&session->game, line);
+    if (prompt->type == GAME_PROMPT_NONE)
+        session_stop(session);
+}
+
+/* split input into lines, @return: < 0 peer gone */
+static int session_read(struct session *session)
+{
+    char *buf = session->in_buf;
+    size_t max = sizeof(session->in_buf) - 1;
+    char *eol;
+    ssize_t n;
+
+    n = read(session->fd, buf + session->in_len, max - session->in_len);
+    if (n < 0)
+        return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+    if (n == 0)
+        return -1;
+
+    session->in_len += n;
+    buf[session->in_len] = '\0';
+
+    while (!session->closing && (eol = memchr(buf, '\n', session->in_len))) {
+        size_t len = eol - buf + 1;
+        char saved = buf[len];
+
+        /* line is tokenized in place, keep the next one intact */
+        buf[len] = '\0';
+        if (session->in_discard)
+            session->in_discard = 0;
+        else
+            session_feed(session, buf);
+        buf[len] = saved;
+
+        session->in_len -= len;
+        memmove(buf, buf + len, session->in_len + 1);
+    }
+
+    if (session->in_len == max) {
+        game_err("line length exceeds maximum %zu characters\n", max - 1);
+        session->in_len = 0;
+        session->in_discard = 1;
+    }
+    return 0;
+}
+
+/* flush and pick events, @return: < 0 session is done */
+static int session_update(struct server *server, struct session *session)
+{
+    unsigned int events = 0;
+    int ret;
+
+    ret = session_flush(session);
+    if (ret < 0)
+        return -1;
+    if (!ret && session->closing)
+        return -1;
+
+    /* new prompt, new deadline */
+    if (session->closing)
+        timer_del(&server->wheel, &session->game.deadline);
+    else
+        game_deadline_arm(&session->game, &server->wheel);
+
+    if (ret > 0)
+        events |= EPOLLOUT;
+    /* slow reader, hold its input until output drains */
+    if (!session->closing && session->out_len - session->out_off < SERVER_OUT_HIGH)
+        events |= EPOLLIN;
+
+    return session_set_events(server, session, events);
+}
+
+static void server_accept(struct server *server)
+{
+    struct epoll_event ev = { .events = EPOLLIN };
+    struct session *session;
+    int fd;
+
+    while ((fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        session = session_new(fd);
+        if (!session) {
+            game_err("fail to create session\n");
+            close(fd);
+            continue;
+        }
+
+        ev.data.ptr = session;
+        session->events = ev.events;
+        if (epoll_ctl(server->epfd, EPOLL_CTL_ADD, fd, &ev)) {
+            game_uninit(&session->game);
+            fclose(session->out);
+            free(session);
+            close(fd);
+            continue;
+        }
+
+        session->game.turn_deadline_ms = server->turn_deadline_ms;
+        session->game.prompt_deadline_ms = server->prompt_deadline_ms;
+
+        list_add_tail(&session->list, &server->sessions);
+        server->n_session++;
+        server->n_served++;
+
+        /* first prompt */
+        session_feed(session, NULL);
+        if (session_update(server, session))
+            session_kill(server, session);
+    }
+}
+
+/* players out of time get the default answer */
+static void server_tick(struct server *server)
+{
+    struct list_head expired;
+    struct session *session;
+
+    INIT_LIST_HEAD(&expired);
+    timer_wheel_tick(&server->wheel, &expired);
+
+    while (!list_empty(&expired)) {
+        session = container_of(expired.next, struct session, game.deadline.node);
+        list_del_init(&session->game.deadline.node);
+
+        if (game_timeout(&session->game)->type == GAME_PROMPT_NONE)
+            session_stop(session);
+        if (session_update(server, session))
+            session_kill(server, session);
+    }
+}
+
+static void server_handle(struct server *server, struct session *session, unsigned int events)
+{
+    int ret = 0;
+
+    if (session->dead)
+        return;
+
+    if (events & (EPOLLERR | EPOLLHUP) && !(events & EPOLLIN))
+        ret = -1;
+    else if (events & EPOLLIN)
+        ret = session_read(session);
+
+    if (ret < 0 || session_update(server, session))
+        session_kill(server, session);
+}
+
+int server_run(struct server *server)
+{
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    int i, n;
+
+    while (!g_game_events.event_term) {
+        n = epoll_wait(server->epfd, events, SERVER_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            game_err("epoll wait fail: %s\n", strerror(errno));
+            return -1;
+        }
+
+        for (i = 0; i < n; i++) {
+            if (!events[i].data.ptr)
+                server_accept(server);
+            else if (events[i].data.ptr == &g_game_events)
+                game_events_read(&g_game_events);
+            else if (events[i].data.ptr == &server->wheel)
+                server_tick(server);
+            else
+                server_handle(server, events[i].data.ptr, events[i].events);
+        }
+        server_reap(server);
+        timer_wheel_sync(&server->wheel);
+    }
+
+    game_dbg("killed by signal %d, %ld sessions served\n", g_game_events.event_term, server->n_served);
+    return 0;
+}
+
+void server_uninit(struct server *server)
+{
+    struct list_head *p, *n;
+
+    list_for_each_safe(p, n, &server->sessions)
+        session_free(server, list_entry(p, struct session, list));
+    server_reap(server);
+
+    close(server->epfd);
+    timer_wheel_uninit(&server->wheel);
+    close(server->listen_fd);
+    if (server->path[0])
+        unlink(server->path);
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "common.h"
+#include "list.h"
+#include "game.h"
+
+/* stop reading a session while this much output is unsent */
+#define SERVER_OUT_HIGH   (64 * 1024)
+#define SERVER_MAX_EVENTS 64
+#define SERVER_BACKLOG    128
+#define SERVER_PATH_SZ    108
+
+/*
+ * Many independent games in one process, one per connection. Sessions speak
+ * the console command language line by line, each line goes to game_feed()
+ * and the game output is sent back. A session ends when its game stops, a
+ * dump is sent before the connection closes. Deadlines of all sessions
+ * share one timer wheel, so an idle player cannot hold up a game.
+ */
+struct session {
+    struct list_head list;
+    int fd;
+    /* events registered in epoll */
+    unsigned int events;
+    /* game stopped, close once output is sent */
+    int closing;
+    /* connection done, on the reap list until the events at hand are handled */
+    int dead;
+
+    struct game game;
+    /* ui output and dump of game, appends to out_buf */
+    FILE *out;
+
+    char in_buf[INPUT_BUF_SIZE];
+    size_t in_len;
+    /* rest of an over long line is dropped */
+    int in_discard;
+
+    char *out_buf;
+    size_t out_len;
+    size_t out_off;
+    size_t out_cap;
+};
+
+struct server {
+    int epfd;
+    int listen_fd;
+    /* unix socket path to unlink, empty for tcp */
+    char path[SERVER_PATH_SZ];
+
+    struct list_head sessions;
+    /* dead sessions, freed after each epoll batch */
+    struct list_head reaped;
+    long n_session;
+    long n_served;
+
+    /* deadlines of every session game, 0 for none */
+    long turn_deadline_ms;
+    long prompt_deadline_ms;
+    struct timer_wheel wheel;
+};
+
+/* @addr: "unix:PATH", or "tcp:PORT" listening on loopback */
+int server_init(struct server *server, const char *addr);
+void server_uninit(struct server *server);
+/* serve until SIGINT/SIGTERM, @return: < 0 err */
+int server_run(struct server *server);
@@ -0,0 +1,109 @@
+#include "common.h"
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include "timer.h"
+
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+
+_Static_assert(!(TIMER_WHEEL_SLOTS & TIMER_WHEEL_MASK), "wheel slots must be power of 2");
+
+int timer_wheel_init(struct timer_wheel *wheel, long tick_ms)
+{
+    int i;
+
+    assert(tick_ms > 0);
+
+    for (i = 0; i < TIMER_WHEEL_SLOTS; i++)
+        INIT_LIST_HEAD(&wheel->slots[i]);
+    wheel->now = 0;
+    wheel->n_timer = 0;
+    wheel->tick_ms = tick_ms;
+    wheel->ticking = 0;
+
+    wheel->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    return wheel->fd < 0 ? -1 : 0;
+}
+
+void timer_wheel_uninit(struct timer_wheel *wheel)
+{
+    if (wheel->fd >= 0)
+        close(wheel->fd);
+    wheel->fd = -1;
+}
+
+void timer_init(struct timer *timer)
+{
+    INIT_LIST_HEAD(&timer->node);
+    timer->expire = 0;
+}
+
+void timer_add(struct timer_wheel *wheel, struct timer *timer, uint64_t ticks)
+{
+    timer_del(wheel, timer);
+
+    timer->expire = wheel->now + (ticks ? ticks : 1);
+    list_add_tail(&timer->node, &wheel->slots[timer->expire & TIMER_WHEEL_MASK]);
+    wheel->n_timer++;
+}
+
+void timer_del(struct timer_wheel *wheel, struct timer *timer)
+{
+    if (!timer_pending(timer))
+        return;
+
+    list_del_init(&timer->node);
+    wheel->n_timer--;
+}
+
+void timer_wheel_advance(struct timer_wheel *wheel, uint64_t ticks, struct list_head *expired)
+{
+    struct list_head *p, *n, *slot;
+    struct timer *timer;
+    uint64_t i, n_slot;
+
+    /* a long stall visits every slot once */
+    n_slot = ticks < TIMER_WHEEL_SLOTS ? ticks : TIMER_WHEEL_SLOTS;
+    wheel->now += ticks;
+
+    for (i = 0; i < n_slot; i++) {
+        slot = &wheel->slots[(wheel->now - i) & TIMER_WHEEL_MASK];
+
+        list_for_each_safe(p, n, slot) {
+            timer = list_entry(p, struct timer, node);
+            if (timer->expire > wheel->now)
+                continue;
+
+            list_move_tail(&timer->node, expired);
+            wheel->n_timer--;
+        }
+    }
+}
+
+void timer_wheel_sync(struct timer_wheel *wheel)
+{
+    struct itimerspec its = {};
+    int on = wheel->n_timer > 0;
+
+    if (on == wheel->ticking)
+        return;
+
+    if (on) {
+        its.it_interval.tv_sec = wheel->tick_ms / 1000;
+        its.it_interval.tv_nsec = wheel->tick_ms % 1000 * 1000000;
+        its.it_value = its.it_interval;
+    }
+
+    /* idle wheel does not wake anybody up */
+    if (!timerfd_settime(wheel->fd, 0, &its, NULL))
+        wheel->ticking = on;
+}
+
+void timer_wheel_tick(struct timer_wheel *wheel, struct list_head *expired)
+{
+    uint64_t ticks;
+
+    if (read(wheel->fd, &ticks, sizeof(ticks)) != sizeof(ticks))
+        return;
+
+    timer_wheel_advance(wheel, ticks, expired);
+}
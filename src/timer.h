@@ -0,0 +1,62 @@
+#pragma once
+#include <stdint.h>
+#include "common.h"
+#include "list.h"
+
+/* slots of the wheel, power of 2 */
+#define TIMER_WHEEL_SLOTS 256
+
+/*
+ * Hashed timer wheel. A timer lands in slot expire % TIMER_WHEEL_SLOTS,
+ * timers further out than one turn of the wheel wait in the slot until
+ * their round comes. Adding and deleting is O(1), and a tick only looks
+ * at the timers of one slot, however many games are running.
+ */
+struct timer {
+    struct list_head node;
+    /* tick of expiry */
+    uint64_t expire;
+};
+
+struct timer_wheel {
+    struct list_head slots[TIMER_WHEEL_SLOTS];
+    /* ticks advanced so far */
+    uint64_t now;
+    long n_timer;
+
+    /* timerfd driving the wheel, only ticks while timers are pending */
+    int fd;
+    long tick_ms;
+    int ticking;
+};
+
+/* @return: < 0 err */
+int timer_wheel_init(struct timer_wheel *wheel, long tick_ms);
+void timer_wheel_uninit(struct timer_wheel *wheel);
+
+void timer_init(struct timer *timer);
+
+static inline int timer_pending(struct timer *timer)
+{
+    return !list_empty(&timer->node);
+}
+
+/* (re)arm @timer to expire @ticks from now, at least one tick */
+void timer_add(struct timer_wheel *wheel, struct timer *timer, uint64_t ticks);
+void timer_del(struct timer_wheel *wheel, struct timer *timer);
+
+static inline uint64_t timer_ms_to_ticks(struct timer_wheel *wheel, long ms)
+{
+    return (ms + wheel->tick_ms - 1) / wheel->tick_ms;
+}
+
+/*
+ * Move the wheel @ticks forward. Expired timers are moved to @expired,
+ * the caller takes them off the list with list_del_init() before handling.
+ */
+void timer_wheel_advance(struct timer_wheel *wheel, uint64_t ticks, struct list_head *expired);
+
+/* start or stop wheel->fd as timers come and go, call before waiting on it */
+void timer_wheel_sync(struct timer_wheel *wheel);
+/* wheel->fd is readable, advance by the ticks elapsed */
+void timer_wheel_tick(struct timer_wheel *wheel, struct list_head *expired);
@@ -0,0 +1,75 @@
+#include "common.h"
+#include "track.h"
+
+/* splitmix64 finalizer, keys are the same in every build and run */
+static inline uint64_t track_mix(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+uint64_t track_key(enum track_field field, int idx, int64_t val)
+{
+    if (!val)
+        return 0;
+
+    return track_mix((uint64_t) field << 56 ^ (uint64_t) (uint16_t) idx << 40 ^ (uint32_t) val);
+}
+
+void track_journal_init(struct track_journal *journal, struct track_entry *entries, uint32_t size)
+{
+    assert(size && !(size & (size - 1)));
+
+    memset(journal, 0, sizeof(*journal));
+    journal->entries = entries;
+    journal->size = size;
+}
+
+void track_journal_clear(struct track_journal *journal)
+{
+    journal->head = 0;
+    journal->tail = 0;
+    journal->n_mark = 0;
+    journal->paused = 0;
+}
+
+void track_journal_push(struct track_journal *journal, enum track_field field, int idx, int64_t old_val)
+{
+    struct track_entry *ent;
+
+    /* full, drop oldest */
+    if (journal->head - journal->tail == journal->size) {
+        ent = &journal->entries[journal->tail++ & (journal->size - 1)];
+        if (ent->field == TRACK_MARK)
+            journal->n_mark--;
+    }
+
+    ent = &journal->entries[journal->head++ & (journal->size - 1)];
+    ent->old_val = old_val;
+    ent->idx = idx;
+    ent->field = field;
+    ent->pad = 0;
+
+    if (field == TRACK_MARK)
+        journal->n_mark++;
+}
+
+const struct track_entry *track_journal_top(const struct track_journal *journal)
+{
+    if (journal->head == journal->tail)
+        return NULL;
+
+    return &journal->entries[(journal->head - 1) & (journal->size - 1)];
+}
+
+void track_journal_pop(struct track_journal *journal)
+{
+    if (journal->head == journal->tail)
+        return;
+
+    if (track_journal_top(journal)->field == TRACK_MARK)
+        journal->n_mark--;
+    journal->head--;
+}
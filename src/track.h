@@ -0,0 +1,106 @@
+#pragma once
+#include <stdint.h>
+#include "common.h"
+
+/*
+ * Tracked game state. Every mutation of a field below goes through
+ * track_update(), which keeps an incremental Zobrist style hash, the xor of
+ * one key per (field, object, value). Zero values have no key, so a freshly
+ * reset game hashes to 0. With a journal attached, the old value of every
+ * update is also kept so turns can be undone.
+ */
+enum track_field {
+    /* per player, idx is player idx */
+    TRACK_PLAYER_POS,
+    TRACK_PLAYER_MONEY,
+    TRACK_PLAYER_POINTS,
+    TRACK_PLAYER_BLOCK,
+    TRACK_PLAYER_BOMB,
+    TRACK_PLAYER_ROBOT,
+    TRACK_PLAYER_GOD,
+    TRACK_PLAYER_EMPTY,
+    TRACK_PLAYER_BANKRUPT,
+    TRACK_PLAYER_ATTACHED,
+    /* stat flags derived from buffs */
+    TRACK_PLAYER_GOD_ON,
+    TRACK_PLAYER_EMPTY_ON,
+    /* per map node, idx is map pos */
+    TRACK_NODE_OWNER,
+    TRACK_NODE_LEVEL,
+    TRACK_NODE_ITEM,
+    TRACK_NODE_ITEM_OWNER,
+    /* idx is 0 */
+    TRACK_NEXT_PLAYER,
+    TRACK_NEXT_SEQ,
+    TRACK_BANKRUPT_NR,
+    /* per player, after the rest so the keys of older fields stay put */
+    TRACK_PLAYER_SELL,
+    TRACK_FIELD_MAX,
+    /* journal only, start of a turn */
+    TRACK_MARK = TRACK_FIELD_MAX,
+};
+
+struct track_entry {
+    int32_t old_val;
+    int16_t idx;
+    uint8_t field;
+    uint8_t pad;
+};
+
+/* ring of old values, oldest entries are dropped when full */
+struct track_journal {
+    struct track_entry *entries;
+    /* power of 2 */
+    uint32_t size;
+    /* ever pushed, and oldest entry kept */
+    uint64_t head;
+    uint64_t tail;
+    /* turn marks between tail and head */
+    long n_mark;
+    /* set while undoing */
+    int paused;
+};
+
+struct track {
+    uint64_t hash;
+    /* optional */
+    struct track_journal *journal;
+};
+
+/* value of player pointer fields, 0 for none */
+#define TRACK_PLAYER_ID(player) ((player) ? (player)->idx + 1 : 0)
+/* value of item fields, 0 for ITEM_INVALID */
+#define TRACK_ITEM_ID(item)     ((item) + 1)
+
+uint64_t track_key(enum track_field field, int idx, int64_t val);
+
+void track_journal_init(struct track_journal *journal, struct track_entry *entries, uint32_t size);
+void track_journal_clear(struct track_journal *journal);
+void track_journal_push(struct track_journal *journal, enum track_field field, int idx, int64_t old_val);
+/* @return: top entry without popping, NULL if empty */
+const struct track_entry *track_journal_top(const struct track_journal *journal);
+void track_journal_pop(struct track_journal *journal);
+
+static inline void track_update(struct track *track, enum track_field field, int idx, int64_t old_val, int64_t new_val)
+{
+    if (!track || old_val == new_val)
+        return;
+
+    track->hash ^= track_key(field, idx, old_val) ^ track_key(field, idx, new_val);
+    if (track->journal && !track->journal->paused)
+        track_journal_push(track->journal, field, idx, old_val);
+}
+
+/* start of a turn, undo stops at marks */
+static inline void track_mark(struct track *track)
+{
+    if (track && track->journal && !track->journal->paused)
+        track_journal_push(track->journal, TRACK_MARK, 0, 0);
+}
+
+/* assign @val to @lval, which is @field of object @idx */
+#define track_set(track, field, idx, lval, val) do {            \
+    __typeof__(lval) __track_val = (val);                       \
+    track_update(track, field, idx, (lval), __track_val);       \
+    (lval) = __track_val;                                       \
+} while (0)
@@ -1,4 +1,5 @@
 #include <stdarg.h>
+#include <errno.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include "common.h"
@@ -6,6 +7,7 @@
 #include "ui.h"
 #include "game.h"
 #include "term.h"
+#include "arena.h"
 
 
 static const char item_ui_char[] = {
@@ -29,12 +31,26 @@ static const char *player_ui_color[] = {
     [PLAYER_COLOR_WHITE] = VT100_COLOR_WHITE,
 };
 
-int ui_init(struct ui *ui)
+static void *ui_calloc(struct ui *ui, size_t n, size_t size)
+{
+    if (ui->arena)
+        return arena_calloc(ui->arena, n, size);
+    return calloc(n, size);
+}
+
+static void ui_free(struct ui *ui, void *ptr)
+{
+    if (!ui->arena)
+        free(ptr);
+}
+
+int ui_init(struct ui *ui, struct arena *arena)
 {
     int i;
     int ret = 0;
 
     memset(ui, 0, sizeof(*ui));
+    ui->arena = arena;
     ui->in = stdin;
     ui->out = stdout;
     ui->err = stderr;
@@ -49,14 +65,15 @@ int ui_init(struct ui *ui)
     }
 
     ui->in_buf_size = INPUT_BUF_SIZE;
-    ui->in_buf = calloc(1, INPUT_BUF_SIZE);
+    ui->in_buf = ui_calloc(ui, 2, INPUT_BUF_SIZE);
     if (!ui->in_buf)
         return -1;
+    ui->in_line = ui->in_buf + INPUT_BUF_SIZE;
 
     ui->out_idx = 0;
     ui->out_offset = 0;
     ui->out_buf_size = OUT_BUF_SIZE;
-    ui->out_buf[0] = calloc(N_OUT_BUF, OUT_BUF_SIZE);
+    ui->out_buf[0] = ui_calloc(ui, N_OUT_BUF, OUT_BUF_SIZE);
     if (!ui->out_buf[0]) {
         ret = -2;
         goto err_freein;
@@ -66,7 +83,7 @@ int ui_init(struct ui *ui)
 
     ui->fmt_idx = 0;
     ui->fmt_buf_size = FORMAT_BUF_SIZE;
-    ui->fmt_buf[0] = calloc(N_FORMAT_BUF, FORMAT_BUF_SIZE);
+    ui->fmt_buf[0] = ui_calloc(ui, N_FORMAT_BUF, FORMAT_BUF_SIZE);
     if (!ui->fmt_buf[0]) {
         ret = -3;
         goto err_freeout;
@@ -74,16 +91,15 @@ int ui_init(struct ui *ui)
     for (i = 1; i < N_FORMAT_BUF; i++)
         ui->fmt_buf[i] = ui->fmt_buf[0] + i * FORMAT_BUF_SIZE;
 
-    setvbuf(ui->in, NULL, _IONBF, 0);
     return 0;
 
 err_freeout:
-    free(ui->out_buf[0]);
+    ui_free(ui, ui->out_buf[0]);
     for (i = 0; i < N_OUT_BUF; i++)
         ui->out_buf[i] = NULL;
 
 err_freein:
-    free(ui->in_buf);
+    ui_free(ui, ui->in_buf);
     ui->in_buf = NULL;
     return ret;
 }
@@ -93,13 +109,14 @@ int ui_uninit(struct ui *ui)
     int i;
 
     if (ui->in_buf) {
-        free(ui->in_buf);
+        ui_free(ui, ui->in_buf);
         ui->in_buf = NULL;
+        ui->in_line = NULL;
         ui->in_buf_size = 0;
     }
 
     if (ui->out_buf[0]) {
-        free(ui->out_buf[0]);
+        ui_free(ui, ui->out_buf[0]);
         for (i = 0; i < N_OUT_BUF; i++)
             ui->out_buf[i] = NULL;
 
@@ -109,7 +126,7 @@ int ui_uninit(struct ui *ui)
     }
 
     if (ui->fmt_buf[0]) {
-        free(ui->fmt_buf[0]);
+        ui_free(ui, ui->fmt_buf[0]);
         for (i = 0; i < N_FORMAT_BUF; i++)
             ui->fmt_buf[i] = NULL;
 
@@ -119,6 +136,22 @@ int ui_uninit(struct ui *ui)
     return 0;
 }
 
+/* drop buffered context and screen mode, keep buffers and terminal info */
+void ui_reset(struct ui *ui)
+{
+    if (ui->out_buf[0])
+        memset(ui->out_buf[0], 0, N_OUT_BUF * ui->out_buf_size);
+
+    ui->out_idx = 0;
+    ui->out_offset = 0;
+    ui->fmt_idx = 0;
+
+    ui->use_clear = 0;
+    ui->clear_ctx = 0;
+    ui->use_setwin = 0;
+    ui->mute = 0;
+}
+
 int ui_is_interactive(struct ui *ui)
 {
     return ui && ui->in_isatty && ui->out_isatty;
@@ -177,6 +210,10 @@ static int ui_buffered_vprintf(struct ui *ui, int newline, int do_print, const c
 
     assert(size >= 2);
 
+    /* nobody reads muted output back, skip formatting it */
+    if (ui->mute)
+        return 0;
+
     n = ui_vsnprintf(buf, size, fmt, ap);
 
     /* full line or truncated, force a new line */
@@ -188,7 +225,7 @@ static int ui_buffered_vprintf(struct ui *ui, int newline, int do_print, const c
         n = size - 1;
     }
 
-    if (do_print)
+    if (do_print && !ui->mute)
         fputs(buf, ui->out);
 
     if (newline) {
@@ -264,67 +301,86 @@ void ui_prompt_player_name(struct ui *ui, struct player *player)
 }
 
 
-static void discard_line(FILE *where)
+/* read what input is ready, call when input is readable. @return: < 0 eof */
+int ui_input_fill(struct ui *ui)
 {
-    int c;
+    ssize_t n;
 
-    while ((c = getc(where)) != EOF) {
-        if (c == '\n')
-            return;
+    if (ui->in_eof)
+        return -1;
+    if (ui->in_len >= ui->in_buf_size)
+        return 0;
+
+    n = read(fileno(ui->in), ui->in_buf + ui->in_len, ui->in_buf_size - ui->in_len);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN))
+        return 0;
+    if (n < 0)
+        game_err("fail to read input, %s\n", strerror(errno));
+
+    if (n <= 0) {
+        game_dbg("end of file\n");
+        ui->in_eof = 1;
+        return -1;
     }
+
+    ui->in_len += n;
+    return 0;
 }
 
-/* @return NULL if eof, empty string if nothing is read */
-char *ui_read_line(struct ui *ui)
+static void ui_input_consume(struct ui *ui, int len)
+{
+    ui->in_len -= len;
+    memmove(ui->in_buf, ui->in_buf + len, ui->in_len);
+}
+
+/* @return: next line of buffered input, NULL if no full line yet */
+char *ui_input_line(struct ui *ui)
 {
-    char *ret;
     char *buf = ui->in_buf;
-    int size = ui->in_buf_size;
+    char *line = ui->in_line;
+    int max = ui->in_buf_size - 2;
+    char *eol;
+    int len;
 
-    if (!buf || size < 2) {
-        game_err("input buffer error, can't read\n");
+again:
+    eol = memchr(buf, '\n', ui->in_len < max + 1 ? ui->in_len : max + 1);
+    if (eol) {
+        len = eol - buf + 1;
+    } else if (ui->in_len > max) {
+        /* keep head of line, drop the rest */
+        len = max;
+    } else if (ui->in_eof && ui->in_len) {
+        /* last line without newline */
+        len = ui->in_len;
+    } else {
         return NULL;
     }
 
-    /* guard */
-    buf[size - 2] = buf[size - 1] = 0;
-
-again:
-    ret = fgets(buf, size, ui->in);
-    if (!ret) {
-        if (feof(ui->in)) {
-            game_dbg("end of file\n");
-            return NULL;
-        }
-        if (g_game_events.event_term) {
-            game_dbg("killed by signal %d\n", g_game_events.event_term);
-            g_game_events.event_term = 0;
-            return NULL;
-        }
-        if (g_game_events.event_winch) {
-            /* handle window resize later in main game loop */
-            goto again;
-        }
-        game_err("fail to read input\n");
-        return "";
+    if (ui->in_discard) {
+        ui_input_consume(ui, len);
+        ui->in_discard = !eol;
+        goto again;
     }
 
-    /* check guard */
-    if (buf[size - 2] && buf[size - 2] != '\n') {
-        game_err("line length exceeds maximum %d characters\n", size - 2);
-        buf[size - 2] = '\n';
-        discard_line(ui->in);
+    memcpy(line, buf, len);
+    ui_input_consume(ui, len);
+
+    if (!eol && len == max) {
+        game_err("line length exceeds maximum %d characters\n", max);
+        ui->in_discard = 1;
+        line[len++] = '\n';
     }
+    line[len] = '\0';
 
     if (!ui->in_isatty) {
         /* echo back user input, a newline is expected in buf */
-        ui_bprintln(ui, "%s", buf);
+        ui_bprintln(ui, "%s", line);
     } else {
-        ui_bufferln(ui, "%s", buf);
+        ui_bufferln(ui, "%s", line);
     }
 
-    game_dbg("read line: %s", ret);
-    return ret;
+    game_dbg("read line: %s", line);
+    return line;
 }
 
 static inline int ui_cmd_eol(int c)
@@ -360,20 +416,18 @@ int ui_cmd_tokenize(char *cmd, const char *argv[], int n)
     return argc;
 }
 
-/* @return: < 0 fatal err, == 0 try again, > 0 done */
-int ui_input_bool_prompt(struct ui *ui, const char *prompt, int *res)
+void ui_input_bool_prompt(struct ui *ui, const char *prompt)
 {
-    char *line = NULL;
-    const char *toks[4], *ans;
-    int val;
-    int n_tok;
-
     if (prompt)
         ui_bprints(ui, "%s (y/n) ", prompt);
+}
 
-    line = ui_read_line(ui);
-    if (!line)
-        return -1;
+/* @return: == 0 try again, > 0 done */
+int ui_input_bool(struct ui *ui, char *line, int *res)
+{
+    const char *toks[4], *ans;
+    int val;
+    int n_tok;
 
     n_tok = ui_cmd_tokenize(line, toks, ARRAY_SIZE(toks));
     if (n_tok == 0) {
@@ -403,20 +457,19 @@ int ui_input_bool_prompt(struct ui *ui, const char *prompt, int *res)
     return 1;
 }
 
-/* @return: < 0 fatal err, == 0 try again, > 0 done */
-int ui_input_int_prompt(struct ui *ui, const char *prompt, const struct range *range, int *res)
+void ui_input_int_prompt(struct ui *ui, const char *prompt)
 {
-    char *endptr, *line = NULL;
-    const char *toks[4];
-    int n_tok, num;
-
     /* no newline expected in prompt */
     if (prompt)
         ui_bprints(ui, "%s", prompt);
+}
 
-    line = ui_read_line(ui);
-    if (!line)
-        return -1;
+/* @return: == 0 try again, > 0 done */
+int ui_input_int(struct ui *ui, char *line, const struct range *range, int *res)
+{
+    char *endptr;
+    const char *toks[4];
+    int n_tok, num;
 
     n_tok = ui_cmd_tokenize(line, toks, ARRAY_SIZE(toks));
     if (n_tok == 0) {
@@ -442,14 +495,11 @@ int ui_input_int_prompt(struct ui *ui, const char *prompt, const struct range *r
     return 1;
 }
 
-/* @return: < 0 fatal err, == 0 try again, > 0 chosen */
-int ui_selection_menu_prompt(struct ui *ui, const char *prompt, struct select *sel)
+/* @return: < 0 nothing to choose, == 0 good */
+int ui_selection_menu_prompt(struct ui *ui, const char *prompt, const struct select *sel)
 {
     int i;
-    struct choice *choice;
-    char *line = NULL;
-    const char *toks[4];
-    int n_tok;
+    const struct choice *choice;
 
     if (sel->n_choice <= 0)
         return -1;
@@ -475,10 +525,16 @@ int ui_selection_menu_prompt(struct ui *ui, const char *prompt, struct select *s
             ui_bprintln(ui, ") %s\n", "NULL");
     }
     ui_bprints(ui, "input your choice? ");
+    return 0;
+}
 
-    line = ui_read_line(ui);
-    if (!line)
-        return -1;
+/* @return: == 0 try again, > 0 chosen */
+int ui_selection_menu(struct ui *ui, char *line, struct select *sel)
+{
+    int i;
+    struct choice *choice;
+    const char *toks[4];
+    int n_tok;
 
     n_tok = ui_cmd_tokenize(line, toks, ARRAY_SIZE(toks));
     if (n_tok == 0) {
@@ -515,7 +571,6 @@ int ui_selection_menu_prompt(struct ui *ui, const char *prompt, struct select *s
     return 0;
 }
 
-
 static const char node_render_tab[MAP_NODE_MAX] = {
     [MAP_NODE_START] = 'S',
     [MAP_NODE_VACANCY] = '0',
@@ -530,20 +585,11 @@ static const char node_render_tab[MAP_NODE_MAX] = {
 
 static void map_node_render(struct ui *ui, struct map *map, unsigned line, unsigned col)
 {
-    int pos = -1;
+    int pos;
     struct map_node *node;
     struct player *player, *owner;
 
-    if (line == 0) {
-        pos = col;
-    } else if (line == map->height - 1) {
-        pos = map->n_used - (map->height - 1) - col;
-    } else if (col == 0) {
-        pos = map->n_used - line;
-    } else if (col == map->width - 1) {
-        pos = map->width + (line - 1);
-    }
-
+    pos = map_screen_pos(map, line, col);
     if (pos < 0) {
         fputc(' ', ui->out);
         return;
@@ -599,7 +645,8 @@ void ui_map_render(struct ui *ui, struct map *map)
 {
     int line, col;
 
-    if (!map->dirty)
+    /* keep dirty, render once unmuted */
+    if (!map->dirty || ui->mute)
         return;
 
     map->dirty = 0;
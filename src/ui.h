@@ -13,6 +13,9 @@
 #define N_FORMAT_BUF   4
 
 struct ui {
+    /* owner of buffers, NULL if buffers are from calloc */
+    struct arena *arena;
+
     FILE *in;
     FILE *out;
     FILE *err;
@@ -26,8 +29,14 @@ struct ui {
     int clear_ctx;
     int use_setwin;
 
+    /* raw input, and the last line taken from it */
     int in_buf_size;
     char *in_buf;
+    char *in_line;
+    int in_len;
+    /* rest of an over long line is dropped */
+    int in_discard;
+    int in_eof;
 
     int out_buf_size;
     char *out_buf[N_OUT_BUF];
@@ -37,10 +46,14 @@ struct ui {
     int fmt_buf_size;
     char *fmt_buf[N_FORMAT_BUF];
     int fmt_idx;
+
+    /* drop all output, used when replaying */
+    int mute;
 };
 
-int ui_init(struct ui *ui);
+int ui_init(struct ui *ui, struct arena *arena);
 int ui_uninit(struct ui *ui);
+void ui_reset(struct ui *ui);
 int ui_is_interactive(struct ui *ui);
 
 const char *ui_player_name(struct ui *ui, struct player *player);
@@ -54,7 +67,9 @@ void ui_handle_winch(struct ui *ui, struct map *map);
 void ui_prompt_player_name(struct ui *ui, struct player *player);
 int ui_dump_player_stats(struct ui *ui, const char *prompt, struct player *player);
 
-char *ui_read_line(struct ui *ui);
+/* input never blocks, fill when readable and take lines until none is left */
+int ui_input_fill(struct ui *ui);
+char *ui_input_line(struct ui *ui);
 int ui_cmd_tokenize(char *cmd, const char *argv[], int n);
 
 
@@ -69,8 +84,14 @@ int ui_bprints(struct ui *ui, const char *fmt, ...) __printf(2, 3);
 /* buffered, one newline */
 int ui_bprintln(struct ui *ui, const char *fmt, ...) __printf(2, 3);
 
-int ui_input_bool_prompt(struct ui *ui, const char *prompt, int *res);
-int ui_input_int_prompt(struct ui *ui, const char *prompt, const struct range *range, int *res);
+/*
+ * Prompts only print, answers are parsed from a line the caller read, so a
+ * game never blocks on input. Parsing tokenizes @line in place.
+ */
+void ui_input_bool_prompt(struct ui *ui, const char *prompt);
+int ui_input_bool(struct ui *ui, char *line, int *res);
+void ui_input_int_prompt(struct ui *ui, const char *prompt);
+int ui_input_int(struct ui *ui, char *line, const struct range *range, int *res);
 
 struct choice {
     const char *name;
@@ -87,4 +108,5 @@ struct select {
     int n_selected;
 };
 
-int ui_selection_menu_prompt(struct ui *ui, const char *prompt, struct select *sel);
+int ui_selection_menu_prompt(struct ui *ui, const char *prompt, const struct select *sel);
+int ui_selection_menu(struct ui *ui, char *line, struct select *sel);
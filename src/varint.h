@@ -0,0 +1,45 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/* LEB128 varints, signed values are zigzag encoded first */
+#define VARINT_MAX_LEN 10
+
+static inline uint64_t varint_zigzag(int64_t val)
+{
+    return ((uint64_t) val << 1) ^ (uint64_t) (val >> 63);
+}
+
+static inline int64_t varint_unzigzag(uint64_t val)
+{
+    return (int64_t) (val >> 1) ^ -(int64_t) (val & 1);
+}
+
+/* @return: bytes written to @buf, at most VARINT_MAX_LEN */
+static inline int varint_put(unsigned char *buf, uint64_t val)
+{
+    int n = 0;
+
+    while (val >= 0x80) {
+        buf[n++] = val | 0x80;
+        val >>= 7;
+    }
+    buf[n++] = val;
+    return n;
+}
+
+/* @return: bytes consumed, < 0 if truncated or too long */
+static inline int varint_get(const unsigned char *buf, size_t size, uint64_t *val)
+{
+    uint64_t v = 0;
+    size_t n = 0;
+
+    do {
+        if (n >= size || n >= VARINT_MAX_LEN)
+            return -1;
+        v |= (uint64_t) (buf[n] & 0x7f) << (7 * n);
+    } while (buf[n++] & 0x80);
+
+    *val = v;
+    return n;
+}
@@ -0,0 +1,516 @@
+#include "common.h"
+#include "vec_env.h"
+#include "bot.h"
+#include "search.h"
+
+struct vec_env_game {
+    struct game game;
+    struct vec_env *env;
+    int idx;
+    uint64_t rng;
+
+    /* player idx of the agent and of every seat, the agent first */
+    int agent;
+    int order[GAME_PLAYER_MAX];
+    /* seat of each player idx in the order search_score() takes */
+    int seats[PLAYER_MAX];
+    /* agent action to play, < 0 none */
+    int pending;
+    int n_decision;
+    float share;
+};
+
+struct vec_env {
+    struct game_image img;
+    const struct bot_policy *opponent;
+    int horizon;
+
+    int n_game;
+    struct vec_env_game *games;
+    struct vec_env_obs obs;
+
+    /* of the running step, NULL to reset */
+    const int32_t *actions;
+    int err;
+};
+
+/* xorshift64*, one stream per game apart from the dice of the real game */
+static inline uint32_t vec_env_rand(struct vec_env_game *g, uint32_t n)
+{
+    g->rng ^= g->rng >> 12;
+    g->rng ^= g->rng << 25;
+    g->rng ^= g->rng >> 27;
+    return (uint32_t) ((g->rng * 0x2545f4914f6cdd1dULL) >> 32) % n;
+}
+
+static inline uint8_t *vec_env_legal(struct vec_env_game *g)
+{
+    return g->env->obs.legal + (long) g->idx * VEC_ENV_N_ACT;
+}
+
+/* @return: pending action of the agent if taken as it is, else the first legal one, < 0 none */
+static int vec_env_take(struct vec_env_game *g)
+{
+    const uint8_t *legal = vec_env_legal(g);
+    int a = g->pending, i;
+
+    if (a < 0)
+        return -1;
+    g->pending = -1;
+
+    if (a < VEC_ENV_N_ACT && legal[a])
+        return a;
+    for (i = 0; i < VEC_ENV_N_ACT; i++) {
+        if (legal[i])
+            return i;
+    }
+    return 0;
+}
+
+static int vec_env_agent_turn(struct controller *ctl, struct game *game, struct player *player, struct act *act)
+{
+    struct vec_env_game *g = ctl->priv;
+    int a = vec_env_take(g);
+
+    if (a < 0)
+        return CONTROLLER_ASK;
+
+    act->val = 0;
+    if (a == VEC_ENV_ACT_ROBOT) {
+        act->type = ACT_ROBOT;
+    } else if (a >= VEC_ENV_ACT_BLOCK && a < VEC_ENV_ACT_BOMB) {
+        act->type = ACT_BLOCK;
+        act->val = a - VEC_ENV_ACT_BLOCK - GAME_ITEM_BLOCK_RANGE;
+    } else if (a >= VEC_ENV_ACT_BOMB) {
+        act->type = ACT_BOMB;
+        act->val = a - VEC_ENV_ACT_BOMB - GAME_ITEM_BOMB_RANGE;
+    } else {
+        act->type = ACT_STEP;
+        act->val = 1 + vec_env_rand(g, game->dice_facets);
+    }
+    return 0;
+}
+
+static int vec_env_agent_bool(struct controller *ctl, struct game *game, struct player *player, struct map_node *node)
+{
+    int a = vec_env_take(ctl->priv);
+
+    return a < 0 ? CONTROLLER_ASK : !!a;
+}
+
+static int vec_env_agent_menu(struct controller *ctl, struct game *game, struct player *player, const struct select *sel)
+{
+    int a = vec_env_take(ctl->priv);
+
+    return a < 0 ? CONTROLLER_ASK : a;
+}
+
+/* the agent seat answers what the step brought, asks for anything else */
+static const struct controller_ops vec_env_agent_ops = {
+    .name = "vec_env",
+    .decide_turn = vec_env_agent_turn,
+    .decide_buy = vec_env_agent_bool,
+    .decide_upgrade = vec_env_agent_bool,
+    .choose_item = vec_env_agent_menu,
+    .choose_gift = vec_env_agent_menu,
+    .choose_magic_target = vec_env_agent_menu,
+};
+
+static int vec_env_bot_turn(struct controller *ctl, struct game *game, struct player *player, struct act *act)
+{
+    struct vec_env_game *g = ctl->priv;
+    struct player *agent = &game->players[g->agent];
+
+    /* the episode is over, the bots would play on without end */
+    if (!agent->attached || agent->stat.bankrupt)
+        return CONTROLLER_ASK;
+
+    g_bot_ops.decide_turn(ctl, game, player, act);
+    if (act->type == ACT_ROLL) {
+        act->type = ACT_STEP;
+        act->val = 1 + vec_env_rand(ctl->priv, game->dice_facets);
+    }
+    return 0;
+}
+
+static int vec_env_bot_buy(struct controller *ctl, struct game *game, struct player *player, struct map_node *node)
+{
+    return g_bot_ops.decide_buy(ctl, game, player, node);
+}
+
+static int vec_env_bot_upgrade(struct controller *ctl, struct game *game, struct player *player, struct map_node *node)
+{
+    return g_bot_ops.decide_upgrade(ctl, game, player, node);
+}
+
+static int vec_env_bot_item(struct controller *ctl, struct game *game, struct player *player, const struct select *sel)
+{
+    return g_bot_ops.choose_item(ctl, game, player, sel);
+}
+
+static int vec_env_bot_gift(struct controller *ctl, struct game *game, struct player *player, const struct select *sel)
+{
+    return g_bot_ops.choose_gift(ctl, game, player, sel);
+}
+
+static int vec_env_bot_magic(struct controller *ctl, struct game *game, struct player *player, const struct select *sel)
+{
+    return g_bot_ops.choose_magic_target(ctl, game, player, sel);
+}
+
+/* the other seats, the bot with dice of the game */
+static const struct controller_ops vec_env_bot_ops = {
+    .name = "vec_env_bot",
+    .decide_turn = vec_env_bot_turn,
+    .decide_buy = vec_env_bot_buy,
+    .decide_upgrade = vec_env_bot_upgrade,
+    .choose_item = vec_env_bot_item,
+    .choose_gift = vec_env_bot_gift,
+    .choose_magic_target = vec_env_bot_magic,
+};
+
+static float vec_env_share(struct vec_env_game *g)
+{
+    float reward[GAME_PLAYER_MAX];
+
+    search_score(&g->game, g->seats, reward);
+    return reward[g->seats[g->agent]];
+}
+
+/* legal actions of the open decision of the agent */
+static void vec_env_fill_legal(struct vec_env_game *g, struct player *agent)
+{
+    struct game_prompt *prompt = &g->game.prompt;
+    uint8_t *legal = vec_env_legal(g);
+    struct act cands[SEARCH_MAX_CAND];
+    int i, n;
+
+    memset(legal, 0, VEC_ENV_N_ACT);
+    n = search_candidates(&g->game, agent, prompt->decision, &prompt->sel, 1, cands);
+    for (i = 0; i < n; i++) {
+        switch (cands[i].type) {
+        case ACT_ROLL:
+            legal[VEC_ENV_ACT_ROLL] = 1;
+            break;
+        case ACT_ROBOT:
+            legal[VEC_ENV_ACT_ROBOT] = 1;
+            break;
+        case ACT_BLOCK:
+            legal[VEC_ENV_ACT_BLOCK + GAME_ITEM_BLOCK_RANGE + cands[i].val] = 1;
+            break;
+        case ACT_BOMB:
+            legal[VEC_ENV_ACT_BOMB + GAME_ITEM_BOMB_RANGE + cands[i].val] = 1;
+            break;
+        default:
+            if (cands[i].val < VEC_ENV_N_ACT)
+                legal[cands[i].val] = 1;
+            break;
+        }
+    }
+}
+
+static void vec_env_fill(struct vec_env_game *g)
+{
+    struct vec_env_obs *obs = &g->env->obs;
+    struct game *game = &g->game;
+    struct player *player;
+    struct map_node *node;
+    int b = g->idx, s, i, seat_of[PLAYER_MAX];
+    long k;
+
+    obs->decision[b] = game->prompt.decision;
+    vec_env_fill_legal(g, &game->players[g->agent]);
+
+    for (s = 0; s < obs->n_seat; s++) {
+        player = &game->players[g->order[s]];
+        seat_of[player->idx] = s;
+
+        k = (long) b * obs->n_seat + s;
+        obs->pos[k] = player->pos;
+        obs->money[k] = player->asset.n_money;
+        obs->points[k] = player->asset.n_points;
+        obs->empty[k] = player->buff.n_empty_rounds;
+        obs->god[k] = player->buff.n_god_rounds;
+        obs->alive[k] = player->attached && !player->stat.bankrupt;
+    }
+
+    memset(obs->owner + (long) b * obs->n_seat * obs->n_node, 0, (size_t) obs->n_seat * obs->n_node * sizeof(float));
+    memset(obs->item + (long) b * 2 * obs->n_node, 0, 2 * (size_t) obs->n_node * sizeof(float));
+    for (i = 0; i < obs->n_node; i++) {
+        node = &game->map.nodes[i];
+        obs->level[(long) b * obs->n_node + i] = node->type == MAP_NODE_VACANCY ? node->estate.level : 0;
+
+        if (node->type == MAP_NODE_VACANCY && node->estate.owner)
+            obs->owner[((long) b * obs->n_seat + seat_of[node->estate.owner->idx]) * obs->n_node + i] = 1;
+        if (node->item == ITEM_BLOCK || node->item == ITEM_BOMB)
+            obs->item[((long) b * 2 + (node->item == ITEM_BOMB)) * obs->n_node + i] = 1;
+    }
+
+    if (obs->tensor)
+        encode_state(&obs->shape, game, &game->players[g->agent], obs->tensor + b * obs->shape.size);
+}
+
+/* agent asked again, @return: 0 if the game goes on */
+static int vec_env_over(struct vec_env_game *g)
+{
+    const struct game_prompt *prompt = &g->game.prompt;
+    struct player *agent = &g->game.players[g->agent];
+
+    if (g->game.state != GAME_STATE_RUNNING || !agent->attached || agent->stat.bankrupt)
+        return 1;
+    if (prompt->player != agent || prompt->decision < GAME_DECIDE_COMMAND)
+        return 1;
+    return g->n_decision >= g->env->horizon;
+}
+
+/* @return: < 0 err */
+static int vec_env_reset_game(struct vec_env_game *g)
+{
+    struct vec_env *env = g->env;
+    struct game *game = &g->game;
+    struct player *agent;
+    int i;
+
+    if (game_sim_load(game, &env->img, GAME_DECIDE_COMMAND))
+        return -1;
+
+    agent = game->next_player;
+    for (i = 0; i < PLAYER_MAX; i++) {
+        game->ctrls[i] = (struct controller) {
+            .type = CONTROLLER_BOT,
+            .ops = i == agent->idx ? &vec_env_agent_ops : &vec_env_bot_ops,
+            .policy = env->opponent,
+            .priv = g,
+        };
+    }
+
+    g->agent = agent->idx;
+    for (i = 0; i < game->cur_player_nr; i++)
+        g->order[i] = game->cur_players[(agent->seq + i) % game->cur_player_nr]->idx;
+    search_seats(game, g->seats);
+    g->pending = -1;
+    g->n_decision = 0;
+
+    /* the agent moves first, nothing to play yet */
+    game_feed(game, NULL);
+    g->share = vec_env_share(g);
+    vec_env_fill(g);
+    return vec_env_over(g) ? -1 : 0;
+}
+
+/* @return: < 0 err */
+static int vec_env_step_game(struct vec_env_game *g, int action)
+{
+    struct vec_env_obs *obs = &g->env->obs;
+    float share;
+
+    g->pending = action < 0 ? 0 : action;
+    g->n_decision++;
+    game_feed(&g->game, NULL);
+
+    share = vec_env_share(g);
+    obs->reward[g->idx] = share - g->share;
+    g->share = share;
+
+    obs->done[g->idx] = vec_env_over(g);
+    if (!obs->done[g->idx]) {
+        vec_env_fill(g);
+        return 0;
+    }
+
+    __atomic_add_fetch(&obs->n_episode, 1, __ATOMIC_RELAXED);
+    return vec_env_reset_game(g);
+}
+
+static void vec_env_work(struct game *sim, int idx, int n, void *arg)
+{
+    struct vec_env *env = arg;
+    int b, ret;
+
+    for (b = idx; b < env->n_game; b += n) {
+        if (env->actions)
+            ret = vec_env_step_game(&env->games[b], env->actions[b]);
+        else
+            ret = vec_env_reset_game(&env->games[b]);
+        if (ret)
+            env->err = ret;
+    }
+}
+
+static int vec_env_run(struct vec_env *env, const int32_t *actions)
+{
+    env->actions = actions;
+    env->err = 0;
+    if (search_run(vec_env_work, env) <= 0)
+        return -1;
+    return env->err;
+}
+
+/* state of a new game of @players at the first turn, @return: < 0 err */
+static int vec_env_new_image(struct vec_env *env, const char *players)
+{
+    char line[64];
+    struct game *game;
+    int ret = -1;
+
+    game = calloc(1, sizeof(*game));
+    if (!game)
+        return -1;
+    if (game_sim_init(game)) {
+        free(game);
+        return -1;
+    }
+
+    game_feed(game, NULL);
+    snprintf(line, sizeof(line), "preset user %s", players);
+    game_feed(game, line);
+    if (game->state == GAME_STATE_RUNNING && game->prompt.decision == GAME_DECIDE_COMMAND)
+        ret = game_save_image(game, &env->img);
+
+    game_uninit(game);
+    free(game);
+    return ret;
+}
+
+static int vec_env_alloc_obs(struct vec_env_obs *obs)
+{
+    long b = obs->n_env, bs = b * obs->n_seat, bn = b * obs->n_node;
+
+    obs->decision = calloc(b, sizeof(*obs->decision));
+    obs->legal = calloc(b * VEC_ENV_N_ACT, sizeof(*obs->legal));
+    obs->pos = calloc(bs, sizeof(*obs->pos));
+    obs->money = calloc(bs, sizeof(*obs->money));
+    obs->points = calloc(bs, sizeof(*obs->points));
+    obs->empty = calloc(bs, sizeof(*obs->empty));
+    obs->god = calloc(bs, sizeof(*obs->god));
+    obs->alive = calloc(bs, sizeof(*obs->alive));
+    obs->owner = calloc(bs * obs->n_node, sizeof(*obs->owner));
+    obs->level = calloc(bn, sizeof(*obs->level));
+    obs->item = calloc(2 * bn, sizeof(*obs->item));
+    obs->reward = calloc(b, sizeof(*obs->reward));
+    obs->done = calloc(b, sizeof(*obs->done));
+
+    if (!obs->decision || !obs->legal || !obs->pos || !obs->money || !obs->points || !obs->empty || !obs->god
+        || !obs->alive || !obs->owner || !obs->level || !obs->item || !obs->reward || !obs->done)
+        return -1;
+    return 0;
+}
+
+static void vec_env_free_obs(struct vec_env_obs *obs)
+{
+    free(obs->decision);
+    free(obs->legal);
+    free(obs->pos);
+    free(obs->money);
+    free(obs->points);
+    free(obs->empty);
+    free(obs->god);
+    free(obs->alive);
+    free(obs->owner);
+    free(obs->level);
+    free(obs->item);
+    free(obs->reward);
+    free(obs->done);
+}
+
+struct vec_env *vec_env_create(const struct vec_env_config *cfg)
+{
+    struct vec_env *env;
+    int i;
+
+    if (cfg->n_env <= 0)
+        return NULL;
+
+    env = calloc(1, sizeof(*env));
+    if (!env)
+        return NULL;
+
+    if (cfg->img)
+        env->img = *cfg->img;
+    else if (vec_env_new_image(env, cfg->players ? cfg->players : "AQ"))
+        goto err;
+    if (env->img.state != GAME_STATE_RUNNING || env->img.next_player < 0) {
+        game_err("vec_env needs a running game with a player to move\n");
+        goto err;
+    }
+
+    env->opponent = bot_policy_find(cfg->opponent);
+    if (!env->opponent) {
+        game_err("unknown bot policy %s\n", cfg->opponent);
+        goto err;
+    }
+    env->horizon = cfg->horizon > 0 ? cfg->horizon : VEC_ENV_HORIZON;
+
+    env->obs.n_env = cfg->n_env;
+    env->obs.n_seat = env->img.cur_player_nr;
+    env->obs.n_node = env->img.n_node;
+    if (vec_env_alloc_obs(&env->obs))
+        goto err;
+
+    if (cfg->tensor && (uintptr_t) cfg->tensor % ENCODE_ALIGN) {
+        game_err("tensor not aligned to %zu\n", ENCODE_ALIGN);
+        goto err;
+    }
+    env->obs.tensor = cfg->tensor;
+    encode_shape(env->obs.n_node, &env->obs.shape);
+
+    env->games = calloc(cfg->n_env, sizeof(*env->games));
+    if (!env->games)
+        goto err;
+    for (i = 0; i < cfg->n_env; i++) {
+        struct vec_env_game *g = &env->games[i];
+
+        if (game_sim_init(&g->game))
+            goto err;
+        env->n_game++;
+        g->env = env;
+        g->idx = i;
+        g->rng = 0x9e3779b97f4a7c15ULL * (i + 1) ^ cfg->seed;
+        if (!g->rng)
+            g->rng = 1;
+    }
+
+    if (vec_env_reset(env))
+        goto err;
+    /* every episode starts from the same map */
+    for (i = 0; env->obs.tensor && i < cfg->n_env; i++)
+        encode_layout(&env->obs.shape, &env->games[i].game, env->obs.tensor + i * env->obs.shape.size);
+    return env;
+
+err:
+    vec_env_destroy(env);
+    return NULL;
+}
+
+void vec_env_destroy(struct vec_env *env)
+{
+    int i;
+
+    if (!env)
+        return;
+
+    for (i = 0; i < env->n_game; i++)
+        game_uninit(&env->games[i].game);
+    free(env->games);
+    vec_env_free_obs(&env->obs);
+    free(env);
+}
+
+const struct vec_env_obs *vec_env_obs(const struct vec_env *env)
+{
+    return &env->obs;
+}
+
+int vec_env_reset(struct vec_env *env)
+{
+    memset(env->obs.reward, 0, env->n_game * sizeof(*env->obs.reward));
+    memset(env->obs.done, 0, env->n_game * sizeof(*env->obs.done));
+    return vec_env_run(env, NULL);
+}
+
+int vec_env_step(struct vec_env *env, const int32_t *actions)
+{
+    if (!actions)
+        return -1;
+    return vec_env_run(env, actions);
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <stdint.h>
+#include "common.h"
+#include "game.h"
+#include "save.h"
+#include "encode.h"
+
+/* agent decisions before an episode is cut */
+#define VEC_ENV_HORIZON   1000
+/* turn actions: roll, robot, then a block and a bomb at every offset in range */
+#define VEC_ENV_ACT_ROLL  0
+#define VEC_ENV_ACT_ROBOT 1
+#define VEC_ENV_ACT_BLOCK 2
+#define VEC_ENV_ACT_BOMB  (VEC_ENV_ACT_BLOCK + 2 * GAME_ITEM_BLOCK_RANGE + 1)
+#define VEC_ENV_N_ACT     (VEC_ENV_ACT_BOMB + 2 * GAME_ITEM_BOMB_RANGE + 1)
+
+struct vec_env_config {
+    int n_env;
+    /* state every episode starts from, the agent is the player to move; NULL for a new game of @players */
+    const struct game_image *img;
+    /* player ids in seat order, the agent first, "AQ" if NULL */
+    const char *players;
+    /* bot policy of the other seats, NULL for the default */
+    const char *opponent;
+    /* 0 for VEC_ENV_HORIZON */
+    int horizon;
+    uint64_t seed;
+    /* optional, n_env tensors (encode.h) of the agent's view, aligned to ENCODE_ALIGN */
+    float *tensor;
+};
+
+/*
+ * Observations of all games, structure of arrays, game b at [b], seat s of
+ * it at [b * n_seat + s] and node i at [b * n_node + i]. Seat 0 is the
+ * agent, the others follow in turn order. Buffers are allocated once and
+ * written in place by every reset and step.
+ */
+struct vec_env_obs {
+    int n_env;
+    int n_seat;
+    int n_node;
+
+    /* enum game_decision the agent answers next */
+    int32_t *decision;
+    /* [b * VEC_ENV_N_ACT + a] 1 if action a is taken as it is, others become the first legal one */
+    uint8_t *legal;
+
+    int32_t *pos;
+    float *money;
+    int32_t *points;
+    int32_t *empty;
+    int32_t *god;
+    /* 0 once bankrupt */
+    int32_t *alive;
+
+    /* [(b * n_seat + s) * n_node + i] 1 if seat s owns node i */
+    float *owner;
+    /* [b * n_node + i] estate level */
+    float *level;
+    /* [(b * 2 + k) * n_node + i] 1 if a block (k = 0) or bomb (k = 1) lies on node i */
+    float *item;
+
+    /* change of the agent's worth share by the step, the final share on done */
+    float *reward;
+    /* episode ended by the step, the observation is of the next one already */
+    uint8_t *done;
+
+    /* game b encoded at tensor + b * shape.size if asked for, NULL if not */
+    float *tensor;
+    struct encode_shape shape;
+
+    /* episodes finished so far */
+    long n_episode;
+};
+
+struct vec_env;
+
+/* @return: NULL err */
+struct vec_env *vec_env_create(const struct vec_env_config *cfg);
+void vec_env_destroy(struct vec_env *env);
+/* observation buffers, valid until vec_env_destroy() */
+const struct vec_env_obs *vec_env_obs(const struct vec_env *env);
+/* start every game over, @return: < 0 err */
+int vec_env_reset(struct vec_env *env);
+/*
+ * Play @actions[b] for the agent of every game b, then every game on to the
+ * next decision of its agent, across the search workers (search.h). A
+ * finished game starts over in place. Turn decisions take VEC_ENV_ACT_*,
+ * y/n questions 0 or 1, menus the index of the choice. Nothing is
+ * allocated. @return: < 0 err
+ */
+int vec_env_step(struct vec_env *env, const int32_t *actions);
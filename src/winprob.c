@@ -0,0 +1,365 @@
+#include "common.h"
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include "winprob.h"
+#include "bot.h"
+#include "save.h"
+#include "search.h"
+
+struct winprob_worker {
+    pthread_t thread;
+    int idx;
+    uint64_t rng;
+    int n_turn;
+    /* pool moved on, the rollout is dropped */
+    int stale;
+
+    /* copy of the posted state, of generation gen */
+    unsigned long gen;
+    struct game_image img;
+    enum game_decision decision;
+    int seats[PLAYER_MAX];
+    struct game sim;
+};
+
+static struct winprob_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t job_cond;
+    /* a rollout got counted */
+    pthread_cond_t done_cond;
+
+    int want_threads;
+    int background;
+    int n_thread;
+    struct winprob_worker *workers;
+
+    int running;
+    int quit;
+    /* bumped by every new state, read by the workers without the lock */
+    unsigned long gen;
+    const struct game *game;
+    uint64_t key;
+    struct game_image img;
+    enum game_decision decision;
+    int seats[PLAYER_MAX];
+    int n_seat;
+
+    long n_rollout;
+    double sum[PLAYER_MAX];
+    double sum_sq[PLAYER_MAX];
+} g_winprob = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .job_cond = PTHREAD_COND_INITIALIZER,
+    .done_cond = PTHREAD_COND_INITIALIZER,
+};
+
+/* xorshift64*, one stream per worker apart from the dice of the real game */
+static inline uint32_t winprob_rand(struct winprob_worker *w, uint32_t n)
+{
+    w->rng ^= w->rng >> 12;
+    w->rng ^= w->rng << 25;
+    w->rng ^= w->rng >> 27;
+    return (uint32_t) ((w->rng * 0x2545f4914f6cdd1dULL) >> 32) % n;
+}
+
+static int winprob_sim_turn(struct controller *ctl, struct game *game, struct player *player, struct act *act)
+{
+    struct winprob_worker *w = ctl->priv;
+    struct winprob_pool *pool = &g_winprob;
+
+    if (!__atomic_load_n(&pool->running, __ATOMIC_RELAXED) || __atomic_load_n(&pool->gen, __ATOMIC_RELAXED) != w->gen) {
+        w->stale = 1;
+        return CONTROLLER_ASK;
+    }
+    /* horizon, game is scored as it stands */
+    if (w->n_turn++ >= WINPROB_HORIZON)
+        return CONTROLLER_ASK;
+
+    g_bot_ops.decide_turn(ctl, game, player, act);
+    if (act->type == ACT_ROLL) {
+        act->type = ACT_STEP;
+        act->val = 1 + winprob_rand(w, game->dice_facets);
+    }
+    return 0;
+}
+
+static int winprob_sim_buy(struct controller *ctl, struct game *game, struct player *player, struct map_node *node)
+{
+    return g_bot_ops.decide_buy(ctl, game, player, node);
+}
+
+static int winprob_sim_upgrade(struct controller *ctl, struct game *game, struct player *player, struct map_node *node)
+{
+    return g_bot_ops.decide_upgrade(ctl, game, player, node);
+}
+
+static int winprob_sim_item(struct controller *ctl, struct game *game, struct player *player, const struct select *sel)
+{
+    return g_bot_ops.choose_item(ctl, game, player, sel);
+}
+
+static int winprob_sim_gift(struct controller *ctl, struct game *game, struct player *player, const struct select *sel)
+{
+    return g_bot_ops.choose_gift(ctl, game, player, sel);
+}
+
+static int winprob_sim_magic(struct controller *ctl, struct game *game, struct player *player, const struct select *sel)
+{
+    return g_bot_ops.choose_magic_target(ctl, game, player, sel);
+}
+
+/* every seat of a copy, the bot with dice of the worker */
+static const struct controller_ops winprob_sim_ops = {
+    .name = "winprob",
+    .decide_turn = winprob_sim_turn,
+    .decide_buy = winprob_sim_buy,
+    .decide_upgrade = winprob_sim_upgrade,
+    .choose_item = winprob_sim_item,
+    .choose_gift = winprob_sim_gift,
+    .choose_magic_target = winprob_sim_magic,
+};
+
+/* @return: < 0 dropped */
+static int winprob_rollout(struct winprob_worker *w, float *reward)
+{
+    struct game *sim = &w->sim;
+    int i;
+
+    if (game_sim_load(sim, &w->img, w->decision))
+        return -1;
+
+    for (i = 0; i < PLAYER_MAX; i++) {
+        sim->ctrls[i] = (struct controller) {
+            .type = CONTROLLER_BOT,
+            .ops = &winprob_sim_ops,
+            .policy = bot_policy_find(NULL),
+            .priv = w,
+        };
+    }
+
+    w->n_turn = 0;
+    w->stale = 0;
+    game_feed(sim, NULL);
+    if (w->stale)
+        return -1;
+
+    search_score(sim, w->seats, reward);
+    return 0;
+}
+
+static void *winprob_worker_main(void *arg)
+{
+    struct winprob_pool *pool = &g_winprob;
+    struct winprob_worker *w = arg;
+    float reward[GAME_PLAYER_MAX];
+    unsigned long gen;
+    int i, ret;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->quit && !pool->running)
+            pthread_cond_wait(&pool->job_cond, &pool->lock);
+        if (pool->quit)
+            break;
+
+        if (w->gen != pool->gen) {
+            w->gen = pool->gen;
+            w->img = pool->img;
+            w->decision = pool->decision;
+            memcpy(w->seats, pool->seats, sizeof(w->seats));
+            w->rng = 0x9e3779b97f4a7c15ULL * (w->idx + 1) ^ w->gen;
+        }
+        gen = w->gen;
+        pthread_mutex_unlock(&pool->lock);
+
+        ret = winprob_rollout(w, reward);
+
+        pthread_mutex_lock(&pool->lock);
+        if (ret || gen != pool->gen)
+            continue;
+
+        pool->n_rollout++;
+        for (i = 0; i < pool->n_seat; i++) {
+            pool->sum[i] += reward[i];
+            pool->sum_sq[i] += reward[i] * reward[i];
+        }
+        pthread_cond_broadcast(&pool->done_cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/* @return: < 0 err */
+static int winprob_start(struct winprob_pool *pool)
+{
+    struct winprob_worker *w;
+    int i, n = pool->want_threads;
+
+    if (n > SEARCH_MAX_THREAD)
+        n = SEARCH_MAX_THREAD;
+
+    pool->workers = calloc(n, sizeof(*pool->workers));
+    if (!pool->workers)
+        return -1;
+
+    for (i = 0; i < n; i++) {
+        w = &pool->workers[i];
+        w->idx = i;
+        /* no state copied yet */
+        w->gen = -1UL;
+
+        if (game_sim_init(&w->sim))
+            break;
+        if (pthread_create(&w->thread, NULL, winprob_worker_main, w)) {
+            game_uninit(&w->sim);
+            break;
+        }
+        pool->n_thread++;
+    }
+
+    if (!pool->n_thread) {
+        game_err("fail to start winprob workers\n");
+        free(pool->workers);
+        pool->workers = NULL;
+        return -1;
+    }
+    game_dbg("%d winprob workers\n", pool->n_thread);
+    return 0;
+}
+
+void winprob_set_threads(int n, int background)
+{
+    g_winprob.want_threads = n;
+    g_winprob.background = background;
+}
+
+/* @return: < 0 no estimate for this game */
+static int winprob_post_locked(struct winprob_pool *pool, struct game *game)
+{
+    enum game_decision decision;
+    uint64_t key;
+
+    if (pool->want_threads <= 0 || game->state != GAME_STATE_RUNNING || !game->next_player)
+        return -1;
+    if (!pool->workers && winprob_start(pool)) {
+        /* do not try again on every prompt */
+        pool->want_threads = 0;
+        return -1;
+    }
+
+    /* a command being run was typed at the command prompt */
+    decision = game->prompt.decision == GAME_DECIDE_NONE ? GAME_DECIDE_COMMAND : game->prompt.decision;
+    key = game->track.hash ^ (uint64_t) decision << 56;
+    if (pool->game != game || pool->key != key) {
+        if (game_save_image(game, &pool->img)) {
+            pool->game = NULL;
+            return -1;
+        }
+        pool->decision = decision;
+        pool->n_seat = search_seats(game, pool->seats);
+        pool->game = game;
+        pool->key = key;
+        __atomic_store_n(&pool->gen, pool->gen + 1, __ATOMIC_RELAXED);
+
+        pool->n_rollout = 0;
+        memset(pool->sum, 0, sizeof(pool->sum));
+        memset(pool->sum_sq, 0, sizeof(pool->sum_sq));
+    }
+
+    __atomic_store_n(&pool->running, 1, __ATOMIC_RELAXED);
+    pthread_cond_broadcast(&pool->job_cond);
+    return 0;
+}
+
+void winprob_post(struct game *game)
+{
+    struct winprob_pool *pool = &g_winprob;
+
+    if (!pool->background)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    winprob_post_locked(pool, game);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void winprob_pause(void)
+{
+    struct winprob_pool *pool = &g_winprob;
+
+    pthread_mutex_lock(&pool->lock);
+    __atomic_store_n(&pool->running, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+long winprob_estimate(struct game *game, struct winprob_estimate *est)
+{
+    struct winprob_pool *pool = &g_winprob;
+    struct player *player;
+    struct timespec deadline;
+    int i, was_running;
+    double mean, var;
+    long n;
+
+    pthread_mutex_lock(&pool->lock);
+    was_running = pool->running;
+    if (winprob_post_locked(pool, game)) {
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+
+    /* the waiting loop paused the threads, give them a moment */
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += WINPROB_WAIT_MS / 1000;
+    deadline.tv_nsec += WINPROB_WAIT_MS % 1000 * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    while (pool->n_rollout < WINPROB_MIN_ROLLOUT) {
+        if (pthread_cond_timedwait(&pool->done_cond, &pool->lock, &deadline) == ETIMEDOUT)
+            break;
+    }
+
+    n = pool->n_rollout;
+    est->n_rollout = n;
+    est->n_seat = pool->n_seat;
+    for_each_player_begin(game, player) {
+        i = pool->seats[player->idx];
+        est->idx[i] = player->idx;
+        mean = n ? pool->sum[i] / n : 0;
+        var = n > 1 ? (pool->sum_sq[i] - n * mean * mean) / (n - 1) : 0;
+        est->mean[i] = mean;
+        est->half[i] = n ? 1.96 * sqrt(var > 0 ? var / n : 0) : 1;
+    } for_each_player_end();
+
+    if (!was_running)
+        __atomic_store_n(&pool->running, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&pool->lock);
+    return n;
+}
+
+void winprob_uninit(void)
+{
+    struct winprob_pool *pool = &g_winprob;
+    int i;
+
+    if (!pool->workers)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->job_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->n_thread; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+        game_uninit(&pool->workers[i].sim);
+    }
+    free(pool->workers);
+    pool->workers = NULL;
+    pool->n_thread = 0;
+    pool->quit = 0;
+    pool->game = NULL;
+}
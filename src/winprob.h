@@ -0,0 +1,47 @@
+#pragma once
+#include "common.h"
+#include "game.h"
+
+/* turns a rollout runs before the game is scored by worth */
+#define WINPROB_HORIZON      400
+/* rollouts the winprob command waits for when nothing ran yet */
+#define WINPROB_MIN_ROLLOUT  400
+#define WINPROB_WAIT_MS      500
+/* threads of winprob_estimate() unless told otherwise, the same on any machine */
+#define WINPROB_DEFAULT_THREADS 2
+
+struct winprob_estimate {
+    long n_rollout;
+    int n_seat;
+    /* player idx in seat order */
+    int idx[PLAYER_MAX];
+    /* mean score and half width of its 95% interval, by seat */
+    double mean[PLAYER_MAX];
+    double half[PLAYER_MAX];
+};
+
+/*
+ * Background win chances of a game while it waits for input. Threads of
+ * its own play the game out from the posted state with the default bot
+ * policy for every seat and dice of their own, a rollout scores 1 for the
+ * winner, or the worth share after WINPROB_HORIZON turns. A new state drops
+ * the rollouts of the old one, a pause stops the threads at their next turn
+ * so they never compete with the game itself.
+ */
+
+/*
+ * Threads of the pool, <= 0 for none, takes effect before the first post.
+ * @background: winprob_post() runs them while waiting for input, else they
+ * only run inside winprob_estimate()
+ */
+void winprob_set_threads(int n, int background);
+/* estimate from the state of @game, it keeps counting if the state is the same */
+void winprob_post(struct game *game);
+void winprob_pause(void);
+/*
+ * Estimate of the state of @game, run for a while first if it has too few
+ * rollouts. @return: < 0 err, == 0 no threads, > 0 rollouts counted
+ */
+long winprob_estimate(struct game *game, struct winprob_estimate *est);
+/* join the threads */
+void winprob_uninit(void);
@@ -20,7 +20,8 @@ from tqdm.contrib.concurrent import process_map, thread_map
 CONFIG_JSON_NAME = 'config.json'
 CAPTURE_CMD = (
     'preset', 'user', 'map', 'fund', 'credit',
-    'gift', 'bomb', 'barrier', 'userloc', 'nextuser'
+    'gift', 'bomb', 'barrier', 'userloc', 'nextuser',
+    'answer'
 )
 DEFAULT_EXEC = '../richman/richman'
 EXPIRE_TIME_MS = 5000
@@ -55,6 +56,8 @@ export_dir = os.path.join(os.curdir, args.outputdir)
 
 
 kv_pat = re.compile(r'([a-zA-Z]+)(?:\s+(\w+))(?:\s+(\w+))?(?:\s+(\w+))?')
+# answers of queries carry more words
+answer_pat = re.compile(r'(answer)((?:\s+\w+)+)$')
 test_list = dict()
 
 
@@ -95,9 +98,9 @@ def parse_key_value_pairs(lines):
         line = trim_line(line)
         if not line:
             continue
-        mat = kv_pat.match(line)
+        mat = answer_pat.match(line) or kv_pat.match(line)
         if mat:
-            ret.append(' '.join((e for e in mat.groups() if e)))
+            ret.append(' '.join((e.strip() for e in mat.groups() if e)))
         else:
             print('Warn::', line)
             # assert False
@@ -0,0 +1,82 @@
+#include "common.h"
+#include <unistd.h>
+#include "unit.h"
+
+#define LOG_PATH "/tmp/monopoly_actlog_test.bin"
+
+/* console output of the lines @lines (NULL ended), @out: freed by the caller */
+static int run(const char *const *lines, char **out)
+{
+    struct game *game;
+    char line[256];
+    size_t size;
+    FILE *fp;
+    int i;
+
+    game = calloc(1, sizeof(*game));
+    if (!game || game_init(game)) {
+        free(game);
+        return -1;
+    }
+    fp = open_memstream(out, &size);
+    if (!fp) {
+        game_uninit(game);
+        free(game);
+        return -1;
+    }
+    game->ui.out = fp;
+    game->ui.in = NULL;
+    game->ui.in_isatty = game->ui.out_isatty = 0;
+
+    game_feed(game, NULL);
+    for (i = 0; lines[i]; i++) {
+        snprintf(line, sizeof(line), "%s", lines[i]);
+        game_feed(game, line);
+    }
+
+    game_uninit(game);
+    free(game);
+    fclose(fp);
+    return 0;
+}
+
+/* a turn the log does not explain stops the replay right there */
+static void check_diverged(void)
+{
+    static const char *const lines[] = {
+        "preset user AQ", "record " LOG_PATH, "step 3", "n",
+        "preset fund Q 5000", "step 2", "n", "step 1", "n", "record stop",
+        "replay " LOG_PATH, NULL,
+    };
+    char *out = NULL;
+
+    UNIT_CHECK(!run(lines, &out));
+    UNIT_CHECK(out && strstr(out, "[REPLAY] State diverged at turn 1,"));
+    free(out);
+    unlink(LOG_PATH);
+}
+
+static void check_same(void)
+{
+    static const char *const lines[] = {
+        "preset user AQ", "record " LOG_PATH, "step 3", "n", "step 2", "n", "step 1", "n", "record stop",
+        "replay " LOG_PATH, NULL,
+    };
+    char *out = NULL;
+
+    UNIT_CHECK(!run(lines, &out));
+    UNIT_CHECK(out && strstr(out, "[REPLAY] Replayed actions from"));
+    UNIT_CHECK(out && !strstr(out, "[REPLAY] State diverged"));
+    free(out);
+    unlink(LOG_PATH);
+}
+
+int main(void)
+{
+    check_diverged();
+    check_same();
+
+    if (g_unit_failed)
+        fprintf(stderr, "actlog_test: %d check(s) failed\n", g_unit_failed);
+    return !!g_unit_failed;
+}
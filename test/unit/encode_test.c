@@ -0,0 +1,176 @@
+#include "common.h"
+#include <unistd.h>
+#include "unit.h"
+#include "encode.h"
+#include "vec_env.h"
+#include "search.h"
+
+/* floats of a plane and of a tensor of the 70 node map, what a trainer reads */
+#define STRIDE 72
+#define SIZE   (23 * STRIDE + 4 * 8)
+
+static float at(const float *t, int plane, int i)
+{
+    return t[plane * STRIDE + i];
+}
+
+static float feat(const float *t, int seat, int f)
+{
+    return t[ENCODE_N_PLANE * STRIDE + seat * ENCODE_N_FEAT + f];
+}
+
+static void check_shape(void)
+{
+    struct encode_shape shape;
+
+    UNIT_CHECK(ENCODE_PLANE_TYPE == 0);
+    UNIT_CHECK(ENCODE_PLANE_OWNER == 9);
+    UNIT_CHECK(ENCODE_PLANE_LEVEL == 13);
+    UNIT_CHECK(ENCODE_PLANE_ITEM == 17);
+    UNIT_CHECK(ENCODE_PLANE_POS == 19);
+    UNIT_CHECK(ENCODE_N_PLANE == 23);
+    UNIT_CHECK(ENCODE_N_FEAT == 8);
+
+    encode_shape(70, &shape);
+    UNIT_CHECK(shape.n_node == 70 && shape.stride == STRIDE && shape.size == SIZE);
+    /* padded to a vector either way */
+    encode_shape(65, &shape);
+    UNIT_CHECK(shape.stride == 72 && shape.size == 23 * 72 + 32);
+    encode_shape(1, &shape);
+    UNIT_CHECK(shape.stride == 8 && shape.size == 23 * 8 + 32);
+}
+
+/* a preset game seen from Q, then from A */
+static void check_state(void)
+{
+    static const char *const lines[] = {
+        "preset user AQS", "preset fund A 1234", "preset credit A 56", "preset map 10 A 2", "preset map 30 Q 1",
+        "preset gift A barrier 2", "preset gift A bomb 1", "preset gift A god 3", "preset userloc Q 20 0",
+        "preset userloc S 40 1",
+        "preset barrier 5", "preset bomb 7", "preset nextuser Q", NULL,
+    };
+    static float out[SIZE] __attribute__((aligned(ENCODE_ALIGN)));
+    static struct game game;
+    struct encode_shape shape;
+    struct game_image img;
+    int i, p, n;
+
+    UNIT_CHECK(!unit_image(lines, &img));
+    UNIT_CHECK(!game_sim_init(&game));
+    UNIT_CHECK(!game_sim_load(&game, &img, GAME_DECIDE_COMMAND));
+
+    encode_shape(game.map.n_used, &shape);
+    UNIT_CHECK(shape.size == SIZE);
+    for (i = 0; i < SIZE; i++)
+        out[i] = -1;
+
+    encode_layout(&shape, &game, out);
+    encode_state(&shape, &game, game.next_player, out);
+
+    /* one type a node, nothing in the padding of any plane */
+    for (i = 0; i < STRIDE; i++) {
+        for (p = 0, n = 0; p < MAP_NODE_MAX; p++)
+            n += at(out, p, i) == 1;
+        UNIT_CHECK(n == (i < 70));
+    }
+    for (p = 0; p < ENCODE_N_PLANE; p++)
+        UNIT_CHECK(at(out, p, 70) == 0 && at(out, p, 71) == 0);
+    UNIT_CHECK(at(out, MAP_NODE_START, 0) == 1);
+    UNIT_CHECK(at(out, MAP_NODE_VACANCY, 1) == 1);
+    UNIT_CHECK(at(out, MAP_NODE_HOSPITAL, 14) == 1);
+    UNIT_CHECK(at(out, MAP_NODE_ITEM_HOUSE, 28) == 1);
+    UNIT_CHECK(at(out, MAP_NODE_GIFT_HOUSE, 35) == 1);
+    UNIT_CHECK(at(out, MAP_NODE_PARK, 49) == 1);
+    UNIT_CHECK(at(out, MAP_NODE_MAGIC_HOUSE, 63) == 1);
+    UNIT_CHECK(at(out, MAP_NODE_MINE, 64) == 1);
+
+    UNIT_CHECK(game.next_player == &game.players[player_char_to_idx('Q')]);
+    /* seats from Q: Q, S, A, then nobody */
+    UNIT_CHECK(at(out, ENCODE_PLANE_OWNER + 0, 30) == 1);
+    UNIT_CHECK(at(out, ENCODE_PLANE_OWNER + 2, 10) == 1);
+    UNIT_CHECK(at(out, ENCODE_PLANE_OWNER + 0, 10) == 0 && at(out, ENCODE_PLANE_OWNER + 1, 10) == 0);
+    UNIT_CHECK(at(out, ENCODE_PLANE_LEVEL + 2, 10) == 1 && at(out, ENCODE_PLANE_LEVEL + 1, 30) == 1);
+    UNIT_CHECK(at(out, ENCODE_PLANE_LEVEL + 0, 11) == 0);
+    UNIT_CHECK(at(out, ENCODE_PLANE_ITEM, 5) == 1 && at(out, ENCODE_PLANE_ITEM + 1, 7) == 1);
+    UNIT_CHECK(at(out, ENCODE_PLANE_ITEM, 7) == 0 && at(out, ENCODE_PLANE_ITEM + 1, 5) == 0);
+    UNIT_CHECK(at(out, ENCODE_PLANE_POS + 0, 20) == 1);
+    UNIT_CHECK(at(out, ENCODE_PLANE_POS + 1, 40) == 1 && at(out, ENCODE_PLANE_POS + 2, 0) == 1);
+    for (i = 0; i < 70; i++)
+        UNIT_CHECK(at(out, ENCODE_PLANE_POS + 3, i) == 0);
+
+    UNIT_CHECK(feat(out, 0, ENCODE_FEAT_MONEY) == 10000 && feat(out, 1, ENCODE_FEAT_EMPTY) == 1);
+    UNIT_CHECK(feat(out, 0, ENCODE_FEAT_ALIVE) == 1 && feat(out, 1, ENCODE_FEAT_ALIVE) == 1);
+    UNIT_CHECK(feat(out, 2, ENCODE_FEAT_MONEY) == 1234 && feat(out, 2, ENCODE_FEAT_POINTS) == 56);
+    UNIT_CHECK(feat(out, 2, ENCODE_FEAT_BLOCK) == 2 && feat(out, 2, ENCODE_FEAT_BOMB) == 1);
+    UNIT_CHECK(feat(out, 2, ENCODE_FEAT_ROBOT) == 0 && feat(out, 2, ENCODE_FEAT_GOD) == 3);
+    UNIT_CHECK(feat(out, 2, ENCODE_FEAT_EMPTY) == 0 && feat(out, 2, ENCODE_FEAT_ALIVE) == 1);
+    for (i = 0; i < ENCODE_N_FEAT; i++)
+        UNIT_CHECK(feat(out, 3, i) == 0);
+
+    /* from A the seats turn round, the layout planes stay as they are */
+    encode_state(&shape, &game, &game.players[player_char_to_idx('A')], out);
+    UNIT_CHECK(at(out, ENCODE_PLANE_OWNER + 0, 10) == 1 && at(out, ENCODE_PLANE_OWNER + 1, 30) == 1);
+    UNIT_CHECK(at(out, ENCODE_PLANE_OWNER + 2, 10) == 0);
+    UNIT_CHECK(at(out, ENCODE_PLANE_POS + 1, 20) == 1);
+    UNIT_CHECK(feat(out, 0, ENCODE_FEAT_MONEY) == 1234 && feat(out, 2, ENCODE_FEAT_EMPTY) == 1);
+    UNIT_CHECK(at(out, MAP_NODE_PARK, 49) == 1);
+
+    game_uninit(&game);
+}
+
+/* what one mapping writes another one of the file reads, and vec_env encodes into it */
+static void check_shared(void)
+{
+    struct vec_env_config cfg = { .n_env = 3, .players = "AQ", .seed = 3 };
+    const struct vec_env_obs *obs;
+    struct vec_env *env;
+    char path[64];
+    float *a, *b;
+    int32_t actions[3] = { VEC_ENV_ACT_ROLL, VEC_ENV_ACT_ROLL, VEC_ENV_ACT_ROLL };
+    int k, i;
+
+    snprintf(path, sizeof(path), "/tmp/encode_test.%d", (int) getpid());
+    a = encode_map_shared(path, 3 * SIZE);
+    b = encode_map_shared(path, 3 * SIZE);
+    UNIT_CHECK(a && b && (uintptr_t) a % ENCODE_ALIGN == 0);
+    if (!a || !b)
+        goto out;
+
+    cfg.tensor = a;
+    env = vec_env_create(&cfg);
+    UNIT_CHECK(env);
+    if (!env)
+        goto out;
+    obs = vec_env_obs(env);
+    UNIT_CHECK(obs->tensor == a && obs->shape.size == SIZE);
+
+    for (k = 0; k < 4; k++) {
+        for (i = 0; i < 3; i++) {
+            /* the agent where the observation has it, seen through the other mapping */
+            UNIT_CHECK(b[i * SIZE + ENCODE_PLANE_POS * STRIDE + obs->pos[i * 2]] == 1);
+            UNIT_CHECK(b[i * SIZE + ENCODE_N_PLANE * STRIDE + ENCODE_FEAT_MONEY] == obs->money[i * 2]);
+            UNIT_CHECK(b[i * SIZE + MAP_NODE_START * STRIDE] == 1);
+        }
+        UNIT_CHECK(!vec_env_step(env, actions));
+        for (i = 0; i < 3; i++)
+            actions[i] = obs->decision[i] == GAME_DECIDE_COMMAND ? VEC_ENV_ACT_ROLL : 0;
+    }
+    vec_env_destroy(env);
+
+out:
+    encode_unmap(a, 3 * SIZE);
+    encode_unmap(b, 3 * SIZE);
+    unlink(path);
+}
+
+int main(void)
+{
+    check_shape();
+    check_state();
+    check_shared();
+    search_uninit();
+
+    if (g_unit_failed)
+        fprintf(stderr, "encode_test: %d check(s) failed\n", g_unit_failed);
+    return !!g_unit_failed;
+}
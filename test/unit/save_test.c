@@ -0,0 +1,74 @@
+#include "common.h"
+#include "unit.h"
+#include "save.h"
+
+/* an image broken in one field is refused, and loading it keeps nothing of it */
+static void check_bad(struct game *game, const struct game_image *good, const char *what,
+                      void (*spoil)(struct game_image *img))
+{
+    static struct game_image img;
+
+    img = *good;
+    spoil(&img);
+    if (game_check_image(&img) == 0)
+        fprintf(stderr, "save_test: %s passes the check\n", what);
+    UNIT_CHECK(game_check_image(&img) < 0);
+    UNIT_CHECK(game_load_image(game, &img) < 0);
+}
+
+static void no_next(struct game_image *img)
+{
+    img->next_player = -1;
+}
+
+static void next_not_seated(struct game_image *img)
+{
+    img->next_player = img->cur_players[(img->next_player_seq + 1) % img->cur_player_nr];
+}
+
+static void seq_past_seats(struct game_image *img)
+{
+    img->next_player_seq = img->cur_player_nr;
+}
+
+static void seq_negative(struct game_image *img)
+{
+    img->next_player_seq = -1;
+}
+
+static void all_bankrupt(struct game_image *img)
+{
+    img->bankrupt_nr = img->cur_player_nr;
+}
+
+static void bankrupt_negative(struct game_image *img)
+{
+    img->bankrupt_nr = -1;
+}
+
+int main(void)
+{
+    static const char *const lines[] = {
+        "preset user AQS", "preset map 3 A 2", "preset nextuser Q", NULL,
+    };
+    static struct game_image good;
+    static struct game game;
+
+    UNIT_CHECK(!unit_image(lines, &good));
+    UNIT_CHECK(!game_sim_init(&game));
+    UNIT_CHECK(!game_check_image(&good));
+    UNIT_CHECK(!game_load_image(&game, &good));
+    UNIT_CHECK(game.next_player == &game.players[player_char_to_idx('Q')]);
+
+    check_bad(&game, &good, "no next player", no_next);
+    check_bad(&game, &good, "next player off its seat", next_not_seated);
+    check_bad(&game, &good, "seat past the players", seq_past_seats);
+    check_bad(&game, &good, "negative seat", seq_negative);
+    check_bad(&game, &good, "everybody bankrupt", all_bankrupt);
+    check_bad(&game, &good, "negative bankrupt count", bankrupt_negative);
+
+    game_uninit(&game);
+    if (g_unit_failed)
+        fprintf(stderr, "save_test: %d check(s) failed\n", g_unit_failed);
+    return !!g_unit_failed;
+}
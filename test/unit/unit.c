@@ -0,0 +1,34 @@
+#include "common.h"
+#include "unit.h"
+
+int g_game_dbg = 0;
+struct game_events g_game_events = {0};
+
+int g_unit_failed;
+
+int unit_image(const char *const *lines, struct game_image *img)
+{
+    struct game *game;
+    char line[256];
+    int i, ret = -1;
+
+    game = calloc(1, sizeof(*game));
+    if (!game)
+        return -1;
+    if (game_sim_init(game)) {
+        free(game);
+        return -1;
+    }
+
+    game_feed(game, NULL);
+    for (i = 0; lines[i]; i++) {
+        snprintf(line, sizeof(line), "%s", lines[i]);
+        game_feed(game, line);
+    }
+    if (game->state == GAME_STATE_RUNNING && game->prompt.decision == GAME_DECIDE_COMMAND)
+        ret = game_save_image(game, img);
+
+    game_uninit(game);
+    free(game);
+    return ret;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "common.h"
+#include <math.h>
+#include "game.h"
+#include "save.h"
+
+/* checks failed so far, the exit status of a test */
+extern int g_unit_failed;
+
+#define UNIT_CHECK(cond)                                                          \
+    do {                                                                          \
+        if (!(cond)) {                                                            \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            g_unit_failed++;                                                      \
+        }                                                                         \
+    } while (0)
+
+#define UNIT_NEAR(a, b) UNIT_CHECK(fabsf((float) (a) - (float) (b)) < 1e-5f)
+
+/* state of a new game after the console lines @lines (NULL ended), at the command prompt, @return: < 0 err */
+int unit_image(const char *const *lines, struct game_image *img);
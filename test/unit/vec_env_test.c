@@ -0,0 +1,256 @@
+#include "common.h"
+#include "unit.h"
+#include "vec_env.h"
+#include "search.h"
+
+#define N_NODE 70
+#define ACT_BLOCK_AT(d) (VEC_ENV_ACT_BLOCK + GAME_ITEM_BLOCK_RANGE + (d))
+
+/* worth share of the player to move in @img, as rewards count it */
+static float share_of(struct game *sim, const struct game_image *img)
+{
+    float reward[GAME_PLAYER_MAX];
+    int seats[PLAYER_MAX];
+
+    if (game_sim_load(sim, img, GAME_DECIDE_COMMAND))
+        return -1;
+    search_seats(sim, seats);
+    search_score(sim, seats, reward);
+    return reward[seats[sim->next_player->idx]];
+}
+
+static struct vec_env *make_env(const char *const *lines, int n_env, uint64_t seed)
+{
+    struct vec_env_config cfg = { 0 };
+    struct game_image img;
+
+    if (unit_image(lines, &img))
+        return NULL;
+    cfg.n_env = n_env;
+    cfg.img = &img;
+    cfg.seed = seed;
+    return vec_env_create(&cfg);
+}
+
+/* presets show up in the first observation of every game, in seat order */
+static void check_reset(void)
+{
+    static const char *const lines[] = {
+        "preset user QA", "preset fund A 1000", "preset map 10 A 2", "preset gift Q barrier 1",
+        "preset userloc A 20 0", NULL,
+    };
+    const struct vec_env_obs *obs;
+    struct vec_env *env;
+    int32_t actions[4];
+    int b, pos;
+
+    env = make_env(lines, 4, 1);
+    UNIT_CHECK(env);
+    if (!env)
+        return;
+    obs = vec_env_obs(env);
+
+    UNIT_CHECK(obs->n_env == 4 && obs->n_seat == 2 && obs->n_node == N_NODE);
+    for (b = 0; b < 4; b++) {
+        /* Q moves first, so it is the agent and seat 0 */
+        UNIT_CHECK(obs->decision[b] == GAME_DECIDE_COMMAND);
+        UNIT_CHECK(obs->pos[b * 2] == 0 && obs->pos[b * 2 + 1] == 20);
+        UNIT_NEAR(obs->money[b * 2], 10000);
+        UNIT_NEAR(obs->money[b * 2 + 1], 1000);
+        UNIT_CHECK(obs->alive[b * 2] && obs->alive[b * 2 + 1]);
+        UNIT_NEAR(obs->owner[(b * 2 + 1) * N_NODE + 10], 1);
+        UNIT_NEAR(obs->owner[(b * 2) * N_NODE + 10], 0);
+        UNIT_NEAR(obs->level[b * N_NODE + 10], 2);
+        UNIT_CHECK(obs->legal[b * VEC_ENV_N_ACT + VEC_ENV_ACT_ROLL]);
+        UNIT_CHECK(!obs->legal[b * VEC_ENV_N_ACT + VEC_ENV_ACT_ROBOT]);
+        UNIT_CHECK(obs->legal[b * VEC_ENV_N_ACT + ACT_BLOCK_AT(3)]);
+        UNIT_CHECK(!obs->legal[b * VEC_ENV_N_ACT + VEC_ENV_ACT_BOMB + GAME_ITEM_BOMB_RANGE + 3]);
+        UNIT_CHECK(!obs->done[b]);
+        UNIT_NEAR(obs->reward[b], 0);
+    }
+
+    /* a block is not the end of the turn, the agent decides again */
+    for (b = 0; b < 4; b++)
+        actions[b] = ACT_BLOCK_AT(3);
+    UNIT_CHECK(!vec_env_step(env, actions));
+    for (b = 0; b < 4; b++) {
+        UNIT_CHECK(obs->decision[b] == GAME_DECIDE_COMMAND && !obs->done[b]);
+        UNIT_CHECK(obs->pos[b * 2] == 0);
+        UNIT_NEAR(obs->item[(b * 2) * N_NODE + 3], 1);
+        UNIT_CHECK(!obs->legal[b * VEC_ENV_N_ACT + ACT_BLOCK_AT(3)]);
+        UNIT_NEAR(obs->reward[b], 0);
+    }
+
+    /* the block stops the walk, a free estate asks to buy */
+    for (b = 0; b < 4; b++)
+        actions[b] = VEC_ENV_ACT_ROLL;
+    UNIT_CHECK(!vec_env_step(env, actions));
+    for (b = 0; b < 4; b++) {
+        pos = obs->pos[b * 2];
+        UNIT_CHECK(pos >= 1 && pos <= 3);
+        UNIT_CHECK(obs->decision[b] == GAME_DECIDE_BUY);
+        UNIT_CHECK(obs->legal[b * VEC_ENV_N_ACT] && obs->legal[b * VEC_ENV_N_ACT + 1]);
+        UNIT_NEAR(obs->item[(b * 2) * N_NODE + 3], pos != 3);
+    }
+
+    /* no, then A plays on and the agent is at the command prompt again */
+    for (b = 0; b < 4; b++)
+        actions[b] = 0;
+    UNIT_CHECK(!vec_env_step(env, actions));
+    for (b = 0; b < 4; b++) {
+        UNIT_CHECK(obs->decision[b] == GAME_DECIDE_COMMAND && !obs->done[b]);
+        UNIT_CHECK(obs->pos[b * 2] >= 1 && obs->pos[b * 2] <= 3);
+        UNIT_CHECK(obs->pos[b * 2 + 1] >= 21 && obs->pos[b * 2 + 1] <= 26);
+        UNIT_NEAR(obs->money[b * 2], 10000);
+    }
+    UNIT_CHECK(obs->n_episode == 0);
+    vec_env_destroy(env);
+}
+
+/* a roll that surely bankrupts the agent ends the episode, the next one starts over */
+static void check_done(struct game *sim)
+{
+    static const char *const lines[] = {
+        "preset user AQ", "preset fund A 100", "preset map 1 Q 3", "preset map 2 Q 3", "preset map 3 Q 3",
+        "preset map 4 Q 3", "preset map 5 Q 3", "preset map 6 Q 3", NULL,
+    };
+    const struct vec_env_obs *obs;
+    struct game_image img;
+    struct vec_env *env;
+    int32_t actions[3] = { VEC_ENV_ACT_ROLL, VEC_ENV_ACT_ROLL, VEC_ENV_ACT_ROLL };
+    float share;
+    int b, k;
+
+    UNIT_CHECK(!unit_image(lines, &img));
+    share = share_of(sim, &img);
+    UNIT_CHECK(share > 0 && share < 1);
+
+    env = make_env(lines, 3, 2);
+    UNIT_CHECK(env);
+    if (!env)
+        return;
+    obs = vec_env_obs(env);
+
+    for (k = 1; k <= 2; k++) {
+        UNIT_CHECK(!vec_env_step(env, actions));
+        UNIT_CHECK(obs->n_episode == 3 * k);
+        for (b = 0; b < 3; b++) {
+            UNIT_CHECK(obs->done[b]);
+            /* from the starting share to nothing */
+            UNIT_NEAR(obs->reward[b], -share);
+            UNIT_CHECK(obs->decision[b] == GAME_DECIDE_COMMAND);
+            UNIT_CHECK(obs->pos[b * 2] == 0 && obs->alive[b * 2]);
+            UNIT_NEAR(obs->money[b * 2], 100);
+            UNIT_NEAR(obs->owner[(b * 2 + 1) * N_NODE + 4], 1);
+            UNIT_NEAR(obs->level[b * N_NODE + 4], 3);
+        }
+    }
+    vec_env_destroy(env);
+}
+
+static uint64_t next_rand(uint64_t *rng)
+{
+    *rng ^= *rng << 13;
+    *rng ^= *rng >> 7;
+    *rng ^= *rng << 17;
+    return *rng;
+}
+
+/* any legal action of game @b */
+static int32_t random_action(const struct vec_env_obs *obs, int b, uint64_t *rng)
+{
+    const uint8_t *legal = obs->legal + (long) b * VEC_ENV_N_ACT;
+    int a, n;
+
+    for (a = 0, n = 0; a < VEC_ENV_N_ACT; a++)
+        n += legal[a];
+    n = n ? (int) (next_rand(rng) % n) : 0;
+    for (a = 0; a < VEC_ENV_N_ACT - 1; a++) {
+        if (legal[a] && !n--)
+            break;
+    }
+    return a;
+}
+
+/*
+ * Random play of short episodes: there is always a legal action, the agent
+ * is in the game, rewards of an episode add up to a share, and the same
+ * seed plays the same.
+ */
+static void check_random(void)
+{
+    enum { N_ENV = 16, N_STEP = 300 };
+    struct vec_env_config cfg = { .n_env = N_ENV, .players = "AQS", .horizon = 40, .seed = 7 };
+    const struct vec_env_obs *obs, *obs2;
+    struct vec_env *env, *env2;
+    int32_t actions[N_ENV];
+    float sum[N_ENV] = { 0 }, share, start = 1.0f / 3;
+    long n_done = 0;
+    uint64_t rng = 11;
+    int b, a, i, n, len[N_ENV] = { 0 };
+
+    env = vec_env_create(&cfg);
+    env2 = vec_env_create(&cfg);
+    UNIT_CHECK(env && env2);
+    if (!env || !env2)
+        goto out;
+    obs = vec_env_obs(env);
+    obs2 = vec_env_obs(env2);
+
+    for (i = 0; i < N_STEP; i++) {
+        for (b = 0; b < N_ENV; b++) {
+            for (a = 0, n = 0; a < VEC_ENV_N_ACT; a++)
+                n += obs->legal[b * VEC_ENV_N_ACT + a];
+            UNIT_CHECK(n > 0);
+            UNIT_CHECK(obs->alive[b * obs->n_seat]);
+            UNIT_CHECK(obs->decision[b] >= GAME_DECIDE_COMMAND);
+            actions[b] = random_action(obs, b, &rng);
+        }
+        UNIT_CHECK(!vec_env_step(env, actions));
+        UNIT_CHECK(!vec_env_step(env2, actions));
+
+        for (b = 0; b < N_ENV; b++) {
+            UNIT_CHECK(obs->reward[b] >= -1 && obs->reward[b] <= 1);
+            sum[b] += obs->reward[b];
+            len[b]++;
+            if (!obs->done[b])
+                continue;
+
+            /* all three start alike, the rewards telescope to the final share */
+            share = start + sum[b];
+            UNIT_CHECK(share > -1e-4f && share < 1 + 1e-4f);
+            UNIT_CHECK(len[b] <= cfg.horizon);
+            sum[b] = 0;
+            len[b] = 0;
+            n_done++;
+        }
+    }
+    UNIT_CHECK(obs->n_episode == n_done && n_done > 0);
+
+    UNIT_CHECK(!memcmp(obs->pos, obs2->pos, N_ENV * obs->n_seat * sizeof(*obs->pos)));
+    UNIT_CHECK(!memcmp(obs->money, obs2->money, N_ENV * obs->n_seat * sizeof(*obs->money)));
+    UNIT_CHECK(!memcmp(obs->owner, obs2->owner, (size_t) N_ENV * obs->n_seat * obs->n_node * sizeof(*obs->owner)));
+    UNIT_CHECK(!memcmp(obs->reward, obs2->reward, N_ENV * sizeof(*obs->reward)));
+    UNIT_CHECK(obs2->n_episode == n_done);
+
+out:
+    vec_env_destroy(env);
+    vec_env_destroy(env2);
+}
+
+int main(void)
+{
+    static struct game sim;
+
+    if (game_sim_init(&sim))
+        return 1;
+    check_reset();
+    check_done(&sim);
+    check_random();
+    game_uninit(&sim);
+    search_uninit();
+
+    if (g_unit_failed)
+        fprintf(stderr, "vec_env_test: %d check(s) failed\n", g_unit_failed);
+    return !!g_unit_failed;
+}